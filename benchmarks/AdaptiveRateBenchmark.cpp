@@ -0,0 +1,180 @@
+// Checks that adaptive limits hold a bottleneck's queueing delay under the target, and find
+// the new operating point when the link capacity changes under them.
+//
+// Usage: AdaptiveRateBenchmark [phase seconds]   (default: 30, simulated)
+//
+// Three greedy processes, each limited to 4 MB/s, share a bottleneck with a 2 MB buffer and
+// 20 ms base RTT. The capacity steps 6 -> 1.25 -> 10 -> 3 MB/s, one phase each. Time is
+// virtual (1 ms steps), so the run is deterministic; the link is a fluid queue and a
+// process's smoothed RTT follows it like TCP's. Controllers are updated every 0.5 s, and
+// every 3 s as the UI's statistics timer does; "static" keeps the user's limits as they are.
+//
+// Per phase: "settle" is the time after the change from which the queueing delay, averaged
+// over each second, stays under the target and the link stays at least 80% used. "util",
+// the delay percentiles and the swing of the summed limits (max - min over mean) are taken
+// over the second half of the phase. Exits nonzero if
+// an adaptive run at the 0.5 s interval does not settle within half a phase or exceeds
+// twice the target at p95.
+
+#include "core/AdaptiveRateController.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+constexpr int PROCESSES = 3;
+constexpr double CEILING = 4.0 * 1024 * 1024;
+constexpr double BUFFER_BYTES = 2.0 * 1024 * 1024;
+constexpr double MB = 1024.0 * 1024.0;
+constexpr uint64_t STEP_NS = 1000000ULL;
+constexpr uint64_t BUCKET_NS = 1000000000ULL; // settling is judged on 1 s averages
+constexpr uint64_t BASE_RTT_NS = 20000000ULL;
+constexpr double CAPACITIES[] = {6.0 * MB, 1.25 * MB, 10.0 * MB, 3.0 * MB};
+constexpr int PHASES = sizeof(CAPACITIES) / sizeof(CAPACITIES[0]);
+
+struct PhaseResult {
+    double settleSec; // negative if it never settled
+    double utilization;
+    double delayP50Ms;
+    double delayP95Ms;
+    double swing;
+};
+
+double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    const size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+// Fluid bottleneck: every process offers its limit, the link drains at its capacity and
+// the buffer tail-drops what does not fit
+std::vector<PhaseResult> run(bool adaptive, uint64_t intervalNs, uint64_t phaseNs) {
+    const AdaptiveRateController::Config config;
+    std::vector<AdaptiveRateController> controllers(PROCESSES, AdaptiveRateController(static_cast<uint64_t>(CEILING)));
+    std::vector<double> rates(PROCESSES, CEILING);
+    std::vector<double> intervalBytes(PROCESSES, 0.0);
+    std::vector<PhaseResult> results(PHASES);
+
+    double queue = 0.0;
+    double srttNs = static_cast<double>(BASE_RTT_NS);
+    const double targetNs = static_cast<double>(config.targetDelayNs);
+    for (int phase = 0; phase < PHASES; ++phase) {
+        const double capacity = CAPACITIES[phase];
+        const double wanted = std::min(capacity, CEILING * PROCESSES);
+        const uint64_t start = phase * phaseNs;
+        const uint64_t steadyStart = start + phaseNs / 2;
+        std::vector<double> delaysMs;
+        double steadyDelivered = 0.0;
+        double minLimit = 1e300;
+        double maxLimit = 0.0;
+        double sumLimit = 0.0;
+        size_t limitSamples = 0;
+        uint64_t lastUnsettled = start;
+        double bucketDelivered = 0.0;
+        double bucketDelay = 0.0;
+
+        for (uint64_t now = start; now < start + phaseNs; now += STEP_NS) {
+            const double dt = STEP_NS / 1e9;
+            double offered = 0.0;
+            for (double rate : rates) {
+                offered += rate * dt;
+            }
+            queue += offered;
+            const double delivered = std::min(queue, capacity * dt);
+            queue = std::min(queue - delivered, BUFFER_BYTES);
+            for (int i = 0; i < PROCESSES; ++i) {
+                intervalBytes[i] += offered > 0.0 ? delivered * rates[i] * dt / offered : 0.0;
+            }
+            const double queueDelayNs = queue / capacity * 1e9;
+            srttNs += (BASE_RTT_NS + queueDelayNs - srttNs) / 8.0;
+
+            bucketDelivered += delivered;
+            bucketDelay += queueDelayNs;
+            if ((now + STEP_NS - start) % BUCKET_NS == 0) {
+                const double buckets = static_cast<double>(BUCKET_NS / STEP_NS);
+                if (bucketDelay / buckets > targetNs || bucketDelivered < 0.8 * wanted * BUCKET_NS / 1e9) {
+                    lastUnsettled = now + STEP_NS;
+                }
+                bucketDelivered = 0.0;
+                bucketDelay = 0.0;
+            }
+            if (now >= steadyStart) {
+                delaysMs.push_back(queueDelayNs / 1e6);
+                steadyDelivered += delivered;
+            }
+
+            if (adaptive && (now + STEP_NS) % intervalNs == 0) {
+                for (int i = 0; i < PROCESSES; ++i) {
+                    AdaptiveRateController::Sample sample = {};
+                    sample.nowNs = now + STEP_NS;
+                    sample.pathDelayNs = static_cast<uint64_t>(srttNs) - BASE_RTT_NS;
+                    sample.shaperDelayNs = 1; // greedy: there is always traffic held back
+                    sample.throughput = static_cast<uint64_t>(intervalBytes[i] / (intervalNs / 1e9));
+                    rates[i] = static_cast<double>(controllers[i].update(sample));
+                    intervalBytes[i] = 0.0;
+                }
+            }
+            if (now >= steadyStart) {
+                double limit = 0.0;
+                for (double rate : rates) {
+                    limit += rate;
+                }
+                minLimit = std::min(minLimit, limit);
+                maxLimit = std::max(maxLimit, limit);
+                sumLimit += limit;
+                ++limitSamples;
+            }
+        }
+
+        PhaseResult& result = results[phase];
+        result.settleSec = lastUnsettled < start + phaseNs ? (lastUnsettled - start) / 1e9 : -1.0;
+        result.utilization = steadyDelivered / (capacity * (phaseNs - phaseNs / 2) / 1e9);
+        result.delayP50Ms = percentile(delaysMs, 0.50);
+        result.delayP95Ms = percentile(delaysMs, 0.95);
+        result.swing = (maxLimit - minLimit) / (sumLimit / limitSamples);
+    }
+    return results;
+}
+
+bool report(const char* mode, const std::vector<PhaseResult>& results, double phaseSec, bool check) {
+    bool passed = true;
+    for (int phase = 0; phase < PHASES; ++phase) {
+        const PhaseResult& result = results[phase];
+        char settle[16];
+        if (result.settleSec >= 0.0) {
+            std::snprintf(settle, sizeof(settle), "%.1f s", result.settleSec);
+        } else {
+            std::snprintf(settle, sizeof(settle), "never");
+        }
+        std::printf("%-16s %8.2f %9s %7.1f%% %9.1f %9.1f %7.1f%%\n", phase == 0 ? mode : "",
+                    CAPACITIES[phase] / MB, settle, 100.0 * result.utilization, result.delayP50Ms,
+                    result.delayP95Ms, 100.0 * result.swing);
+        if (check && (result.settleSec < 0.0 || result.settleSec > phaseSec / 2 ||
+                      result.delayP95Ms > 2.0 * AdaptiveRateController::DEFAULT_TARGET_DELAY_NS / 1e6)) {
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const double phaseSec = argc > 1 ? std::atof(argv[1]) : 30.0;
+    const uint64_t phaseNs = static_cast<uint64_t>(phaseSec) * BUCKET_NS;
+
+    std::printf("%d greedy processes at %.0f MB/s each, %.0f ms target, %.0f s per capacity\n", PROCESSES,
+                CEILING / MB, AdaptiveRateController::DEFAULT_TARGET_DELAY_NS / 1e6, phaseNs / 1e9);
+    std::printf("%-16s %8s %9s %8s %9s %9s %8s\n", "mode", "MB/s", "settle", "util", "p50 ms", "p95 ms", "swing");
+    report("static", run(false, BUCKET_NS, phaseNs), phaseSec, false);
+    const bool passed = report("adaptive, 0.5 s", run(true, BUCKET_NS / 2, phaseNs), phaseSec, true);
+    report("adaptive, 3 s", run(true, 3 * BUCKET_NS, phaseNs), phaseSec, false);
+    std::printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+// Measures throttling many processes at once: one startThrottling/stopThrottling call per
+// PID against a single applyBatch/removeBatch, and what a rejected batch costs.
+//
+// Usage: BatchThrottleBenchmark [processes] [rounds]   (default: 500 5)
+//
+// The PIDs are real: the benchmark forks that many idle children. Limits are published to
+// a private shared-memory table. Times are the best of the rounds, in microseconds for the
+// whole set and nanoseconds per process.
+
+#include "platform/linux/NetworkThrottler.h"
+#include "core/MonotonicClock.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t DOWNLOAD = 1024 * 1024;
+constexpr uint64_t UPLOAD = 256 * 1024;
+
+struct Timing {
+    double best = 1e18;
+
+    void add(uint64_t ns) { best = ns < best ? ns : best; }
+};
+
+void report(const char* name, const Timing& timing, size_t processes) {
+    std::printf("%-34s %12.1f %12.1f\n", name, timing.best / 1000.0, timing.best / processes);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t processes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 500;
+    const int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    std::vector<uint32_t> pids;
+    for (size_t i = 0; i < processes; ++i) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            pause();
+            _exit(0);
+        }
+        if (pid < 0) {
+            std::fprintf(stderr, "fork failed after %zu children\n", pids.size());
+            break;
+        }
+        pids.push_back(static_cast<uint32_t>(pid));
+    }
+
+    const std::string shmName = "/bandwidth-batch-benchmark-" + std::to_string(getpid());
+    setenv("BANDWIDTH_THROTTLER_SHM", shmName.c_str(), 1);
+    bool consistent = true;
+    {
+        NetworkThrottler throttler;
+        std::vector<ThrottleRequest> requests;
+        for (uint32_t pid : pids) {
+            requests.emplace_back(pid, DOWNLOAD, UPLOAD);
+        }
+        // A PID that has already exited, placed last so the rest of the set is validated first
+        std::vector<ThrottleRequest> rejected(requests);
+        const pid_t exited = fork();
+        if (exited == 0) {
+            _exit(0);
+        }
+        waitpid(exited, nullptr, 0);
+        rejected.emplace_back(static_cast<uint32_t>(exited), DOWNLOAD, UPLOAD);
+
+        Timing loopStart, loopUpdate, loopStop, batchStart, batchUpdate, batchStop, batchRejected;
+        for (int round = 0; round < rounds; ++round) {
+            uint64_t start = MonotonicClock::nowNs();
+            for (const ThrottleRequest& request : requests) {
+                consistent &= throttler.startThrottling(request.pid, request.downloadLimit, request.uploadLimit);
+            }
+            loopStart.add(MonotonicClock::nowNs() - start);
+
+            start = MonotonicClock::nowNs();
+            for (const ThrottleRequest& request : requests) {
+                consistent &= throttler.startThrottling(request.pid, request.downloadLimit * 2, request.uploadLimit);
+            }
+            loopUpdate.add(MonotonicClock::nowNs() - start);
+
+            start = MonotonicClock::nowNs();
+            for (uint32_t pid : pids) {
+                consistent &= throttler.stopThrottling(pid);
+            }
+            loopStop.add(MonotonicClock::nowNs() - start);
+
+            start = MonotonicClock::nowNs();
+            consistent &= throttler.applyBatch(requests);
+            batchStart.add(MonotonicClock::nowNs() - start);
+
+            std::vector<ThrottleRequest> doubled(requests);
+            for (ThrottleRequest& request : doubled) {
+                request.downloadLimit *= 2;
+            }
+            start = MonotonicClock::nowNs();
+            consistent &= throttler.applyBatch(doubled);
+            batchUpdate.add(MonotonicClock::nowNs() - start);
+
+            // Rejected while every PID is throttled: nothing may change
+            start = MonotonicClock::nowNs();
+            consistent &= !throttler.applyBatch(rejected);
+            batchRejected.add(MonotonicClock::nowNs() - start);
+            for (uint32_t pid : pids) {
+                SharedLimitSnapshot status;
+                consistent &= throttler.getThrottleStatus(pid, status) && status.downloadLimit == DOWNLOAD * 2;
+            }
+
+            start = MonotonicClock::nowNs();
+            consistent &= throttler.removeBatch(pids);
+            batchStop.add(MonotonicClock::nowNs() - start);
+            consistent &= throttler.activeThrottles().empty();
+        }
+
+        std::printf("%zu processes, best of %d rounds\n%-34s %12s %12s\n", pids.size(), rounds, "operation",
+                    "total us", "ns/process");
+        report("startThrottling loop", loopStart, pids.size());
+        report("applyBatch", batchStart, pids.size());
+        report("startThrottling loop, update", loopUpdate, pids.size());
+        report("applyBatch, update", batchUpdate, pids.size());
+        report("stopThrottling loop", loopStop, pids.size());
+        report("removeBatch", batchStop, pids.size());
+        report("applyBatch, rejected (dead PID)", batchRejected, pids.size());
+        std::printf("state after each step as expected: %s\n", consistent ? "yes" : "NO");
+    }
+    shm_unlink(shmName.c_str());
+
+    for (uint32_t pid : pids) {
+        kill(static_cast<pid_t>(pid), SIGKILL);
+    }
+    while (wait(nullptr) > 0) {
+    }
+    return consistent ? 0 : 1;
+}
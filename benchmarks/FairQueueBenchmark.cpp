@@ -0,0 +1,190 @@
+// Measures how fairly processes that share one budget are served: a plain shared token
+// bucket that every sender polls, against TrafficShaper's weighted deficit round robin.
+//
+// Usage: FairQueueBenchmark [seconds]   (default: 10, simulated)
+//
+// Every flow offers more than its fair share, but at different rates (1x to 16x the fair
+// share) and with different segment sizes (512 to 2048 bytes), so the eager senders are
+// the ones a first-come bucket rewards. Time is virtual, so the run is deterministic and
+// not limited by this machine. Fairness is Jain's index over each flow's throughput
+// divided by its weight, counted after the first tenth of the run: 1.0 is a perfectly
+// even split, 1/n means one flow got everything. The weighted runs give the flows weights
+// 1, 2 and 4 in turn. "ns/release" is the wall time the shaper spent per released segment.
+
+#include "core/MonotonicClock.h"
+#include "core/TokenBucket.h"
+#include "core/TrafficShaper.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t BUDGET = 10ULL * 1024 * 1024;
+constexpr uint32_t SEGMENTS_PER_FLOW = 8;
+constexpr uint64_t NS_PER_SEC = 1000000000ULL;
+
+struct Sender {
+    uint32_t segmentBytes;
+    uint64_t intervalNs; // between sends at the offered rate
+    uint32_t weight;
+    uint64_t counted = 0;
+};
+
+struct Result {
+    double jain;
+    double aggregate; // MB/s
+    double nsPerRelease;
+};
+
+std::vector<Sender> makeSenders(size_t flows, bool weighted) {
+    static const uint32_t WEIGHTS[] = {1, 2, 4};
+    std::vector<Sender> senders(flows);
+    const double fairShare = static_cast<double>(BUDGET) / flows;
+    for (size_t i = 0; i < flows; ++i) {
+        Sender& sender = senders[i];
+        sender.segmentBytes = 512 * static_cast<uint32_t>(1 + i % 4);
+        sender.weight = weighted ? WEIGHTS[i % 3] : 1;
+        const double offered = fairShare * sender.weight * static_cast<double>(1u << (i % 5)) * 1.25;
+        sender.intervalNs = std::max<uint64_t>(1, static_cast<uint64_t>(sender.segmentBytes * 1e9 / offered));
+    }
+    return senders;
+}
+
+Result summarize(const std::vector<Sender>& senders, double windowSeconds) {
+    double sum = 0.0;
+    double squares = 0.0;
+    uint64_t total = 0;
+    for (const Sender& sender : senders) {
+        const double normalized = static_cast<double>(sender.counted) / sender.weight;
+        sum += normalized;
+        squares += normalized * normalized;
+        total += sender.counted;
+    }
+    Result result = {};
+    result.jain = squares > 0.0 ? sum * sum / (senders.size() * squares) : 0.0;
+    result.aggregate = total / windowSeconds / (1024.0 * 1024.0);
+    return result;
+}
+
+using Event = std::pair<uint64_t, uint32_t>; // time, flow
+using EventQueue = std::priority_queue<Event, std::vector<Event>, std::greater<Event>>;
+
+// Every sender polls the shared bucket at its own rate and sends whenever it is admitted
+Result runPlainBucket(std::vector<Sender> senders, uint64_t durationNs) {
+    TokenBucket bucket(BUDGET);
+    bucket.tryConsume(bucket.burst(), 0); // start empty, like a bucket that has been in use
+    const uint64_t windowStart = durationNs / 10;
+    EventQueue events;
+    for (uint32_t i = 0; i < senders.size(); ++i) {
+        events.emplace(i, i);
+    }
+    while (!events.empty() && events.top().first < durationNs) {
+        const Event event = events.top();
+        events.pop();
+        Sender& sender = senders[event.second];
+        if (bucket.tryConsume(sender.segmentBytes, event.first) && event.first >= windowStart) {
+            sender.counted += sender.segmentBytes;
+        }
+        events.emplace(event.first + sender.intervalNs, event.second);
+    }
+    return summarize(senders, (durationNs - windowStart) / 1e9);
+}
+
+// Every sender submits to the shaper at its own rate; held segments come back from releaseDue
+Result runFairQueue(std::vector<Sender> senders, uint64_t durationNs) {
+    const size_t flows = senders.size();
+    TrafficShaper shaper(flows * SEGMENTS_PER_FLOW);
+    auto limiter = std::make_shared<ProcessLimiter>(1, BUDGET, BUDGET);
+    limiter->upload.tryConsume(limiter->upload.burst(), 0);
+    for (uint32_t i = 0; i < flows; ++i) {
+        const uint32_t pid = i + 1;
+        shaper.attachProcess(pid, TrafficShaper::LINK_GROUP, ShapingRates(), ShapingRates(), limiter);
+        shaper.setFairShare(pid, TrafficShaper::FairShare(senders[i].weight));
+        // A few segments each, so that no sender can hold the pool on its own
+        shaper.setQueueLimits(pid, TrafficShaper::QueueLimits(SEGMENTS_PER_FLOW / 2 * 2048));
+    }
+
+    const uint64_t windowStart = durationNs / 10;
+    EventQueue events;
+    for (uint32_t i = 0; i < flows; ++i) {
+        events.emplace(i, i);
+    }
+    std::vector<TrafficShaper::ReleasedUnit> released;
+    BufferPool& pool = shaper.pool();
+    uint64_t releases = 0;
+    uint64_t releaseNs = 0;
+    uint64_t now = 0;
+    while (now < durationNs) {
+        const uint64_t wakeup = shaper.nextWakeup();
+        now = std::max(now, std::min(events.top().first, wakeup));
+        if (wakeup <= now) {
+            released.clear();
+            const uint64_t start = MonotonicClock::nowNs();
+            shaper.releaseDue(now, released);
+            releaseNs += MonotonicClock::nowNs() - start;
+            releases += released.size();
+            for (const TrafficShaper::ReleasedUnit& unit : released) {
+                if (now >= windowStart) {
+                    senders[unit.pid - 1].counted += unit.bytes;
+                }
+                pool.release(unit.segment);
+            }
+        }
+        while (events.top().first <= now) {
+            const uint32_t flow = events.top().second;
+            events.pop();
+            Sender& sender = senders[flow];
+            events.emplace(now + sender.intervalNs, flow);
+            const uint32_t segment = pool.acquire();
+            if (segment == BufferPool::INVALID_SEGMENT) {
+                continue;
+            }
+            pool.setLength(segment, sender.segmentBytes);
+            if (shaper.submit(flow + 1, TrafficDirection::Upload, segment, now) == TrafficShaper::Verdict::Pass) {
+                if (now >= windowStart) {
+                    sender.counted += sender.segmentBytes;
+                }
+                pool.release(segment);
+            }
+        }
+        if (shaper.nextWakeup() <= now && events.top().first > now) {
+            ++now; // a wheel lower bound that did not fire yet
+        }
+    }
+    Result result = summarize(senders, (durationNs - windowStart) / 1e9);
+    result.nsPerRelease = releases > 0 ? static_cast<double>(releaseNs) / releases : 0.0;
+    return result;
+}
+
+void report(const char* mode, size_t flows, const Result& result) {
+    std::printf("%-22s %6zu %10.4f %12.2f", mode, flows, result.jain, result.aggregate);
+    if (result.nsPerRelease > 0.0) {
+        std::printf(" %12.1f\n", result.nsPerRelease);
+    } else {
+        std::printf(" %12s\n", "-");
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const double seconds = argc > 1 ? std::atof(argv[1]) : 10.0;
+    const uint64_t durationNs = static_cast<uint64_t>(seconds * NS_PER_SEC);
+
+    std::printf("%.0f MB/s shared budget, %.1f s simulated\n", BUDGET / (1024.0 * 1024.0), seconds);
+    std::printf("%-22s %6s %10s %12s %12s\n", "mode", "flows", "Jain", "MB/s", "ns/release");
+    for (size_t flows : {2, 50, 1000}) {
+        report("plain shared bucket", flows, runPlainBucket(makeSenders(flows, false), durationNs));
+        report("fair queue", flows, runFairQueue(makeSenders(flows, false), durationNs));
+        report("plain bucket, weighted", flows, runPlainBucket(makeSenders(flows, true), durationNs));
+        report("fair queue, weighted", flows, runFairQueue(makeSenders(flows, true), durationNs));
+    }
+    return 0;
+}
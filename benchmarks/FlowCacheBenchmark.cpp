@@ -0,0 +1,132 @@
+// Measures FlowCache lookup throughput from several threads, with and without a writer
+// opening and closing connections at the same time.
+//
+// Usage: FlowCacheBenchmark [threads] [flows] [seconds]   (default: 4 50000 1)
+//
+// Every flow's owner is derived from its key, so each hit is also checked for a torn
+// read; the mismatch count must be zero.
+
+#include "core/FlowCache.h"
+#include "core/MonotonicClock.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr uint8_t PROTOCOL_TCP = 6;
+
+FlowKey flowKey(uint32_t index) {
+    // 10.0.x.y:port -> 192.168.0.1:443, like a busy client
+    return FlowKey::ipv4(PROTOCOL_TCP, 0x0A000000u | (index >> 14), static_cast<uint16_t>(1024 + (index & 0x3FFF)),
+                         0xC0A80001u, 443);
+}
+
+FlowEntry owner(uint32_t index) {
+    return FlowEntry{1000 + index % 977, index % 7};
+}
+
+struct ThreadResult {
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+    uint64_t mismatches = 0;
+};
+
+void runReaders(const FlowCache& cache, uint32_t flows, int threads, double seconds, bool churn,
+                FlowCache* writable) {
+    std::atomic<bool> stop(false);
+    std::vector<ThreadResult> results(threads);
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            // Looks up existing flows plus 10% that were never inserted
+            uint64_t state = 0x9E3779B97F4A7C15ULL * (t + 1);
+            ThreadResult local;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int batch = 0; batch < 1024; ++batch) {
+                    state ^= state << 13;
+                    state ^= state >> 7;
+                    state ^= state << 17;
+                    const uint32_t index = static_cast<uint32_t>(state % (flows + flows / 10));
+                    FlowEntry entry;
+                    ++local.lookups;
+                    if (cache.lookup(flowKey(index), entry)) {
+                        ++local.hits;
+                        const FlowEntry expected = owner(index);
+                        if (entry.pid != expected.pid || entry.classId != expected.classId) {
+                            ++local.mismatches;
+                        }
+                    }
+                }
+            }
+            results[t] = local;
+        });
+    }
+
+    uint64_t churned = 0;
+    const uint64_t start = MonotonicClock::nowNs();
+    const uint64_t end = start + static_cast<uint64_t>(seconds * 1e9);
+    if (churn) {
+        // Close and reopen connections continuously, as a loaded server would
+        uint32_t index = 0;
+        while (MonotonicClock::nowNs() < end) {
+            writable->remove(flowKey(index));
+            writable->insert(flowKey(index), owner(index));
+            index = (index + 1) % flows;
+            ++churned;
+        }
+    } else {
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    }
+    stop.store(true);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    const double elapsed = static_cast<double>(MonotonicClock::nowNs() - start) / 1e9;
+
+    ThreadResult total;
+    for (const ThreadResult& result : results) {
+        total.lookups += result.lookups;
+        total.hits += result.hits;
+        total.mismatches += result.mismatches;
+    }
+    std::printf("%-22s %8d %12.1f %12.1f %9.1f%% %11llu %12.0f\n", churn ? "with writer churn" : "read only",
+                threads, total.lookups / elapsed / 1e6, total.lookups / elapsed / 1e6 / threads,
+                100.0 * total.hits / std::max<uint64_t>(total.lookups, 1),
+                static_cast<unsigned long long>(total.mismatches), churned / elapsed);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int threads = argc > 1 ? std::atoi(argv[1]) : 4;
+    const uint32_t flows = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 50000;
+    const double seconds = argc > 3 ? std::atof(argv[3]) : 1.0;
+
+    FlowCache cache(static_cast<size_t>(flows) * 2);
+    for (uint32_t i = 0; i < flows; ++i) {
+        if (!cache.insert(flowKey(i), owner(i))) {
+            std::fprintf(stderr, "cache full after %u flows\n", i);
+            return 1;
+        }
+    }
+
+    std::printf("%u flows in %zu slots\n", flows, cache.stats().capacity);
+    std::printf("%-22s %8s %12s %12s %10s %11s %12s\n", "mode", "threads", "Mlookups/s", "per thread",
+                "hit rate", "mismatches", "writes/s");
+    for (int t = 1; t <= threads; t *= 2) {
+        runReaders(cache, flows, t, seconds, false, nullptr);
+    }
+    runReaders(cache, flows, threads, seconds, true, &cache);
+
+    const FlowCache::Stats stats = cache.stats();
+    std::printf("cache counters: %llu lookups, %.1f%% hits, %llu inserts, %llu removals\n",
+                static_cast<unsigned long long>(stats.lookups), 100.0 * stats.hitRate(),
+                static_cast<unsigned long long>(stats.inserts), static_cast<unsigned long long>(stats.removals));
+    return 0;
+}
@@ -0,0 +1,351 @@
+// Checks TrtcmPolicer against RFC 2698 and shows what its per-color actions do to bursty
+// traffic under TrafficShaper.
+//
+// Usage: PolicerBenchmark [random units]   (default: 1000000)
+//
+// Conformance: a hand-worked trace (CIR 1000 B/s, PIR 2000 B/s, CBS 3000 B, PBS 4000 B,
+// color-blind and color-aware units) must come out with the colors the RFC's algorithm
+// gives, and random traces (sizes, gaps, precolors and configurations) must match a
+// direct transcription of the RFC in 128-bit arithmetic unit for unit, token counts
+// included. "ns/mark" is the wall time per unit over the random trace, for the policer
+// and for that transcription.
+//
+// Shaping: one process sends on/off bursts (3 MB/s for 200 ms, then 300 ms idle: 1.2 MB/s
+// on average) in 1500-byte units for 20 simulated seconds, policed at CIR 1 MB/s and PIR
+// 2 MB/s with the default bursts, under several action sets; "bucket" is a plain 1 MB/s
+// shaper limit for comparison. Delay percentiles are over the units that were sent.
+// Exits nonzero on any conformance mismatch.
+
+#include "core/MonotonicClock.h"
+#include "core/TrafficShaper.h"
+#include "core/TrtcmPolicer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t NS_PER_SEC = 1000000000ULL;
+constexpr double MB = 1024.0 * 1024.0;
+
+const char* colorName(PolicerColor color) {
+    static const char* const NAMES[] = {"green", "yellow", "red"};
+    return NAMES[static_cast<size_t>(color)];
+}
+
+// RFC 2698 section 3 as written: refill both buckets by the elapsed time, then test the
+// peak bucket first and the committed bucket second
+class ReferenceMarker {
+public:
+    ReferenceMarker(uint64_t cir, uint64_t pir, uint64_t cbs, uint64_t pbs)
+        : cir_(cir), pir_(pir), cbs_(static_cast<__int128>(cbs) * NS_PER_SEC),
+          pbs_(static_cast<__int128>(pbs) * NS_PER_SEC), tc_(cbs_), tp_(pbs_), lastNs_(0) {}
+
+    PolicerColor mark(uint32_t bytes, uint64_t nowNs, PolicerColor precolor) {
+        if (nowNs > lastNs_) {
+            const __int128 elapsed = nowNs - lastNs_;
+            tc_ = std::min(cbs_, tc_ + elapsed * cir_);
+            tp_ = std::min(pbs_, tp_ + elapsed * pir_);
+            lastNs_ = nowNs;
+        }
+        const __int128 needed = static_cast<__int128>(bytes) * NS_PER_SEC;
+        if (precolor == PolicerColor::Red || tp_ < needed) {
+            return PolicerColor::Red;
+        }
+        if (precolor == PolicerColor::Yellow || tc_ < needed) {
+            tp_ -= needed;
+            return PolicerColor::Yellow;
+        }
+        tp_ -= needed;
+        tc_ -= needed;
+        return PolicerColor::Green;
+    }
+
+    uint64_t committedTokens() const { return static_cast<uint64_t>(tc_ / NS_PER_SEC); }
+    uint64_t peakTokens() const { return static_cast<uint64_t>(tp_ / NS_PER_SEC); }
+
+private:
+    uint64_t cir_;
+    uint64_t pir_;
+    __int128 cbs_;
+    __int128 pbs_;
+    __int128 tc_;
+    __int128 tp_;
+    uint64_t lastNs_;
+};
+
+struct TraceUnit {
+    uint64_t atMs;
+    uint32_t bytes;
+    PolicerColor precolor;
+    PolicerColor expected;
+};
+
+bool checkWorkedTrace() {
+    const PolicerColor G = PolicerColor::Green;
+    const PolicerColor Y = PolicerColor::Yellow;
+    const PolicerColor R = PolicerColor::Red;
+    // Tc/Tp after each unit in the comments
+    const TraceUnit trace[] = {
+        {0, 1000, G, G},    // 2000/3000
+        {0, 1000, G, G},    // 1000/2000
+        {0, 1000, G, G},    // 0/1000
+        {0, 1000, G, Y},    // 0/0: peak fits, committed does not
+        {0, 500, G, R},     // 0/0
+        {500, 500, G, G},   // +500/+1000 -> 0/500
+        {500, 600, G, R},   // peak short by 100
+        {500, 500, G, Y},   // 0/0
+        {1000, 400, Y, Y},  // +500/+1000 -> 500/600; precolor caps it at yellow
+        {1000, 500, G, G},  // 0/100
+        {1000, 50, R, R},   // red stays red with tokens left
+    };
+    TrtcmPolicer policer;
+    policer.configure(TrtcmPolicer::Config(1000, 2000, 3000, 4000), 0);
+    bool passed = true;
+    for (const TraceUnit& unit : trace) {
+        const PolicerColor color = policer.mark(unit.bytes, unit.atMs * 1000000ULL, unit.precolor);
+        if (color != unit.expected) {
+            std::printf("worked trace: %u bytes at %llu ms (%s) marked %s, expected %s\n", unit.bytes,
+                        static_cast<unsigned long long>(unit.atMs), colorName(unit.precolor),
+                        colorName(color), colorName(unit.expected));
+            passed = false;
+        }
+    }
+    const uint64_t endNs = NS_PER_SEC;
+    if (policer.committedTokens(endNs) != 0 || policer.peakTokens(endNs) != 100) {
+        std::printf("worked trace: ends with %llu/%llu tokens, expected 0/100\n",
+                    static_cast<unsigned long long>(policer.committedTokens(endNs)),
+                    static_cast<unsigned long long>(policer.peakTokens(endNs)));
+        passed = false;
+    }
+    const TrtcmPolicer::Stats& stats = policer.stats();
+    std::printf("worked trace: %llu green, %llu yellow, %llu red units: %s\n",
+                static_cast<unsigned long long>(stats.packets[0]), static_cast<unsigned long long>(stats.packets[1]),
+                static_cast<unsigned long long>(stats.packets[2]), passed ? "match" : "MISMATCH");
+    return passed;
+}
+
+struct RandomUnit {
+    uint64_t nowNs;
+    uint32_t bytes;
+    PolicerColor precolor;
+};
+
+std::vector<RandomUnit> makeRandomTrace(std::mt19937_64& generator, size_t units, uint64_t meanGapNs) {
+    std::uniform_int_distribution<uint32_t> sizes(40, 9000);
+    std::exponential_distribution<double> gaps(1.0 / meanGapNs);
+    std::uniform_int_distribution<int> precolors(0, 9);
+    std::vector<RandomUnit> trace(units);
+    uint64_t now = 0;
+    for (RandomUnit& unit : trace) {
+        now += static_cast<uint64_t>(gaps(generator));
+        unit.nowNs = now;
+        unit.bytes = sizes(generator);
+        // Mostly color-blind traffic, some precolored
+        const int precolor = precolors(generator);
+        unit.precolor = precolor < 8 ? PolicerColor::Green : static_cast<PolicerColor>(precolor - 7);
+    }
+    return trace;
+}
+
+struct DifferentialResult {
+    bool matched;
+    uint64_t colors[3];
+    double policerNsPerMark;
+    double referenceNsPerMark;
+};
+
+DifferentialResult runDifferential(size_t units, uint64_t seed) {
+    std::mt19937_64 generator(seed);
+    DifferentialResult result = {true, {0, 0, 0}, 0.0, 0.0};
+    uint64_t policerNs = 0;
+    uint64_t referenceNs = 0;
+    size_t marked = 0;
+    const size_t rounds = 20;
+    std::vector<PolicerColor> colors;
+    std::vector<PolicerColor> expected;
+    for (size_t round = 0; round < rounds && result.matched; ++round) {
+        std::uniform_int_distribution<uint64_t> rates(1000, 100ULL * 1024 * 1024);
+        const uint64_t cir = rates(generator);
+        const uint64_t pir = cir + rates(generator) % (3 * cir);
+        const uint64_t cbs = std::max<uint64_t>(1500, cir / (1 + generator() % 20));
+        const uint64_t pbs = cbs + generator() % (cbs + 1);
+        // Offered load around the peak rate, so all three colors are common
+        const uint64_t meanGapNs = std::max<uint64_t>(1, 4520ULL * NS_PER_SEC / pir);
+        const std::vector<RandomUnit> trace = makeRandomTrace(generator, units / rounds, meanGapNs);
+
+        TrtcmPolicer policer;
+        policer.configure(TrtcmPolicer::Config(cir, pir, cbs, pbs), 0);
+        colors.resize(trace.size());
+        uint64_t start = MonotonicClock::nowNs();
+        for (size_t i = 0; i < trace.size(); ++i) {
+            colors[i] = policer.mark(trace[i].bytes, trace[i].nowNs, trace[i].precolor);
+        }
+        policerNs += MonotonicClock::nowNs() - start;
+
+        ReferenceMarker reference(cir, pir, cbs, pbs);
+        expected.resize(trace.size());
+        start = MonotonicClock::nowNs();
+        for (size_t i = 0; i < trace.size(); ++i) {
+            expected[i] = reference.mark(trace[i].bytes, trace[i].nowNs, trace[i].precolor);
+        }
+        referenceNs += MonotonicClock::nowNs() - start;
+        marked += trace.size();
+
+        for (size_t i = 0; i < trace.size(); ++i) {
+            ++result.colors[static_cast<size_t>(expected[i])];
+            if (colors[i] != expected[i]) {
+                std::printf("random trace %zu: unit %zu (%u bytes at %llu ns) marked %s, expected %s\n", round, i,
+                            trace[i].bytes, static_cast<unsigned long long>(trace[i].nowNs),
+                            colorName(colors[i]), colorName(expected[i]));
+                result.matched = false;
+                break;
+            }
+        }
+        const uint64_t endNs = trace.empty() ? 0 : trace.back().nowNs;
+        if (result.matched && (policer.committedTokens(endNs) != reference.committedTokens() ||
+                               policer.peakTokens(endNs) != reference.peakTokens())) {
+            std::printf("random trace %zu: token counts differ from the reference\n", round);
+            result.matched = false;
+        }
+    }
+    result.policerNsPerMark = marked > 0 ? static_cast<double>(policerNs) / marked : 0.0;
+    result.referenceNsPerMark = marked > 0 ? static_cast<double>(referenceNs) / marked : 0.0;
+    return result;
+}
+
+struct ShapingResult {
+    double sentMBps;
+    double markedPercent;
+    double droppedPercent;
+    double delayP50Ms;
+    double delayP99Ms;
+};
+
+double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    const size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+// On/off sender against one process's upload: either a policer with the given actions, or
+// (policed == false) a plain shaper limit at CIR
+ShapingResult runShaping(bool policed, PolicerAction yellow, PolicerAction red, uint64_t durationNs) {
+    constexpr uint32_t PID = 1;
+    constexpr uint32_t UNIT_BYTES = 1500;
+    constexpr uint64_t ON_RATE = 3ULL * 1024 * 1024;
+    constexpr uint64_t ON_NS = 200000000ULL;
+    constexpr uint64_t PERIOD_NS = 500000000ULL;
+    constexpr uint64_t CIR = 1024ULL * 1024;
+    constexpr uint64_t PIR = 2ULL * 1024 * 1024;
+    const uint64_t intervalNs = UNIT_BYTES * NS_PER_SEC / ON_RATE;
+
+    TrafficShaper shaper(4096);
+    shaper.attachProcess(PID, TrafficShaper::LINK_GROUP, ShapingRates(), ShapingRates(CIR, CIR));
+    if (policed) {
+        TrtcmPolicer::Config config(CIR, PIR);
+        config.action(PolicerColor::Yellow) = yellow;
+        config.action(PolicerColor::Red) = red;
+        shaper.setPolicer(PID, TrafficDirection::Upload, config, 0);
+    }
+
+    BufferPool& pool = shaper.pool();
+    std::vector<uint64_t> submittedAt(pool.capacity(), 0);
+    std::vector<TrafficShaper::ReleasedUnit> released;
+    std::vector<double> delaysMs;
+    uint64_t offered = 0;
+    uint64_t sent = 0;
+    uint64_t marked = 0;
+    uint64_t dropped = 0;
+    uint64_t nextSend = 0;
+    uint64_t now = 0;
+    while (now < durationNs) {
+        now = std::min(nextSend, std::max(now, shaper.nextWakeup()));
+        released.clear();
+        shaper.releaseDue(now, released);
+        for (const TrafficShaper::ReleasedUnit& unit : released) {
+            sent += unit.bytes;
+            delaysMs.push_back((now - submittedAt[unit.segment]) / 1e6);
+            pool.release(unit.segment);
+        }
+        if (now < nextSend) {
+            if (released.empty() && shaper.nextWakeup() <= now) {
+                ++now; // a wheel lower bound that did not fire yet
+            }
+            continue;
+        }
+        nextSend = now + intervalNs;
+        if (now % PERIOD_NS >= ON_NS) {
+            continue;
+        }
+        offered += UNIT_BYTES;
+        const uint32_t segment = pool.acquire();
+        if (segment == BufferPool::INVALID_SEGMENT) {
+            dropped += UNIT_BYTES;
+            continue;
+        }
+        pool.setLength(segment, UNIT_BYTES);
+        submittedAt[segment] = now;
+        switch (shaper.submit(PID, TrafficDirection::Upload, segment, now)) {
+        case TrafficShaper::Verdict::Marked:
+            marked += UNIT_BYTES;
+            // fall through
+        case TrafficShaper::Verdict::Pass:
+            sent += UNIT_BYTES;
+            delaysMs.push_back(0.0);
+            pool.release(segment);
+            break;
+        case TrafficShaper::Verdict::Dropped:
+            dropped += UNIT_BYTES;
+            break;
+        case TrafficShaper::Verdict::Held:
+            break;
+        }
+    }
+
+    ShapingResult result = {};
+    result.sentMBps = sent / (durationNs / 1e9) / MB;
+    result.markedPercent = offered > 0 ? 100.0 * marked / offered : 0.0;
+    result.droppedPercent = offered > 0 ? 100.0 * dropped / offered : 0.0;
+    result.delayP50Ms = percentile(delaysMs, 0.50);
+    result.delayP99Ms = percentile(delaysMs, 0.99);
+    return result;
+}
+
+void reportShaping(const char* mode, const ShapingResult& result) {
+    std::printf("%-28s %8.2f %8.1f%% %8.1f%% %9.1f %9.1f\n", mode, result.sentMBps, result.markedPercent,
+                result.droppedPercent, result.delayP50Ms, result.delayP99Ms);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t units = argc > 1 ? static_cast<size_t>(std::atoll(argv[1])) : 1000000;
+
+    bool passed = checkWorkedTrace();
+    const DifferentialResult differential = runDifferential(units, 2698);
+    passed = passed && differential.matched;
+    std::printf("random traces: %zu units (%llu green, %llu yellow, %llu red): %s\n", units,
+                static_cast<unsigned long long>(differential.colors[0]),
+                static_cast<unsigned long long>(differential.colors[1]),
+                static_cast<unsigned long long>(differential.colors[2]),
+                differential.matched ? "match" : "MISMATCH");
+    std::printf("ns/mark: policer %.1f, reference %.1f\n\n", differential.policerNsPerMark,
+                differential.referenceNsPerMark);
+
+    const uint64_t durationNs = 20 * NS_PER_SEC;
+    std::printf("on/off sender: 3 MB/s for 200 ms every 500 ms (1.2 MB/s average), 20 s simulated\n");
+    std::printf("%-28s %8s %9s %9s %9s %9s\n", "mode", "MB/s", "marked", "dropped", "p50 ms", "p99 ms");
+    reportShaping("bucket 1 MB/s", runShaping(false, PolicerAction::Pass, PolicerAction::Pass, durationNs));
+    reportShaping("trTCM pass/mark/drop", runShaping(true, PolicerAction::Mark, PolicerAction::Drop, durationNs));
+    reportShaping("trTCM pass/pass/drop", runShaping(true, PolicerAction::Pass, PolicerAction::Drop, durationNs));
+    reportShaping("trTCM pass/delay/drop", runShaping(true, PolicerAction::Delay, PolicerAction::Drop, durationNs));
+    std::printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : 1;
+}
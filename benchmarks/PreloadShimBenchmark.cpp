@@ -0,0 +1,280 @@
+// Measures what the LD_PRELOAD shim adds to socket calls, and checks the rate it enforces.
+//
+// Usage: PreloadShimBenchmark [iterations]   (default: 1000000)
+//
+// Every configuration runs in a fresh process (re-executing this binary, with or without
+// LD_PRELOAD). The wrapper cost is timed with PreloadShimStub loaded behind the shim, so
+// send/recv return without entering the kernel: syscall times vary more between runs than
+// the wrapper costs. The loopback part then ping-pongs 64-byte messages over a connected
+// pair (send/recv, then write/read) and streams 64 KiB writes. Limits come from a private
+// shared-memory table that this process creates and publishes to.
+
+#include "platform/linux/SharedLimits.h"
+#include "core/MonotonicClock.h"
+
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr size_t SMALL = 64;
+constexpr size_t LARGE = 64 * 1024;
+constexpr uint64_t UNDER_LIMIT = 100ULL * 1024 * 1024 * 1024; // never reached on loopback
+constexpr uint64_t THROTTLED = 8ULL * 1024 * 1024;
+constexpr int BATCHES = 5;
+constexpr int GO_FD = 3;
+
+enum class Preload { None, Shim, Stub, ShimAndStub };
+
+bool connectedPair(int& a, int& b) {
+    const int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), length) != 0 ||
+        listen(listener, 1) != 0 || getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        return false;
+    }
+    a = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const bool ok = a >= 0 && connect(a, reinterpret_cast<sockaddr*>(&address), length) == 0 &&
+                    (b = accept(listener, nullptr, nullptr)) >= 0;
+    close(listener);
+    const int noDelay = 1;
+    setsockopt(a, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    return ok;
+}
+
+// ns per call, send and receive counted separately; best of several batches
+double pingPong(int a, int b, long iterations, bool useReadWrite) {
+    char buffer[SMALL] = {};
+    double best = 1e18;
+    for (int batch = 0; batch < BATCHES; ++batch) {
+        const uint64_t start = MonotonicClock::nowNs();
+        for (long i = 0; i < iterations; ++i) {
+            if (useReadWrite) {
+                if (write(a, buffer, SMALL) != static_cast<ssize_t>(SMALL) ||
+                    read(b, buffer, SMALL) != static_cast<ssize_t>(SMALL)) {
+                    return -1.0;
+                }
+            } else if (send(a, buffer, SMALL, 0) != static_cast<ssize_t>(SMALL) ||
+                       recv(b, buffer, SMALL, MSG_WAITALL) != static_cast<ssize_t>(SMALL)) {
+                return -1.0;
+            }
+        }
+        const double ns = static_cast<double>(MonotonicClock::nowNs() - start) / (2.0 * iterations);
+        best = ns < best ? ns : best;
+    }
+    return best;
+}
+
+// MB/s of 64 KiB sends drained by a reader thread. The first fifth of the run is not
+// counted, so a throttled run is not flattered by its initial burst.
+double stream(int a, int b, double seconds) {
+    std::thread reader([b]() {
+        std::vector<char> buffer(LARGE);
+        while (recv(b, buffer.data(), buffer.size(), 0) > 0) {
+        }
+    });
+    std::vector<char> buffer(LARGE);
+    uint64_t sent = 0;
+    const uint64_t begin = MonotonicClock::nowNs();
+    const uint64_t start = begin + static_cast<uint64_t>(seconds * 0.2e9);
+    const uint64_t end = begin + static_cast<uint64_t>(seconds * 1e9);
+    uint64_t now = begin;
+    while ((now = MonotonicClock::nowNs()) < end) {
+        const ssize_t n = send(a, buffer.data(), buffer.size(), 0);
+        if (n <= 0) {
+            break;
+        }
+        if (now >= start) {
+            sent += static_cast<uint64_t>(n);
+        }
+    }
+    shutdown(a, SHUT_WR);
+    reader.join();
+    return sent / (static_cast<double>(now - start) / 1e9) / (1024.0 * 1024.0);
+}
+
+// Prints "attached value..." for the parent to parse
+int runChild(long iterations, double seconds, bool stubbed) {
+    char go = 0;
+    if (read(GO_FD, &go, 1) != 1) {
+        return 1;
+    }
+    close(GO_FD);
+    int a = -1;
+    int b = -1;
+    if (!connectedPair(a, b)) {
+        return 1;
+    }
+    auto attached = reinterpret_cast<int (*)()>(dlsym(RTLD_DEFAULT, "bandwidth_shim_attached"));
+    const int state = attached ? attached() : -1;
+    if (stubbed) {
+        // The stub answers at once, so this is the wrapper plus two plain calls
+        std::printf("%d %.2f\n", state, pingPong(a, b, iterations * 2, false));
+        return 0;
+    }
+    const double sendRecv = pingPong(a, b, iterations / BATCHES, false);
+    const double readWrite = pingPong(a, b, iterations / BATCHES, true);
+    const double throughput = stream(a, b, seconds);
+    std::printf("%d %.1f %.1f %.1f\n", state, sendRecv, readWrite, throughput);
+    return 0;
+}
+
+// Runs one configuration in a child and returns its output line
+bool runConfiguration(const char* self, const std::string& shmName, Preload preload, uint64_t downloadLimit,
+                      uint64_t uploadLimit, long iterations, double seconds, SharedLimits& limits,
+                      std::string& line) {
+    int go[2];
+    int output[2];
+    if (pipe(go) != 0 || pipe(output) != 0) {
+        return false;
+    }
+    const bool stubbed = preload == Preload::Stub || preload == Preload::ShimAndStub;
+    const pid_t pid = fork();
+    if (pid == 0) {
+        dup2(go[0], GO_FD);
+        dup2(output[1], STDOUT_FILENO);
+        setenv("BANDWIDTH_THROTTLER_SHM", shmName.c_str(), 1);
+        // The stub goes last so that the shim's RTLD_NEXT lookups find it instead of libc
+        const char* libraries = preload == Preload::Shim          ? SHIM_PATH
+                                : preload == Preload::Stub        ? STUB_PATH
+                                : preload == Preload::ShimAndStub ? SHIM_PATH ":" STUB_PATH
+                                                                  : nullptr;
+        if (libraries) {
+            setenv("LD_PRELOAD", libraries, 1);
+        } else {
+            unsetenv("LD_PRELOAD");
+        }
+        const std::string iterationArg = std::to_string(iterations);
+        const std::string secondsArg = std::to_string(seconds);
+        execl(self, self, "--child", iterationArg.c_str(), secondsArg.c_str(), stubbed ? "1" : "0",
+              static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    close(go[0]);
+    close(output[1]);
+
+    // exec keeps the PID, so the limits can be published before the child measures
+    if (downloadLimit != 0 || uploadLimit != 0) {
+        limits.publish(static_cast<uint32_t>(pid), downloadLimit, uploadLimit);
+    }
+    const char start = 1;
+    const bool started = write(go[1], &start, 1) == 1;
+    close(go[1]);
+
+    char buffer[256] = {};
+    size_t used = 0;
+    ssize_t n;
+    while (used + 1 < sizeof(buffer) && (n = read(output[0], buffer + used, sizeof(buffer) - 1 - used)) > 0) {
+        used += static_cast<size_t>(n);
+    }
+    close(output[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    limits.remove(static_cast<uint32_t>(pid));
+    line = buffer;
+    return started && WIFEXITED(status) && WEXITSTATUS(status) == 0 && !line.empty();
+}
+
+const char* attachedName(int attached) {
+    return attached < 0 ? "-" : (attached ? "yes" : "no");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::strcmp(argv[1], "--child") == 0) {
+        return runChild(argc > 2 ? std::atol(argv[2]) : 1000000, argc > 3 ? std::atof(argv[3]) : 1.0,
+                        argc > 4 && argv[4][0] == '1');
+    }
+    const long iterations = argc > 1 ? std::atol(argv[1]) : 1000000;
+
+    const std::string shmName = "/bandwidth-shim-benchmark-" + std::to_string(getpid());
+    SharedLimits limits;
+    if (!limits.create(shmName)) {
+        std::fprintf(stderr, "cannot create shared memory table %s\n", shmName.c_str());
+        return 1;
+    }
+
+    struct Configuration {
+        const char* name;
+        Preload preload;
+        uint64_t downloadLimit;
+        uint64_t uploadLimit;
+        double seconds;
+    };
+
+    std::printf("wrapper cost, syscalls stubbed out\n%-22s %9s %12s %12s\n", "configuration", "attached",
+                "ns per call", "wrapper ns");
+    const Configuration stubbed[] = {
+        {"stub only", Preload::Stub, 0, 0, 0.0},
+        {"shim, not throttled", Preload::ShimAndStub, 0, 0, 0.0},
+        {"shim, under limit", Preload::ShimAndStub, UNDER_LIMIT, UNDER_LIMIT, 0.0},
+    };
+    double baseline = 0.0;
+    for (const Configuration& configuration : stubbed) {
+        std::string line;
+        int attached = 0;
+        double ns = 0.0;
+        if (!runConfiguration(argv[0], shmName, configuration.preload, configuration.downloadLimit,
+                              configuration.uploadLimit, iterations, 0.0, limits, line) ||
+            std::sscanf(line.c_str(), "%d %lf", &attached, &ns) != 2) {
+            std::fprintf(stderr, "%s: run failed\n", configuration.name);
+            continue;
+        }
+        if (configuration.preload == Preload::Stub) {
+            baseline = ns;
+        }
+        std::printf("%-22s %9s %12.2f %+12.2f\n", configuration.name, attachedName(attached), ns, ns - baseline);
+    }
+
+    std::printf("\nloopback\n%-22s %9s %14s %14s %12s\n", "configuration", "attached", "send/recv ns",
+                "write/read ns", "stream MB/s");
+    // The throttled run limits uploads only, so its reader is not slowed down as well
+    const Configuration loopback[] = {
+        {"no shim", Preload::None, 0, 0, 1.0},
+        {"shim, not throttled", Preload::Shim, 0, 0, 1.0},
+        {"shim, under limit", Preload::Shim, UNDER_LIMIT, UNDER_LIMIT, 1.0},
+        {"shim, 8 MB/s upload", Preload::Shim, 0, THROTTLED, 3.0},
+    };
+    for (const Configuration& configuration : loopback) {
+        // The full ping-pong count would take minutes at 8 MB/s
+        const long count = configuration.uploadLimit == THROTTLED ? 5000 : iterations;
+        std::string line;
+        int attached = 0;
+        double sendRecv = 0.0;
+        double readWrite = 0.0;
+        double throughput = 0.0;
+        if (!runConfiguration(argv[0], shmName, configuration.preload, configuration.downloadLimit,
+                              configuration.uploadLimit, count, configuration.seconds, limits, line) ||
+            std::sscanf(line.c_str(), "%d %lf %lf %lf", &attached, &sendRecv, &readWrite, &throughput) != 4) {
+            std::fprintf(stderr, "%s: run failed\n", configuration.name);
+            continue;
+        }
+        std::printf("%-22s %9s %14.1f %14.1f %12.1f", configuration.name, attachedName(attached), sendRecv,
+                    readWrite, throughput);
+        if (configuration.uploadLimit == THROTTLED) {
+            const double limit = THROTTLED / (1024.0 * 1024.0);
+            std::printf("   (%+.2f%% of the limit)", 100.0 * (throughput - limit) / limit);
+        }
+        std::printf("\n");
+    }
+
+    limits.close();
+    shm_unlink(shmName.c_str());
+    return 0;
+}
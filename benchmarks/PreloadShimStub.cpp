@@ -0,0 +1,14 @@
+// Stand-in for libc's send/recv that returns at once. PreloadShimBenchmark loads it after
+// the shim, so the shim's wrappers forward to it and their own cost can be timed without
+// a syscall (whose run-to-run variation is larger than that cost) in the measurement.
+
+#include <sys/types.h>
+#include <cstddef>
+
+extern "C" __attribute__((visibility("default"))) ssize_t send(int, const void*, size_t length, int) {
+    return static_cast<ssize_t>(length);
+}
+
+extern "C" __attribute__((visibility("default"))) ssize_t recv(int, void*, size_t length, int) {
+    return static_cast<ssize_t>(length);
+}
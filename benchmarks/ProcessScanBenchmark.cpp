@@ -0,0 +1,232 @@
+// Measures process enumeration from a cold start: the old serial scan that resolved every
+// executable path, against the cheap scan (names and start times, stat reads spread over
+// the monitor's TaskPool) with paths resolved only for the rows on screen, and the time
+// from starting a ProcessSampler to the first snapshot a table could show.
+//
+// Usage: ProcessScanBenchmark [processes | proc root] [rounds]   (default: 5000 9)
+//
+// With a number, a synthetic procfs of that many processes is built in a temporary
+// directory; with a path (such as /proc), that tree is scanned as it is. Every round starts
+// from a new monitor. Times are medians in milliseconds.
+//
+// On a synthetic tree it then measures the steady state the monitor is built for: before
+// each round 1% of the processes change, half exiting and being replaced, half having
+// their PID reused by a new process with a later start time. A full refresh with every
+// path is timed on one monitor that keeps its cache across rounds, re-reading only new and
+// recycled PIDs, against the baseline of re-reading all of them. Exits nonzero if a
+// recycled PID keeps its old path.
+
+#include "ProcessSampler.h"
+#include "SyntheticProcFs.h"
+#include "core/MonotonicClock.h"
+#include "core/TaskPool.h"
+#include "platform/linux/ProcessMonitor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t VISIBLE_ROWS = 40;
+
+double medianMs(std::vector<uint64_t>& samples) {
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2] / 1e6;
+}
+
+// Median time of `step` over the rounds, each on a monitor prepared by `setup`
+double timeRounds(int rounds, const std::string& root, size_t workers,
+                  const std::function<void(ProcessMonitor&)>& setup,
+                  const std::function<void(ProcessMonitor&)>& step) {
+    std::vector<uint64_t> samples;
+    for (int round = 0; round < rounds; ++round) {
+        ProcessMonitor monitor(root, workers);
+        setup(monitor);
+        const uint64_t start = MonotonicClock::nowNs();
+        step(monitor);
+        samples.push_back(MonotonicClock::nowNs() - start);
+    }
+    return medianMs(samples);
+}
+
+// The rows on screen: the newest processes, which unlike kernel threads have paths
+std::vector<uint32_t> lastPids(const ProcessList& processes) {
+    const size_t first = processes.size() > VISIBLE_ROWS ? processes.size() - VISIBLE_ROWS : 0;
+    return std::vector<uint32_t>(processes.pids.begin() + first, processes.pids.end());
+}
+
+// From starting a sampler to the first snapshot with processes, and on to the one with
+// the paths of the rows on screen after asking for them
+void timeSampler(int rounds, const std::string& root, double& firstTableMs, double& visiblePathsMs) {
+    std::vector<uint64_t> firstTable;
+    std::vector<uint64_t> visiblePaths;
+    for (int round = 0; round < rounds; ++round) {
+        const uint64_t start = MonotonicClock::nowNs();
+        ProcessMonitor monitor(root);
+        ProcessSampler sampler(monitor);
+        sampler.start();
+        const ProcessSnapshot* snapshot = &sampler.latest();
+        while (snapshot->processes->empty()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            snapshot = &sampler.latest();
+        }
+        const uint64_t shown = MonotonicClock::nowNs();
+        firstTable.push_back(shown - start);
+
+        const uint64_t version = snapshot->version;
+        sampler.setWantedPaths(lastPids(*snapshot->processes), false);
+        // A newer snapshot may be a network sample published before the paths; some
+        // processes have none, so any path among the rows will do (or give up after 2 s)
+        auto hasPaths = [](const ProcessSnapshot& current) {
+            const ProcessList& processes = *current.processes;
+            for (size_t i = processes.size() > VISIBLE_ROWS ? processes.size() - VISIBLE_ROWS : 0; i < processes.size();
+                 ++i) {
+                if (!processes.paths[i].empty()) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        for (;;) {
+            snapshot = &sampler.latest();
+            if ((snapshot->version != version && hasPaths(*snapshot)) ||
+                MonotonicClock::nowNs() - shown > 2000000000ULL) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        visiblePaths.push_back(MonotonicClock::nowNs() - shown);
+        sampler.stop();
+    }
+    firstTableMs = medianMs(firstTable);
+    visiblePathsMs = medianMs(visiblePaths);
+}
+
+// Full refreshes after churn, cached and not; false if a recycled PID kept a stale path
+bool timeChurn(int rounds, SyntheticProcFs& procFs, size_t workers, double& cachedMs, double& uncachedMs) {
+    const size_t changes = std::max<size_t>(procFs.size() / 100, 2);
+    std::mt19937 generator(5);
+    ProcessMonitor cached(procFs.root(), workers);
+    cached.refresh();
+    cached.resolveAllPaths();
+
+    std::vector<uint64_t> cachedSamples;
+    std::vector<uint64_t> uncachedSamples;
+    bool recycledSeen = true;
+    for (int round = 0; round < rounds; ++round) {
+        std::vector<uint32_t> recycled;
+        for (size_t i = 0; i < changes / 2; ++i) {
+            procFs.removeRandom(generator);
+            procFs.addProcess();
+        }
+        for (size_t i = 0; i < changes / 2; ++i) {
+            recycled.push_back(procFs.recycleRandom(generator));
+        }
+
+        uint64_t start = MonotonicClock::nowNs();
+        cached.refresh();
+        cached.resolveAllPaths();
+        cachedSamples.push_back(MonotonicClock::nowNs() - start);
+
+        ProcessMonitor uncached(procFs.root(), workers);
+        start = MonotonicClock::nowNs();
+        uncached.refresh();
+        uncached.resolveAllPaths();
+        uncachedSamples.push_back(MonotonicClock::nowNs() - start);
+
+        const std::shared_ptr<const ProcessList> processes = cached.getRunningProcesses();
+        for (uint32_t pid : recycled) {
+            auto it = std::lower_bound(processes->pids.begin(), processes->pids.end(), pid);
+            const size_t index = static_cast<size_t>(it - processes->pids.begin());
+            recycledSeen = recycledSeen && pid != 0 && it != processes->pids.end() && *it == pid &&
+                           processes->paths[index] == procFs.image(pid);
+        }
+    }
+    cachedMs = medianMs(cachedSamples);
+    uncachedMs = medianMs(uncachedSamples);
+    return recycledSeen;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::string target = argc > 1 ? argv[1] : "5000";
+    const int rounds = argc > 2 ? std::atoi(argv[2]) : 9;
+    if (rounds <= 0) {
+        std::fprintf(stderr, "Usage: %s [processes | proc root] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    SyntheticProcFs procFs;
+    std::string root = target;
+    if (target[0] != '/') {
+        const size_t processes = std::strtoul(target.c_str(), nullptr, 10);
+        if (!procFs.valid() || processes == 0) {
+            std::fprintf(stderr, "Usage: %s [processes | proc root] [rounds]\n", argv[0]);
+            return 1;
+        }
+        for (size_t i = 0; i < processes; ++i) {
+            if (!procFs.addProcess()) {
+                std::perror("creating the synthetic procfs");
+                return 1;
+            }
+        }
+        root = procFs.root();
+    }
+
+    size_t processes = 0;
+    {
+        ProcessMonitor monitor(root);
+        monitor.refresh();
+        processes = monitor.getRunningProcesses()->size();
+    }
+    const size_t workers = TaskPool::defaultWorkers();
+    std::printf("%s: %zu processes, %zu scan threads, %d rounds; medians in ms\n", root.c_str(), processes,
+                workers + 1, rounds);
+
+    auto none = [](ProcessMonitor&) {};
+    auto scanned = [](ProcessMonitor& monitor) { monitor.refresh(); };
+    auto fullScan = [](ProcessMonitor& monitor) {
+        monitor.refresh();
+        monitor.resolveAllPaths();
+    };
+    std::vector<uint32_t> visible;
+    auto scannedVisible = [&visible](ProcessMonitor& monitor) {
+        monitor.refresh();
+        visible = lastPids(*monitor.getRunningProcesses());
+    };
+    auto visiblePaths = [&visible](ProcessMonitor& monitor) { monitor.resolvePaths(visible); };
+    auto allPaths = [](ProcessMonitor& monitor) { monitor.resolveAllPaths(); };
+
+    std::printf("%-44s %8.2f\n", "cold scan, every path, serial (before)", timeRounds(rounds, root, 0, none, fullScan));
+    std::printf("%-44s %8.2f\n", "cold scan, names only, serial", timeRounds(rounds, root, 0, none, scanned));
+    std::printf("%-44s %8.2f\n", "cold scan, names only, pool", timeRounds(rounds, root, workers, none, scanned));
+    std::printf("%-44s %8.2f\n", "paths of 40 rows on screen",
+                timeRounds(rounds, root, workers, scannedVisible, visiblePaths));
+    std::printf("%-44s %8.2f\n", "every path, pool (search)", timeRounds(rounds, root, workers, scanned, allPaths));
+    std::printf("%-44s %8.2f\n", "rescan, nothing new", timeRounds(rounds, root, workers, fullScan, scanned));
+
+    double firstTableMs = 0.0;
+    double visiblePathsMs = 0.0;
+    timeSampler(rounds, root, firstTableMs, visiblePathsMs);
+    std::printf("%-44s %8.2f\n", "sampler start to first snapshot", firstTableMs);
+    std::printf("%-44s %8.2f\n", "then to the paths of 40 rows", visiblePathsMs);
+
+    if (root != procFs.root()) {
+        return 0;
+    }
+    double cachedMs = 0.0;
+    double uncachedMs = 0.0;
+    const bool recycledSeen = timeChurn(rounds, procFs, workers, cachedMs, uncachedMs);
+    std::printf("%-44s %8.2f\n", "refresh after 1% churn, every path (baseline)", uncachedMs);
+    std::printf("%-44s %8.2f\n", "refresh after 1% churn, new/recycled only", cachedMs);
+    std::printf("recycled PIDs %s\n", recycledSeen ? "re-read" : "kept a STALE path");
+    return recycledSeen ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+// Measures what handing the process list around costs per tick with a synthetic procfs of
+// 20,000 processes: heap allocations, bytes allocated and time per stage, and peak RSS.
+//
+// Usage: ProcessSnapshotBenchmark [processes] [ticks]   (default: 20000 20)
+//
+// Each tick a percent of the processes exits and as many start, and the monitor rescans
+// and resolves every path (as while searching). The list is then published through a
+// TripleBuffer as ProcessSampler does, taken by the reader and applied to the table rows.
+// Then network statistics are sampled and the list published again, as the sampler does
+// several times between rescans. Readers hold the monitor's shared ProcessList; the copy that
+// getRunningProcesses() used to return by value, a ProcessInfo per process, is timed
+// afterwards for comparison, outside the peak RSS. A list taken before the first tick is
+// held throughout and checked at the end, as its strings must outlive the monitor
+// compacting its arena.
+
+#include "ProcessRows.h"
+#include "ProcessSampler.h"
+#include "SyntheticProcFs.h"
+#include "core/MonotonicClock.h"
+#include "core/TripleBuffer.h"
+#include "platform/linux/ProcessMonitor.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+std::atomic<uint64_t> allocations(0);
+std::atomic<uint64_t> allocatedBytes(0);
+
+struct Counters {
+    uint64_t allocations;
+    uint64_t bytes;
+    uint64_t ns;
+};
+
+// Adds what happened since `from` to `stage`, and returns now
+Counters count(const Counters& from, Counters& stage) {
+    const Counters now = {allocations.load(std::memory_order_relaxed), allocatedBytes.load(std::memory_order_relaxed),
+                          MonotonicClock::nowNs()};
+    stage.allocations += now.allocations - from.allocations;
+    stage.bytes += now.bytes - from.bytes;
+    stage.ns += now.ns - from.ns;
+    return now;
+}
+
+Counters now() {
+    Counters none = {0, 0, 0};
+    return count(none, none);
+}
+
+// As ProcessSampler::publish() and latest() do; returns the reader's list
+const ProcessList& publishList(ProcessMonitor& monitor, TripleBuffer<ProcessSnapshot>& snapshots) {
+    ProcessSnapshot& slot = snapshots.back();
+    slot.processes.reset();
+    slot.processes = monitor.getRunningProcesses();
+    snapshots.publish();
+    snapshots.update();
+    return *snapshots.front().processes;
+}
+
+// The list as a reader used to get it
+std::vector<ProcessInfo> copyOut(const ProcessList& processes) {
+    std::vector<ProcessInfo> copy;
+    copy.reserve(processes.size());
+    for (size_t i = 0; i < processes.size(); ++i) {
+        copy.push_back(processes.info(i));
+    }
+    return copy;
+}
+
+// Sorted by PID, and every resolved name is its path's last component
+bool consistent(const ProcessList& processes) {
+    for (size_t i = 0; i < processes.size(); ++i) {
+        if (i > 0 && processes.pids[i - 1] >= processes.pids[i]) {
+            return false;
+        }
+        const std::string_view path = processes.paths[i];
+        const std::string_view name = processes.names[i];
+        if (!path.empty() && (path.size() < name.size() || path.substr(path.size() - name.size()) != name)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size != 0 ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+int main(int argc, char** argv) {
+    const size_t processes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    const int ticks = argc > 2 ? std::atoi(argv[2]) : 20;
+    SyntheticProcFs procFs;
+    if (!procFs.valid() || processes < 100 || ticks <= 0) {
+        std::fprintf(stderr, "Usage: %s [processes] [ticks]\n", argv[0]);
+        return 1;
+    }
+    for (size_t i = 0; i < processes; ++i) {
+        if (!procFs.addProcess()) {
+            std::perror("creating the synthetic procfs");
+            return 1;
+        }
+    }
+
+    ProcessMonitor monitor(procFs.root());
+    TripleBuffer<ProcessSnapshot> snapshots;
+    ProcessRows rows;
+    const std::unordered_set<uint32_t> throttled;
+    monitor.refresh();
+    monitor.resolveAllPaths();
+    monitor.updateNetworkStats();
+    const std::shared_ptr<const ProcessList> held = monitor.getRunningProcesses();
+    const std::vector<ProcessInfo> heldCopy = copyOut(*held);
+    rows.update(*held, throttled, nullptr);
+
+    std::mt19937 generator(3);
+    Counters scan = {};
+    Counters publish = {};
+    Counters rowsUpdate = {};
+    Counters sample = {};
+    Counters copy = {};
+    bool correct = true;
+    for (int tick = 0; tick < ticks; ++tick) {
+        for (size_t i = 0; i < processes / 100; ++i) {
+            procFs.removeRandom(generator);
+            procFs.addProcess();
+        }
+
+        Counters mark = now();
+        monitor.refresh();
+        monitor.resolveAllPaths();
+        mark = count(mark, scan);
+        const ProcessList& list = publishList(monitor, snapshots);
+        mark = count(mark, publish);
+        rows.update(list, throttled, nullptr);
+        mark = count(mark, rowsUpdate);
+        correct = correct && list.size() == procFs.size() && consistent(list) && rows.size() == list.size();
+
+        monitor.updateNetworkStats();
+        const ProcessList& sampled = publishList(monitor, snapshots);
+        count(mark, sample);
+        correct = correct && sampled.size() == list.size() && consistent(sampled);
+    }
+
+    // The first list, held across every tick, reads as it did
+    for (size_t i = 0; i < held->size(); ++i) {
+        correct = correct && held->names[i] == heldCopy[i].name && held->paths[i] == heldCopy[i].path;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    // Afterwards, so the copies do not count towards the peak
+    const std::shared_ptr<const ProcessList> last = monitor.getRunningProcesses();
+    for (int tick = 0; tick < ticks; ++tick) {
+        const Counters mark = now();
+        const std::vector<ProcessInfo> copied = copyOut(*last);
+        count(mark, copy);
+        correct = correct && copied.size() == last->size();
+    }
+    std::printf("%zu processes, %d ticks; per tick\n", processes, ticks);
+    std::printf("%-40s %12s %12s %10s\n", "stage", "allocations", "KB", "ms");
+    auto report = [ticks](const char* name, const Counters& stage) {
+        std::printf("%-40s %12.1f %12.1f %10.2f\n", name, static_cast<double>(stage.allocations) / ticks,
+                    stage.bytes / 1024.0 / ticks, stage.ns / 1e6 / ticks);
+    };
+    report("rescan and resolve paths", scan);
+    report("publish and take the shared list", publish);
+    report("update the table rows", rowsUpdate);
+    report("network sample, publish and take", sample);
+    report("copy into ProcessInfo (before)", copy);
+    std::printf("peak RSS %.1f MB\n", usage.ru_maxrss / 1024.0);
+    std::printf("%s\n", correct ? "PASS" : "FAIL: a list differs from the processes or the list held throughout");
+    return correct ? 0 : 1;
+}
@@ -0,0 +1,242 @@
+// Measures updating the process table's rows at 10k processes: ProcessRows::update (what
+// ProcessTableModel runs on each refresh) and applying the delta a sampler snapshot carries
+// against formatting and sorting every row, the non-Qt part of the old rebuild of the whole
+// table.
+//
+// Usage: ProcessTableBenchmark [processes] [ticks]   (default: 10000 200)
+//
+// Each tick changes a synthetic snapshot the way a refresh does: some processes exit, new
+// ones start, and the speeds of the active ones change. A mirror kept purely from the
+// observer's notifications is checked against the rows after every update, so the signals
+// a view would get are exactly what happened, and the rows kept from deltas (ProcessList::diff
+// of consecutive lists) are checked against the rows kept from whole lists. Times are
+// medians per update in microseconds; the delta time leaves out the diff, which the sampler
+// computes on its worker thread.
+
+#include "BandwidthController.h"
+#include "ProcessRows.h"
+#include "core/MonotonicClock.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+// Applies the notifications to a list of PIDs, as a view's model index mapping would
+class MirrorObserver : public ProcessRows::Observer {
+public:
+    explicit MirrorObserver(const ProcessRows& rows) : signals(0), rowsSignalled(0), rows_(rows) {}
+
+    uint64_t signals;       // begin/change notifications
+    uint64_t rowsSignalled; // rows they covered
+
+    void beforeRemove(size_t first, size_t last) override {
+        pids_.erase(pids_.begin() + first, pids_.begin() + last + 1);
+        ++signals;
+        rowsSignalled += last - first + 1;
+    }
+    void afterRemove() override {}
+    void beforeInsert(size_t first, size_t last) override {
+        insertFirst_ = first;
+        insertLast_ = last;
+        ++signals;
+        rowsSignalled += last - first + 1;
+    }
+    void afterInsert() override {
+        for (size_t i = insertFirst_; i <= insertLast_; ++i) {
+            pids_.insert(pids_.begin() + i, rows_.row(i).info.pid);
+        }
+    }
+    void rowsChanged(size_t first, size_t last, int, int) override {
+        ++signals;
+        rowsSignalled += last - first + 1;
+    }
+
+    bool matches() const {
+        if (pids_.size() != rows_.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < pids_.size(); ++i) {
+            if (pids_[i] != rows_.row(i).info.pid) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    const ProcessRows& rows_;
+    std::vector<uint32_t> pids_;
+    size_t insertFirst_ = 0;
+    size_t insertLast_ = 0;
+};
+
+ProcessInfo makeProcess(uint32_t pid, uint64_t creationTime) {
+    const std::string name = "proc" + std::to_string(pid % 997) + ".exe";
+    ProcessInfo process(pid, name, "/opt/apps/" + std::to_string(pid % 89) + "/bin/" + name);
+    process.creationTime = creationTime;
+    return process;
+}
+
+struct Workload {
+    double exitShare;   // processes exiting per tick
+    double activeShare; // processes whose speeds change per tick
+};
+
+double median(std::vector<uint64_t>& samples) {
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2] / 1000.0;
+}
+
+// Formats every cell and sorts by download speed: the work the old table rebuild did
+// before creating its Qt items
+uint64_t rebuildTable(const std::vector<ProcessInfo>& processes) {
+    struct Cells {
+        std::string text[ProcessRows::COLUMN_COUNT];
+        uint64_t downloadSpeed;
+    };
+    const uint64_t start = MonotonicClock::nowNs();
+    std::vector<Cells> table(processes.size());
+    for (size_t i = 0; i < processes.size(); ++i) {
+        const ProcessInfo& process = processes[i];
+        table[i].text[ProcessRows::PidColumn] = std::to_string(process.pid);
+        table[i].text[ProcessRows::NameColumn] = process.name;
+        table[i].text[ProcessRows::DownloadColumn] = BandwidthController::formatBandwidth(process.downloadSpeed);
+        table[i].text[ProcessRows::UploadColumn] = BandwidthController::formatBandwidth(process.uploadSpeed);
+        table[i].text[ProcessRows::PathColumn] = process.path;
+        table[i].downloadSpeed = process.downloadSpeed;
+    }
+    std::sort(table.begin(), table.end(),
+              [](const Cells& a, const Cells& b) { return a.downloadSpeed > b.downloadSpeed; });
+    return MonotonicClock::nowNs() - start;
+}
+
+bool sameRows(const ProcessRows& a, const ProcessRows& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        const ProcessRows::Row& x = a.row(i);
+        const ProcessRows::Row& y = b.row(i);
+        if (x.info.pid != y.info.pid || x.info.name != y.info.name || x.info.path != y.info.path ||
+            x.info.downloadSpeed != y.info.downloadSpeed || x.info.uploadSpeed != y.info.uploadSpeed ||
+            x.throttled != y.throttled) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool runWorkload(const char* name, const Workload& workload, size_t processes, int ticks) {
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::vector<ProcessInfo> snapshot;
+    uint32_t nextPid = 1000;
+    for (size_t i = 0; i < processes; ++i) {
+        snapshot.push_back(makeProcess(nextPid, nextPid));
+        nextPid += 1 + generator() % 4;
+    }
+    std::unordered_set<uint32_t> throttled;
+
+    ProcessRows rows;
+    MirrorObserver mirror(rows);
+    std::shared_ptr<const ProcessList> list = ProcessList::copyOf(snapshot);
+    const uint64_t start = MonotonicClock::nowNs();
+    rows.update(*list, throttled, &mirror);
+    const double populateUs = (MonotonicClock::nowNs() - start) / 1000.0;
+    bool consistent = mirror.matches();
+    // Versions as the sampler numbers them: the rows start at version 0, the empty list
+    ProcessRows deltaRows;
+    MirrorObserver deltaMirror(deltaRows);
+    ProcessDelta delta;
+    ProcessList().diff(*list, delta);
+    deltaRows.update(*list, 1, &delta, 0, throttled, &deltaMirror);
+    consistent = consistent && deltaMirror.matches() && sameRows(rows, deltaRows);
+
+    std::vector<uint64_t> updateNs;
+    std::vector<uint64_t> deltaNs;
+    std::vector<uint64_t> rebuildNs;
+    uint64_t signals = 0;
+    uint64_t rowsSignalled = 0;
+    for (int tick = 0; tick < ticks; ++tick) {
+        // Exits, starts (PIDs keep increasing, so the snapshot stays sorted), speed changes
+        std::vector<ProcessInfo> next;
+        next.reserve(snapshot.size() + 64);
+        size_t exited = 0;
+        for (ProcessInfo& process : snapshot) {
+            if (chance(generator) < workload.exitShare) {
+                ++exited;
+                continue;
+            }
+            if (chance(generator) < workload.activeShare) {
+                process.downloadSpeed = generator() % (10 * 1024 * 1024);
+                process.uploadSpeed = generator() % (1024 * 1024);
+            }
+            next.push_back(std::move(process));
+        }
+        for (size_t i = 0; i < exited; ++i) {
+            next.push_back(makeProcess(nextPid, nextPid));
+            nextPid += 1 + generator() % 4;
+        }
+        snapshot.swap(next);
+        if (tick % 10 == 0) {
+            // Now and then a throttle starts or ends
+            const uint32_t pid = snapshot[generator() % snapshot.size()].pid;
+            if (!throttled.erase(pid)) {
+                throttled.insert(pid);
+            }
+        }
+
+        const uint64_t signalsBefore = mirror.signals;
+        const uint64_t rowsBefore = mirror.rowsSignalled;
+        std::shared_ptr<const ProcessList> previous = list;
+        list = ProcessList::copyOf(snapshot);
+        uint64_t begin = MonotonicClock::nowNs();
+        rows.update(*list, throttled, &mirror);
+        updateNs.push_back(MonotonicClock::nowNs() - begin);
+        signals += mirror.signals - signalsBefore;
+        rowsSignalled += mirror.rowsSignalled - rowsBefore;
+        consistent = consistent && mirror.matches();
+
+        previous->diff(*list, delta);
+        const uint64_t version = static_cast<uint64_t>(tick) + 2;
+        begin = MonotonicClock::nowNs();
+        deltaRows.update(*list, version, &delta, version - 1, throttled, &deltaMirror);
+        deltaNs.push_back(MonotonicClock::nowNs() - begin);
+        consistent = consistent && deltaMirror.matches() && sameRows(rows, deltaRows);
+        rebuildNs.push_back(rebuildTable(snapshot));
+    }
+
+    std::printf("%-14s %8.0f %10.1f %10.1f %10.1f %9.1f %11.1f %8s\n", name, populateUs, median(updateNs),
+                median(deltaNs), median(rebuildNs), static_cast<double>(signals) / ticks,
+                static_cast<double>(rowsSignalled) / ticks, consistent ? "yes" : "NO");
+    return consistent;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t processes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    const int ticks = argc > 2 ? std::atoi(argv[2]) : 200;
+    if (processes == 0 || ticks <= 0) {
+        std::fprintf(stderr, "Usage: %s [processes] [ticks]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("%zu processes, %d ticks; times in microseconds\n", processes, ticks);
+    std::printf("%-14s %8s %10s %10s %10s %9s %11s %8s\n", "workload", "populate", "update", "delta", "rebuild",
+                "signals", "rows/update", "correct");
+    bool ok = true;
+    ok = runWorkload("idle", Workload{0.0, 0.0}, processes, ticks) && ok;
+    ok = runWorkload("typical", Workload{0.002, 0.05}, processes, ticks) && ok;
+    ok = runWorkload("busy", Workload{0.01, 0.3}, processes, ticks) && ok;
+    ok = runWorkload("all changing", Workload{0.05, 1.0}, processes, ticks) && ok;
+    std::printf("%s\n", ok ? "PASS" : "FAIL: notifications or delta updates do not match the rows");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,262 @@
+// Checks that a throttle tree holds its aggregate rate while its root forks many children,
+// and times how the controller picks the children up.
+//
+// Usage: ProcessTreeBenchmark [children] [seconds]   (default: 200 3)
+//
+// A root process is started under the LD_PRELOAD shim and throttled, then forks the
+// children; every second child also execs this binary again, so both ways a child can
+// inherit its tree are covered. Each child streams 64 KiB sends over loopback into a
+// reader in this process, which counts what arrives after the first fifth of the run.
+// The same run with only the root throttled on its own shows what the children would
+// get without the tree. Limits come from a private shared-memory table.
+
+#include "platform/linux/NetworkThrottler.h"
+#include "core/MonotonicClock.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr size_t LARGE = 64 * 1024;
+constexpr uint64_t LIMIT = 8ULL * 1024 * 1024;
+constexpr int GO_FD = 3;
+
+// Streams until the deadline; run in every child
+int runSender(int port, uint64_t deadlineNs) {
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        return 1;
+    }
+    std::vector<char> buffer(LARGE);
+    while (MonotonicClock::nowNs() < deadlineNs) {
+        if (send(fd, buffer.data(), buffer.size(), MSG_NOSIGNAL) <= 0) {
+            break;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+// The throttled root: waits for its limits, then forks the children and waits for them
+int runRoot(const char* self, int children, double seconds, int port) {
+    char go = 0;
+    if (read(GO_FD, &go, 1) != 1) {
+        return 1;
+    }
+    close(GO_FD);
+    const uint64_t deadline = MonotonicClock::nowNs() + static_cast<uint64_t>(seconds * 1e9);
+    const std::string portArg = std::to_string(port);
+    const std::string deadlineArg = std::to_string(deadline);
+    for (int i = 0; i < children; ++i) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            if (i % 2 == 1) {
+                execl(self, self, "--sender", portArg.c_str(), deadlineArg.c_str(), static_cast<char*>(nullptr));
+                _exit(127);
+            }
+            _exit(runSender(port, deadline));
+        }
+    }
+    int failed = 0;
+    int status = 0;
+    while (wait(&status) > 0) {
+        failed += WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+// Accepts and drains every connection, counting bytes that arrive inside the window
+class Sink {
+public:
+    bool open() {
+        listener_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (listener_ < 0 || bind(listener_, reinterpret_cast<sockaddr*>(&address), length) != 0 ||
+            listen(listener_, 1024) != 0 || getsockname(listener_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            return false;
+        }
+        port_ = ntohs(address.sin_port);
+        epoll_ = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = listener_;
+        return epoll_ >= 0 && epoll_ctl(epoll_, EPOLL_CTL_ADD, listener_, &event) == 0;
+    }
+
+    int port() const { return port_; }
+
+    void start(uint64_t windowStart, uint64_t windowEnd) {
+        windowStart_ = windowStart;
+        windowEnd_ = windowEnd;
+        counted_ = 0;
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    // MB/s over the window
+    double stop() {
+        stopping_.store(true);
+        thread_.join();
+        stopping_.store(false);
+        return counted_ / ((windowEnd_ - windowStart_) / 1e9) / (1024.0 * 1024.0);
+    }
+
+    ~Sink() {
+        close(epoll_);
+        close(listener_);
+    }
+
+private:
+    void run() {
+        std::vector<char> buffer(LARGE);
+        epoll_event events[64];
+        while (!stopping_.load()) {
+            const int ready = epoll_wait(epoll_, events, 64, 50);
+            for (int i = 0; i < ready; ++i) {
+                const int fd = events[i].data.fd;
+                if (fd == listener_) {
+                    int connection;
+                    while ((connection = accept4(listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                        epoll_event event = {};
+                        event.events = EPOLLIN;
+                        event.data.fd = connection;
+                        epoll_ctl(epoll_, EPOLL_CTL_ADD, connection, &event);
+                    }
+                    continue;
+                }
+                ssize_t n;
+                while ((n = recv(fd, buffer.data(), buffer.size(), 0)) > 0) {
+                    const uint64_t now = MonotonicClock::nowNs();
+                    if (now >= windowStart_ && now < windowEnd_) {
+                        counted_ += static_cast<uint64_t>(n);
+                    }
+                }
+                if (n == 0) {
+                    close(fd);
+                }
+            }
+        }
+    }
+
+    int listener_ = -1;
+    int epoll_ = -1;
+    int port_ = 0;
+    uint64_t windowStart_ = 0;
+    uint64_t windowEnd_ = 0;
+    uint64_t counted_ = 0;
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+struct Result {
+    double throughput;
+    size_t joined;
+    double updateUs;
+    size_t members;
+};
+
+bool runMode(const char* self, NetworkThrottler& throttler, Sink& sink, bool tree, int children, double seconds,
+             Result& result) {
+    int go[2];
+    if (pipe(go) != 0) {
+        return false;
+    }
+    const pid_t root = fork();
+    if (root == 0) {
+        dup2(go[0], GO_FD);
+        setenv("LD_PRELOAD", SHIM_PATH, 1);
+        const std::string childrenArg = std::to_string(children);
+        const std::string secondsArg = std::to_string(seconds);
+        const std::string portArg = std::to_string(sink.port());
+        execl(self, self, "--root", childrenArg.c_str(), secondsArg.c_str(), portArg.c_str(),
+              static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    close(go[0]);
+
+    // exec keeps the PID, so the root is throttled before it forks anything
+    const bool started = tree ? throttler.startThrottlingTree(static_cast<uint32_t>(root), 0, LIMIT)
+                              : throttler.startThrottling(static_cast<uint32_t>(root), 0, LIMIT);
+    const uint64_t begin = MonotonicClock::nowNs();
+    sink.start(begin + static_cast<uint64_t>(seconds * 0.2e9), begin + static_cast<uint64_t>(seconds * 1e9));
+    const char start = 1;
+    const bool signalled = write(go[1], &start, 1) == 1;
+    close(go[1]);
+
+    // Give the root time to fork everything, then let the controller catch up
+    std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<long>(seconds * 500)));
+    const uint64_t updateStart = MonotonicClock::nowNs();
+    result.joined = throttler.updateTrees();
+    result.updateUs = (MonotonicClock::nowNs() - updateStart) / 1000.0;
+    result.members = throttler.treeMembers(static_cast<uint32_t>(root)).size();
+
+    int status = 0;
+    waitpid(root, &status, 0);
+    result.throughput = sink.stop();
+    throttler.stopThrottling(static_cast<uint32_t>(root));
+    throttler.updateTrees();
+    return started && signalled && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc > 3 && std::strcmp(argv[1], "--sender") == 0) {
+        return runSender(std::atoi(argv[2]), std::strtoull(argv[3], nullptr, 10));
+    }
+    if (argc > 4 && std::strcmp(argv[1], "--root") == 0) {
+        return runRoot(argv[0], std::atoi(argv[2]), std::atof(argv[3]), std::atoi(argv[4]));
+    }
+    const int children = argc > 1 ? std::atoi(argv[1]) : 200;
+    const double seconds = argc > 2 ? std::atof(argv[2]) : 3.0;
+
+    const std::string shmName = "/bandwidth-tree-benchmark-" + std::to_string(getpid());
+    setenv("BANDWIDTH_THROTTLER_SHM", shmName.c_str(), 1);
+    int failures = 0;
+    {
+        NetworkThrottler throttler;
+        Sink sink;
+        if (!throttler.sharedLimitsAvailable() || !sink.open()) {
+            std::fprintf(stderr, "cannot create the shared limit table or the sink\n");
+            return 1;
+        }
+
+        const double limit = LIMIT / (1024.0 * 1024.0);
+        std::printf("%d children (half exec'd), %.0f MB/s upload limit, %.1f s\n", children, limit, seconds);
+        std::printf("%-22s %12s %10s %10s %14s %9s\n", "mode", "aggregate", "of limit", "joined", "updateTrees us",
+                    "members");
+        for (bool tree : {false, true}) {
+            Result result = {};
+            if (!runMode(argv[0], throttler, sink, tree, children, seconds, result)) {
+                std::fprintf(stderr, "%s: run failed\n", tree ? "tree" : "root only");
+                ++failures;
+                continue;
+            }
+            std::printf("%-22s %9.2f MB/s %+9.1f%% %10zu %14.1f %9zu\n", tree ? "throttle tree" : "root throttled alone",
+                        result.throughput, 100.0 * (result.throughput - limit) / limit, result.joined,
+                        result.updateUs, result.members);
+        }
+    }
+    shm_unlink(shmName.c_str());
+    return failures == 0 ? 0 : 1;
+}
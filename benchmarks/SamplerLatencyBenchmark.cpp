@@ -0,0 +1,249 @@
+// Measures how long the GUI event loop is held up by process monitoring with a synthetic
+// procfs of 5,000 processes: scans and network samples on the event loop, as the window
+// used to run them, against the background ProcessSampler.
+//
+// Usage: SamplerLatencyBenchmark [processes] [seconds]   (default: 5000 20)
+//
+// The event loop is emulated: a 16 ms frame tick stands for input and repaints, and the
+// monitoring timers run between ticks on the same thread, each handler blocking it until
+// done. A frame's latency is how late its tick was handled. Synchronously, the monitor
+// scans serially, resolving every path, once on construction (as it did) and then every
+// 5 s, and network statistics are sampled every 3 s, each followed by taking the list and
+// updating the table rows. With the sampler, the loop polls for a new snapshot every
+// 100 ms, updates the rows when there is one and asks for the paths of the first 40 rows,
+// as the window does for the rows on screen. Meanwhile another thread keeps starting and
+// ending processes.
+
+#include "ProcessRows.h"
+#include "ProcessSampler.h"
+#include "SyntheticProcFs.h"
+#include "core/MonotonicClock.h"
+#include "platform/linux/ProcessMonitor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t MS = 1000000ULL;
+constexpr uint64_t FRAME_NS = 16 * MS;
+
+// Ends and starts a few processes every 200 ms until stopped
+class Churn {
+public:
+    explicit Churn(SyntheticProcFs& procFs) : procFs_(procFs), stopping_(false) {
+        thread_ = std::thread([this]() {
+            std::mt19937 generator(7);
+            while (!stopping_.load(std::memory_order_relaxed)) {
+                for (int i = 0; i < 5; ++i) {
+                    procFs_.removeRandom(generator);
+                    procFs_.addProcess();
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            }
+        });
+    }
+    ~Churn() {
+        stopping_ = true;
+        thread_.join();
+    }
+
+private:
+    SyntheticProcFs& procFs_;
+    std::atomic<bool> stopping_;
+    std::thread thread_;
+};
+
+struct Timer {
+    uint64_t dueNs;
+    uint64_t intervalNs;
+    std::function<void()> fire;
+};
+
+struct LoopResult {
+    std::vector<uint64_t> latencyNs; // per frame tick
+    uint64_t handlerNs;              // time spent in monitoring handlers
+    uint64_t longestHandlerNs;
+};
+
+// Single-threaded timer loop: the frame tick and the given timers, for durationNs
+LoopResult runLoop(std::vector<Timer>& timers, uint64_t startNs, uint64_t durationNs) {
+    LoopResult result = {};
+    uint64_t frameDueNs = startNs + FRAME_NS;
+    const uint64_t endNs = startNs + durationNs;
+    for (;;) {
+        uint64_t nextNs = frameDueNs;
+        for (const Timer& timer : timers) {
+            nextNs = std::min(nextNs, timer.dueNs);
+        }
+        if (nextNs >= endNs) {
+            break;
+        }
+        uint64_t nowNs = MonotonicClock::nowNs();
+        if (nextNs > nowNs) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(nextNs - nowNs));
+            nowNs = MonotonicClock::nowNs();
+        }
+        if (nowNs >= frameDueNs) {
+            // Ticks missed while blocked are one late tick, as a coalescing event loop has it
+            result.latencyNs.push_back(nowNs - frameDueNs);
+            while (frameDueNs <= nowNs) {
+                frameDueNs += FRAME_NS;
+            }
+        }
+        for (Timer& timer : timers) {
+            if (timer.dueNs <= nowNs) {
+                const uint64_t begin = MonotonicClock::nowNs();
+                timer.fire();
+                const uint64_t spent = MonotonicClock::nowNs() - begin;
+                result.handlerNs += spent;
+                result.longestHandlerNs = std::max(result.longestHandlerNs, spent);
+                timer.dueNs = MonotonicClock::nowNs() + timer.intervalNs; // as QTimer restarts
+            }
+        }
+    }
+    return result;
+}
+
+double percentileMs(std::vector<uint64_t> samples, double fraction) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[static_cast<size_t>(fraction * (samples.size() - 1))] / 1e6;
+}
+
+void report(const char* name, const LoopResult& result, uint64_t startupNs, uint64_t firstTableNs) {
+    size_t missed = 0;
+    for (uint64_t latency : result.latencyNs) {
+        if (latency >= FRAME_NS) {
+            ++missed;
+        }
+    }
+    std::printf("%-13s %9.1f %11.1f %8.2f %8.2f %8.1f %7zu %9.1f %10.1f\n", name, startupNs / 1e6,
+                firstTableNs / 1e6, percentileMs(result.latencyNs, 0.5), percentileMs(result.latencyNs, 0.99),
+                percentileMs(result.latencyNs, 1.0), missed, result.longestHandlerNs / 1e6,
+                result.handlerNs / 1e6);
+}
+
+// The monitor on the event loop, as the window ran it before
+void runSynchronous(const std::string& root, uint64_t durationNs) {
+    std::unordered_set<uint32_t> throttled;
+    ProcessRows rows;
+    std::shared_ptr<const ProcessList> processes;
+
+    const uint64_t startNs = MonotonicClock::nowNs();
+    // Serially and with every path, as the monitor used to scan
+    ProcessMonitor monitor(root, 0);
+    monitor.refresh(); // the constructor's scan
+    monitor.resolveAllPaths();
+    const uint64_t startupNs = MonotonicClock::nowNs() - startNs;
+    uint64_t firstTableNs = 0;
+
+    auto showTable = [&]() {
+        processes = monitor.getRunningProcesses();
+        rows.update(*processes, throttled, nullptr);
+        if (firstTableNs == 0 && rows.size() > 0) {
+            firstTableNs = MonotonicClock::nowNs() - startNs;
+        }
+    };
+    const uint64_t loopStartNs = MonotonicClock::nowNs();
+    std::vector<Timer> timers;
+    // The first refresh 100 ms after startup, then every 5 s
+    timers.push_back(Timer{loopStartNs + 100 * MS, 5000 * MS, [&]() {
+                               monitor.refresh();
+                               monitor.resolveAllPaths();
+                               showTable();
+                           }});
+    // Network statistics every 3 s, the first after 2 s
+    timers.push_back(Timer{loopStartNs + 2000 * MS, 3000 * MS, [&]() {
+                               monitor.updateNetworkStats();
+                               showTable();
+                           }});
+    const LoopResult result = runLoop(timers, loopStartNs, durationNs);
+    report("synchronous", result, startupNs, firstTableNs);
+}
+
+// The monitor on the sampler's thread; the event loop picks up snapshots
+void runSampled(const std::string& root, uint64_t durationNs) {
+    std::unordered_set<uint32_t> throttled;
+    ProcessRows rows;
+
+    const uint64_t startNs = MonotonicClock::nowNs();
+    ProcessMonitor monitor(root);
+    ProcessSampler sampler(monitor);
+    sampler.start();
+    const uint64_t startupNs = MonotonicClock::nowNs() - startNs;
+    uint64_t firstTableNs = 0;
+    uint64_t shownVersion = 0;
+
+    const uint64_t loopStartNs = MonotonicClock::nowNs();
+    std::vector<Timer> timers;
+    timers.push_back(Timer{loopStartNs + 100 * MS, 100 * MS, [&]() {
+                               const ProcessSnapshot& snapshot = sampler.latest();
+                               if (snapshot.version == shownVersion) {
+                                   return;
+                               }
+                               shownVersion = snapshot.version;
+                               rows.update(*snapshot.processes, throttled, nullptr);
+                               if (firstTableNs == 0 && rows.size() > 0) {
+                                   firstTableNs = MonotonicClock::nowNs() - startNs;
+                                   std::vector<uint32_t> visible;
+                                   for (size_t i = 0; i < rows.size() && i < 40; ++i) {
+                                       visible.push_back(rows.row(i).info.pid);
+                                   }
+                                   sampler.setWantedPaths(std::move(visible), false);
+                               }
+                           }});
+    const LoopResult result = runLoop(timers, loopStartNs, durationNs);
+    sampler.stop();
+    report("sampler", result, startupNs, firstTableNs);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t processes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 5000;
+    const int seconds = argc > 2 ? std::atoi(argv[2]) : 20;
+    if (processes < 10 || seconds <= 0) {
+        std::fprintf(stderr, "Usage: %s [processes] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    SyntheticProcFs procFs;
+    if (!procFs.valid()) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    for (size_t i = 0; i < processes; ++i) {
+        if (!procFs.addProcess()) {
+            std::perror("creating the synthetic procfs");
+            return 1;
+        }
+    }
+
+    const uint64_t durationNs = static_cast<uint64_t>(seconds) * 1000 * MS;
+    std::printf("%zu processes, %d s per mode, %u CPUs; times in ms, frame tick every 16 ms\n", processes, seconds,
+                std::thread::hardware_concurrency());
+    std::printf("%-13s %9s %11s %8s %8s %8s %7s %9s %10s\n", "mode", "startup", "first table", "p50", "p99", "max",
+                "missed", "longest", "in handler");
+    {
+        Churn churn(procFs);
+        runSynchronous(procFs.root(), durationNs);
+    }
+    {
+        Churn churn(procFs);
+        runSampled(procFs.root(), durationNs);
+    }
+    return 0;
+}
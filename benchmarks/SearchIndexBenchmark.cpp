@@ -0,0 +1,216 @@
+// Measures the process table's search at 20k processes: from a keystroke to knowing which
+// rows match, through ProcessRows' SearchIndex (ProcessRows::setSearch, then
+// matchesSearch for every row, as the filter proxy does when it is invalidated) against
+// the old filter, which case-folded every name and path on each keystroke and copied the
+// matching processes.
+//
+// Usage: SearchIndexBenchmark [processes] [rounds]   (default: 20000 5)
+//
+// Each round types a set of queries one character at a time, deletes them again, and
+// refreshes the rows (some processes exit, some start, some get their path) between
+// queries. The keystrokes are then replayed and the matches after each checked against a
+// plain fold-and-find over the rows. Times are per keystroke, in microseconds.
+
+#include "ProcessRows.h"
+#include "core/MonotonicClock.h"
+#include "core/SearchIndex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+const char* const NAMES[] = {
+    "chrome", "firefox", "python3", "systemd-journald", "kworker/3:1", "bash", "sshd", "code", "node", "java",
+    "postgres", "nginx", "Xorg", "pulseaudio", "gnome-shell", "QtWebEngineProcess", "dockerd", "containerd-shim",
+    "Électron", "Диспетчер", "svchost.exe", "MsMpEng.exe", "explorer.exe", "RuntimeBroker.exe",
+};
+
+const char* const DIRECTORIES[] = {
+    "/usr/bin/", "/usr/lib/x86_64-linux-gnu/", "/opt/google/chrome/", "/snap/code/current/usr/share/",
+    "C:\\Windows\\System32\\", "C:\\Program Files\\Mozilla Firefox\\", "/home/user/.local/bin/",
+};
+
+// Typed a character at a time, then deleted the same way
+const char* const QUERIES[] = {
+    "chrome", "PYTHON3", "/usr/lib/x86", "systemd-", "1234", "Qtweb", "élec", "диспетчер", "program files",
+    "zzzz",
+};
+
+ProcessInfo makeProcess(std::mt19937& generator, uint32_t pid) {
+    const size_t kinds = sizeof(NAMES) / sizeof(NAMES[0]);
+    std::string name = NAMES[generator() % kinds];
+    if (generator() % 3 == 0) {
+        name += "-" + std::to_string(generator() % 100);
+    }
+    // Kernel threads and processes not looked up yet have no path
+    std::string path;
+    if (generator() % 5 != 0) {
+        path = std::string(DIRECTORIES[generator() % (sizeof(DIRECTORIES) / sizeof(DIRECTORIES[0]))]) + name;
+    }
+    ProcessInfo process(pid, name, path);
+    process.creationTime = pid;
+    return process;
+}
+
+bool contains(const std::string& text, const std::string& folded, std::string& scratch) {
+    SearchIndex::foldCase(text, scratch);
+    return scratch.find(folded) != std::string::npos;
+}
+
+// Fold every name and path, keep copies of the matches: the old filter's work
+uint64_t filterByCopy(const std::vector<ProcessInfo>& processes, const std::string& query,
+                      std::vector<ProcessInfo>& matches) {
+    const uint64_t start = MonotonicClock::nowNs();
+    std::string folded;
+    std::string scratch;
+    SearchIndex::foldCase(query, folded);
+    matches.clear();
+    for (const ProcessInfo& process : processes) {
+        if (folded.empty() || contains(process.name, folded, scratch) || contains(process.path, folded, scratch) ||
+            std::to_string(process.pid).find(folded) != std::string::npos) {
+            matches.push_back(process);
+        }
+    }
+    return MonotonicClock::nowNs() - start;
+}
+
+// Whether the rows' matches are what a fold-and-find over each of them gives
+bool matchesReference(ProcessRows& rows, const std::string& query) {
+    std::string folded;
+    std::string scratch;
+    SearchIndex::foldCase(query, folded);
+    size_t expected = 0;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const ProcessInfo& process = rows.row(i).info;
+        const bool match = folded.empty() || contains(process.name, folded, scratch) ||
+                           contains(process.path, folded, scratch) ||
+                           std::to_string(process.pid).find(folded) != std::string::npos;
+        if (match != rows.matchesSearch(i)) {
+            return false;
+        }
+        expected += match ? 1 : 0;
+    }
+    return rows.setSearch(query) == expected;
+}
+
+double percentile(std::vector<uint64_t>& samples, double share) {
+    std::sort(samples.begin(), samples.end());
+    return samples[std::min(samples.size() - 1, static_cast<size_t>(samples.size() * share))] / 1000.0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t processes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    const int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+    if (processes == 0 || rounds <= 0) {
+        std::fprintf(stderr, "Usage: %s [processes] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    std::mt19937 generator(42);
+    std::vector<ProcessInfo> snapshot;
+    uint32_t nextPid = 300;
+    for (size_t i = 0; i < processes; ++i) {
+        snapshot.push_back(makeProcess(generator, nextPid));
+        nextPid += 1 + generator() % 3;
+    }
+    const std::unordered_set<uint32_t> throttled;
+
+    ProcessRows rows;
+    uint64_t start = MonotonicClock::nowNs();
+    rows.update(*ProcessList::copyOf(snapshot), throttled, nullptr);
+    const double populateMs = (MonotonicClock::nowNs() - start) / 1e6;
+
+    std::vector<uint64_t> indexNs;
+    std::vector<uint64_t> copyNs;
+    std::vector<uint64_t> refreshNs;
+    std::vector<ProcessInfo> copies;
+    std::vector<size_t> shown;
+    size_t keystrokes = 0;
+    bool correct = true;
+    for (int round = 0; round < rounds; ++round) {
+        for (const char* query : QUERIES) {
+            const std::string full = query;
+            std::vector<std::string> typed;
+            for (size_t length = 1; length <= full.size(); ++length) {
+                // Whole UTF-8 characters only, as an edit field would pass them
+                if (length < full.size() && (static_cast<unsigned char>(full[length]) & 0xC0) == 0x80) {
+                    continue;
+                }
+                typed.push_back(full.substr(0, length));
+            }
+            for (size_t i = typed.size(); i-- > 1;) {
+                typed.push_back(typed[i - 1]);
+            }
+            typed.push_back(std::string());
+
+            // Timed on their own, then replayed against the reference and the old filter,
+            // so neither leaves the caches cold for the next keystroke
+            shown.clear();
+            for (const std::string& text : typed) {
+                start = MonotonicClock::nowNs();
+                rows.setSearch(text);
+                size_t count = 0;
+                for (size_t i = 0; i < rows.size(); ++i) {
+                    count += rows.matchesSearch(i) ? 1 : 0;
+                }
+                indexNs.push_back(MonotonicClock::nowNs() - start);
+                shown.push_back(count);
+            }
+            for (size_t i = 0; i < typed.size(); ++i) {
+                correct = correct && rows.setSearch(typed[i]) == shown[i] && matchesReference(rows, typed[i]);
+                copyNs.push_back(filterByCopy(snapshot, typed[i], copies));
+                correct = correct && copies.size() == shown[i];
+            }
+            keystrokes += typed.size();
+
+            // A refresh while searching: exits, new processes, paths looked up
+            rows.setSearch(full);
+            std::vector<ProcessInfo> next;
+            next.reserve(snapshot.size() + 64);
+            size_t exited = 0;
+            for (ProcessInfo& process : snapshot) {
+                if (generator() % 100 == 0) {
+                    ++exited;
+                    continue;
+                }
+                if (process.path.empty() && generator() % 10 == 0) {
+                    process.path = std::string("/usr/bin/") + process.name;
+                }
+                next.push_back(std::move(process));
+            }
+            for (size_t i = 0; i < exited; ++i) {
+                next.push_back(makeProcess(generator, nextPid));
+                nextPid += 1 + generator() % 3;
+            }
+            snapshot.swap(next);
+            const std::shared_ptr<const ProcessList> list = ProcessList::copyOf(snapshot);
+            start = MonotonicClock::nowNs();
+            rows.update(*list, throttled, nullptr);
+            refreshNs.push_back(MonotonicClock::nowNs() - start);
+            correct = correct && matchesReference(rows, full);
+        }
+    }
+
+    const double indexP99 = percentile(indexNs, 0.99);
+    std::printf("%zu processes, %zu keystrokes, %d rounds; populating the rows took %.1f ms\n", rows.size(),
+                keystrokes, rounds, populateMs);
+    std::printf("%-34s %10s %10s %10s\n", "per keystroke (us)", "median", "p99", "max");
+    std::printf("%-34s %10.1f %10.1f %10.1f\n", "search index, every row checked", percentile(indexNs, 0.5),
+                indexP99, percentile(indexNs, 1.0));
+    std::printf("%-34s %10.1f %10.1f %10.1f\n", "fold every row, copy (before)", percentile(copyNs, 0.5),
+                percentile(copyNs, 0.99), percentile(copyNs, 1.0));
+    std::printf("%-34s %10.1f %10.1f %10.1f\n", "refresh with a search active", percentile(refreshNs, 0.5),
+                percentile(refreshNs, 0.99), percentile(refreshNs, 1.0));
+    std::printf("p99 keystroke %s 1 ms\n", indexP99 < 1000.0 ? "within" : "OVER");
+    std::printf("%s\n", correct ? "PASS" : "FAIL: matches differ from a fold-and-find over the rows");
+    return correct ? 0 : 1;
+}
@@ -0,0 +1,363 @@
+// Measures the shaping proxy on loopback: throughput without limits against a direct
+// connection, and the rate actually delivered under per-process limits.
+//
+// Usage: ShapingProxyBenchmark [seconds]   (default: 4)
+//
+// Every client is a forked process, so the proxy identifies and throttles each one by PID
+// exactly as it would a real application. Rates are measured at the receiving end after a
+// one second warm-up, which keeps the initial burst and socket buffer fill out of the
+// figures.
+
+#include "platform/linux/NetworkThrottler.h"
+#include "platform/linux/ShapingProxy.h"
+#include "core/MonotonicClock.h"
+
+#include <arpa/inet.h>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr double MB = 1024.0 * 1024.0;
+constexpr uint64_t WARMUP_NS = 1000000000ULL;
+constexpr size_t IO_SIZE = 256 * 1024;
+
+enum class Route { Direct, Forward, Socks };
+
+struct Transfer {
+    bool upload;
+    Route route;
+    uint64_t limit; // bytes/s in the measured direction, 0 = unthrottled
+};
+
+// Rate seen by a receiver: bytes and time after the warm-up, from the first byte on
+class RateMeter {
+public:
+    RateMeter() : firstNs_(0), lastNs_(0), bytes_(0) {}
+
+    void add(size_t bytes) {
+        const uint64_t now = MonotonicClock::nowNs();
+        if (firstNs_ == 0) {
+            firstNs_ = now;
+        }
+        if (now >= firstNs_ + WARMUP_NS) {
+            bytes_ += bytes;
+            lastNs_ = now;
+        }
+    }
+
+    double rate() const {
+        return lastNs_ > firstNs_ + WARMUP_NS ? bytes_ / ((lastNs_ - firstNs_ - WARMUP_NS) / 1e9) : 0.0;
+    }
+
+private:
+    uint64_t firstNs_;
+    uint64_t lastNs_;
+    uint64_t bytes_;
+};
+
+bool readExact(int fd, void* data, size_t length) {
+    auto* p = static_cast<char*>(data);
+    while (length > 0) {
+        const ssize_t n = read(fd, p, length);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool writeExact(int fd, const void* data, size_t length) {
+    const auto* p = static_cast<const char*>(data);
+    while (length > 0) {
+        const ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Sink for uploads (reports the received rate per client id) and source for downloads
+class TestServer {
+public:
+    bool start() {
+        fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (fd_ < 0 || bind(fd_, reinterpret_cast<sockaddr*>(&address), length) != 0 || listen(fd_, 64) != 0 ||
+            getsockname(fd_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            return false;
+        }
+        port_ = ntohs(address.sin_port);
+        std::thread([this]() { acceptLoop(); }).detach();
+        return true;
+    }
+
+    uint16_t port() const { return port_; }
+
+    double waitForUpload(uint32_t id) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&]() { return rates_.count(id) != 0; });
+        const double rate = rates_[id];
+        rates_.erase(id);
+        return rate;
+    }
+
+private:
+    void acceptLoop() {
+        for (;;) {
+            const int client = accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                return;
+            }
+            std::thread([this, client]() { serve(client); }).detach();
+        }
+    }
+
+    void serve(int client) {
+        char header[5];
+        std::vector<char> buffer(IO_SIZE);
+        if (readExact(client, header, sizeof(header))) {
+            uint32_t id;
+            std::memcpy(&id, header + 1, sizeof(id));
+            if (header[0] == 'U') {
+                RateMeter meter;
+                ssize_t n;
+                while ((n = read(client, buffer.data(), buffer.size())) > 0) {
+                    meter.add(static_cast<size_t>(n));
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                rates_[id] = meter.rate();
+                done_.notify_all();
+            } else {
+                while (send(client, buffer.data(), buffer.size(), MSG_NOSIGNAL) > 0) {
+                }
+            }
+        }
+        close(client);
+    }
+
+    int fd_ = -1;
+    uint16_t port_ = 0;
+    std::mutex mutex_;
+    std::condition_variable done_;
+    std::map<uint32_t, double> rates_;
+};
+
+int connectLoopback(uint16_t port) {
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        return -1;
+    }
+    return fd;
+}
+
+bool socksConnect(int fd, uint16_t port) {
+    const uint8_t greeting[] = {5, 1, 0};
+    uint8_t reply[10];
+    if (!writeExact(fd, greeting, sizeof(greeting)) || !readExact(fd, reply, 2) || reply[1] != 0) {
+        return false;
+    }
+    const uint8_t request[] = {5, 1, 0, 1, 127, 0, 0, 1, static_cast<uint8_t>(port >> 8),
+                               static_cast<uint8_t>(port & 0xFF)};
+    return writeExact(fd, request, sizeof(request)) && readExact(fd, reply, 10) && reply[1] == 0;
+}
+
+// Child process: connect, report ready, wait for the go byte, transfer for `seconds`.
+// Downloads report their own received rate; uploads are measured by the server.
+[[noreturn]] void runClient(const Transfer& transfer, uint32_t id, uint16_t port, uint16_t serverPort,
+                            int goFd, int resultFd, double seconds) {
+    double rate = -1.0;
+    const int fd = connectLoopback(port);
+    char header[5] = {transfer.upload ? 'U' : 'D'};
+    std::memcpy(header + 1, &id, sizeof(id));
+    const bool ok = fd >= 0 && (transfer.route != Route::Socks || socksConnect(fd, serverPort)) &&
+                    writeExact(fd, header, sizeof(header));
+    char go = ok ? 1 : 0;
+    if (write(resultFd, &go, 1) != 1 || !ok || read(goFd, &go, 1) != 1) {
+        _exit(1);
+    }
+
+    std::vector<char> buffer(IO_SIZE);
+    const uint64_t end = MonotonicClock::nowNs() + static_cast<uint64_t>(seconds * 1e9);
+    if (transfer.upload) {
+        while (MonotonicClock::nowNs() < end && writeExact(fd, buffer.data(), buffer.size())) {
+        }
+        rate = 0.0;
+    } else {
+        RateMeter meter;
+        ssize_t n;
+        while (MonotonicClock::nowNs() < end && (n = read(fd, buffer.data(), buffer.size())) > 0) {
+            meter.add(static_cast<size_t>(n));
+        }
+        rate = meter.rate();
+    }
+    close(fd);
+    if (write(resultFd, &rate, sizeof(rate)) != sizeof(rate)) {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+// Runs the transfers concurrently and returns each one's rate in bytes/s
+std::vector<double> runTransfers(const std::vector<Transfer>& transfers, NetworkThrottler& throttler,
+                                 TestServer& server, uint16_t forwardPort, uint16_t socksPort, double seconds) {
+    static uint32_t nextId = 0;
+    struct Child {
+        pid_t pid;
+        uint32_t id;
+        int goFd;
+        int resultFd;
+    };
+    std::vector<Child> children;
+    for (const Transfer& transfer : transfers) {
+        int go[2];
+        int result[2];
+        if (pipe(go) != 0 || pipe(result) != 0) {
+            break;
+        }
+        const uint16_t port = transfer.route == Route::Direct ? server.port()
+                              : transfer.route == Route::Forward ? forwardPort : socksPort;
+        const uint32_t id = nextId++;
+        const pid_t pid = fork();
+        if (pid == 0) {
+            close(go[1]);
+            close(result[0]);
+            runClient(transfer, id, port, server.port(), go[0], result[1], seconds);
+        }
+        close(go[0]);
+        close(result[1]);
+        children.push_back(Child{pid, id, go[1], result[0]});
+    }
+
+    std::vector<double> rates(children.size(), 0.0);
+    for (size_t i = 0; i < children.size(); ++i) {
+        char ready = 0;
+        if (read(children[i].resultFd, &ready, 1) != 1 || ready != 1) {
+            std::fprintf(stderr, "client %zu failed to connect\n", i);
+        }
+        if (transfers[i].limit != 0) {
+            throttler.startThrottling(static_cast<uint32_t>(children[i].pid), transfers[i].limit, transfers[i].limit);
+        }
+    }
+    for (const Child& child : children) {
+        const char go = 1;
+        if (write(child.goFd, &go, 1) != 1) {
+            std::fprintf(stderr, "client %d is gone\n", child.pid);
+        }
+    }
+    for (size_t i = 0; i < children.size(); ++i) {
+        double rate = 0.0;
+        if (read(children[i].resultFd, &rate, sizeof(rate)) == sizeof(rate)) {
+            rates[i] = transfers[i].upload ? server.waitForUpload(children[i].id) : rate;
+        }
+        waitpid(children[i].pid, nullptr, 0);
+        close(children[i].goFd);
+        close(children[i].resultFd);
+        throttler.stopThrottling(static_cast<uint32_t>(children[i].pid));
+    }
+    return rates;
+}
+
+const char* routeName(Route route) {
+    return route == Route::Direct ? "direct" : route == Route::Forward ? "forward" : "socks5";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const double seconds = argc > 1 ? std::atof(argv[1]) : 4.0;
+    signal(SIGPIPE, SIG_IGN);
+
+    TestServer server;
+    NetworkThrottler throttler;
+    ShapingProxy::Config forwardConfig;
+    forwardConfig.mode = ShapingProxy::Mode::Forward;
+    forwardConfig.listenPort = 0;
+    forwardConfig.upstreamAddress = "127.0.0.1";
+    ShapingProxy::Config socksConfig;
+    socksConfig.listenPort = 0;
+
+    if (!server.start()) {
+        std::fprintf(stderr, "cannot start the test server\n");
+        return 1;
+    }
+    forwardConfig.upstreamPort = server.port();
+    ShapingProxy forward(throttler, forwardConfig);
+    ShapingProxy socks(throttler, socksConfig);
+    if (!forward.start() || !socks.start()) {
+        std::fprintf(stderr, "cannot start the proxies\n");
+        return 1;
+    }
+    std::thread forwardThread([&]() { forward.run(); });
+    std::thread socksThread([&]() { socks.run(); });
+
+    auto run = [&](const std::vector<Transfer>& transfers) {
+        return runTransfers(transfers, throttler, server, forward.port(), socks.port(), seconds);
+    };
+
+    std::printf("unthrottled (MB/s)\n%-10s %12s %12s %12s\n", "direction", "direct", "proxied", "of direct");
+    for (bool upload : {true, false}) {
+        const double direct = run({Transfer{upload, Route::Direct, 0}})[0];
+        const double proxied = run({Transfer{upload, Route::Forward, 0}})[0];
+        std::printf("%-10s %12.1f %12.1f %11.1f%%\n", upload ? "upload" : "download", direct / MB,
+                    proxied / MB, direct > 0.0 ? 100.0 * proxied / direct : 0.0);
+    }
+
+    std::printf("\nthrottled, one client at a time\n%-10s %-8s %12s %12s %9s\n", "direction", "route",
+                "limit MB/s", "measured", "error");
+    for (bool upload : {true, false}) {
+        for (uint64_t limitMb : {1, 8, 64}) {
+            const Transfer transfer{upload, upload ? Route::Forward : Route::Socks, limitMb * 1024 * 1024};
+            const double rate = run({transfer})[0];
+            std::printf("%-10s %-8s %12llu %12.3f %8.2f%%\n", upload ? "upload" : "download",
+                        routeName(transfer.route), static_cast<unsigned long long>(limitMb), rate / MB,
+                        100.0 * (rate - transfer.limit) / transfer.limit);
+        }
+    }
+
+    std::printf("\nthrottled, three clients at once (socks5 upload)\n%12s %12s %9s\n", "limit MB/s", "measured",
+                "error");
+    const std::vector<Transfer> concurrent = {Transfer{true, Route::Socks, 1 * 1024 * 1024},
+                                              Transfer{true, Route::Socks, 4 * 1024 * 1024},
+                                              Transfer{true, Route::Socks, 16 * 1024 * 1024}};
+    const std::vector<double> rates = run(concurrent);
+    for (size_t i = 0; i < rates.size(); ++i) {
+        std::printf("%12llu %12.3f %8.2f%%\n", static_cast<unsigned long long>(concurrent[i].limit / (1024 * 1024)),
+                    rates[i] / MB, 100.0 * (rates[i] - concurrent[i].limit) / concurrent[i].limit);
+    }
+
+    const ShapingProxy::Stats stats = socks.stats();
+    std::printf("\nsocks5 proxy: %llu connections, %llu identified by pid, %llu throttle waits\n",
+                static_cast<unsigned long long>(stats.connections),
+                static_cast<unsigned long long>(stats.identifiedClients),
+                static_cast<unsigned long long>(stats.throttleWaits));
+
+    forward.stop();
+    socks.stop();
+    forwardThread.join();
+    socksThread.join();
+    return 0;
+}
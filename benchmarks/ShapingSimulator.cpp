@@ -0,0 +1,392 @@
+// Deterministic shaping-accuracy and cost suite: synthetic workloads driven through
+// TrafficShaper on a virtual clock (see src/sim).
+//
+// Usage: ShapingSimulator [seconds] [csv file]   (default: 20, simulated)
+//
+// Scenarios, each with per-process limits in the shaper:
+//   bulk         4 greedy uploads with a 256 KB window, limited to 0.25, 1, 4 and 16 MB/s
+//   bursty       8 on/off uploads, 128 KB bursts at 8 MB/s every 250 ms, limited to 1 MB/s
+//   req/resp     16 clients: 400 B request (64 KB/s up), 64 KB response (512 KB/s down)
+//                after 5 ms, then 100 ms mean think time
+//   small flows  1,000 processes opening short uploads (20 KB mean, 2 per second on
+//                average, paced at 1 MB/s), each limited to 64 KB/s
+//
+// The first second is warmup (full buckets). "rate/limit" is the bytes sent over what the
+// processes could have sent, min(offered, limit) each, summed; traffic still held at the
+// end counts against it. "peak" is the highest of one process's bytes sent over its limit,
+// which may exceed 1 only by the bucket's 100 ms burst. "worst" is, for greedy processes,
+// the largest deviation of one from its limit. Delay is the time a sent unit spent in the
+// shaper. "ns/dec" is the wall time inside the shaper per decision (a submit or a released
+// unit), "ns/KB" the same per KB sent. The csv file, if given, gets one line per scenario
+// for tracking across commits. Exits nonzero if a greedy process is more than 1% off its
+// limit, any process sends more than its limit and burst allow, or the pool runs out.
+//
+// Then a group check: two greedy uploads under a group with a 2 MB/s ceiling, one with a
+// 512 KB/s rate and no ceiling of its own, one with 512 KB/s and a 4 MB/s ceiling. Together
+// they must send the group's ceiling within 1%, each at least its rate, and the first
+// one's limiter (for enforcers outside the shaper) must hold the group's ceiling.
+//
+// Last, a class tree of 328 classes: a 40 MB/s link, 8 groups with a 4 MB/s rate (even
+// groups may borrow up to 8 MB/s, odd ones not at all) and 40 processes in each with a
+// fortieth of that as their rate (every fourth bounded by its group alone, the others by
+// a ceil of four times their rate).
+// All processes of groups 0-3 are greedy uploads, only four of groups 4-7. The link must
+// be used within 1%, every active class must get its rate, no class may exceed its ceil
+// (or its group's, or the link's), and the groups with idle members must still send their
+// full rate, lent by the idle ones.
+
+#include "core/TrafficShaper.h"
+#include "sim/SyntheticSources.h"
+#include "sim/TrafficSimulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t NS_PER_SEC = 1000000000ULL;
+constexpr uint64_t KB = 1024;
+constexpr uint64_t MB = 1024 * 1024;
+constexpr uint64_t WARMUP_NS = NS_PER_SEC;
+constexpr double BURST_SEC = 0.1; // TokenBucket's default burst
+constexpr uint32_t MTU = 1500;
+
+struct Limit {
+    uint32_t pid;
+    TrafficDirection direction;
+    uint64_t rate;
+};
+
+struct Scenario {
+    const char* name;
+    bool greedy;            // every process always has traffic: sent must match the limit
+    size_t segments;        // pool size
+    std::vector<Limit> limits;
+    std::vector<std::unique_ptr<TrafficSource>> sources;
+    std::vector<const RequestResponseSource*> clients; // owned by the simulator once run
+};
+
+struct Result {
+    size_t processes;
+    double limitMBps;
+    double offeredMBps;
+    double sentMBps;
+    double accuracy;
+    double peak;
+    double worst;
+    bool overLimit;
+    double dropPercent;
+    double delayP50Ms;
+    double delayP99Ms;
+    double delayP999Ms;
+    double nsPerDecision;
+    double nsPerKB;
+    uint64_t poolExhausted;
+    size_t transactions;
+    double transactionP50Ms;
+    double transactionP99Ms;
+};
+
+double percentile(std::vector<uint64_t>& values, double fraction) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    const size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return static_cast<double>(values[index]);
+}
+
+Scenario bulk() {
+    Scenario scenario = {"bulk", true, 4096, {}, {}, {}};
+    const uint64_t rates[] = {256 * KB, 1 * MB, 4 * MB, 16 * MB};
+    uint32_t pid = 1;
+    for (uint64_t rate : rates) {
+        scenario.limits.push_back(Limit{pid, TrafficDirection::Upload, rate});
+        scenario.sources.push_back(std::make_unique<BulkSource>(pid, TrafficDirection::Upload, 1500, 256 * KB));
+        ++pid;
+    }
+    return scenario;
+}
+
+Scenario bursty() {
+    Scenario scenario = {"bursty", false, 4096, {}, {}, {}};
+    for (uint32_t pid = 1; pid <= 8; ++pid) {
+        scenario.limits.push_back(Limit{pid, TrafficDirection::Upload, 1 * MB});
+        scenario.sources.push_back(std::make_unique<BurstySource>(pid, TrafficDirection::Upload, 1500, 128 * KB,
+                                                                  NS_PER_SEC / 4, 8 * MB, pid));
+    }
+    return scenario;
+}
+
+Scenario requestResponse() {
+    Scenario scenario = {"req/resp", false, 4096, {}, {}, {}};
+    for (uint32_t pid = 1; pid <= 16; ++pid) {
+        scenario.limits.push_back(Limit{pid, TrafficDirection::Upload, 64 * KB});
+        scenario.limits.push_back(Limit{pid, TrafficDirection::Download, 512 * KB});
+        auto client =
+            std::make_unique<RequestResponseSource>(pid, 400, 64 * KB, NS_PER_SEC / 200, NS_PER_SEC / 10, pid);
+        scenario.clients.push_back(client.get());
+        scenario.sources.push_back(std::move(client));
+    }
+    return scenario;
+}
+
+Scenario smallFlows() {
+    Scenario scenario = {"small flows", false, 65536, {}, {}, {}};
+    for (uint32_t pid = 1; pid <= 1000; ++pid) {
+        scenario.limits.push_back(Limit{pid, TrafficDirection::Upload, 64 * KB});
+        scenario.sources.push_back(std::make_unique<ShortFlowSource>(pid, TrafficDirection::Upload, 1500, 20 * KB,
+                                                                     NS_PER_SEC / 2, 1 * MB, pid));
+    }
+    return scenario;
+}
+
+Result run(Scenario& scenario, uint64_t durationNs) {
+    TrafficShaper shaper(scenario.segments);
+    // A process may be limited in both directions
+    std::vector<Limit> byPid = scenario.limits;
+    std::stable_sort(byPid.begin(), byPid.end(), [](const Limit& a, const Limit& b) { return a.pid < b.pid; });
+    for (size_t i = 0; i < byPid.size();) {
+        ShapingRates download;
+        ShapingRates upload;
+        size_t j = i;
+        for (; j < byPid.size() && byPid[j].pid == byPid[i].pid; ++j) {
+            ShapingRates& rates = byPid[j].direction == TrafficDirection::Download ? download : upload;
+            rates = ShapingRates(byPid[j].rate, byPid[j].rate);
+        }
+        shaper.attachProcess(byPid[i].pid, TrafficShaper::LINK_GROUP, download, upload);
+        i = j;
+    }
+
+    TrafficSimulator simulator(shaper);
+    for (auto& source : scenario.sources) {
+        simulator.addSource(std::move(source));
+    }
+    scenario.sources.clear();
+    simulator.setMeasureFrom(WARMUP_NS);
+    simulator.run(durationNs);
+
+    const double windowSec = (durationNs - WARMUP_NS) / 1e9;
+    Result result = {};
+    result.processes = scenario.limits.size();
+    uint64_t offered = 0;
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+    double expected = 0.0;
+    std::vector<uint64_t> delays;
+    for (const Limit& limit : scenario.limits) {
+        result.limitMBps += limit.rate / static_cast<double>(MB);
+        const TrafficSimulator::ClassStats* stats = nullptr;
+        for (const TrafficSimulator::ClassStats& candidate : simulator.classes()) {
+            if (candidate.pid == limit.pid && candidate.direction == limit.direction) {
+                stats = &candidate;
+            }
+        }
+        if (!stats) {
+            continue;
+        }
+        const double allowed = limit.rate * windowSec;
+        expected += scenario.greedy ? allowed : std::min<double>(stats->offeredBytes, allowed);
+        result.peak = std::max(result.peak, stats->sentBytes / allowed);
+        if (scenario.greedy) {
+            result.worst = std::max(result.worst, std::fabs(stats->sentBytes / allowed - 1.0));
+        }
+        if (stats->sentBytes > limit.rate * (windowSec + BURST_SEC) + MTU) {
+            result.overLimit = true;
+        }
+        offered += stats->offeredBytes;
+        sent += stats->sentBytes;
+        dropped += stats->droppedBytes;
+        delays.insert(delays.end(), stats->delaysNs.begin(), stats->delaysNs.end());
+    }
+    result.offeredMBps = offered / windowSec / MB;
+    result.sentMBps = sent / windowSec / MB;
+    result.accuracy = expected > 0.0 ? sent / expected : 0.0;
+    result.dropPercent = offered > 0 ? 100.0 * dropped / offered : 0.0;
+    result.delayP50Ms = percentile(delays, 0.50) / 1e6;
+    result.delayP99Ms = percentile(delays, 0.99) / 1e6;
+    result.delayP999Ms = percentile(delays, 0.999) / 1e6;
+    const TrafficSimulator::Cost& cost = simulator.cost();
+    result.nsPerDecision = cost.decisions > 0 ? static_cast<double>(cost.shaperNs) / cost.decisions : 0.0;
+    result.nsPerKB = sent > 0 ? static_cast<double>(cost.shaperNs) * KB / sent : 0.0;
+    result.poolExhausted = simulator.poolExhausted();
+
+    std::vector<uint64_t> transactions;
+    for (const RequestResponseSource* client : scenario.clients) {
+        transactions.insert(transactions.end(), client->transactionsNs().begin(), client->transactionsNs().end());
+    }
+    result.transactions = transactions.size();
+    result.transactionP50Ms = percentile(transactions, 0.50) / 1e6;
+    result.transactionP99Ms = percentile(transactions, 0.99) / 1e6;
+    return result;
+}
+
+// Two children borrowing up to their group's ceiling, but no further
+bool checkGroupCeiling(uint64_t durationNs) {
+    constexpr uint64_t GROUP_CEIL = 2 * MB;
+    constexpr uint64_t CHILD_RATE = 512 * KB;
+    TrafficShaper shaper(4096);
+    const uint32_t group = shaper.createGroup(TrafficShaper::LINK_GROUP, ShapingRates(GROUP_CEIL, GROUP_CEIL),
+                                              ShapingRates(GROUP_CEIL, GROUP_CEIL));
+    shaper.attachProcess(1, group, ShapingRates(), ShapingRates(CHILD_RATE, 0));
+    shaper.attachProcess(2, group, ShapingRates(), ShapingRates(CHILD_RATE, 4 * MB));
+
+    TrafficSimulator simulator(shaper);
+    for (uint32_t pid = 1; pid <= 2; ++pid) {
+        simulator.addSource(std::make_unique<BulkSource>(pid, TrafficDirection::Upload, MTU, 256 * KB));
+    }
+    simulator.setMeasureFrom(WARMUP_NS);
+    simulator.run(durationNs);
+
+    const double windowSec = (durationNs - WARMUP_NS) / 1e9;
+    uint64_t sent = 0;
+    bool childrenKept = true;
+    for (const TrafficSimulator::ClassStats& stats : simulator.classes()) {
+        sent += stats.sentBytes;
+        childrenKept = childrenKept && stats.sentBytes >= 0.99 * CHILD_RATE * windowSec;
+        std::printf("group child %u: %.2f MB/s\n", stats.pid, stats.sentBytes / windowSec / MB);
+    }
+    const double ratio = sent / (GROUP_CEIL * windowSec);
+    const std::shared_ptr<ProcessLimiter> limiter = shaper.limiter(1);
+    const bool limiterKept = limiter && limiter->upload.rate() == GROUP_CEIL;
+    std::printf("group of 2: %.2f MB/s, %.4f of its %.2f MB/s ceiling, limiter %s\n", sent / windowSec / MB, ratio,
+                GROUP_CEIL / static_cast<double>(MB), limiterKept ? "bounded by the group" : "NOT bounded");
+    return std::fabs(ratio - 1.0) <= 0.01 && childrenKept && limiterKept;
+}
+
+// Borrowing and ceilings across a link, groups and hundreds of processes
+bool checkClassTree(uint64_t durationNs) {
+    constexpr uint64_t LINK = 40 * MB;
+    constexpr uint32_t GROUPS = 8;
+    constexpr uint32_t MEMBERS = 40;
+    constexpr uint32_t FEW = 4; // active members of the groups with idle ones
+    constexpr uint64_t GROUP_RATE = 4 * MB;
+    constexpr uint64_t MEMBER_RATE = GROUP_RATE / MEMBERS;
+    constexpr uint64_t MEMBER_CEIL = 4 * MEMBER_RATE;
+    const auto groupCeil = [](uint32_t g) { return g % 2 == 0 ? 2 * GROUP_RATE : GROUP_RATE; };
+    const auto memberCeil = [](uint32_t i) { return i % 4 == 0 ? 0 : MEMBER_CEIL; };
+    const auto active = [](uint32_t g, uint32_t i) { return g < GROUPS / 2 || i < FEW; };
+
+    TrafficShaper shaper(16384);
+    shaper.setLinkCapacity(0, LINK);
+    TrafficSimulator simulator(shaper);
+    for (uint32_t g = 0; g < GROUPS; ++g) {
+        const uint32_t group = shaper.createGroup(TrafficShaper::LINK_GROUP, ShapingRates(),
+                                                  ShapingRates(GROUP_RATE, groupCeil(g)));
+        for (uint32_t i = 0; i < MEMBERS; ++i) {
+            const uint32_t pid = 1 + g * MEMBERS + i;
+            shaper.attachProcess(pid, group, ShapingRates(), ShapingRates(MEMBER_RATE, memberCeil(i)));
+            if (active(g, i)) {
+                simulator.addSource(std::make_unique<BulkSource>(pid, TrafficDirection::Upload, MTU, 64 * KB));
+            }
+        }
+    }
+    simulator.setMeasureFrom(WARMUP_NS);
+    simulator.run(durationNs);
+
+    const double windowSec = (durationNs - WARMUP_NS) / 1e9;
+    // Within a ceiling: over the window, plus one burst and one unit
+    const auto within = [&](double bytes, uint64_t ceil) {
+        return bytes <= ceil * (windowSec + BURST_SEC) + MTU;
+    };
+    std::vector<double> groupSent(GROUPS, 0.0);
+    bool membersKept = true;
+    double total = 0.0;
+    for (const TrafficSimulator::ClassStats& stats : simulator.classes()) {
+        const uint32_t g = (stats.pid - 1) / MEMBERS;
+        const uint32_t i = (stats.pid - 1) % MEMBERS;
+        const double sent = static_cast<double>(stats.sentBytes);
+        membersKept = membersKept && sent >= 0.99 * MEMBER_RATE * windowSec &&
+                      (memberCeil(i) == 0 || within(sent, memberCeil(i)));
+        groupSent[g] += sent;
+        total += sent;
+    }
+
+    bool passed = membersKept && simulator.poolExhausted() == 0;
+    std::printf("\nclass tree: %u groups of %u processes under a %.0f MB/s link\n", GROUPS, MEMBERS,
+                LINK / static_cast<double>(MB));
+    std::printf("%6s %7s %8s %8s %8s\n", "group", "active", "rate", "ceil", "sent");
+    for (uint32_t g = 0; g < GROUPS; ++g) {
+        const uint32_t members = g < GROUPS / 2 ? MEMBERS : FEW;
+        std::printf("%6u %7u %8.2f %8.2f %8.2f\n", g, members, GROUP_RATE / static_cast<double>(MB),
+                    groupCeil(g) / static_cast<double>(MB), groupSent[g] / windowSec / MB);
+        // A group sends at least its rate, lent by idle members if need be, and never more
+        // than its ceiling
+        passed = passed && groupSent[g] >= 0.99 * GROUP_RATE * windowSec && within(groupSent[g], groupCeil(g));
+    }
+    const double borrowed = total - GROUPS * GROUP_RATE * windowSec;
+    const double linkRatio = total / (LINK * windowSec);
+    passed = passed && std::fabs(linkRatio - 1.0) <= 0.01;
+    std::printf("link %.2f MB/s (%.4f of capacity), %.2f MB/s borrowed above the groups' rates, processes %s\n",
+                total / windowSec / MB, linkRatio, borrowed / windowSec / MB,
+                membersKept ? "within rate and ceil" : "OUT of rate or ceil");
+    return passed;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const double seconds = argc > 1 ? std::atof(argv[1]) : 20.0;
+    const uint64_t durationNs = static_cast<uint64_t>(seconds * NS_PER_SEC);
+    if (durationNs <= WARMUP_NS) {
+        std::fprintf(stderr, "run for more than the 1 s warmup\n");
+        return 2;
+    }
+    FILE* csv = argc > 2 ? std::fopen(argv[2], "w") : nullptr;
+    if (argc > 2 && !csv) {
+        std::perror(argv[2]);
+        return 2;
+    }
+    if (csv) {
+        std::fprintf(csv, "scenario,classes,limit_mbps,offered_mbps,sent_mbps,rate_over_limit,peak,worst,drop_percent,"
+                          "p50_ms,p99_ms,p999_ms,ns_per_decision,ns_per_kb\n");
+    }
+
+    std::printf("%.0f s simulated, first second is warmup\n", seconds);
+    std::printf("%-12s %7s %7s %7s %7s %10s %6s %6s %6s %8s %8s %8s %7s %7s\n", "scenario", "classes", "limit",
+                "offered", "sent", "rate/limit", "peak", "worst", "drop", "p50 ms", "p99 ms", "p99.9", "ns/dec",
+                "ns/KB");
+    Scenario scenarios[] = {bulk(), bursty(), requestResponse(), smallFlows()};
+    bool passed = true;
+    std::vector<Result> results;
+    for (Scenario& scenario : scenarios) {
+        const Result result = run(scenario, durationNs);
+        char worst[16];
+        if (scenario.greedy) {
+            std::snprintf(worst, sizeof(worst), "%.2f%%", 100.0 * result.worst);
+        } else {
+            std::snprintf(worst, sizeof(worst), "-");
+        }
+        std::printf("%-12s %7zu %7.2f %7.2f %7.2f %10.4f %6.4f %6s %5.1f%% %8.2f %8.2f %8.2f %7.1f %7.1f\n",
+                    scenario.name, result.processes, result.limitMBps, result.offeredMBps, result.sentMBps,
+                    result.accuracy, result.peak, worst, result.dropPercent, result.delayP50Ms, result.delayP99Ms,
+                    result.delayP999Ms, result.nsPerDecision, result.nsPerKB);
+        if (csv) {
+            std::fprintf(csv, "%s,%zu,%.3f,%.3f,%.3f,%.5f,%.5f,%.5f,%.3f,%.3f,%.3f,%.3f,%.1f,%.1f\n",
+                         scenario.name, result.processes, result.limitMBps, result.offeredMBps, result.sentMBps,
+                         result.accuracy, result.peak, result.worst, result.dropPercent, result.delayP50Ms, result.delayP99Ms,
+                         result.delayP999Ms, result.nsPerDecision, result.nsPerKB);
+        }
+        if ((scenario.greedy && result.worst > 0.01) || result.overLimit || result.poolExhausted > 0) {
+            passed = false;
+        }
+        results.push_back(result);
+    }
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (results[i].transactions > 0) {
+            std::printf("%s: %zu transactions, p50 %.1f ms, p99 %.1f ms\n", scenarios[i].name,
+                        results[i].transactions, results[i].transactionP50Ms, results[i].transactionP99Ms);
+        }
+    }
+    if (csv) {
+        std::fclose(csv);
+    }
+    passed = checkGroupCeiling(durationNs) && passed;
+    passed = checkClassTree(durationNs) && passed;
+    std::printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : 1;
+}
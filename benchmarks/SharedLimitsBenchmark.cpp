@@ -0,0 +1,156 @@
+// Measures status reads of throttled processes while one writer keeps updating limits:
+// the seqlocked shared-memory table against the mutex-guarded std::map that
+// NetworkThrottler used before.
+//
+// Usage: SharedLimitsBenchmark [readers] [entries] [seconds]   (default: 8 1000 1)
+//
+// The writer always sets equal download and upload limits, so a reader that sees them
+// differ has read a torn entry; that count must be zero for the table.
+
+#include "platform/linux/SharedLimits.h"
+#include "core/MonotonicClock.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t FIRST_PID = 1000;
+
+struct Limits {
+    uint64_t download;
+    uint64_t upload;
+};
+
+// The previous NetworkThrottler layout: every reader and the writer share one lock
+class LockedMap {
+public:
+    void publish(uint32_t pid, uint64_t download, uint64_t upload) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        limits_[pid] = Limits{download, upload};
+    }
+    bool read(uint32_t pid, Limits& limits) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = limits_.find(pid);
+        if (it == limits_.end()) {
+            return false;
+        }
+        limits = it->second;
+        return true;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::map<uint32_t, Limits> limits_;
+};
+
+struct TableStore {
+    SharedLimits& table;
+    void publish(uint32_t pid, uint64_t download, uint64_t upload) { table.publish(pid, download, upload); }
+    bool read(uint32_t pid, Limits& limits) const {
+        SharedLimitSnapshot snapshot;
+        if (!table.read(pid, snapshot)) {
+            return false;
+        }
+        limits = Limits{snapshot.downloadLimit, snapshot.uploadLimit};
+        return true;
+    }
+};
+
+struct ThreadResult {
+    uint64_t reads = 0;
+    uint64_t hits = 0;
+    uint64_t torn = 0;
+};
+
+template <typename Store>
+void run(const char* name, Store& store, uint32_t entries, int readers, double seconds) {
+    std::atomic<bool> stop(false);
+    std::vector<ThreadResult> results(readers);
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < readers; ++t) {
+        workers.emplace_back([&, t]() {
+            // Reads throttled PIDs plus 10% that are not throttled
+            uint64_t state = 0x9E3779B97F4A7C15ULL * (t + 1);
+            ThreadResult local;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int batch = 0; batch < 1024; ++batch) {
+                    state ^= state << 13;
+                    state ^= state >> 7;
+                    state ^= state << 17;
+                    const uint32_t pid = FIRST_PID + static_cast<uint32_t>(state % (entries + entries / 10));
+                    Limits limits;
+                    ++local.reads;
+                    if (store.read(pid, limits)) {
+                        ++local.hits;
+                        local.torn += limits.download != limits.upload;
+                    }
+                }
+            }
+            results[t] = local;
+        });
+    }
+
+    // One writer, changing limits as fast as it can, as a policy engine reacting to load would
+    uint64_t writes = 0;
+    const uint64_t start = MonotonicClock::nowNs();
+    const uint64_t end = start + static_cast<uint64_t>(seconds * 1e9);
+    while (MonotonicClock::nowNs() < end) {
+        const uint64_t rate = 1024 * 1024 + writes;
+        store.publish(FIRST_PID + static_cast<uint32_t>(writes % entries), rate, rate);
+        ++writes;
+    }
+    stop.store(true);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    const double elapsed = static_cast<double>(MonotonicClock::nowNs() - start) / 1e9;
+
+    ThreadResult total;
+    for (const ThreadResult& result : results) {
+        total.reads += result.reads;
+        total.hits += result.hits;
+        total.torn += result.torn;
+    }
+    std::printf("%-16s %8d %11.2f %12.2f %8.1f%% %6llu %11.2f\n", name, readers, total.reads / elapsed / 1e6,
+                total.reads / elapsed / 1e6 / readers, 100.0 * total.hits / (total.reads ? total.reads : 1),
+                static_cast<unsigned long long>(total.torn), writes / elapsed / 1e6);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int readers = argc > 1 ? std::atoi(argv[1]) : 8;
+    const uint32_t entries = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 1000;
+    const double seconds = argc > 3 ? std::atof(argv[3]) : 1.0;
+
+    SharedLimits limits;
+    if (!limits.createAnonymous()) {
+        std::fprintf(stderr, "cannot map the table\n");
+        return 1;
+    }
+    TableStore table{limits};
+    LockedMap locked;
+    for (uint32_t i = 0; i < entries; ++i) {
+        if (!limits.publish(FIRST_PID + i, 1024 * 1024, 1024 * 1024)) {
+            std::fprintf(stderr, "table full after %u entries\n", i);
+            return 1;
+        }
+        locked.publish(FIRST_PID + i, 1024 * 1024, 1024 * 1024);
+    }
+
+    std::printf("%u entries, 1 writer, %u hardware threads\n", entries, std::thread::hardware_concurrency());
+    std::printf("%-16s %8s %11s %12s %9s %6s %11s\n", "store", "readers", "Mreads/s", "per reader", "hit rate",
+                "torn", "Mwrites/s");
+    for (int t = 1; t <= readers; t *= 2) {
+        run("seqlock table", table, entries, t, seconds);
+        run("mutex + map", locked, entries, t, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,221 @@
+// Compares the sock_diag collector with a /proc/net/tcp parser on loopback sockets.
+//
+// Usage: SockDiagBenchmark [socket counts...]   (default: 1000 10000 100000)
+//
+// Each count is reached with connected loopback pairs held by helper processes, so the
+// per-process descriptor limit does not cap the total. /proc/net/tcp carries no byte
+// counters; its parser only extracts inodes, which makes it a lower bound for that path.
+
+#include "platform/linux/SocketStatsCollector.h"
+#include "core/MonotonicClock.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr int RUNS = 7;
+constexpr int PAIRS_PER_LISTENER = 10000; // stays inside the ephemeral port range
+constexpr int RESERVED_FDS = 64;
+
+int openListener(uint16_t& port) {
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&address), length) != 0 || listen(fd, 4096) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        return -1;
+    }
+    port = ntohs(address.sin_port);
+    return fd;
+}
+
+bool openPair(int listener, uint16_t port) {
+    const int client = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (client < 0 || connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        return false;
+    }
+    return accept(listener, nullptr, nullptr) >= 0;
+}
+
+// Forks helpers that together hold `sockets` connected sockets until killed
+bool spawnHelpers(int sockets, int descriptorsPerHelper, std::vector<pid_t>& helpers) {
+    const int pairsPerHelper = std::max(1, (descriptorsPerHelper - RESERVED_FDS) / 2);
+    for (int remaining = sockets / 2; remaining > 0; remaining -= pairsPerHelper) {
+        const int pairs = std::min(remaining, pairsPerHelper);
+        int ready[2];
+        if (pipe(ready) != 0) {
+            return false;
+        }
+        const pid_t pid = fork();
+        if (pid == 0) {
+            close(ready[0]);
+            char status = 1;
+            int listener = -1;
+            uint16_t port = 0;
+            for (int i = 0; i < pairs; ++i) {
+                if (i % PAIRS_PER_LISTENER == 0) {
+                    listener = openListener(port);
+                }
+                if (listener < 0 || !openPair(listener, port)) {
+                    status = 0;
+                    break;
+                }
+            }
+            if (write(ready[1], &status, 1) != 1) {
+                _exit(1);
+            }
+            pause();
+            _exit(0);
+        }
+        close(ready[1]);
+        char status = 0;
+        const bool ok = pid > 0 && read(ready[0], &status, 1) == 1 && status == 1;
+        close(ready[0]);
+        if (pid > 0) {
+            helpers.push_back(pid);
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void stopHelpers(std::vector<pid_t>& helpers) {
+    for (pid_t pid : helpers) {
+        kill(pid, SIGKILL);
+    }
+    for (pid_t pid : helpers) {
+        waitpid(pid, nullptr, 0);
+    }
+    helpers.clear();
+}
+
+// Reads a whole /proc/net file and pulls the inode (10th column) out of every row
+size_t parseProcNetTcp(const char* path, std::vector<char>& buffer, std::vector<uint64_t>& inodes) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    size_t used = 0;
+    for (;;) {
+        if (buffer.size() - used < 65536) {
+            buffer.resize(buffer.size() * 2 + 65536);
+        }
+        const ssize_t n = read(fd, buffer.data() + used, buffer.size() - used);
+        if (n <= 0) {
+            break;
+        }
+        used += static_cast<size_t>(n);
+    }
+    close(fd);
+
+    const char* p = static_cast<const char*>(std::memchr(buffer.data(), '\n', used));
+    const char* end = buffer.data() + used;
+    size_t rows = 0;
+    while (p && ++p < end) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        int column = 0;
+        const char* q = p;
+        while (q < lineEnd && column < 9) {
+            while (q < lineEnd && *q == ' ') {
+                ++q;
+            }
+            while (q < lineEnd && *q != ' ') {
+                ++q;
+            }
+            ++column;
+        }
+        while (q < lineEnd && *q == ' ') {
+            ++q;
+        }
+        uint64_t inode = 0;
+        for (; q < lineEnd && *q >= '0' && *q <= '9'; ++q) {
+            inode = inode * 10 + static_cast<uint64_t>(*q - '0');
+        }
+        inodes.push_back(inode);
+        ++rows;
+        p = lineEnd;
+    }
+    return rows;
+}
+
+double medianMs(std::vector<uint64_t>& samples) {
+    std::sort(samples.begin(), samples.end());
+    return static_cast<double>(samples[samples.size() / 2]) / 1e6;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<int> counts;
+    for (int i = 1; i < argc; ++i) {
+        counts.push_back(std::atoi(argv[i]));
+    }
+    if (counts.empty()) {
+        counts = {1000, 10000, 100000};
+    }
+
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    const int descriptorsPerHelper = static_cast<int>(std::min<rlim_t>(limit.rlim_cur, 1 << 20));
+
+    std::printf("%10s %10s %14s %14s %8s\n", "sockets", "collected", "sock_diag ms", "proc/net ms", "speedup");
+    SocketStatsCollector collector;
+    std::vector<SocketCounters> sockets;
+    std::vector<char> buffer;
+    std::vector<uint64_t> inodes;
+
+    for (int count : counts) {
+        std::vector<pid_t> helpers;
+        if (!spawnHelpers(count, descriptorsPerHelper, helpers)) {
+            std::fprintf(stderr, "could not open %d sockets (descriptor or port limits)\n", count);
+            stopHelpers(helpers);
+            continue;
+        }
+
+        std::vector<uint64_t> diagNs;
+        std::vector<uint64_t> procNs;
+        for (int run = 0; run < RUNS; ++run) {
+            uint64_t start = MonotonicClock::nowNs();
+            collector.collect(sockets);
+            diagNs.push_back(MonotonicClock::nowNs() - start);
+
+            inodes.clear();
+            start = MonotonicClock::nowNs();
+            parseProcNetTcp("/proc/net/tcp", buffer, inodes);
+            parseProcNetTcp("/proc/net/tcp6", buffer, inodes);
+            procNs.push_back(MonotonicClock::nowNs() - start);
+        }
+
+        const double diagMs = medianMs(diagNs);
+        const double procMs = medianMs(procNs);
+        std::printf("%10d %10zu %14.2f %14.2f %7.1fx\n", count, sockets.size(), diagMs, procMs,
+                    diagMs > 0.0 ? procMs / diagMs : 0.0);
+        stopHelpers(helpers);
+    }
+    return 0;
+}
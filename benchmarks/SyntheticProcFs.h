@@ -0,0 +1,102 @@
+#ifndef BENCHMARKS_SYNTHETICPROCFS_H
+#define BENCHMARKS_SYNTHETICPROCFS_H
+
+#include <cstdint>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// Shared by the Linux process monitoring benchmarks: a procfs tree of many processes in a
+// temporary directory, for ProcessMonitor's procRoot.
+// A /proc look-alike: <pid>/stat with comm and starttime, <pid>/exe pointing at the image
+class SyntheticProcFs {
+public:
+    SyntheticProcFs() : nextPid_(1000), recycled_(0) {
+        char pattern[] = "/tmp/sampler-procfs-XXXXXX";
+        root_ = mkdtemp(pattern) ? pattern : "";
+    }
+    ~SyntheticProcFs() {
+        for (uint32_t pid : pids_) {
+            removeProcess(pid);
+        }
+        rmdir(root_.c_str());
+    }
+
+    bool valid() const { return !root_.empty(); }
+    const std::string& root() const { return root_; }
+    size_t size() const { return pids_.size(); }
+
+    bool addProcess() {
+        const uint32_t pid = nextPid_++;
+        const std::string dir = root_ + "/" + std::to_string(pid);
+        if (mkdir(dir.c_str(), 0755) != 0 ||
+            !writeProcess(pid, pid * 7, "/opt/vendor" + std::to_string(pid % 41) + "/bin/")) {
+            return false;
+        }
+        pids_.push_back(pid);
+        return true;
+    }
+
+    // Gives an existing PID to a new process: a later start time and another image.
+    // Returns the PID, or 0 on failure.
+    uint32_t recycleRandom(std::mt19937& generator) {
+        const uint32_t pid = pids_[generator() % pids_.size()];
+        const std::string dir = root_ + "/" + std::to_string(pid);
+        unlink((dir + "/exe").c_str());
+        ++recycled_;
+        return writeProcess(pid, nextPid_ * 7 + recycled_, "/opt/recycled" + std::to_string(recycled_) + "/bin/")
+                   ? pid
+                   : 0;
+    }
+
+    // Where <pid>/exe of a process written by this tree points
+    std::string image(uint32_t pid) const {
+        char target[256];
+        const ssize_t length =
+            readlink((root_ + "/" + std::to_string(pid) + "/exe").c_str(), target, sizeof(target));
+        return length > 0 ? std::string(target, static_cast<size_t>(length)) : std::string();
+    }
+
+    void removeRandom(std::mt19937& generator) {
+        const size_t index = generator() % pids_.size();
+        removeProcess(pids_[index]);
+        pids_[index] = pids_.back();
+        pids_.pop_back();
+    }
+
+private:
+    bool writeProcess(uint32_t pid, uint64_t startTime, const std::string& imageDir) {
+        const std::string dir = root_ + "/" + std::to_string(pid);
+        const std::string name = "app" + std::to_string(pid % 613);
+        // Fields 3-21 are filler; field 22 is starttime
+        std::string stat = std::to_string(pid) + " (" + name + ") S";
+        for (int field = 4; field < 22; ++field) {
+            stat += " 0";
+        }
+        stat += " " + std::to_string(startTime) + " 0 0 0\n";
+        const int fd = open((dir + "/stat").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        const bool written = write(fd, stat.data(), stat.size()) == static_cast<ssize_t>(stat.size());
+        close(fd);
+        return written && symlink((imageDir + name).c_str(), (dir + "/exe").c_str()) == 0;
+    }
+
+    void removeProcess(uint32_t pid) {
+        const std::string dir = root_ + "/" + std::to_string(pid);
+        unlink((dir + "/stat").c_str());
+        unlink((dir + "/exe").c_str());
+        rmdir(dir.c_str());
+    }
+
+    std::string root_;
+    uint32_t nextPid_;
+    uint32_t recycled_;
+    std::vector<uint32_t> pids_;
+};
+
+#endif // BENCHMARKS_SYNTHETICPROCFS_H
@@ -0,0 +1,134 @@
+// Measures start/stop/lookup throughput of the throttle table from several threads,
+// against the mutex-guarded std::map that NetworkThrottler used before.
+//
+// Usage: ThrottleTableBenchmark [threads] [entries] [seconds]   (default: 8 10000 1)
+//
+// The table starts with `entries` throttles. Each thread picks PIDs at random from twice
+// that range and either looks them up, starts them or stops them, so the table stays near
+// its initial size while entries churn.
+
+#include "core/MonotonicClock.h"
+#include "core/ThrottleTable.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Same shape as NetworkThrottler's per-throttle state
+struct ThrottleInfo {
+    uint64_t downloadLimit = 0;
+    uint64_t uploadLimit = 0;
+    std::shared_ptr<int> limiter;
+};
+
+class LockedMap {
+public:
+    bool find(uint32_t pid, ThrottleInfo& info) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = throttles_.find(pid);
+        if (it == throttles_.end()) {
+            return false;
+        }
+        info = it->second;
+        return true;
+    }
+    bool insert(uint32_t pid, ThrottleInfo info) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return throttles_.insert_or_assign(pid, std::move(info)).second;
+    }
+    bool erase(uint32_t pid) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return throttles_.erase(pid) != 0;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::map<uint32_t, ThrottleInfo> throttles_;
+};
+
+struct Mix {
+    const char* name;
+    unsigned lookupPercent; // the rest is split evenly between start and stop
+};
+
+template <typename Store>
+void run(const char* storeName, const Mix& mix, uint32_t entries, int threads, double seconds) {
+    Store store;
+    const std::shared_ptr<int> limiter = std::make_shared<int>(0);
+    for (uint32_t pid = 1; pid <= entries * 2; pid += 2) {
+        store.insert(pid, ThrottleInfo{1000000, 1000000, limiter});
+    }
+
+    std::atomic<bool> stop(false);
+    std::vector<uint64_t> operations(threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            uint64_t state = 0x9E3779B97F4A7C15ULL * (t + 1);
+            uint64_t local = 0;
+            ThrottleInfo info;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int batch = 0; batch < 256; ++batch) {
+                    state ^= state << 13;
+                    state ^= state >> 7;
+                    state ^= state << 17;
+                    const uint32_t pid = 1 + static_cast<uint32_t>(state % (entries * 2));
+                    const unsigned roll = static_cast<unsigned>((state >> 40) % 100);
+                    if (roll < mix.lookupPercent) {
+                        store.find(pid, info);
+                    } else if ((roll - mix.lookupPercent) % 2 == 0) {
+                        store.insert(pid, ThrottleInfo{2000000, 2000000, limiter});
+                    } else {
+                        store.erase(pid);
+                    }
+                    ++local;
+                }
+            }
+            operations[t] = local;
+        });
+    }
+    const uint64_t start = MonotonicClock::nowNs();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(true);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    const double elapsed = static_cast<double>(MonotonicClock::nowNs() - start) / 1e9;
+
+    uint64_t total = 0;
+    for (uint64_t count : operations) {
+        total += count;
+    }
+    std::printf("%-14s %-18s %8d %10.2f %12.2f\n", storeName, mix.name, threads, total / elapsed / 1e6,
+                total / elapsed / 1e6 / threads);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int threads = argc > 1 ? std::atoi(argv[1]) : 8;
+    const uint32_t entries = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 10000;
+    const double seconds = argc > 3 ? std::atof(argv[3]) : 1.0;
+
+    const Mix mixes[] = {
+        {"lookup only", 100},
+        {"80% lookup", 80},
+        {"start/stop only", 0},
+    };
+    std::printf("%u throttles, %u hardware threads\n", entries, std::thread::hardware_concurrency());
+    std::printf("%-14s %-18s %8s %10s %12s\n", "store", "operations", "threads", "Mops/s", "per thread");
+    for (const Mix& mix : mixes) {
+        for (int t = 1; t <= threads; t *= 2) {
+            run<ThrottleTable<ThrottleInfo>>("sharded table", mix, entries, t, seconds);
+            run<LockedMap>("mutex + map", mix, entries, t, seconds);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,227 @@
+// Compares the shaper's hierarchical timing wheel with a binary heap as the timer store
+// for 10,000, 100,000 and 1,000,000 pending timers.
+//
+// Usage: TimerWheelBenchmark [fires per size]   (default: 2000000)
+//
+// The workload is the shaper's: every timer is a backlogged flow waiting for its head to
+// become admissible, 1 ms to 100 ms ahead. Time moves in 100 us steps; each step fires
+// what is due and re-arms every fired timer, and one pending timer in eight is cancelled
+// and re-armed (a rate change or head drop moving a deadline). The heap is indexed, so it
+// cancels in O(log n) as well. Deadlines come from a hash of the timer and its generation,
+// so both stores see the same schedule and must fire the same timers, never early. Time
+// is virtual; "ns/op" is the wall time per schedule, cancel or fire. Exits nonzero if the
+// two stores disagree or one fires a timer before its deadline.
+
+#include "core/MonotonicClock.h"
+#include "core/TimerWheel.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t NS_PER_MS = 1000000ULL;
+constexpr uint64_t STEP_NS = 100000ULL;
+constexpr uint64_t MIN_DELAY_NS = NS_PER_MS;
+constexpr uint64_t MAX_DELAY_NS = 100 * NS_PER_MS;
+constexpr uint32_t REARM_EVERY = 8;
+
+uint64_t mix(uint64_t value) {
+    // splitmix64 finalizer
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
+
+uint64_t delayOf(uint32_t timer, uint64_t generation) {
+    return MIN_DELAY_NS + mix(static_cast<uint64_t>(timer) << 32 ^ generation) % (MAX_DELAY_NS - MIN_DELAY_NS);
+}
+
+// Binary min-heap on deadline with a position per timer, so any timer can be cancelled
+class IndexedHeap {
+public:
+    static constexpr uint32_t ABSENT = UINT32_MAX;
+
+    explicit IndexedHeap(size_t timers) : position_(timers, ABSENT), deadline_(timers, 0) {
+        heap_.reserve(timers);
+    }
+
+    void schedule(uint32_t timer, uint64_t deadlineNs) {
+        deadline_[timer] = deadlineNs;
+        position_[timer] = static_cast<uint32_t>(heap_.size());
+        heap_.push_back(timer);
+        siftUp(position_[timer]);
+    }
+
+    void cancel(uint32_t timer) {
+        const uint32_t at = position_[timer];
+        if (at == ABSENT) {
+            return;
+        }
+        position_[timer] = ABSENT;
+        const uint32_t last = heap_.back();
+        heap_.pop_back();
+        if (at < heap_.size()) {
+            heap_[at] = last;
+            position_[last] = at;
+            siftDown(at);
+            siftUp(position_[last]);
+        }
+    }
+
+    template <typename Fire>
+    void advance(uint64_t nowNs, Fire fire) {
+        while (!heap_.empty() && deadline_[heap_.front()] <= nowNs) {
+            const uint32_t timer = heap_.front();
+            cancel(timer);
+            fire(timer, deadline_[timer]);
+        }
+    }
+
+private:
+    void place(uint32_t at, uint32_t timer) {
+        heap_[at] = timer;
+        position_[timer] = at;
+    }
+
+    void siftUp(uint32_t at) {
+        const uint32_t timer = heap_[at];
+        while (at > 0) {
+            const uint32_t parent = (at - 1) / 2;
+            if (deadline_[heap_[parent]] <= deadline_[timer]) {
+                break;
+            }
+            place(at, heap_[parent]);
+            at = parent;
+        }
+        place(at, timer);
+    }
+
+    void siftDown(uint32_t at) {
+        const uint32_t timer = heap_[at];
+        const uint32_t size = static_cast<uint32_t>(heap_.size());
+        while (true) {
+            uint32_t child = 2 * at + 1;
+            if (child >= size) {
+                break;
+            }
+            if (child + 1 < size && deadline_[heap_[child + 1]] < deadline_[heap_[child]]) {
+                ++child;
+            }
+            if (deadline_[timer] <= deadline_[heap_[child]]) {
+                break;
+            }
+            place(at, heap_[child]);
+            at = child;
+        }
+        place(at, timer);
+    }
+
+    std::vector<uint32_t> heap_;
+    std::vector<uint32_t> position_; // by timer
+    std::vector<uint64_t> deadline_; // by timer
+};
+
+struct Result {
+    uint64_t operations;
+    uint64_t fired;
+    uint64_t checksum; // over (timer, deadline) of every fire, independent of order
+    bool early;
+    double nsPerOp;
+};
+
+// Drives one store through the workload. Store adapts schedule/cancel/advance.
+template <typename Store>
+Result run(Store& store, uint32_t timers, uint64_t fires) {
+    std::vector<uint64_t> generation(timers, 0);
+    std::vector<uint32_t> due;
+    Result result = {0, 0, 0, false, 0.0};
+    uint64_t now = 0;
+    for (uint32_t timer = 0; timer < timers; ++timer) {
+        store.schedule(timer, delayOf(timer, 0));
+    }
+    result.operations += timers;
+
+    uint32_t rearmCursor = 0;
+    const uint64_t start = MonotonicClock::nowNs();
+    while (result.fired < fires) {
+        now += STEP_NS;
+        due.clear();
+        store.advance(now, [&](uint32_t timer, uint64_t deadlineNs) {
+            due.push_back(timer);
+            result.early = result.early || deadlineNs > now;
+            result.checksum += mix(static_cast<uint64_t>(timer) << 32 ^ deadlineNs);
+        });
+        result.fired += due.size();
+        for (uint32_t timer : due) {
+            store.schedule(timer, now + delayOf(timer, ++generation[timer]));
+        }
+        // Move a slice of the pending deadlines
+        const uint32_t rearms = static_cast<uint32_t>(due.size() / REARM_EVERY);
+        for (uint32_t i = 0; i < rearms; ++i) {
+            const uint32_t timer = rearmCursor;
+            rearmCursor = (rearmCursor + 7919) % timers;
+            store.cancel(timer);
+            store.schedule(timer, now + delayOf(timer, ++generation[timer]));
+        }
+        result.operations += due.size() * 2 + rearms * 2;
+    }
+    const uint64_t elapsed = MonotonicClock::nowNs() - start;
+    result.nsPerOp = static_cast<double>(elapsed) / (result.operations - timers);
+    return result;
+}
+
+class WheelStore {
+public:
+    explicit WheelStore(uint32_t timers) : ids_(timers, TimerWheel::INVALID_TIMER) {}
+
+    void schedule(uint32_t timer, uint64_t deadlineNs) { ids_[timer] = wheel_.schedule(deadlineNs, timer); }
+    void cancel(uint32_t timer) { wheel_.cancel(ids_[timer]); }
+
+    template <typename Fire>
+    void advance(uint64_t nowNs, Fire fire) {
+        expired_.clear();
+        wheel_.advance(nowNs, expired_);
+        for (const TimerWheel::Expired& timer : expired_) {
+            fire(static_cast<uint32_t>(timer.cookie), timer.deadlineNs);
+        }
+    }
+
+private:
+    TimerWheel wheel_;
+    std::vector<TimerWheel::TimerId> ids_;
+    std::vector<TimerWheel::Expired> expired_;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const long long fires = argc > 1 ? std::atoll(argv[1]) : 2000000;
+    if (fires <= 0) {
+        std::fprintf(stderr, "Usage: %s [fires per size]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("deadlines %llu-%llu ms ahead, %llu us steps, %lld fires per size\n",
+                static_cast<unsigned long long>(MIN_DELAY_NS / NS_PER_MS),
+                static_cast<unsigned long long>(MAX_DELAY_NS / NS_PER_MS),
+                static_cast<unsigned long long>(STEP_NS / 1000), fires);
+    std::printf("%10s %12s %12s %8s %8s\n", "timers", "wheel ns/op", "heap ns/op", "speedup", "check");
+    bool passed = true;
+    const uint32_t sizes[] = {10000, 100000, 1000000};
+    for (uint32_t timers : sizes) {
+        WheelStore wheel(timers);
+        const Result wheelResult = run(wheel, timers, static_cast<uint64_t>(fires));
+        IndexedHeap heap(timers);
+        const Result heapResult = run(heap, timers, static_cast<uint64_t>(fires));
+        const bool ok = wheelResult.fired == heapResult.fired && wheelResult.checksum == heapResult.checksum &&
+                        !wheelResult.early && !heapResult.early;
+        std::printf("%10u %12.1f %12.1f %7.2fx %8s\n", timers, wheelResult.nsPerOp, heapResult.nsPerOp,
+                    heapResult.nsPerOp / wheelResult.nsPerOp, ok ? "match" : "MISMATCH");
+        passed = passed && ok;
+    }
+    std::printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : 1;
+}
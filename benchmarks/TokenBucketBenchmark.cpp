@@ -0,0 +1,236 @@
+// Checks that TokenBucket holds long-run throughput to its configured rate, and times its
+// decisions.
+//
+// Usage: TokenBucketBenchmark [threads] [seconds]   (default: 4 1)
+//
+// Conformance runs on a virtual clock, for rates from 1 KB/s to 1 Gbit/s and units from
+// 100 bytes to 64 KB, each with the default burst:
+// - "paced" waits for nextAvailableAt() and then consumes, which must always succeed;
+// - "polled" consumes as much as it can every millisecond;
+// - "random" offers four times the rate at exponential gaps and drops what is refused.
+//   It runs only with units of at most half the burst: a unit as large as the burst is
+//   admitted only against a full bucket, so a policer that drops it keeps the rate only
+//   if it is retried the moment the bucket fills, as the paced and polled senders do.
+// Throughput is measured over a window that starts once the initial burst is spent and
+// must be within 1% of the rate. Over the whole run, admitted bytes must never exceed
+// rate x time plus the burst (and one oversized unit).
+//
+// Timing: ns/decision for tryConsume() admitting and refusing with a given time, with the
+// clock read, and for nextAvailableAt(), on one thread. Then `threads` threads share one
+// 100 MB/s bucket on the real clock for `seconds`; what they admit must stay within the
+// same bound. Exits nonzero if any check fails.
+
+#include "core/MonotonicClock.h"
+#include "core/TokenBucket.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t NS_PER_SEC = 1000000000ULL;
+constexpr uint64_t POLL_NS = 1000000ULL;
+constexpr double TOLERANCE = 0.01;
+
+enum class Sender { Paced, Polled, Random };
+
+const char* senderName(Sender sender) {
+    static const char* const NAMES[] = {"paced", "polled", "random"};
+    return NAMES[static_cast<size_t>(sender)];
+}
+
+struct ConformanceResult {
+    double windowRatio; // admitted in the window / rate x window
+    bool withinBound;   // never above rate x time + burst
+    bool paceKept;      // every paced consume succeeded
+};
+
+// Bytes a bucket may admit by `nowNs` after starting full at time 0
+uint64_t admissible(uint64_t rate, uint64_t burst, uint32_t unit, uint64_t nowNs) {
+    const double bytes = static_cast<double>(rate) * nowNs / NS_PER_SEC;
+    return static_cast<uint64_t>(bytes) + burst + unit;
+}
+
+ConformanceResult runConformance(Sender sender, uint64_t rate, uint32_t unit, uint64_t seed) {
+    TokenBucket bucket(rate);
+    const uint64_t burst = bucket.burst();
+    // Enough units that one more or less stays well inside the tolerance, and at least
+    // two seconds, starting after the burst (100 ms at the default) is spent
+    const uint64_t windowNs =
+        std::max(2 * NS_PER_SEC, static_cast<uint64_t>(2000.0 * unit * NS_PER_SEC / rate));
+    const uint64_t windowStart = std::max(NS_PER_SEC / 2, 4 * burst * NS_PER_SEC / rate);
+    const uint64_t endNs = windowStart + windowNs;
+
+    std::mt19937_64 generator(seed);
+    std::exponential_distribution<double> gaps(4.0 * rate / unit / NS_PER_SEC);
+    ConformanceResult result = {0.0, true, true};
+    uint64_t admitted = 0;
+    uint64_t inWindow = 0;
+    uint64_t now = 0;
+    while (now < endNs) {
+        bool consumed = false;
+        switch (sender) {
+        case Sender::Paced:
+            now = bucket.nextAvailableAt(unit, now);
+            if (now >= endNs) {
+                break;
+            }
+            consumed = bucket.tryConsume(unit, now);
+            result.paceKept = result.paceKept && consumed;
+            break;
+        case Sender::Polled:
+            consumed = bucket.tryConsume(unit, now);
+            if (!consumed) {
+                now += POLL_NS;
+            }
+            break;
+        case Sender::Random:
+            consumed = bucket.tryConsume(unit, now);
+            now += static_cast<uint64_t>(gaps(generator)) + 1;
+            break;
+        }
+        if (!consumed) {
+            continue;
+        }
+        admitted += unit;
+        if (now >= windowStart) {
+            inWindow += unit;
+        }
+        result.withinBound = result.withinBound && admitted <= admissible(rate, burst, unit, now);
+    }
+    result.windowRatio = inWindow / (static_cast<double>(rate) * windowNs / NS_PER_SEC);
+    return result;
+}
+
+bool checkConformance() {
+    const uint64_t rates[] = {1000, 125000, 12500000, 125000000};
+    const uint32_t units[] = {100, 1500, 65536};
+    const Sender senders[] = {Sender::Paced, Sender::Polled, Sender::Random};
+    std::printf("%-8s %14s %8s %12s %10s\n", "sender", "rate B/s", "unit", "throughput", "bound");
+    bool passed = true;
+    uint64_t seed = 1;
+    for (Sender sender : senders) {
+        double worst = 0.0;
+        for (uint64_t rate : rates) {
+            for (uint32_t unit : units) {
+                if (sender == Sender::Random && 2 * unit > TokenBucket(rate).burst()) {
+                    continue;
+                }
+                const ConformanceResult result = runConformance(sender, rate, unit, seed++);
+                const bool ok = std::fabs(result.windowRatio - 1.0) <= TOLERANCE && result.withinBound &&
+                                result.paceKept;
+                worst = std::max(worst, std::fabs(result.windowRatio - 1.0));
+                std::printf("%-8s %14llu %8u %11.3f%% %10s%s\n", senderName(sender),
+                            static_cast<unsigned long long>(rate), unit, 100.0 * result.windowRatio,
+                            result.withinBound ? "kept" : "EXCEEDED", ok ? "" : "  FAIL");
+                passed = passed && ok;
+            }
+        }
+        std::printf("%-8s worst deviation from the rate %.3f%%\n", senderName(sender), 100.0 * worst);
+    }
+    return passed;
+}
+
+// Keeps the optimizer from dropping the timed calls
+std::atomic<uint64_t> sink(0);
+
+template <typename Decide>
+double nsPerDecision(Decide decide) {
+    constexpr uint64_t DECISIONS = 10000000;
+    uint64_t result = 0;
+    const uint64_t start = MonotonicClock::nowNs();
+    for (uint64_t i = 0; i < DECISIONS; ++i) {
+        result += decide(i);
+    }
+    const uint64_t elapsed = MonotonicClock::nowNs() - start;
+    sink.fetch_add(result, std::memory_order_relaxed);
+    return static_cast<double>(elapsed) / DECISIONS;
+}
+
+void reportTiming() {
+    // Fast enough that every decision admits, or slow enough that none does
+    TokenBucket open(1ULL << 50);
+    TokenBucket empty(1000);
+    empty.tryConsume(1000000, 0);
+    TokenBucket clocked(1ULL << 50);
+    std::printf("\n%-36s %10s\n", "decision", "ns");
+    std::printf("%-36s %10.1f\n", "tryConsume(bytes, now), admitted",
+                nsPerDecision([&](uint64_t i) { return open.tryConsume(1500, i) ? 1 : 0; }));
+    std::printf("%-36s %10.1f\n", "tryConsume(bytes, now), refused",
+                nsPerDecision([&](uint64_t i) { return empty.tryConsume(1500, i) ? 1 : 0; }));
+    std::printf("%-36s %10.1f\n", "tryConsume(bytes), clock read",
+                nsPerDecision([&](uint64_t) { return clocked.tryConsume(1500) ? 1 : 0; }));
+    std::printf("%-36s %10.1f\n", "nextAvailableAt(bytes, now)",
+                nsPerDecision([&](uint64_t i) { return empty.nextAvailableAt(1500, i); }));
+}
+
+// Threads racing for one bucket on the real clock
+bool checkShared(int threads, double seconds) {
+    constexpr uint64_t RATE = 100ULL * 1024 * 1024;
+    constexpr uint32_t UNIT = 1500;
+    TokenBucket bucket(RATE);
+    std::atomic<bool> stop(false);
+    std::vector<uint64_t> admitted(threads, 0);
+    std::vector<uint64_t> decisions(threads, 0);
+    std::vector<std::thread> workers;
+    const uint64_t start = MonotonicClock::nowNs();
+    bucket.configure(RATE);
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            uint64_t bytes = 0;
+            uint64_t count = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (bucket.tryConsume(UNIT)) {
+                    bytes += UNIT;
+                }
+                ++count;
+            }
+            admitted[t] = bytes;
+            decisions[t] = count;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(true, std::memory_order_relaxed);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    const uint64_t elapsed = MonotonicClock::nowNs() - start;
+    uint64_t totalAdmitted = 0;
+    uint64_t totalDecisions = 0;
+    for (int t = 0; t < threads; ++t) {
+        totalAdmitted += admitted[t];
+        totalDecisions += decisions[t];
+    }
+    const bool withinBound = totalAdmitted <= admissible(RATE, bucket.burst(), UNIT, elapsed);
+    // Past the initial burst
+    const double steady = static_cast<double>(totalAdmitted) - static_cast<double>(bucket.burst());
+    std::printf("\n%d threads on one %llu B/s bucket for %.2f s: %.1f ns/decision, %.2f%% of the rate, %s\n",
+                threads, static_cast<unsigned long long>(RATE), elapsed / 1e9,
+                static_cast<double>(elapsed) * threads / std::max<uint64_t>(totalDecisions, 1),
+                100.0 * steady / (static_cast<double>(RATE) * elapsed / NS_PER_SEC),
+                withinBound ? "bound kept" : "bound EXCEEDED");
+    return withinBound;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int threads = argc > 1 ? std::atoi(argv[1]) : 4;
+    const double seconds = argc > 2 ? std::atof(argv[2]) : 1.0;
+    if (threads <= 0 || seconds <= 0.0) {
+        std::fprintf(stderr, "Usage: %s [threads] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    bool passed = checkConformance();
+    reportTiming();
+    passed = checkShared(threads, seconds) && passed;
+    std::printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : 1;
+}
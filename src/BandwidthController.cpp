@@ -1,42 +1,100 @@
 #include "BandwidthController.h"
 #include "ProcessInfo.h"
+#include "core/MonotonicClock.h"
+#ifdef _WIN32
 #include "platform/windows/ProcessMonitor.h"
 #include "platform/windows/NetworkThrottler.h"
+#else
+#include "platform/linux/ProcessMonitor.h"
+#include "platform/linux/NetworkThrottler.h"
+#endif
 
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
 #include <cctype>
 
-BandwidthController::BandwidthController() {
+BandwidthController::BandwidthController() : adaptiveVersion_(0) {
     processMonitor_ = std::make_unique<ProcessMonitor>();
     networkThrottler_ = std::make_unique<NetworkThrottler>();
 }
 
 BandwidthController::~BandwidthController() = default;
 
-std::vector<ProcessInfo> BandwidthController::getRunningProcesses() {
+std::shared_ptr<const ProcessList> BandwidthController::getRunningProcesses() {
+    if (isSampling()) {
+        return sampler_->current().processes;
+    }
     if (processMonitor_) {
         return processMonitor_->getRunningProcesses();
     }
-    return {};
+    return std::make_shared<const ProcessList>();
 }
 
 bool BandwidthController::refreshProcessList() {
+    if (isSampling()) {
+        sampler_->requestRefresh();
+        return true;
+    }
     if (processMonitor_) {
         return processMonitor_->refresh();
     }
     return false;
 }
 
+bool BandwidthController::refreshProcessList(ProcessDelta& delta) {
+    delta.clear();
+    if (processMonitor_ && !isSampling()) {
+        return processMonitor_->refresh(delta);
+    }
+    return false;
+}
+
 bool BandwidthController::updateNetworkStats() {
+    if (isSampling()) {
+        return true;
+    }
     if (processMonitor_) {
         return processMonitor_->updateNetworkStats();
     }
     return false;
 }
 
+void BandwidthController::requestPaths(std::vector<uint32_t> pids, bool all) {
+    if (isSampling()) {
+        sampler_->setWantedPaths(std::move(pids), all);
+    } else if (processMonitor_) {
+        if (all) {
+            processMonitor_->resolveAllPaths();
+        } else {
+            processMonitor_->resolvePaths(pids);
+        }
+    }
+}
+
+bool BandwidthController::startSampling(const ProcessSampler::Config& config) {
+    if (!processMonitor_) {
+        return false;
+    }
+    if (isSampling()) {
+        return true;
+    }
+    sampler_ = std::make_unique<ProcessSampler>(*processMonitor_, config);
+    return sampler_->start();
+}
+
+void BandwidthController::stopSampling() {
+    if (sampler_) {
+        sampler_->stop();
+    }
+}
+
+const ProcessSnapshot& BandwidthController::latestSnapshot() {
+    return isSampling() ? sampler_->latest() : emptySnapshot_;
+}
+
 bool BandwidthController::startThrottling(uint32_t pid, uint64_t downloadLimitBytesPerSec, uint64_t uploadLimitBytesPerSec) {
+    adaptive_.erase(pid);
     if (networkThrottler_) {
         return networkThrottler_->startThrottling(pid, downloadLimitBytesPerSec, uploadLimitBytesPerSec);
     }
@@ -44,6 +102,7 @@ bool BandwidthController::startThrottling(uint32_t pid, uint64_t downloadLimitBy
 }
 
 bool BandwidthController::stopThrottling(uint32_t pid) {
+    adaptive_.erase(pid);
     if (networkThrottler_) {
         return networkThrottler_->stopThrottling(pid);
     }
@@ -57,6 +116,210 @@ bool BandwidthController::isThrottlingActive(uint32_t pid) const {
     return false;
 }
 
+std::vector<ThrottleStatus> BandwidthController::getActiveThrottles() const {
+    if (networkThrottler_) {
+        return networkThrottler_->activeThrottles();
+    }
+    return {};
+}
+
+size_t BandwidthController::stopAllThrottling() {
+    adaptive_.clear();
+    if (networkThrottler_) {
+        return networkThrottler_->stopAll();
+    }
+    return 0;
+}
+
+bool BandwidthController::startThrottlingTree(uint32_t rootPid, uint64_t downloadLimitBytesPerSec,
+                                              uint64_t uploadLimitBytesPerSec) {
+    adaptive_.erase(rootPid);
+    if (networkThrottler_) {
+        return networkThrottler_->startThrottlingTree(rootPid, downloadLimitBytesPerSec, uploadLimitBytesPerSec);
+    }
+    return false;
+}
+
+size_t BandwidthController::updateThrottleTrees() {
+    if (networkThrottler_) {
+        return networkThrottler_->updateTrees();
+    }
+    return 0;
+}
+
+bool BandwidthController::applyThrottleBatch(const std::vector<ThrottleRequest>& requests) {
+    if (networkThrottler_ && networkThrottler_->applyBatch(requests)) {
+        for (const ThrottleRequest& request : requests) {
+            adaptive_.erase(request.pid);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool BandwidthController::removeThrottleBatch(const std::vector<uint32_t>& pids) {
+    if (networkThrottler_ && networkThrottler_->removeBatch(pids)) {
+        for (uint32_t pid : pids) {
+            adaptive_.erase(pid);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool BandwidthController::startAdaptiveThrottling(uint32_t pid, uint64_t downloadCeilingBytesPerSec,
+                                                  uint64_t uploadCeilingBytesPerSec,
+                                                  const AdaptiveRateController::Config& config) {
+    if (!startThrottling(pid, downloadCeilingBytesPerSec, uploadCeilingBytesPerSec)) {
+        return false;
+    }
+    // Tuning starts from the ceilings, which are the limits just applied
+    adaptive_.emplace(pid, AdaptiveThrottle{AdaptiveRateController(downloadCeilingBytesPerSec, config),
+                                            AdaptiveRateController(uploadCeilingBytesPerSec, config)});
+    return true;
+}
+
+size_t BandwidthController::updateAdaptiveLimits() {
+    if (!processMonitor_ || !networkThrottler_) {
+        return 0;
+    }
+    const ProcessSnapshot* snapshot = nullptr;
+    uint64_t nowNs;
+    if (isSampling()) {
+        // The worker samples; tell it whose RTTs to include and tune once per new sample
+        std::vector<uint32_t> pids;
+        pids.reserve(adaptive_.size());
+        for (const auto& entry : adaptive_) {
+            pids.push_back(entry.first);
+        }
+        sampler_->setWatchedPids(std::move(pids));
+        snapshot = &sampler_->latest();
+        if (adaptive_.empty() || snapshot->version == adaptiveVersion_) {
+            return 0;
+        }
+        adaptiveVersion_ = snapshot->version;
+        nowNs = snapshot->sampledAtNs;
+    } else {
+        if (adaptive_.empty()) {
+            return 0;
+        }
+        processMonitor_->updateNetworkStats();
+        nowNs = MonotonicClock::nowNs();
+    }
+    size_t changed = 0;
+    for (auto it = adaptive_.begin(); it != adaptive_.end();) {
+        const uint32_t pid = it->first;
+        AdaptiveThrottle& throttle = it->second;
+        TrafficAccountant::ProcessTraffic traffic = {};
+        if (snapshot) {
+            snapshot->findTraffic(pid, traffic);
+        } else {
+            processMonitor_->getTraffic(pid, traffic);
+        }
+        TrafficShaper::QueueStats queue = {};
+        networkThrottler_->shaper().queueStats(pid, queue);
+
+        // The RTT covers both directions of the process's connections. The shaper's
+        // smoothed delay only says something while traffic is actually held.
+        AdaptiveRateController::Sample sample = {};
+        sample.nowNs = nowNs;
+        sample.pathDelayNs = traffic.rttUs > traffic.minRttUs ? (traffic.rttUs - traffic.minRttUs) * 1000ULL : 0;
+        sample.shaperDelayNs = queue.heldBytes > 0 ? queue.downloadDelayNs : 0;
+        sample.throughput = static_cast<uint64_t>(traffic.downloadRate);
+        const uint64_t previousDownload = throttle.download.rate();
+        const uint64_t download = throttle.download.update(sample);
+        sample.shaperDelayNs = queue.heldBytes > 0 ? queue.uploadDelayNs : 0;
+        sample.throughput = static_cast<uint64_t>(traffic.uploadRate);
+        const uint64_t previousUpload = throttle.upload.rate();
+        const uint64_t upload = throttle.upload.update(sample);
+        if (download == previousDownload && upload == previousUpload) {
+            ++it;
+            continue;
+        }
+        // Fails once the throttle was stopped elsewhere or folded into a tree
+        if (!networkThrottler_->updateLimits(pid, ShapingRates(download, download), ShapingRates(upload, upload))) {
+            it = adaptive_.erase(it);
+            continue;
+        }
+        ++changed;
+        ++it;
+    }
+    return changed;
+}
+
+bool BandwidthController::isAdaptive(uint32_t pid) const {
+    return adaptive_.find(pid) != adaptive_.end();
+}
+
+bool BandwidthController::startPolicing(uint32_t pid, const TrtcmPolicer::Config& download,
+                                        const TrtcmPolicer::Config& upload) {
+    adaptive_.erase(pid);
+    if (networkThrottler_) {
+        return networkThrottler_->startPolicing(pid, download, upload);
+    }
+    return false;
+}
+
+void BandwidthController::setLinkCapacity(uint64_t downloadBytesPerSec, uint64_t uploadBytesPerSec) {
+    if (networkThrottler_) {
+        networkThrottler_->setLinkCapacity(downloadBytesPerSec, uploadBytesPerSec);
+    }
+}
+
+uint32_t BandwidthController::createThrottleGroup(uint32_t parentGroupId, const ShapingRates& download, const ShapingRates& upload) {
+    if (networkThrottler_) {
+        return networkThrottler_->createGroup(parentGroupId, download, upload);
+    }
+    return INVALID_GROUP;
+}
+
+bool BandwidthController::removeThrottleGroup(uint32_t groupId) {
+    if (networkThrottler_) {
+        return networkThrottler_->removeGroup(groupId);
+    }
+    return false;
+}
+
+bool BandwidthController::startThrottling(uint32_t pid, uint32_t groupId, const ShapingRates& download, const ShapingRates& upload) {
+    adaptive_.erase(pid);
+    if (networkThrottler_) {
+        return networkThrottler_->startThrottling(pid, groupId, download, upload);
+    }
+    return false;
+}
+
+bool BandwidthController::setQueueLimits(uint32_t pid, const TrafficShaper::QueueLimits& limits) {
+    if (networkThrottler_) {
+        return networkThrottler_->shaper().setQueueLimits(pid, limits);
+    }
+    return false;
+}
+
+bool BandwidthController::setFairShare(uint32_t pid, const TrafficShaper::FairShare& share) {
+    if (networkThrottler_) {
+        return networkThrottler_->shaper().setFairShare(pid, share);
+    }
+    return false;
+}
+
+bool BandwidthController::getQueueStats(uint32_t pid, TrafficShaper::QueueStats& stats) const {
+    if (networkThrottler_) {
+        return networkThrottler_->shaper().queueStats(pid, stats);
+    }
+    return false;
+}
+
+TrafficShaper::Stats BandwidthController::getShapingStats() const {
+    if (networkThrottler_) {
+        return networkThrottler_->shaper().stats();
+    }
+    return TrafficShaper::Stats{};
+}
+
+bool BandwidthController::throttlingRequiresElevation() {
+    return NetworkThrottler::requiresElevation();
+}
+
 uint64_t BandwidthController::parseBandwidthString(const std::string& bandwidthStr) {
     if (bandwidthStr.empty()) return 0;
     
@@ -2,9 +2,15 @@
 #define BANDWIDTHCONTROLLER_H
 
 #include "ProcessInfo.h"
+#include "ProcessList.h"
+#include "ProcessSampler.h"
+#include "core/AdaptiveRateController.h"
+#include "core/TrafficShaper.h"
+#include "core/TrtcmPolicer.h"
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 // Forward declarations
@@ -16,23 +22,104 @@ public:
     BandwidthController();
     ~BandwidthController();
     
-    // Process monitoring
-    std::vector<ProcessInfo> getRunningProcesses();
+    // Process monitoring. Construction does not scan; without background sampling the
+    // caller refreshes explicitly. A refresh names processes but leaves their executable
+    // paths empty until requestPaths() asks for them.
+    // Shared, not copied; the list stays as it is for as long as it is held
+    std::shared_ptr<const ProcessList> getRunningProcesses();
     bool refreshProcessList();
+    // Rescans and reports only what changed since the previous refresh; not available
+    // while sampling in the background, where each snapshot carries its delta instead
+    // (ProcessSnapshot::delta)
+    bool refreshProcessList(ProcessDelta& delta);
     bool updateNetworkStats(); // Update network usage statistics
+    // The processes whose paths are needed (rows on screen), or all of them (a search);
+    // replaces the previous request. While sampling, the paths arrive with a later snapshot
+    // and the request also covers processes found by later scans.
+    void requestPaths(std::vector<uint32_t> pids, bool all);
+    
+    // Background sampling: a worker thread rescans and samples network statistics and
+    // publishes snapshots, and the calling thread (the GUI thread) picks up the newest with
+    // latestSnapshot() without waiting. While it runs, getRunningProcesses() reads the
+    // current snapshot, refreshProcessList() asks the worker for a rescan and
+    // updateNetworkStats() leaves sampling to the worker.
+    bool startSampling(const ProcessSampler::Config& config = ProcessSampler::Config());
+    void stopSampling();
+    bool isSampling() const { return sampler_ && sampler_->isRunning(); }
+    // Valid until the next call; version 0 until the first scan is published
+    const ProcessSnapshot& latestSnapshot();
     
     // Bandwidth throttling
     bool startThrottling(uint32_t pid, uint64_t downloadLimitBytesPerSec, uint64_t uploadLimitBytesPerSec);
     bool stopThrottling(uint32_t pid);
     bool isThrottlingActive(uint32_t pid) const;
+    // Any number of processes can be throttled at once
+    std::vector<ThrottleStatus> getActiveThrottles() const;
+    size_t stopAllThrottling();
+    // A process and all of its descendants, including ones started later, under one shared
+    // budget; stopping any of them stops the whole tree
+    bool startThrottlingTree(uint32_t rootPid, uint64_t downloadLimitBytesPerSec, uint64_t uploadLimitBytesPerSec);
+    // Picks up processes that joined or left throttle trees; returns the number of changes
+    size_t updateThrottleTrees();
+    // All-or-nothing: if any process cannot be throttled (or any PID is not throttled,
+    // for removal), no limits change
+    bool applyThrottleBatch(const std::vector<ThrottleRequest>& requests);
+    bool removeThrottleBatch(const std::vector<uint32_t>& pids);
+    
+    // Adaptive throttling: the limits become ceilings, and each direction is tuned below
+    // its ceiling to keep the queueing delay on the process's connections under the
+    // target (AIMD, see AdaptiveRateController). Starting a fixed throttle on the PID ends
+    // adaptive mode. updateAdaptiveLimits() takes a network sample (within the monitor's
+    // CPU budget) and retunes every adaptive throttle; call it about every 0.5 s. While
+    // sampling in the background it uses the newest snapshot instead, and does nothing
+    // until a newer one arrives. Returns the number of throttles whose limits changed.
+    bool startAdaptiveThrottling(uint32_t pid, uint64_t downloadCeilingBytesPerSec, uint64_t uploadCeilingBytesPerSec,
+                                 const AdaptiveRateController::Config& config = AdaptiveRateController::Config());
+    size_t updateAdaptiveLimits();
+    bool isAdaptive(uint32_t pid) const;
+    size_t adaptiveThrottleCount() const { return adaptive_.size(); }
+    
+    // Two-rate three-color policing (RFC 2698): traffic within CIR/CBS is green, within
+    // PIR/PBS yellow, the rest red, and each color gets its configured action. Replaces
+    // any throttle on the PID; stopThrottling() ends it.
+    bool startPolicing(uint32_t pid, const TrtcmPolicer::Config& download, const TrtcmPolicer::Config& upload);
+    
+    // Hierarchical throttling: a machine-wide link budget, groups below it and processes
+    // below the groups. Idle classes lend unused bandwidth to siblings up to their ceil.
+    static constexpr uint32_t LINK_GROUP = 0;
+    static constexpr uint32_t INVALID_GROUP = UINT32_MAX;
+    void setLinkCapacity(uint64_t downloadBytesPerSec, uint64_t uploadBytesPerSec);
+    uint32_t createThrottleGroup(uint32_t parentGroupId, const ShapingRates& download, const ShapingRates& upload);
+    bool removeThrottleGroup(uint32_t groupId);
+    bool startThrottling(uint32_t pid, uint32_t groupId, const ShapingRates& download, const ShapingRates& upload);
+    
+    // Held traffic: per-process byte caps, buffer pool occupancy and drop counters
+    bool setQueueLimits(uint32_t pid, const TrafficShaper::QueueLimits& limits);
+    bool getQueueStats(uint32_t pid, TrafficShaper::QueueStats& stats) const;
+    // Weight and optional own ceiling of a throttle tree member within the tree's budget
+    bool setFairShare(uint32_t pid, const TrafficShaper::FairShare& share);
+    TrafficShaper::Stats getShapingStats() const;
+    
+    // Whether the platform's throttler needs elevated privileges (administrator on Windows;
+    // the Linux backend needs none)
+    static bool throttlingRequiresElevation();
     
     // Utility
     static uint64_t parseBandwidthString(const std::string& bandwidthStr);
     static std::string formatBandwidth(uint64_t bytesPerSec);
     
 private:
+    struct AdaptiveThrottle {
+        AdaptiveRateController download;
+        AdaptiveRateController upload;
+    };
+    
     std::unique_ptr<ProcessMonitor> processMonitor_;
     std::unique_ptr<NetworkThrottler> networkThrottler_;
+    std::unique_ptr<ProcessSampler> sampler_; // declared after the monitor, so it stops first
+    std::unordered_map<uint32_t, AdaptiveThrottle> adaptive_;
+    uint64_t adaptiveVersion_; // snapshot the adaptive limits were last tuned on
+    ProcessSnapshot emptySnapshot_;
 };
 
 #endif // BANDWIDTHCONTROLLER_H
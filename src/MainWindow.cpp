@@ -1,61 +1,123 @@
 #include "MainWindow.h"
 #include "BandwidthController.h"
 #include "ProcessInfo.h"
-#include "NumericTableWidgetItem.h"
+#include "ProcessFilterProxyModel.h"
+#include "ProcessTableModel.h"
 
 #include <QHeaderView>
+#include <QScrollBar>
 #include <QMessageBox>
 #include <QTimer>
-#include <QTableWidgetItem>
-#include <QList>
+#include <QItemSelectionModel>
 #include <QSlider>
 #include <QLabel>
-#include <QAbstractItemModel>
+#include <algorithm>
 #include <cmath>
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
+namespace {
+
+#ifdef _WIN32
+// Throttling through WFP needs an elevated token
+bool isRunningElevated() {
+    BOOL isElevated = FALSE;
+    HANDLE token = NULL;
+    if (OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
+        TOKEN_ELEVATION elevation;
+        DWORD size;
+        if (GetTokenInformation(token, TokenElevation, &elevation, sizeof(elevation), &size)) {
+            isElevated = elevation.TokenIsElevated;
+        }
+        CloseHandle(token);
+    }
+    return isElevated == TRUE;
+}
+
+// Whether the active backend can throttle with the privileges we have
+bool canThrottle() {
+    return !BandwidthController::throttlingRequiresElevation() || isRunningElevated();
+}
+
+const char* const MISSING_PRIVILEGES =
+    "Warning: Not running as administrator. Network throttling requires administrator privileges.";
+const char* const ELEVATION_HINT =
+    "Network throttling requires administrator privileges.\n\n"
+    "Please run the application as administrator (right-click and select 'Run as administrator').";
+const char* const THROTTLE_FAILURE_CAUSES =
+    "Possible causes:\n"
+    "- Windows Filtering Platform (WFP) not available\n"
+    "- Insufficient permissions\n"
+    "- Process not found or already terminated\n\n"
+    "Make sure you're running as administrator.";
+#else
+// The Linux backend needs no privileges (see NetworkThrottler::requiresElevation()), so
+// there is nothing to warn about
+bool canThrottle() {
+    return !BandwidthController::throttlingRequiresElevation();
+}
+
+const char* const THROTTLE_FAILURE_CAUSES =
+    "Possible causes:\n"
+    "- The shared limit table in /dev/shm could not be created or is full\n"
+    "- Process not found or already terminated\n\n"
+    "Limits apply to programs started with LD_PRELOAD=libbandwidthshim.so or routed "
+    "through BandwidthProxy.";
+#endif
+
+} // namespace
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , controller_(std::make_unique<BandwidthController>())
-    , refreshTimer_(new QTimer(this))
-    , currentThrottledPid_(0)
+    , snapshotTimer_(new QTimer(this))
+    , tableModel_(new ProcessTableModel(this))
+    , tableProxy_(new ProcessFilterProxyModel(this))
+    , columnsSized_(false)
+    , shownVersion_(0)
+    , allPaths_(false)
 {
     ui_.setupUi(this);
     setupUI();
     
-    // Delay initial refresh to allow UI to render first
-    QTimer::singleShot(100, this, &MainWindow::refreshProcessList);
-    
-    // Auto-refresh process list every 5 seconds
-    connect(refreshTimer_, &QTimer::timeout, this, &MainWindow::refreshProcessList);
-    refreshTimer_->start(5000);
+    // Scans and network samples run on the controller's worker thread; the event loop only
+    // picks up finished snapshots, so a slow scan never holds up the window
+    controller_->startSampling();
+    connect(snapshotTimer_, &QTimer::timeout, this, &MainWindow::showLatestSnapshot);
+    snapshotTimer_->start(100);
 }
 
 MainWindow::~MainWindow() {
-    if (currentThrottledPid_ != 0) {
-        controller_->stopThrottling(currentThrottledPid_);
-    }
+    controller_->stopAllThrottling();
 }
 
 void MainWindow::setupUI() {
-    // Configure process table
+    // Configure process table: the model keeps one row per process and the proxy sorts
+    // (numerically on the PID and speed columns) and applies the search
+    tableProxy_->setSourceModel(tableModel_);
+    ui_.processTable->setModel(tableProxy_);
     ui_.processTable->horizontalHeader()->setStretchLastSection(true);
+    // Columns are sized once, from a sample of rows, rather than on every update
+    ui_.processTable->horizontalHeader()->setResizeContentsPrecision(200);
+    // Fixed row heights let the view lay out thousands of rows without measuring them
+    ui_.processTable->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    ui_.processTable->verticalHeader()->hide();
     ui_.processTable->setAlternatingRowColors(true);
     ui_.processTable->setSortingEnabled(true);
-    ui_.processTable->sortByColumn(2, Qt::DescendingOrder); // Sort by download speed by default
-    
-    // Set up custom sorting for network speed columns (columns 2 and 3)
-    // We'll handle this by storing numeric values in UserRole
+    ui_.processTable->sortByColumn(ProcessRows::DownloadColumn, Qt::DescendingOrder); // busiest first
     
     // Connect signals
     connect(ui_.refreshButton, &QPushButton::clicked, this, &MainWindow::refreshProcessList);
     connect(ui_.startButton, &QPushButton::clicked, this, &MainWindow::startThrottling);
     connect(ui_.stopButton, &QPushButton::clicked, this, &MainWindow::stopThrottling);
-    connect(ui_.processTable, &QTableWidget::itemSelectionChanged, this, &MainWindow::onProcessSelected);
+    connect(ui_.stopAllButton, &QPushButton::clicked, this, &MainWindow::stopAllThrottling);
+    connect(ui_.processTable->selectionModel(), &QItemSelectionModel::selectionChanged,
+            this, &MainWindow::onProcessSelected);
     connect(ui_.searchEdit, &QLineEdit::textChanged, this, &MainWindow::onSearchTextChanged);
     connect(ui_.clearSearchButton, &QPushButton::clicked, this, &MainWindow::clearSearch);
+    connect(ui_.processTable->verticalScrollBar(), &QScrollBar::valueChanged, this,
+            [this]() { requestVisiblePaths(); });
     
     // Connect slider signals
     connect(ui_.downloadSlider, &QSlider::valueChanged, this, &MainWindow::onDownloadSliderChanged);
@@ -69,35 +131,18 @@ void MainWindow::setupUI() {
     updateSliderValue(ui_.downloadSlider, ui_.downloadValueLabel, ui_.downloadSlider->value());
     updateSliderValue(ui_.uploadSlider, ui_.uploadValueLabel, ui_.uploadSlider->value());
     
-    // Check if running as administrator
-    bool isAdmin = false;
 #ifdef _WIN32
-    BOOL isElevated = FALSE;
-    HANDLE token = NULL;
-    if (OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
-        TOKEN_ELEVATION elevation;
-        DWORD size;
-        if (GetTokenInformation(token, TokenElevation, &elevation, sizeof(elevation), &size)) {
-            isElevated = elevation.TokenIsElevated;
-        }
-        CloseHandle(token);
-    }
-    isAdmin = (isElevated == TRUE);
-#endif
-    if (!isAdmin) {
-        ui_.statusLabel->setText("Warning: Not running as administrator. Network throttling requires administrator privileges.");
+    if (!canThrottle()) {
+        ui_.statusLabel->setText(MISSING_PRIVILEGES);
         ui_.statusLabel->setStyleSheet("padding: 5px; background-color: #fff3cd; border: 1px solid #ffc107; color: #856404;");
     }
+#endif
     
-    // Network stats update timer (update every 3 seconds, delayed start)
-    // Delay to avoid blocking UI on startup
-    QTimer* networkStatsTimer = new QTimer(this);
-    connect(networkStatsTimer, &QTimer::timeout, this, &MainWindow::updateNetworkStats);
-    networkStatsTimer->setSingleShot(false);
-    // Delay first network stats update by 2 seconds to let UI render
-    QTimer::singleShot(2000, this, [networkStatsTimer]() { 
-        if (networkStatsTimer) networkStatsTimer->start(3000); 
-    });
+    // Adaptive limits follow the path's queueing delay and are retuned on every new network
+    // sample; returns at once while no throttle is adaptive or no new sample arrived
+    QTimer* adaptiveTimer = new QTimer(this);
+    connect(adaptiveTimer, &QTimer::timeout, this, [this]() { controller_->updateAdaptiveLimits(); });
+    adaptiveTimer->start(500);
     
     // Status update timer
     QTimer* statusTimer = new QTimer(this);
@@ -106,91 +151,66 @@ void MainWindow::setupUI() {
 }
 
 void MainWindow::refreshProcessList() {
-    if (controller_) {
-        controller_->refreshProcessList();
-        allProcesses_ = controller_->getRunningProcesses();
-        updateProcessTable();
+    // The worker rescans at once; the result arrives with the next snapshot
+    controller_->refreshProcessList();
+}
+
+void MainWindow::showLatestSnapshot() {
+    // Also catches resizes and re-sorts that bring other rows into view
+    requestVisiblePaths();
+    if (controller_->latestSnapshot().version == shownVersion_) {
+        return;
     }
+    if (controller_->updateThrottleTrees() != 0) {
+        refreshThrottledPids();
+    }
+    updateProcessTable();
 }
 
 void MainWindow::updateProcessTable() {
     if (!controller_) return;
     
-    // Get search text and filter processes
-    QString searchText = ui_.searchEdit->text();
-    auto filteredProcesses = filterProcesses(allProcesses_, searchText);
-    
-    // Store current sort column and order before disabling sorting
-    int sortColumn = ui_.processTable->horizontalHeader()->sortIndicatorSection();
-    Qt::SortOrder sortOrder = ui_.processTable->horizontalHeader()->sortIndicatorOrder();
-    if (sortColumn < 0) sortColumn = 2; // Default to download speed column
-    
-    // Disable sorting while updating to avoid issues
-    ui_.processTable->setSortingEnabled(false);
-    ui_.processTable->setRowCount(filteredProcesses.size());
-    
-    for (size_t i = 0; i < filteredProcesses.size(); ++i) {
-        const auto& proc = filteredProcesses[i];
-        
-        // PID
-        QTableWidgetItem* pidItem = new QTableWidgetItem(QString::number(proc.pid));
-        pidItem->setData(Qt::UserRole, proc.pid); // Store for sorting
-        ui_.processTable->setItem(i, 0, pidItem);
-        
-        // Process Name
-        ui_.processTable->setItem(i, 1, new QTableWidgetItem(QString::fromStdString(proc.name)));
-        
-        // Download Speed (formatted) - use custom item for proper numeric sorting
-        QString downloadStr = QString::fromStdString(BandwidthController::formatBandwidth(proc.downloadSpeed));
-        NumericTableWidgetItem* downloadItem = new NumericTableWidgetItem(downloadStr, proc.downloadSpeed);
-        downloadItem->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-        ui_.processTable->setItem(i, 2, downloadItem);
-        
-        // Upload Speed (formatted) - use custom item for proper numeric sorting
-        QString uploadStr = QString::fromStdString(BandwidthController::formatBandwidth(proc.uploadSpeed));
-        NumericTableWidgetItem* uploadItem = new NumericTableWidgetItem(uploadStr, proc.uploadSpeed);
-        uploadItem->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-        ui_.processTable->setItem(i, 3, uploadItem);
-        
-        // Path
-        ui_.processTable->setItem(i, 4, new QTableWidgetItem(QString::fromStdString(proc.path)));
+    // Only the rows that appeared, went away or changed are signalled; the proxy re-sorts
+    // and re-filters just those, and the view keeps its selection and scroll position
+    const ProcessSnapshot& snapshot = controller_->latestSnapshot();
+    shownVersion_ = snapshot.version;
+    tableModel_->update(snapshot, throttledPids_);
+    if (!columnsSized_ && tableModel_->rowCount() > 0) {
+        ui_.processTable->resizeColumnsToContents();
+        columnsSized_ = true;
     }
-    
-    // Re-enable sorting and restore sort order
-    ui_.processTable->setSortingEnabled(true);
-    ui_.processTable->sortByColumn(sortColumn, sortOrder);
-    ui_.processTable->resizeColumnsToContents();
 }
 
-std::vector<ProcessInfo> MainWindow::filterProcesses(const std::vector<ProcessInfo>& processes, const QString& searchText) const {
-    if (searchText.isEmpty()) {
-        return processes;
-    }
-    
-    std::vector<ProcessInfo> filtered;
-    QString searchLower = searchText.toLower();
-    
-    for (const auto& proc : processes) {
-        QString name = QString::fromStdString(proc.name).toLower();
-        QString path = QString::fromStdString(proc.path).toLower();
-        QString pid = QString::number(proc.pid);
-        
-        // Check if search text matches process name, path, or PID
-        if (name.contains(searchLower) || path.contains(searchLower) || pid.contains(searchLower)) {
-            filtered.push_back(proc);
+void MainWindow::requestVisiblePaths() {
+    // Scans leave paths out; the table shows them only for rows that were on screen
+    const bool all = !tableProxy_->searchText().isEmpty() || tableProxy_->sortColumn() == ProcessRows::PathColumn;
+    std::vector<uint32_t> pids;
+    const int first = ui_.processTable->rowAt(0);
+    if (!all && first >= 0) {
+        int last = ui_.processTable->rowAt(ui_.processTable->viewport()->height() - 1);
+        if (last < 0) {
+            last = tableProxy_->rowCount() - 1;
+        }
+        pids.reserve(static_cast<size_t>(last - first + 1));
+        for (int row = first; row <= last; ++row) {
+            pids.push_back(tableProxy_->pidAt(row));
         }
     }
-    
-    return filtered;
+    if (all == allPaths_ && pids == pathPids_) {
+        return;
+    }
+    allPaths_ = all;
+    pathPids_ = pids;
+    controller_->requestPaths(std::move(pids), all);
 }
 
 void MainWindow::onSearchTextChanged() {
-    updateProcessTable();
+    tableProxy_->setSearchText(ui_.searchEdit->text());
+    requestVisiblePaths();
 }
 
 void MainWindow::clearSearch() {
-    ui_.searchEdit->clear();
-    updateProcessTable();
+    ui_.searchEdit->clear(); // textChanged clears the filter
 }
 
 int MainWindow::snapToCheckpoint(int value) const {
@@ -275,82 +295,37 @@ void MainWindow::onSliderReleased() {
 }
 
 void MainWindow::onProcessSelected() {
-    uint32_t pid = getSelectedPid();
-    if (pid != 0) {
-        ui_.statusLabel->setText(QString("Selected process: PID %1").arg(pid));
-        bool isAdmin = false;
-#ifdef _WIN32
-        BOOL isElevated = FALSE;
-        HANDLE token = NULL;
-        if (OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
-            TOKEN_ELEVATION elevation;
-            DWORD size;
-            if (GetTokenInformation(token, TokenElevation, &elevation, sizeof(elevation), &size)) {
-                isElevated = elevation.TokenIsElevated;
-            }
-            CloseHandle(token);
-        }
-        isAdmin = (isElevated == TRUE);
-#endif
-        if (isAdmin) {
+    std::vector<uint32_t> pids = getSelectedPids();
+    if (!pids.empty()) {
+        ui_.statusLabel->setText(pids.size() == 1 ? QString("Selected process: PID %1").arg(pids[0])
+                                                  : QString("Selected %1 processes").arg(pids.size()));
+        if (canThrottle()) {
             ui_.statusLabel->setStyleSheet("padding: 5px; background-color: #f0f0f0; border: 1px solid #ccc;");
         }
     }
 }
 
-uint32_t MainWindow::getSelectedPid() const {
-    QList<QTableWidgetItem*> selected = ui_.processTable->selectedItems();
-    if (!selected.isEmpty()) {
-        QTableWidgetItem* pidItem = ui_.processTable->item(selected[0]->row(), 0);
-        if (pidItem) {
-            bool ok;
-            uint32_t pid = pidItem->text().toUInt(&ok);
-            return ok ? pid : 0;
-        }
-    }
-    return 0;
-}
-
-void MainWindow::updateNetworkStats() {
-    if (controller_ && !allProcesses_.empty()) {
-        // Only update network stats, don't refresh the entire process list
-        // This is faster and less blocking
-        controller_->updateNetworkStats();
-        allProcesses_ = controller_->getRunningProcesses();
-        
-        // Update table without full refresh (preserves selection and scroll position)
-        updateProcessTable();
+std::vector<uint32_t> MainWindow::getSelectedPids() const {
+    std::vector<uint32_t> pids;
+    for (const QModelIndex& index : ui_.processTable->selectionModel()->selectedRows(0)) {
+        pids.push_back(tableProxy_->pidAt(index.row()));
     }
+    return pids;
 }
 
 void MainWindow::startThrottling() {
-    uint32_t pid = getSelectedPid();
-    if (pid == 0) {
-        QMessageBox::warning(this, "No Process Selected", "Please select a process from the list.");
+    std::vector<uint32_t> pids = getSelectedPids();
+    if (pids.empty()) {
+        QMessageBox::warning(this, "No Process Selected", "Please select one or more processes from the list.");
         return;
     }
     
-    // Check if running as administrator
-    bool isAdmin = false;
 #ifdef _WIN32
-    BOOL isElevated = FALSE;
-    HANDLE token = NULL;
-    if (OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
-        TOKEN_ELEVATION elevation;
-        DWORD size;
-        if (GetTokenInformation(token, TokenElevation, &elevation, sizeof(elevation), &size)) {
-            isElevated = elevation.TokenIsElevated;
-        }
-        CloseHandle(token);
-    }
-    isAdmin = (isElevated == TRUE);
-#endif
-    if (!isAdmin) {
-        QMessageBox::critical(this, "Permission Denied", 
-            "Network throttling requires administrator privileges.\n\n"
-            "Please run the application as administrator (right-click and select 'Run as administrator').");
+    if (!canThrottle()) {
+        QMessageBox::critical(this, "Permission Denied", ELEVATION_HINT);
         return;
     }
+#endif
     
     // Get values from sliders (in Mbps, convert to bytes per second)
     int downloadMbps = ui_.downloadSlider->value();
@@ -360,77 +335,144 @@ void MainWindow::startThrottling() {
     uint64_t downloadLimit = static_cast<uint64_t>(downloadMbps) * 125000ULL;
     uint64_t uploadLimit = static_cast<uint64_t>(uploadMbps) * 125000ULL;
     
-    // Stop previous throttling if any
-    if (currentThrottledPid_ != 0 && currentThrottledPid_ != pid) {
-        controller_->stopThrottling(currentThrottledPid_);
+    // Each selected process gets its own limit; other throttles stay as they are. The
+    // selection is applied as one batch, so it either all takes effect or none of it does.
+    // With child processes included, each selected process instead starts a tree whose
+    // members share the limit. Adaptive limits are tuned per process and are started one
+    // process at a time as well.
+    const bool trees = ui_.includeChildrenCheckBox->isChecked();
+    const bool adaptive = !trees && ui_.adaptiveCheckBox->isChecked();
+    bool applied = true;
+    if (trees) {
+        for (uint32_t pid : pids) {
+            applied = controller_->startThrottlingTree(pid, downloadLimit, uploadLimit) && applied;
+        }
+    } else if (adaptive) {
+        for (uint32_t pid : pids) {
+            applied = controller_->startAdaptiveThrottling(pid, downloadLimit, uploadLimit) && applied;
+        }
+    } else {
+        std::vector<ThrottleRequest> requests;
+        requests.reserve(pids.size());
+        for (uint32_t pid : pids) {
+            requests.emplace_back(pid, downloadLimit, uploadLimit);
+        }
+        applied = controller_->applyThrottleBatch(requests);
     }
+    refreshThrottledPids();
+    updateProcessTable();
+    showThrottleStatus();
     
-    if (controller_->startThrottling(pid, downloadLimit, uploadLimit)) {
-        currentThrottledPid_ = pid;
-        ui_.startButton->setEnabled(false);
-        ui_.stopButton->setEnabled(true);
-        ui_.statusLabel->setText(QString("Throttling active for PID %1 - Down: %2 Mbps, Up: %3 Mbps")
-            .arg(pid).arg(downloadMbps).arg(uploadMbps));
-        ui_.statusLabel->setStyleSheet("padding: 5px; background-color: #d4edda; border: 1px solid #c3e6cb; color: #155724;");
-    } else {
-        QMessageBox::critical(this, "Error", 
-            "Failed to start throttling.\n\n"
-            "Possible causes:\n"
-            "- Windows Filtering Platform (WFP) not available\n"
-            "- Insufficient permissions\n"
-            "- Process not found or already terminated\n\n"
-            "Make sure you're running as administrator.");
+    if (!applied) {
+        const QString failure = trees || adaptive
+            ? QString("Failed to start throttling for some of the %1 selected %2.\n\n")
+                  .arg(pids.size())
+                  .arg(trees ? "process trees" : "processes")
+            : QString("Failed to start throttling for the %1 selected processes; no limits were changed.\n\n")
+                  .arg(pids.size());
+        QMessageBox::critical(this, "Error", failure + THROTTLE_FAILURE_CAUSES);
     }
 }
 
 void MainWindow::stopThrottling() {
-    if (currentThrottledPid_ != 0) {
-        if (controller_->stopThrottling(currentThrottledPid_)) {
-            ui_.statusLabel->setText("Throttling stopped.");
-            currentThrottledPid_ = 0;
-            ui_.startButton->setEnabled(true);
-            ui_.stopButton->setEnabled(false);
+    // Stops the selected processes that are throttled; with nothing selected, all
+    std::vector<uint32_t> pids = getSelectedPids();
+    if (pids.empty()) {
+        stopAllThrottling();
+        return;
+    }
+    pids.erase(std::remove_if(pids.begin(), pids.end(),
+                              [this](uint32_t pid) { return throttledPids_.count(pid) == 0; }),
+               pids.end());
+    if (pids.empty()) {
+        QMessageBox::warning(this, "Not Throttled", "None of the selected processes is throttled.");
+        return;
+    }
+    
+    // Members of a throttle tree stop with their whole tree; the rest go as one batch. A
+    // throttle can end between the refresh and this call; the batch then removes nothing.
+    std::unordered_set<uint32_t> treeMembers;
+    for (const ThrottleStatus& status : controller_->getActiveThrottles()) {
+        if (status.treeRoot != 0) {
+            treeMembers.insert(status.pid);
+        }
+    }
+    std::vector<uint32_t> trees;
+    for (auto it = pids.begin(); it != pids.end();) {
+        if (treeMembers.count(*it) != 0) {
+            trees.push_back(*it);
+            it = pids.erase(it);
         } else {
-            QMessageBox::warning(this, "Error", "Failed to stop throttling.");
+            ++it;
+        }
+    }
+    bool removed = pids.empty() || controller_->removeThrottleBatch(pids);
+    for (uint32_t pid : trees) {
+        // Stopping one member also stops the others, so later ones may already be gone
+        if (controller_->isThrottlingActive(pid)) {
+            removed = controller_->stopThrottling(pid) && removed;
         }
     }
+    refreshThrottledPids();
+    updateProcessTable();
+    showThrottleStatus();
+    if (!removed) {
+        QMessageBox::warning(this, "Error",
+            QString("Failed to stop throttling for some of the selected processes."));
+    }
 }
 
-void MainWindow::updateStatus() {
-    if (currentThrottledPid_ != 0) {
-        if (controller_->isThrottlingActive(currentThrottledPid_)) {
-            int downloadMbps = ui_.downloadSlider->value();
-            int uploadMbps = ui_.uploadSlider->value();
-            ui_.statusLabel->setText(QString("Throttling active for PID %1 - Down: %2 Mbps, Up: %3 Mbps")
-                .arg(currentThrottledPid_).arg(downloadMbps).arg(uploadMbps));
-            ui_.statusLabel->setStyleSheet("padding: 5px; background-color: #d4edda; border: 1px solid #c3e6cb; color: #155724;");
-        } else {
-            ui_.statusLabel->setText("Throttling stopped.");
-            ui_.statusLabel->setStyleSheet("padding: 5px; background-color: #f0f0f0; border: 1px solid #ccc;");
-            currentThrottledPid_ = 0;
-            ui_.startButton->setEnabled(true);
-            ui_.stopButton->setEnabled(false);
-        }
-    } else {
-        // Check if running as administrator
-        bool isAdmin = false;
-#ifdef _WIN32
-        BOOL isElevated = FALSE;
-        HANDLE token = NULL;
-        if (OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
-            TOKEN_ELEVATION elevation;
-            DWORD size;
-            if (GetTokenInformation(token, TokenElevation, &elevation, sizeof(elevation), &size)) {
-                isElevated = elevation.TokenIsElevated;
+void MainWindow::stopAllThrottling() {
+    controller_->stopAllThrottling();
+    refreshThrottledPids();
+    updateProcessTable();
+    showThrottleStatus();
+}
+
+bool MainWindow::refreshThrottledPids() {
+    std::unordered_set<uint32_t> pids;
+    for (const ThrottleStatus& status : controller_->getActiveThrottles()) {
+        pids.insert(status.pid);
+    }
+    if (pids == throttledPids_) {
+        return false;
+    }
+    throttledPids_.swap(pids);
+    return true;
+}
+
+void MainWindow::showThrottleStatus() {
+    ui_.stopButton->setEnabled(!throttledPids_.empty());
+    ui_.stopAllButton->setEnabled(!throttledPids_.empty());
+    
+    if (throttledPids_.size() == 1) {
+        const uint32_t pid = *throttledPids_.begin();
+        for (const ThrottleStatus& status : controller_->getActiveThrottles()) {
+            if (status.pid == pid) {
+                ui_.statusLabel->setText(QString("Throttling active for PID %1 - Down: %2 Mbps, Up: %3 Mbps")
+                    .arg(pid).arg(status.downloadLimit / 125000ULL).arg(status.uploadLimit / 125000ULL));
             }
-            CloseHandle(token);
         }
-        isAdmin = (isElevated == TRUE);
+        ui_.statusLabel->setStyleSheet("padding: 5px; background-color: #d4edda; border: 1px solid #c3e6cb; color: #155724;");
+    } else if (!throttledPids_.empty()) {
+        ui_.statusLabel->setText(QString("Throttling active for %1 processes").arg(throttledPids_.size()));
+        ui_.statusLabel->setStyleSheet("padding: 5px; background-color: #d4edda; border: 1px solid #c3e6cb; color: #155724;");
+#ifdef _WIN32
+    } else if (!canThrottle()) {
+        ui_.statusLabel->setText(MISSING_PRIVILEGES);
+        ui_.statusLabel->setStyleSheet("padding: 5px; background-color: #fff3cd; border: 1px solid #ffc107; color: #856404;");
 #endif
-        if (!isAdmin) {
-            ui_.statusLabel->setText("Warning: Not running as administrator. Network throttling requires administrator privileges.");
-            ui_.statusLabel->setStyleSheet("padding: 5px; background-color: #fff3cd; border: 1px solid #ffc107; color: #856404;");
-        }
+    } else {
+        ui_.statusLabel->setText("Throttling stopped.");
+        ui_.statusLabel->setStyleSheet("padding: 5px; background-color: #f0f0f0; border: 1px solid #ccc;");
+    }
+}
+
+void MainWindow::updateStatus() {
+    // Throttles end on their own when processes exit; only redraw when the set changed
+    if (refreshThrottledPids()) {
+        updateProcessTable();
+        showThrottleStatus();
     }
 }
 
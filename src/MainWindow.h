@@ -4,11 +4,14 @@
 #include <QMainWindow>
 #include <QTimer>
 #include <memory>
+#include <unordered_set>
 #include <vector>
 #include "ui_MainWindow.h"
 #include "ProcessInfo.h"
 
 class BandwidthController;
+class ProcessFilterProxyModel;
+class ProcessTableModel;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -22,6 +25,7 @@ private slots:
     void onProcessSelected();
     void startThrottling();
     void stopThrottling();
+    void stopAllThrottling();
     void updateStatus();
     void onSearchTextChanged();
     void clearSearch();
@@ -29,21 +33,32 @@ private slots:
     void onUploadSliderChanged(int value);
     void onSliderPressed();
     void onSliderReleased();
-    void updateNetworkStats();
+    // Shows the controller's newest snapshot, if it is newer than the one shown
+    void showLatestSnapshot();
 
 private:
     void setupUI();
     void updateProcessTable();
-    uint32_t getSelectedPid() const;
-    std::vector<ProcessInfo> filterProcesses(const std::vector<ProcessInfo>& processes, const QString& searchText) const;
+    // Asks for the paths of the rows on screen, or of all processes while searching or
+    // sorting by path, when that changed
+    void requestVisiblePaths();
+    std::vector<uint32_t> getSelectedPids() const;
+    // Re-reads the active throttles; true if the set changed
+    bool refreshThrottledPids();
+    void showThrottleStatus();
     int snapToCheckpoint(int value) const;
     void updateSliderValue(QSlider* slider, QLabel* label, int value);
     
     Ui::MainWindow ui_;
     std::unique_ptr<BandwidthController> controller_;
-    QTimer* refreshTimer_;
-    uint32_t currentThrottledPid_;
-    std::vector<ProcessInfo> allProcesses_;
+    QTimer* snapshotTimer_;
+    ProcessTableModel* tableModel_;
+    ProcessFilterProxyModel* tableProxy_; // sorting and search; the view shows this
+    bool columnsSized_;
+    std::unordered_set<uint32_t> throttledPids_; // mirrors the controller, for row highlighting
+    uint64_t shownVersion_; // snapshot the table shows
+    std::vector<uint32_t> pathPids_; // last path request
+    bool allPaths_;
     static constexpr int CHECKPOINTS[] = {1, 5, 10, 25, 50, 75, 100, 250, 500};
     static constexpr int CHECKPOINT_COUNT = 9;
     static constexpr int SNAP_THRESHOLD = 5; // units threshold for snapping (increased for better usability)
@@ -0,0 +1,43 @@
+#include "ProcessFilterProxyModel.h"
+#include "ProcessTableModel.h"
+
+ProcessFilterProxyModel::ProcessFilterProxyModel(QObject* parent)
+    : QSortFilterProxyModel(parent)
+    , processModel_(nullptr)
+{
+    setSortRole(Qt::UserRole);
+    setSortCaseSensitivity(Qt::CaseInsensitive);
+    // Changed rows are re-sorted and re-filtered on their own, not the whole table
+    setDynamicSortFilter(true);
+}
+
+void ProcessFilterProxyModel::setSourceModel(QAbstractItemModel* sourceModel) {
+    processModel_ = qobject_cast<ProcessTableModel*>(sourceModel);
+    if (processModel_) {
+        processModel_->setSearchText(searchText_.toStdString());
+    }
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+}
+
+void ProcessFilterProxyModel::setSearchText(const QString& text) {
+    if (text == searchText_) {
+        return;
+    }
+    searchText_ = text;
+    if (processModel_) {
+        processModel_->setSearchText(text.toStdString());
+    }
+    invalidateFilter();
+}
+
+uint32_t ProcessFilterProxyModel::pidAt(int row) const {
+    return processModel_->pidAt(mapToSource(index(row, 0)).row());
+}
+
+bool ProcessFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const {
+    Q_UNUSED(sourceParent);
+    if (searchText_.isEmpty() || !processModel_) {
+        return true;
+    }
+    return processModel_->rows().matchesSearch(static_cast<size_t>(sourceRow));
+}
@@ -0,0 +1,34 @@
+#ifndef PROCESSFILTERPROXYMODEL_H
+#define PROCESSFILTERPROXYMODEL_H
+
+#include <QSortFilterProxyModel>
+#include <QString>
+
+class ProcessTableModel;
+
+// Sorts the process table on each column's Qt::UserRole key and filters it by a search
+// text matched, case-insensitively, against the name, the path and the PID. Matching is
+// done by the source model's search index, so a keystroke does not go through the rows'
+// strings. The source rows stay put; only this proxy's mapping changes.
+class ProcessFilterProxyModel : public QSortFilterProxyModel {
+    Q_OBJECT
+
+public:
+    explicit ProcessFilterProxyModel(QObject* parent = nullptr);
+
+    void setSourceModel(QAbstractItemModel* sourceModel) override;
+    void setSearchText(const QString& text);
+    const QString& searchText() const { return searchText_; }
+
+    // PID shown in a row of this proxy
+    uint32_t pidAt(int row) const;
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const override;
+
+private:
+    ProcessTableModel* processModel_;
+    QString searchText_;
+};
+
+#endif // PROCESSFILTERPROXYMODEL_H
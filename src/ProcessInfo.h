@@ -3,9 +3,11 @@
 
 #include <string>
 #include <cstdint>
+#include <vector>
 
 struct ProcessInfo {
     uint32_t pid;
+    uint64_t creationTime; // platform start time; (pid, creationTime) identifies a process
     std::string name;
     std::string path;
     
@@ -16,9 +18,45 @@ struct ProcessInfo {
     uint64_t totalUploaded;   // total bytes uploaded
     
     ProcessInfo(uint32_t p = 0, const std::string& n = "", const std::string& pa = "")
-        : pid(p), name(n), path(pa), downloadSpeed(0), uploadSpeed(0), 
+        : pid(p), creationTime(0), name(n), path(pa), downloadSpeed(0), uploadSpeed(0), 
           totalDownloaded(0), totalUploaded(0) {}
 };
 
+// Difference between two consecutive process snapshots. A recycled PID shows up in both
+// `removed` (old process) and `added` (new one), so apply removals before additions.
+struct ProcessDelta {
+    std::vector<ProcessInfo> added;
+    std::vector<ProcessInfo> removed;  // last known state of exited processes
+    std::vector<ProcessInfo> changed;  // same process, new image (exec) or name
+    
+    bool empty() const { return added.empty() && removed.empty() && changed.empty(); }
+    void clear() {
+        added.clear();
+        removed.clear();
+        changed.clear();
+    }
+};
+
+// One active throttle, as listed by BandwidthController::getActiveThrottles()
+struct ThrottleStatus {
+    uint32_t pid;
+    uint64_t downloadLimit; // bytes/sec, 0 = unlimited
+    uint64_t uploadLimit;
+    uint32_t treeRoot; // root of the throttle tree whose budget the process shares, or 0
+    
+    ThrottleStatus(uint32_t p = 0, uint64_t down = 0, uint64_t up = 0, uint32_t root = 0)
+        : pid(p), downloadLimit(down), uploadLimit(up), treeRoot(root) {}
+};
+
+// One entry of BandwidthController::applyThrottleBatch()
+struct ThrottleRequest {
+    uint32_t pid;
+    uint64_t downloadLimit; // bytes/sec
+    uint64_t uploadLimit;
+    
+    ThrottleRequest(uint32_t p = 0, uint64_t down = 0, uint64_t up = 0)
+        : pid(p), downloadLimit(down), uploadLimit(up) {}
+};
+
 #endif // PROCESSINFO_H
 
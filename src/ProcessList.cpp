@@ -0,0 +1,120 @@
+#include "ProcessList.h"
+
+#include <atomic>
+#include <string>
+
+ProcessInfo ProcessRecord::info() const {
+    ProcessInfo process(pid);
+    process.name.assign(name.data(), name.size());
+    process.path.assign(path.data(), path.size());
+    process.creationTime = creationTime;
+    process.downloadSpeed = downloadSpeed;
+    process.uploadSpeed = uploadSpeed;
+    process.totalDownloaded = totalDownloaded;
+    process.totalUploaded = totalUploaded;
+    return process;
+}
+
+ProcessInfo ProcessList::info(size_t index) const {
+    ProcessInfo process(pids[index]);
+    process.name.assign(names[index].data(), names[index].size());
+    process.path.assign(paths[index].data(), paths[index].size());
+    process.creationTime = creationTimes[index];
+    process.downloadSpeed = downloadSpeeds[index];
+    process.uploadSpeed = uploadSpeeds[index];
+    process.totalDownloaded = totalDownloaded[index];
+    process.totalUploaded = totalUploaded[index];
+    return process;
+}
+
+void ProcessList::clear() {
+    pids.clear();
+    creationTimes.clear();
+    names.clear();
+    paths.clear();
+    downloadSpeeds.clear();
+    uploadSpeeds.clear();
+    totalDownloaded.clear();
+    totalUploaded.clear();
+    strings.reset();
+}
+
+void ProcessList::reserve(size_t count) {
+    pids.reserve(count);
+    creationTimes.reserve(count);
+    names.reserve(count);
+    paths.reserve(count);
+    downloadSpeeds.reserve(count);
+    uploadSpeeds.reserve(count);
+    totalDownloaded.reserve(count);
+    totalUploaded.reserve(count);
+}
+
+void ProcessList::append(const ProcessRecord& process) {
+    pids.push_back(process.pid);
+    creationTimes.push_back(process.creationTime);
+    names.push_back(process.name);
+    paths.push_back(process.path);
+    downloadSpeeds.push_back(process.downloadSpeed);
+    uploadSpeeds.push_back(process.uploadSpeed);
+    totalDownloaded.push_back(process.totalDownloaded);
+    totalUploaded.push_back(process.totalUploaded);
+}
+
+void ProcessList::diff(const ProcessList& newer, ProcessDelta& delta) const {
+    delta.clear();
+    size_t i = 0;
+    size_t j = 0;
+    while (i < size() || j < newer.size()) {
+        if (j == newer.size() || (i < size() && pids[i] < newer.pids[j])) {
+            delta.removed.push_back(info(i++));
+        } else if (i == size() || newer.pids[j] < pids[i]) {
+            delta.added.push_back(newer.info(j++));
+        } else if (creationTimes[i] != newer.creationTimes[j]) {
+            // A recycled PID: the old process went away and a new one came
+            delta.removed.push_back(info(i++));
+            delta.added.push_back(newer.info(j++));
+        } else {
+            if (names[i] != newer.names[j] || paths[i] != newer.paths[j] ||
+                downloadSpeeds[i] != newer.downloadSpeeds[j] || uploadSpeeds[i] != newer.uploadSpeeds[j]) {
+                delta.changed.push_back(newer.info(j));
+            }
+            ++i;
+            ++j;
+        }
+    }
+}
+
+std::shared_ptr<const ProcessList> ProcessList::copyOf(const std::vector<ProcessInfo>& processes) {
+    StringArena arena;
+    auto list = std::make_shared<ProcessList>();
+    list->reserve(processes.size());
+    for (const ProcessInfo& info : processes) {
+        ProcessRecord process(info.pid, arena.intern(info.name));
+        process.creationTime = info.creationTime;
+        process.path = arena.intern(info.path);
+        process.downloadSpeed = info.downloadSpeed;
+        process.uploadSpeed = info.uploadSpeed;
+        process.totalDownloaded = info.totalDownloaded;
+        process.totalUploaded = info.totalUploaded;
+        list->append(process);
+    }
+    list->strings = arena.pin();
+    return list;
+}
+
+std::shared_ptr<ProcessList> ProcessListPool::acquire() {
+    for (const std::shared_ptr<ProcessList>& list : lists_) {
+        if (list.use_count() == 1) {
+            // The last reader's release of it happens before we write to it again
+            std::atomic_thread_fence(std::memory_order_acquire);
+            list->clear();
+            return list;
+        }
+    }
+    auto list = std::make_shared<ProcessList>();
+    if (lists_.size() < MAX_LISTS) {
+        lists_.push_back(list);
+    }
+    return list;
+}
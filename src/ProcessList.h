@@ -0,0 +1,84 @@
+#ifndef PROCESSLIST_H
+#define PROCESSLIST_H
+
+#include "ProcessInfo.h"
+#include "core/StringArena.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// One process as a monitor keeps it: a ProcessInfo whose name and path are interned in a
+// StringArena
+struct ProcessRecord {
+    uint32_t pid;
+    uint64_t creationTime;
+    std::string_view name;
+    std::string_view path;
+    uint64_t downloadSpeed; // bytes/sec
+    uint64_t uploadSpeed;
+    uint64_t totalDownloaded;
+    uint64_t totalUploaded;
+
+    ProcessRecord(uint32_t p = 0, std::string_view n = std::string_view())
+        : pid(p), creationTime(0), name(n), downloadSpeed(0), uploadSpeed(0), totalDownloaded(0),
+          totalUploaded(0) {}
+
+    // A copy that owns its strings
+    ProcessInfo info() const;
+};
+
+// A process list as of one moment, shared rather than copied: monitors hand out
+// shared_ptr<const ProcessList>, and nothing changes a list once it is handed out, so any
+// thread may read one for as long as it holds it.
+//
+// The columns are separate arrays (a struct of arrays), so a pass over PIDs and start
+// times, such as matching a list against table rows, reads only those. Names and paths are
+// views of strings interned in the monitor's StringArena, which persists across refreshes;
+// `strings` pins their storage, so a list stays valid after the arena moves on and costs no
+// string copies to make.
+struct ProcessList {
+    std::vector<uint32_t> pids;
+    std::vector<uint64_t> creationTimes;
+    std::vector<std::string_view> names;
+    std::vector<std::string_view> paths;
+    std::vector<uint64_t> downloadSpeeds; // bytes/sec
+    std::vector<uint64_t> uploadSpeeds;
+    std::vector<uint64_t> totalDownloaded;
+    std::vector<uint64_t> totalUploaded;
+    StringArena::Pin strings;
+
+    size_t size() const { return pids.size(); }
+    bool empty() const { return pids.empty(); }
+    ProcessInfo info(size_t index) const;
+
+    void clear();
+    void reserve(size_t count);
+    // The record's strings must be in the arena `strings` will pin
+    void append(const ProcessRecord& process);
+
+    // What changed from this list to `newer`, both sorted by PID, into `delta` (cleared
+    // first): processes added and removed, and as `changed` those whose name, path or speeds
+    // differ. One merge pass, with no lookups.
+    void diff(const ProcessList& newer, ProcessDelta& delta) const;
+
+    // A list of these processes, in this order, with strings of its own
+    static std::shared_ptr<const ProcessList> copyOf(const std::vector<ProcessInfo>& processes);
+};
+
+// Lists for one thread to fill and hand out. acquire() reuses a list once every reader has
+// let go of it, arrays and all, so a monitor that publishes a list per sample allocates
+// nothing in steady state as long as readers only hold a few at a time.
+class ProcessListPool {
+public:
+    // An empty list that no one else holds
+    std::shared_ptr<ProcessList> acquire();
+
+private:
+    static constexpr size_t MAX_LISTS = 4;
+
+    std::vector<std::shared_ptr<ProcessList>> lists_;
+};
+
+#endif // PROCESSLIST_H
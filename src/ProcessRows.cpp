@@ -0,0 +1,347 @@
+#include "ProcessRows.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr uint32_t ALL_COLUMNS = (1u << ProcessRows::COLUMN_COUNT) - 1;
+
+uint32_t columnBit(ProcessRows::Column column) {
+    return 1u << column;
+}
+
+// Columns whose shown value differs from entry `i`; totals are not shown
+uint32_t changedColumns(const ProcessRows::Row& row, const ProcessList& processes, size_t i, bool throttled) {
+    if (row.throttled != throttled) {
+        return ALL_COLUMNS; // the whole row is tinted
+    }
+    uint32_t columns = 0;
+    if (row.info.name != processes.names[i]) {
+        columns |= columnBit(ProcessRows::NameColumn);
+    }
+    if (row.info.path != processes.paths[i]) {
+        columns |= columnBit(ProcessRows::PathColumn);
+    }
+    if (row.info.downloadSpeed != processes.downloadSpeeds[i]) {
+        columns |= columnBit(ProcessRows::DownloadColumn);
+    }
+    if (row.info.uploadSpeed != processes.uploadSpeeds[i]) {
+        columns |= columnBit(ProcessRows::UploadColumn);
+    }
+    return columns;
+}
+
+uint32_t changedColumns(const ProcessRows::Row& row, const ProcessInfo& process) {
+    uint32_t columns = 0;
+    if (row.info.name != process.name) {
+        columns |= columnBit(ProcessRows::NameColumn);
+    }
+    if (row.info.path != process.path) {
+        columns |= columnBit(ProcessRows::PathColumn);
+    }
+    if (row.info.downloadSpeed != process.downloadSpeed) {
+        columns |= columnBit(ProcessRows::DownloadColumn);
+    }
+    if (row.info.uploadSpeed != process.uploadSpeed) {
+        columns |= columnBit(ProcessRows::UploadColumn);
+    }
+    return columns;
+}
+
+} // namespace
+
+// An empty list is version 0, like a sampler's snapshot before the first scan
+ProcessRows::ProcessRows() : gapStart_(0), gapEnd_(0), version_(0), nextSearchKey_(0) {}
+
+size_t ProcessRows::setSearch(const std::string& text) {
+    return search_.search(text);
+}
+
+void ProcessRows::indexRow(size_t position) {
+    const ProcessInfo& info = rows_[position].info;
+    fields_[0] = info.name;
+    fields_[1] = info.path;
+    fields_[2] = std::to_string(info.pid);
+    search_.set(searchKeys_[position], fields_, 3);
+}
+
+long ProcessRows::rowOf(uint32_t pid) const {
+    auto it = index_.find(pid);
+    return it == index_.end() ? -1 : static_cast<long>(it->second);
+}
+
+ProcessRows::UpdateStats ProcessRows::update(const ProcessList& processes, const std::unordered_set<uint32_t>& throttled,
+                                             Observer* observer) {
+    UpdateStats stats = {};
+    version_ = NO_VERSION;
+    throttled_ = throttled;
+
+    // Rows whose process is still there (same PID and start time) stay; the rest go first,
+    // so the surviving rows are renumbered once before anything is added
+    matched_.assign(processes.size(), NO_ROW);
+    keep_.assign(rows_.size(), 0);
+    for (size_t i = 0; i < processes.size(); ++i) {
+        auto it = index_.find(processes.pids[i]);
+        if (it != index_.end() && rows_[it->second].info.creationTime == processes.creationTimes[i]) {
+            matched_[i] = it->second;
+            keep_[it->second] = 1;
+        }
+    }
+    const size_t before = rows_.size();
+    removeRows(observer);
+    stats.removed = before - rows_.size();
+
+    changed_.clear();
+    added_.clear();
+    for (size_t i = 0; i < processes.size(); ++i) {
+        if (matched_[i] == NO_ROW) {
+            added_.push_back(i);
+            continue;
+        }
+        const size_t index = stats.removed != 0 ? renumbered_[matched_[i]] : matched_[i];
+        Row& row = rows_[index];
+        const bool isThrottled = throttled.count(processes.pids[i]) != 0;
+        const uint32_t columns = changedColumns(row, processes, i, isThrottled);
+        // Strings are copied only when they changed
+        if (columns & columnBit(NameColumn)) {
+            row.info.name = processes.names[i];
+        }
+        if (columns & columnBit(PathColumn)) {
+            row.info.path = processes.paths[i];
+        }
+        row.info.downloadSpeed = processes.downloadSpeeds[i];
+        row.info.uploadSpeed = processes.uploadSpeeds[i];
+        row.info.totalDownloaded = processes.totalDownloaded[i];
+        row.info.totalUploaded = processes.totalUploaded[i];
+        row.throttled = isThrottled;
+        if (columns & (columnBit(NameColumn) | columnBit(PathColumn))) {
+            indexRow(index); // before the change is reported, so a filter sees it
+        }
+        if (columns != 0) {
+            changed_.push_back(Pending{index, columns});
+        }
+    }
+    stats.changed = changed_.size();
+    reportChanges(observer);
+
+    if (!added_.empty()) {
+        const size_t first = rows_.size();
+        if (observer) {
+            observer->beforeInsert(first, first + added_.size() - 1);
+        }
+        rows_.reserve(first + added_.size());
+        for (size_t i : added_) {
+            appendRow(processes.info(i), throttled.count(processes.pids[i]) != 0);
+        }
+        if (observer) {
+            observer->afterInsert();
+        }
+        stats.inserted = added_.size();
+    }
+    return stats;
+}
+
+ProcessRows::UpdateStats ProcessRows::update(const ProcessList& processes, uint64_t version, const ProcessDelta* delta,
+                                             uint64_t deltaBase, const std::unordered_set<uint32_t>& throttled,
+                                             Observer* observer) {
+    const UpdateStats stats = delta && version_ != NO_VERSION && deltaBase == version_
+                                  ? applyDelta(*delta, throttled, observer)
+                                  : update(processes, throttled, observer);
+    version_ = version;
+    return stats;
+}
+
+ProcessRows::UpdateStats ProcessRows::applyDelta(const ProcessDelta& delta,
+                                                 const std::unordered_set<uint32_t>& throttled, Observer* observer) {
+    UpdateStats stats = {};
+    if (!delta.removed.empty()) {
+        keep_.assign(rows_.size(), 1);
+        for (const ProcessInfo& process : delta.removed) {
+            auto it = index_.find(process.pid);
+            if (it != index_.end() && rows_[it->second].info.creationTime == process.creationTime) {
+                keep_[it->second] = 0;
+            }
+        }
+        const size_t before = rows_.size();
+        removeRows(observer);
+        stats.removed = before - rows_.size();
+    }
+
+    changed_.clear();
+    for (const ProcessInfo& process : delta.changed) {
+        auto it = index_.find(process.pid);
+        if (it == index_.end() || rows_[it->second].info.creationTime != process.creationTime) {
+            continue;
+        }
+        Row& row = rows_[it->second];
+        const uint32_t columns = changedColumns(row, process);
+        if (columns & columnBit(NameColumn)) {
+            row.info.name = process.name;
+        }
+        if (columns & columnBit(PathColumn)) {
+            row.info.path = process.path;
+        }
+        row.info.downloadSpeed = process.downloadSpeed;
+        row.info.uploadSpeed = process.uploadSpeed;
+        row.info.totalDownloaded = process.totalDownloaded;
+        row.info.totalUploaded = process.totalUploaded;
+        if (columns & (columnBit(NameColumn) | columnBit(PathColumn))) {
+            indexRow(it->second);
+        }
+        if (columns != 0) {
+            changed_.push_back(Pending{it->second, columns});
+        }
+    }
+    // Throttles started or stopped since the last update retint their rows
+    auto retint = [this](uint32_t pid, bool isThrottled) {
+        auto it = index_.find(pid);
+        if (it != index_.end() && rows_[it->second].throttled != isThrottled) {
+            rows_[it->second].throttled = isThrottled;
+            changed_.push_back(Pending{it->second, ALL_COLUMNS});
+        }
+    };
+    for (uint32_t pid : throttled) {
+        if (throttled_.count(pid) == 0) {
+            retint(pid, true);
+        }
+    }
+    for (uint32_t pid : throttled_) {
+        if (throttled.count(pid) == 0) {
+            retint(pid, false);
+        }
+    }
+    throttled_ = throttled;
+    sortChanges();
+    stats.changed = changed_.size();
+    reportChanges(observer);
+
+    if (!delta.added.empty()) {
+        const size_t first = rows_.size();
+        if (observer) {
+            observer->beforeInsert(first, first + delta.added.size() - 1);
+        }
+        rows_.reserve(first + delta.added.size());
+        for (const ProcessInfo& process : delta.added) {
+            appendRow(process, throttled.count(process.pid) != 0);
+        }
+        if (observer) {
+            observer->afterInsert();
+        }
+        stats.inserted = delta.added.size();
+    }
+    return stats;
+}
+
+void ProcessRows::appendRow(ProcessInfo info, bool throttled) {
+    index_[info.pid] = rows_.size();
+    uint32_t searchKey = nextSearchKey_;
+    if (freeSearchKeys_.empty()) {
+        ++nextSearchKey_;
+    } else {
+        searchKey = freeSearchKeys_.back();
+        freeSearchKeys_.pop_back();
+    }
+    rows_.push_back(Row{std::move(info), throttled});
+    searchKeys_.push_back(searchKey);
+    indexRow(rows_.size() - 1);
+}
+
+void ProcessRows::removeRows(Observer* observer) {
+    const size_t count = rows_.size();
+    size_t first = 0;
+    while (first < count && keep_[first]) {
+        ++first;
+    }
+    if (first == count) {
+        return;
+    }
+    renumbered_.resize(count);
+    for (size_t i = 0; i < first; ++i) {
+        renumbered_[i] = i;
+    }
+
+    // Runs are removed lowest first. Kept rows move down across the gap as it is reached,
+    // which leaves every row's index as seen from outside unchanged, so each removal only
+    // has to announce the run itself and the whole pass moves each row at most once.
+    gapStart_ = first;
+    gapEnd_ = first;
+    size_t next = first;
+    while (next < count) {
+        if (keep_[next]) {
+            const uint32_t pid = rows_[next].info.pid;
+            rows_[gapStart_] = std::move(rows_[next]);
+            searchKeys_[gapStart_] = searchKeys_[next];
+            index_[pid] = gapStart_;
+            renumbered_[next] = gapStart_;
+            ++gapStart_;
+            gapEnd_ = ++next;
+            continue;
+        }
+        size_t end = next;
+        while (end < count && !keep_[end]) {
+            ++end;
+        }
+        if (observer) {
+            observer->beforeRemove(gapStart_, gapStart_ + (end - next) - 1);
+        }
+        for (size_t i = next; i < end; ++i) {
+            // A recycled PID keeps its entry only if the row is its current process
+            auto it = index_.find(rows_[i].info.pid);
+            if (it != index_.end() && it->second == i) {
+                index_.erase(it);
+            }
+            search_.remove(searchKeys_[i]);
+            freeSearchKeys_.push_back(searchKeys_[i]);
+        }
+        gapEnd_ = end;
+        if (observer) {
+            observer->afterRemove();
+        }
+        next = end;
+    }
+    rows_.erase(rows_.begin() + gapStart_, rows_.end());
+    searchKeys_.resize(gapStart_);
+    gapStart_ = 0;
+    gapEnd_ = 0;
+}
+
+void ProcessRows::sortChanges() {
+    std::sort(changed_.begin(), changed_.end(), [](const Pending& a, const Pending& b) { return a.row < b.row; });
+    // A row can be both changed and retinted; it is reported once
+    size_t kept = 0;
+    for (size_t i = 0; i < changed_.size(); ++i) {
+        if (kept != 0 && changed_[kept - 1].row == changed_[i].row) {
+            changed_[kept - 1].columns |= changed_[i].columns;
+        } else {
+            changed_[kept++] = changed_[i];
+        }
+    }
+    changed_.resize(kept);
+}
+
+void ProcessRows::reportChanges(Observer* observer) {
+    if (!observer || changed_.empty()) {
+        return;
+    }
+    std::sort(changed_.begin(), changed_.end(), [](const Pending& a, const Pending& b) { return a.row < b.row; });
+    // Adjacent rows go out as one range over the union of their changed columns
+    size_t first = 0;
+    while (first < changed_.size()) {
+        size_t last = first;
+        uint32_t columns = changed_[first].columns;
+        while (last + 1 < changed_.size() && changed_[last + 1].row == changed_[last].row + 1) {
+            ++last;
+            columns |= changed_[last].columns;
+        }
+        int firstColumn = 0;
+        while (!(columns & (1u << firstColumn))) {
+            ++firstColumn;
+        }
+        int lastColumn = COLUMN_COUNT - 1;
+        while (!(columns & (1u << lastColumn))) {
+            --lastColumn;
+        }
+        observer->rowsChanged(changed_[first].row, changed_[last].row, firstColumn, lastColumn);
+        first = last + 1;
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef PROCESSROWS_H
+#define PROCESSROWS_H
+
+#include "ProcessInfo.h"
+#include "ProcessList.h"
+#include "core/SearchIndex.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Rows of the process table, kept stable across refreshes.
+//
+// Each process keeps its row for as long as it lives (identified by PID and start time, so
+// a recycled PID is a removal plus an insertion). update() brings the rows in line with a
+// new snapshot and reports only what happened to them through an Observer: contiguous runs
+// of removed rows (highest first), one run of appended rows, and runs of rows whose shown
+// values changed, with the columns affected. A view model forwards these as its row and
+// data change signals, so views keep selection and scroll position and redraw only what
+// changed. Given the delta a ProcessSnapshot carries, an update touches only the rows it
+// names instead of matching the whole list. The rows' names, paths and PIDs are kept in a
+// SearchIndex, so a search text is matched against them without touching the rows. No Qt
+// dependency.
+class ProcessRows {
+public:
+    enum Column { PidColumn, NameColumn, DownloadColumn, UploadColumn, PathColumn, COLUMN_COUNT };
+
+    struct Row {
+        ProcessInfo info;
+        bool throttled;
+    };
+
+    // Each begin/end pair brackets one change to the rows
+    class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void beforeRemove(size_t first, size_t last) = 0;
+        virtual void afterRemove() = 0;
+        virtual void beforeInsert(size_t first, size_t last) = 0;
+        virtual void afterInsert() = 0;
+        virtual void rowsChanged(size_t first, size_t last, int firstColumn, int lastColumn) = 0;
+    };
+
+    struct UpdateStats {
+        size_t removed;
+        size_t inserted;
+        size_t changed; // rows with a shown value changed
+    };
+
+    ProcessRows();
+
+    // Makes the rows match the processes (any order); observer may be null. Rows copy a
+    // process's strings when it is added and when they change, and nothing else of the list.
+    UpdateStats update(const ProcessList& processes, const std::unordered_set<uint32_t>& throttled,
+                       Observer* observer);
+    // Same for the list of a given version. When `delta` leads from the version the rows
+    // last matched (deltaBase), only the processes it names and those whose throttled state
+    // changed are looked at; otherwise the whole list is matched. delta may be null.
+    UpdateStats update(const ProcessList& processes, uint64_t version, const ProcessDelta* delta,
+                       uint64_t deltaBase, const std::unordered_set<uint32_t>& throttled, Observer* observer);
+
+    size_t size() const { return rows_.size() - (gapEnd_ - gapStart_); }
+    const Row& row(size_t index) const { return rows_[slot(index)]; }
+    // Row of a PID, or -1
+    long rowOf(uint32_t pid) const;
+
+    // Case-insensitive match of the name, path or PID; rows added or changed later are
+    // matched as they come. An empty text matches every row. Returns the matching rows.
+    size_t setSearch(const std::string& text);
+    bool matchesSearch(size_t index) const { return search_.matches(searchKeys_[slot(index)]); }
+
+private:
+    struct Pending {
+        size_t row;
+        uint32_t columns; // bit per Column
+    };
+
+    static constexpr size_t NO_ROW = SIZE_MAX;
+    static constexpr uint64_t NO_VERSION = UINT64_MAX;
+
+    size_t slot(size_t index) const { return index < gapStart_ ? index : index + gapEnd_ - gapStart_; }
+    UpdateStats applyDelta(const ProcessDelta& delta, const std::unordered_set<uint32_t>& throttled,
+                           Observer* observer);
+    void removeRows(Observer* observer);
+    void appendRow(ProcessInfo info, bool throttled);
+    void sortChanges(); // by row, one entry per row
+    void reportChanges(Observer* observer);
+    void indexRow(size_t position); // position in rows_
+
+    // Removed rows are compacted away in one pass; while that runs, the rows seen through
+    // row() and size() skip the gap [gapStart_, gapEnd_) of rows already dropped or moved
+    std::vector<Row> rows_;
+    size_t gapStart_;
+    size_t gapEnd_;
+    std::unordered_map<uint32_t, size_t> index_; // PID -> row
+    uint64_t version_; // of the list the rows match, or NO_VERSION if unknown
+    std::unordered_set<uint32_t> throttled_; // as of the last update
+    // Each row's document in the search index, by slot of rows_ so that a filter pass
+    // does not walk the rows themselves. Keys are reused once free, which keeps them dense.
+    SearchIndex search_;
+    std::vector<uint32_t> searchKeys_;
+    std::vector<uint32_t> freeSearchKeys_;
+    uint32_t nextSearchKey_;
+    std::string fields_[3]; // reused by indexRow()
+    // Per update, reused: snapshot entry -> its row, which rows stay, row renumbering,
+    // snapshot entries that are new
+    std::vector<size_t> matched_;
+    std::vector<uint8_t> keep_;
+    std::vector<size_t> renumbered_;
+    std::vector<size_t> added_;
+    std::vector<Pending> changed_;
+};
+
+#endif // PROCESSROWS_H
@@ -0,0 +1,182 @@
+#include "ProcessSampler.h"
+#include "core/MonotonicClock.h"
+#ifdef _WIN32
+#include "platform/windows/ProcessMonitor.h"
+#else
+#include "platform/linux/ProcessMonitor.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+
+bool ProcessSnapshot::findTraffic(uint32_t pid, TrafficAccountant::ProcessTraffic& result) const {
+    auto it = std::lower_bound(traffic.begin(), traffic.end(), pid,
+                               [](const std::pair<uint32_t, TrafficAccountant::ProcessTraffic>& entry,
+                                  uint32_t key) { return entry.first < key; });
+    if (it == traffic.end() || it->first != pid) {
+        return false;
+    }
+    result = it->second;
+    return true;
+}
+
+ProcessSampler::ProcessSampler(ProcessMonitor& monitor, const Config& config)
+    : monitor_(monitor), config_(config), takenVersion_(0), stopping_(false), refreshRequested_(false),
+      pathsRequested_(false), allPaths_(false), version_(0), wantAllPaths_(false) {
+    bases_.emplace_back(0, snapshots_.front().processes);
+}
+
+ProcessSampler::~ProcessSampler() {
+    stop();
+}
+
+bool ProcessSampler::start() {
+    if (isRunning()) {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = false;
+    }
+    worker_ = std::thread(&ProcessSampler::run, this);
+    return true;
+}
+
+void ProcessSampler::stop() {
+    if (!isRunning()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    worker_.join();
+}
+
+void ProcessSampler::requestRefresh() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        refreshRequested_ = true;
+    }
+    wake_.notify_one();
+}
+
+void ProcessSampler::setWatchedPids(std::vector<uint32_t> pids) {
+    std::sort(pids.begin(), pids.end());
+    pids.erase(std::unique(pids.begin(), pids.end()), pids.end());
+    std::lock_guard<std::mutex> lock(mutex_);
+    watchedPids_.swap(pids);
+}
+
+void ProcessSampler::setWantedPaths(std::vector<uint32_t> pids, bool all) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pathPids_.swap(pids);
+        allPaths_ = all;
+        pathsRequested_ = true;
+    }
+    wake_.notify_one();
+}
+
+const ProcessSnapshot& ProcessSampler::latest() {
+    if (snapshots_.update()) {
+        takenVersion_.store(snapshots_.front().version, std::memory_order_relaxed);
+    }
+    return snapshots_.front();
+}
+
+void ProcessSampler::run() {
+    uint64_t nextRefreshNs = 0; // scan at once
+    uint64_t nextStatsNs = 0;
+    for (;;) {
+        bool refresh;
+        bool resolve;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            const uint64_t dueNs = std::min(nextRefreshNs, nextStatsNs);
+            const uint64_t nowNs = MonotonicClock::nowNs();
+            if (dueNs > nowNs) {
+                wake_.wait_for(lock, std::chrono::nanoseconds(dueNs - nowNs),
+                               [this]() { return stopping_ || refreshRequested_ || pathsRequested_; });
+            }
+            if (stopping_) {
+                return;
+            }
+            refresh = refreshRequested_ || MonotonicClock::nowNs() >= nextRefreshNs;
+            refreshRequested_ = false;
+            resolve = refresh || pathsRequested_;
+            if (pathsRequested_) {
+                wantedPaths_ = pathPids_;
+                wantAllPaths_ = allPaths_;
+                pathsRequested_ = false;
+            }
+            watched_ = watchedPids_;
+        }
+
+        const uint64_t nowNs = MonotonicClock::nowNs();
+        bool changed = version_ == 0;
+        if (refresh) {
+            monitor_.refresh(delta_);
+            changed = changed || !delta_.empty();
+            nextRefreshNs = nowNs + config_.refreshIntervalNs;
+        }
+        if (resolve) {
+            // New processes come without paths; look up the ones that are wanted
+            const size_t resolved = wantAllPaths_ ? monitor_.resolveAllPaths() : monitor_.resolvePaths(wantedPaths_);
+            changed = changed || resolved != 0;
+        }
+        if (changed) {
+            // Published before the network sample, so the list never waits for it
+            publish(nowNs);
+        }
+        if (nowNs >= nextStatsNs) {
+            const uint64_t samples = monitor_.sampleCount();
+            monitor_.updateNetworkStats();
+            if (monitor_.sampleCount() != samples) {
+                publish(MonotonicClock::nowNs());
+            }
+            nextStatsNs = nowNs + config_.statsIntervalNs;
+        }
+    }
+}
+
+void ProcessSampler::publish(uint64_t nowNs) {
+    // The slot holds an older snapshot; overwriting in place reuses its buffers
+    ProcessSnapshot& snapshot = snapshots_.back();
+    snapshot.version = ++version_;
+    snapshot.sampledAtNs = nowNs;
+    // Let go of the slot's old list first, so the monitor can reuse its arrays
+    snapshot.processes.reset();
+    snapshot.processes = monitor_.getRunningProcesses();
+    snapshot.traffic.clear();
+    for (uint32_t pid : watched_) {
+        TrafficAccountant::ProcessTraffic traffic;
+        if (monitor_.getTraffic(pid, traffic)) {
+            snapshot.traffic.emplace_back(pid, traffic);
+        }
+    }
+
+    // The delta leads from the reader's list. If the reader took a newer snapshot after
+    // this load, its version does not match deltaBase and it compares the whole list.
+    const uint64_t taken = takenVersion_.load(std::memory_order_relaxed);
+    auto base = std::find_if(bases_.begin(), bases_.end(),
+                             [taken](const std::pair<uint64_t, std::shared_ptr<const ProcessList>>& entry) {
+                                 return entry.first == taken;
+                             });
+    snapshot.hasDelta = base != bases_.end();
+    snapshot.deltaBase = taken;
+    if (snapshot.hasDelta) {
+        base->second->diff(*snapshot.processes, snapshot.delta);
+    } else {
+        snapshot.delta.clear();
+    }
+    // Anything older than the newest published list is overwritten before the reader gets it
+    bases_.erase(std::remove_if(bases_.begin(), bases_.end(),
+                                [taken, this](const std::pair<uint64_t, std::shared_ptr<const ProcessList>>& entry) {
+                                    return entry.first != taken && entry.first + 1 != version_;
+                                }),
+                 bases_.end());
+    bases_.emplace_back(version_, snapshot.processes);
+    snapshots_.publish();
+}
@@ -0,0 +1,118 @@
+#ifndef PROCESSSAMPLER_H
+#define PROCESSSAMPLER_H
+
+#include "ProcessInfo.h"
+#include "ProcessList.h"
+#include "core/TrafficAccountant.h"
+#include "core/TripleBuffer.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class ProcessMonitor;
+
+// What the sampler knew at one point: the process list and the traffic of the PIDs asked for
+struct ProcessSnapshot {
+    uint64_t version;     // increases with every publication; 0 until the first one
+    uint64_t sampledAtNs; // MonotonicClock time the snapshot was taken
+    std::shared_ptr<const ProcessList> processes; // sorted by PID; shared with the monitor, never null
+    std::vector<std::pair<uint32_t, TrafficAccountant::ProcessTraffic>> traffic; // watched PIDs, sorted by PID
+    // When hasDelta, how `processes` differs from the list of version deltaBase (see
+    // ProcessList::diff), which is the snapshot the reader took before unless it took a
+    // newer one in the meantime. A reader showing deltaBase applies just this.
+    bool hasDelta;
+    uint64_t deltaBase;
+    ProcessDelta delta;
+
+    ProcessSnapshot()
+        : version(0), sampledAtNs(0), processes(std::make_shared<const ProcessList>()), hasDelta(false),
+          deltaBase(0) {}
+
+    // Traffic of a watched PID; false if it was not watched or had no connections
+    bool findTraffic(uint32_t pid, TrafficAccountant::ProcessTraffic& result) const;
+};
+
+// Runs ProcessMonitor on a worker thread and hands its results to one reader thread.
+//
+// The worker rescans processes every refreshIntervalNs (or at once on requestRefresh()) and
+// samples network statistics every statsIntervalNs, which the monitor further paces within
+// its CPU budget. Scans leave executable paths out; the worker resolves them for the PIDs
+// set with setWantedPaths() (the rows on screen, say), or for every process while all are
+// wanted (a search), as soon as they are asked for and after each rescan. Whenever any of
+// this changed something it fills a ProcessSnapshot, which shares the monitor's immutable
+// ProcessList rather than copying it, together with its difference from the list the
+// reader took last, and publishes it through a TripleBuffer, so the reader never waits for
+// a scan and the worker never waits for the reader. While the sampler runs the monitor
+// belongs to the worker; nothing else may call it until stop() returns.
+//
+// latest() and current() belong to the reader thread (the GUI thread); the snapshot they
+// return stays unchanged until that thread calls latest() again. The other calls may come
+// from any thread.
+class ProcessSampler {
+public:
+    struct Config {
+        uint64_t refreshIntervalNs;
+        uint64_t statsIntervalNs;
+
+        Config(uint64_t refreshInterval = 5000000000ULL, uint64_t statsInterval = 500000000ULL)
+            : refreshIntervalNs(refreshInterval), statsIntervalNs(statsInterval) {}
+    };
+
+    explicit ProcessSampler(ProcessMonitor& monitor, const Config& config = Config());
+    ~ProcessSampler();
+
+    ProcessSampler(const ProcessSampler&) = delete;
+    ProcessSampler& operator=(const ProcessSampler&) = delete;
+
+    // The first snapshot follows the first scan, which start() does not wait for
+    bool start();
+    void stop();
+    bool isRunning() const { return worker_.joinable(); }
+
+    // Rescans at once instead of at the next interval
+    void requestRefresh();
+    // PIDs whose traffic (RTTs included) goes into snapshots
+    void setWatchedPids(std::vector<uint32_t> pids);
+    // PIDs whose executable paths snapshots should have; all of them if `all`
+    void setWantedPaths(std::vector<uint32_t> pids, bool all);
+
+    // Takes the newest publication, if any, and returns it
+    const ProcessSnapshot& latest();
+    // The snapshot the last latest() returned
+    const ProcessSnapshot& current() const { return snapshots_.front(); }
+
+private:
+    void run();
+    void publish(uint64_t nowNs);
+
+    ProcessMonitor& monitor_;
+    Config config_;
+    std::thread worker_;
+    TripleBuffer<ProcessSnapshot> snapshots_;
+    std::atomic<uint64_t> takenVersion_; // version of the reader's snapshot
+
+    std::mutex mutex_; // guards the fields below and wakes the worker
+    std::condition_variable wake_;
+    bool stopping_;
+    bool refreshRequested_;
+    bool pathsRequested_;
+    std::vector<uint32_t> watchedPids_; // sorted
+    std::vector<uint32_t> pathPids_;
+    bool allPaths_;
+
+    // Worker's own
+    uint64_t version_;
+    std::vector<uint32_t> watched_;
+    std::vector<uint32_t> wantedPaths_;
+    bool wantAllPaths_;
+    ProcessDelta delta_;
+    // Lists a delta may lead from: the reader's and the newest published, which it may take next
+    std::vector<std::pair<uint64_t, std::shared_ptr<const ProcessList>>> bases_;
+};
+
+#endif // PROCESSSAMPLER_H
@@ -0,0 +1,111 @@
+#include "ProcessTableModel.h"
+#include "BandwidthController.h"
+
+#include <QColor>
+
+namespace {
+
+const char* const HEADERS[ProcessRows::COLUMN_COUNT] = {
+    "PID", "Process Name", "Download Speed", "Upload Speed", "Path"
+};
+
+// Throttled processes are tinted so they stand out among thousands of rows
+const QColor THROTTLED_BACKGROUND(0xd4, 0xed, 0xda);
+
+} // namespace
+
+ProcessTableModel::ProcessTableModel(QObject* parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+void ProcessTableModel::update(const ProcessList& processes, const std::unordered_set<uint32_t>& throttled) {
+    rows_.update(processes, throttled, this);
+}
+
+void ProcessTableModel::update(const ProcessSnapshot& snapshot, const std::unordered_set<uint32_t>& throttled) {
+    rows_.update(*snapshot.processes, snapshot.version, snapshot.hasDelta ? &snapshot.delta : nullptr,
+                 snapshot.deltaBase, throttled, this);
+}
+
+int ProcessTableModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : static_cast<int>(rows_.size());
+}
+
+int ProcessTableModel::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : ProcessRows::COLUMN_COUNT;
+}
+
+QVariant ProcessTableModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return QVariant();
+    }
+    const ProcessRows::Row& row = rows_.row(static_cast<size_t>(index.row()));
+    const ProcessInfo& process = row.info;
+    switch (role) {
+    case Qt::DisplayRole:
+        switch (index.column()) {
+        case ProcessRows::PidColumn:
+            return QString::number(process.pid);
+        case ProcessRows::NameColumn:
+            return QString::fromStdString(process.name);
+        case ProcessRows::DownloadColumn:
+            return QString::fromStdString(BandwidthController::formatBandwidth(process.downloadSpeed));
+        case ProcessRows::UploadColumn:
+            return QString::fromStdString(BandwidthController::formatBandwidth(process.uploadSpeed));
+        case ProcessRows::PathColumn:
+            return QString::fromStdString(process.path);
+        }
+        break;
+    case Qt::UserRole:
+        switch (index.column()) {
+        case ProcessRows::PidColumn:
+            return static_cast<qulonglong>(process.pid);
+        case ProcessRows::DownloadColumn:
+            return static_cast<qulonglong>(process.downloadSpeed);
+        case ProcessRows::UploadColumn:
+            return static_cast<qulonglong>(process.uploadSpeed);
+        default:
+            return data(index, Qt::DisplayRole);
+        }
+    case Qt::TextAlignmentRole:
+        if (index.column() == ProcessRows::DownloadColumn || index.column() == ProcessRows::UploadColumn) {
+            return int(Qt::AlignRight | Qt::AlignVCenter);
+        }
+        break;
+    case Qt::BackgroundRole:
+        if (row.throttled) {
+            return THROTTLED_BACKGROUND;
+        }
+        break;
+    }
+    return QVariant();
+}
+
+QVariant ProcessTableModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole && section >= 0 &&
+        section < ProcessRows::COLUMN_COUNT) {
+        return QString(HEADERS[section]);
+    }
+    return QAbstractTableModel::headerData(section, orientation, role);
+}
+
+void ProcessTableModel::beforeRemove(size_t first, size_t last) {
+    beginRemoveRows(QModelIndex(), static_cast<int>(first), static_cast<int>(last));
+}
+
+void ProcessTableModel::afterRemove() {
+    endRemoveRows();
+}
+
+void ProcessTableModel::beforeInsert(size_t first, size_t last) {
+    beginInsertRows(QModelIndex(), static_cast<int>(first), static_cast<int>(last));
+}
+
+void ProcessTableModel::afterInsert() {
+    endInsertRows();
+}
+
+void ProcessTableModel::rowsChanged(size_t first, size_t last, int firstColumn, int lastColumn) {
+    emit dataChanged(index(static_cast<int>(first), firstColumn), index(static_cast<int>(last), lastColumn));
+}
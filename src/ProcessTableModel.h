@@ -0,0 +1,44 @@
+#ifndef PROCESSTABLEMODEL_H
+#define PROCESSTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <unordered_set>
+#include <vector>
+#include "ProcessRows.h"
+#include "ProcessSampler.h"
+
+// Process table as a Qt model over ProcessRows. Rows are stable per process; an update
+// signals only the rows inserted, removed or changed, and cell text is formatted when a
+// view asks for it, i.e. only for visible rows. Qt::UserRole holds the sort key: numbers
+// for the PID and speed columns, text otherwise.
+class ProcessTableModel : public QAbstractTableModel, private ProcessRows::Observer {
+    Q_OBJECT
+
+public:
+    explicit ProcessTableModel(QObject* parent = nullptr);
+
+    void update(const ProcessList& processes, const std::unordered_set<uint32_t>& throttled);
+    // Applies the snapshot's delta when it follows the snapshot shown last
+    void update(const ProcessSnapshot& snapshot, const std::unordered_set<uint32_t>& throttled);
+    // Search text the rows are matched against (see ProcessRows::matchesSearch)
+    void setSearchText(const std::string& text) { rows_.setSearch(text); }
+
+    const ProcessRows& rows() const { return rows_; }
+    uint32_t pidAt(int row) const { return rows_.row(static_cast<size_t>(row)).info.pid; }
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    void beforeRemove(size_t first, size_t last) override;
+    void afterRemove() override;
+    void beforeInsert(size_t first, size_t last) override;
+    void afterInsert() override;
+    void rowsChanged(size_t first, size_t last, int firstColumn, int lastColumn) override;
+
+    ProcessRows rows_;
+};
+
+#endif // PROCESSTABLEMODEL_H
@@ -0,0 +1,110 @@
+#include "BandwidthController.h"
+#include "platform/linux/NetworkThrottler.h"
+#include "platform/linux/ShapingProxy.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+ShapingProxy* runningProxy = nullptr;
+
+void onSignal(int) {
+    if (runningProxy) {
+        runningProxy->stop();
+    }
+}
+
+// "host:port" or "[v6]:port"
+bool splitEndpoint(const std::string& endpoint, std::string& host, uint16_t& port) {
+    const size_t colon = endpoint.rfind(':');
+    if (colon == std::string::npos || colon + 1 == endpoint.size()) {
+        return false;
+    }
+    host = endpoint.substr(0, colon);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    const long value = std::strtol(endpoint.c_str() + colon + 1, nullptr, 10);
+    if (value < 0 || value > 65535) {
+        return false;
+    }
+    port = static_cast<uint16_t>(value);
+    return true;
+}
+
+void usage(const char* program) {
+    std::fprintf(stderr,
+                 "Usage: %s [options]\n"
+                 "  --listen ADDR:PORT      listen address (default 127.0.0.1:1080)\n"
+                 "  --forward HOST:PORT     forward every connection to HOST:PORT instead of\n"
+                 "                          acting as a SOCKS5 proxy\n"
+                 "  --client-limit DOWN UP  limits for each client process, e.g. 1MB 256KB\n"
+                 "  --limit PID DOWN UP     limits for one process (may be repeated)\n",
+                 program);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    NetworkThrottler throttler;
+    ShapingProxy::Config config;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (option == "--listen" && i + 1 < argc) {
+            if (!splitEndpoint(argv[++i], config.listenAddress, config.listenPort)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (option == "--forward" && i + 1 < argc) {
+            config.mode = ShapingProxy::Mode::Forward;
+            if (!splitEndpoint(argv[++i], config.upstreamAddress, config.upstreamPort)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (option == "--client-limit" && i + 2 < argc) {
+            config.clientDownloadLimit = BandwidthController::parseBandwidthString(argv[++i]);
+            config.clientUploadLimit = BandwidthController::parseBandwidthString(argv[++i]);
+        } else if (option == "--limit" && i + 3 < argc) {
+            const uint32_t pid = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            const uint64_t download = BandwidthController::parseBandwidthString(argv[++i]);
+            const uint64_t upload = BandwidthController::parseBandwidthString(argv[++i]);
+            if (!throttler.startThrottling(pid, download, upload)) {
+                std::fprintf(stderr, "cannot throttle process %u\n", pid);
+                return 1;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    ShapingProxy proxy(throttler, config);
+    if (!proxy.start()) {
+        std::fprintf(stderr, "cannot listen on %s:%u: %s\n", config.listenAddress.c_str(),
+                     config.listenPort, std::strerror(errno));
+        return 1;
+    }
+    std::printf("%s proxy listening on %s:%u\n",
+                config.mode == ShapingProxy::Mode::Socks5 ? "SOCKS5" : "Forwarding",
+                config.listenAddress.c_str(), proxy.port());
+    std::fflush(stdout);
+
+    runningProxy = &proxy;
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    const bool ok = proxy.run();
+    runningProxy = nullptr;
+
+    const ShapingProxy::Stats stats = proxy.stats();
+    std::printf("%llu connections (%llu identified), %.2f MB uploaded, %.2f MB downloaded\n",
+                static_cast<unsigned long long>(stats.connections),
+                static_cast<unsigned long long>(stats.identifiedClients),
+                stats.bytesUploaded / (1024.0 * 1024.0), stats.bytesDownloaded / (1024.0 * 1024.0));
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,379 @@
+#include "BandwidthController.h"
+#include "core/MonotonicClock.h"
+#include "core/TrafficShaper.h"
+#include "sim/PacketClassifier.h"
+#include "sim/PcapReader.h"
+#include "sim/TrafficSimulator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t NS_PER_SEC = 1000000000ULL;
+
+struct ProcessConfig {
+    ShapingRates download;
+    ShapingRates upload;
+    uint64_t maxHeldBytes = TrafficShaper::DEFAULT_MAX_HELD_BYTES;
+    bool policed[2] = {false, false}; // by direction
+    TrtcmPolicer::Config policers[2];
+};
+
+struct ReplayConfig {
+    std::map<uint32_t, ProcessConfig> processes;
+};
+
+size_t directionIndex(TrafficDirection direction) {
+    return direction == TrafficDirection::Download ? 0 : 1;
+}
+
+const char* directionName(TrafficDirection direction) {
+    return direction == TrafficDirection::Download ? "download" : "upload";
+}
+
+bool parseDirection(const std::string& text, TrafficDirection& direction) {
+    if (text == "download") {
+        direction = TrafficDirection::Download;
+    } else if (text == "upload") {
+        direction = TrafficDirection::Upload;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parseAction(const std::string& text, PolicerAction& action) {
+    static const char* const NAMES[] = {"pass", "delay", "mark", "drop"};
+    for (size_t i = 0; i < 4; ++i) {
+        if (text == NAMES[i]) {
+            action = static_cast<PolicerAction>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// police PID DIRECTION CIR PIR [cbs BYTES] [pbs BYTES] [green|yellow|red ACTION]...
+bool parsePolice(std::istringstream& tokens, ReplayConfig& config, std::string& error) {
+    uint32_t pid = 0;
+    std::string direction;
+    std::string cir;
+    std::string pir;
+    TrafficDirection parsed;
+    if (!(tokens >> pid >> direction >> cir >> pir) || pid == 0 || !parseDirection(direction, parsed)) {
+        error = "expected: police PID upload|download CIR PIR [cbs BYTES] [pbs BYTES] [COLOR ACTION]...";
+        return false;
+    }
+    TrtcmPolicer::Config policer(BandwidthController::parseBandwidthString(cir),
+                                 BandwidthController::parseBandwidthString(pir));
+    std::string field;
+    std::string value;
+    while (tokens >> field >> value) {
+        PolicerAction action;
+        if (field == "cbs") {
+            policer.committedBurst = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (field == "pbs") {
+            policer.peakBurst = std::strtoull(value.c_str(), nullptr, 10);
+        } else if ((field == "green" || field == "yellow" || field == "red") && parseAction(value, action)) {
+            const PolicerColor color = field == "green"    ? PolicerColor::Green
+                                       : field == "yellow" ? PolicerColor::Yellow
+                                                           : PolicerColor::Red;
+            policer.action(color) = action;
+        } else {
+            error = "bad " + field + " " + value;
+            return false;
+        }
+    }
+    if (!policer.isValid()) {
+        error = "policer rates must satisfy 0 < CIR <= PIR";
+        return false;
+    }
+    ProcessConfig& process = config.processes[pid];
+    process.policed[directionIndex(parsed)] = true;
+    process.policers[directionIndex(parsed)] = policer;
+    return true;
+}
+
+// One directive per line; see usage()
+bool loadRules(const std::string& path, PacketClassifier& classifier, ReplayConfig& config) {
+    std::ifstream file(path);
+    if (!file) {
+        std::fprintf(stderr, "cannot read %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    for (size_t number = 1; std::getline(file, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream tokens(line);
+        std::string keyword;
+        if (!(tokens >> keyword)) {
+            continue;
+        }
+        std::string error;
+        bool ok = true;
+        if (keyword == "class") {
+            ok = classifier.addRule(line, error);
+            if (ok) {
+                uint32_t pid = 0;
+                tokens >> pid;
+                config.processes[pid]; // every class is attached, limited or not
+            }
+        } else if (keyword == "limit") {
+            uint32_t pid = 0;
+            std::string download;
+            std::string upload;
+            ok = static_cast<bool>(tokens >> pid >> download >> upload) && pid != 0;
+            if (ok) {
+                const uint64_t downloadRate = BandwidthController::parseBandwidthString(download);
+                const uint64_t uploadRate = BandwidthController::parseBandwidthString(upload);
+                config.processes[pid].download = ShapingRates(downloadRate, downloadRate);
+                config.processes[pid].upload = ShapingRates(uploadRate, uploadRate);
+            } else {
+                error = "expected: limit PID DOWNLOAD UPLOAD";
+            }
+        } else if (keyword == "queue") {
+            uint32_t pid = 0;
+            uint64_t bytes = 0;
+            ok = static_cast<bool>(tokens >> pid >> bytes) && pid != 0 && bytes != 0;
+            if (ok) {
+                config.processes[pid].maxHeldBytes = bytes;
+            } else {
+                error = "expected: queue PID BYTES";
+            }
+        } else if (keyword == "police") {
+            ok = parsePolice(tokens, config, error);
+        } else {
+            ok = false;
+            error = "unknown directive " + keyword;
+        }
+        if (!ok) {
+            std::fprintf(stderr, "%s:%zu: %s\n", path.c_str(), number, error.c_str());
+            return false;
+        }
+    }
+    if (classifier.ruleCount() == 0) {
+        std::fprintf(stderr, "%s: no class rules\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Feeds the capture's classified packets to the simulator at their (scaled) trace times
+class TraceSource : public TrafficSource {
+public:
+    struct Stats {
+        uint64_t packets;
+        uint64_t unparsed;
+        uint64_t firstNs;
+        uint64_t lastNs;
+    };
+
+    TraceSource(PcapReader& reader, PacketClassifier& classifier, double speed)
+        : reader_(reader), classifier_(classifier), speed_(speed), stats_(), nextNs_(IDLE), started_(false) {
+        advance();
+    }
+
+    uint64_t nextAt() const override { return nextNs_; }
+
+    SimUnit emit(uint64_t nowNs) override {
+        (void)nowNs;
+        const SimUnit unit = unit_;
+        advance();
+        return unit;
+    }
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    void advance() {
+        PcapReader::Packet packet;
+        PacketHeaders headers;
+        PacketClassifier::Match match;
+        while (reader_.next(packet)) {
+            ++stats_.packets;
+            if (!started_) {
+                started_ = true;
+                stats_.firstNs = packet.timestampNs;
+            }
+            // Captures merged from several interfaces may step back a little; time does not
+            stats_.lastNs = std::max(stats_.lastNs, packet.timestampNs);
+            if (!parsePacketHeaders(packet.linkType, packet.data, packet.capturedLength, headers)) {
+                ++stats_.unparsed;
+                continue;
+            }
+            if (!classifier_.classify(headers, match)) {
+                continue;
+            }
+            unit_ = SimUnit{match.pid, match.direction, packet.wireLength};
+            nextNs_ = static_cast<uint64_t>((stats_.lastNs - stats_.firstNs) / speed_);
+            return;
+        }
+        nextNs_ = IDLE;
+    }
+
+    PcapReader& reader_;
+    PacketClassifier& classifier_;
+    double speed_;
+    Stats stats_;
+    SimUnit unit_;
+    uint64_t nextNs_;
+    bool started_;
+};
+
+void writeSeries(FILE* out, const TrafficSimulator& simulator, uint64_t intervalNs) {
+    std::fprintf(out, "time_s,pid,direction,offered_bytes,sent_bytes,dropped_bytes,sent_rate_bps,delay_mean_ms,"
+                      "delay_max_ms\n");
+    size_t intervals = 0;
+    for (const TrafficSimulator::ClassStats& stats : simulator.classes()) {
+        intervals = std::max(intervals, stats.series.size());
+    }
+    const TrafficSimulator::SeriesPoint empty = {};
+    for (size_t i = 0; i < intervals; ++i) {
+        for (const TrafficSimulator::ClassStats& stats : simulator.classes()) {
+            const TrafficSimulator::SeriesPoint& point = i < stats.series.size() ? stats.series[i] : empty;
+            std::fprintf(out, "%.3f,%u,%s,%llu,%llu,%llu,%.0f,%.3f,%.3f\n", i * intervalNs / 1e9, stats.pid,
+                         directionName(stats.direction), static_cast<unsigned long long>(point.offeredBytes),
+                         static_cast<unsigned long long>(point.sentBytes),
+                         static_cast<unsigned long long>(point.droppedBytes),
+                         point.sentBytes * 8.0 * NS_PER_SEC / intervalNs,
+                         point.sentUnits ? point.delaySumNs / 1e6 / point.sentUnits : 0.0, point.delayMaxNs / 1e6);
+        }
+    }
+}
+
+void usage(const char* program) {
+    std::fprintf(stderr,
+                 "Usage: %s [options] CAPTURE RULES\n"
+                 "Replays a pcap/pcapng capture through the shaper on a virtual clock and writes\n"
+                 "per-class throughput, delay and drop time series as CSV.\n"
+                 "  --speed X        compress trace time X times (default 1: trace time)\n"
+                 "  --interval MS    time series interval (default 1000)\n"
+                 "  --series FILE    write the time series to FILE instead of stdout\n"
+                 "  --segments N     shaper buffer pool size (default 65536)\n"
+                 "Rules file, one directive per line ('#' starts a comment):\n"
+                 "  class PID upload|download [proto tcp|udp|icmp|N] [src CIDR] [dst CIDR]\n"
+                 "        [sport P[-Q]] [dport P[-Q]]     first matching class wins\n"
+                 "  limit PID DOWNLOAD UPLOAD             e.g. limit 100 2MB 512KB (0 = none)\n"
+                 "  police PID upload|download CIR PIR [cbs BYTES] [pbs BYTES]\n"
+                 "        [green|yellow|red pass|delay|mark|drop]...\n"
+                 "  queue PID BYTES                       cap on held bytes, both directions (default 1 MB)\n",
+                 program);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    double speed = 1.0;
+    uint64_t intervalNs = NS_PER_SEC;
+    size_t segments = 65536;
+    std::string seriesPath;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (option == "--speed" && i + 1 < argc) {
+            speed = std::atof(argv[++i]);
+        } else if (option == "--interval" && i + 1 < argc) {
+            intervalNs = static_cast<uint64_t>(std::atof(argv[++i]) * 1e6);
+        } else if (option == "--series" && i + 1 < argc) {
+            seriesPath = argv[++i];
+        } else if (option == "--segments" && i + 1 < argc) {
+            segments = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10));
+        } else if (option.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            positional.push_back(option);
+        }
+    }
+    if (positional.size() != 2 || speed <= 0.0 || intervalNs == 0 || segments == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    PacketClassifier classifier;
+    ReplayConfig config;
+    if (!loadRules(positional[1], classifier, config)) {
+        return 1;
+    }
+    PcapReader reader;
+    if (!reader.open(positional[0])) {
+        std::fprintf(stderr, "%s: %s\n", positional[0].c_str(), reader.error().c_str());
+        return 1;
+    }
+
+    TrafficShaper shaper(segments);
+    for (const auto& entry : config.processes) {
+        const ProcessConfig& process = entry.second;
+        shaper.attachProcess(entry.first, TrafficShaper::LINK_GROUP, process.download, process.upload);
+        shaper.setQueueLimits(entry.first, TrafficShaper::QueueLimits(process.maxHeldBytes));
+        for (TrafficDirection direction : {TrafficDirection::Download, TrafficDirection::Upload}) {
+            if (process.policed[directionIndex(direction)]) {
+                shaper.setPolicer(entry.first, direction, process.policers[directionIndex(direction)], 0);
+            }
+        }
+    }
+
+    TrafficSimulator simulator(shaper);
+    simulator.setSeriesInterval(intervalNs);
+    simulator.setRecordDelays(false);
+    auto owned = std::make_unique<TraceSource>(reader, classifier, speed);
+    const TraceSource* trace = owned.get();
+    simulator.addSource(std::move(owned));
+
+    const uint64_t start = MonotonicClock::nowNs();
+    simulator.run(TrafficSource::IDLE);
+    const double wallSec = (MonotonicClock::nowNs() - start) / 1e9;
+    if (!reader.error().empty()) {
+        std::fprintf(stderr, "%s: stopped at byte %llu: %s\n", positional[0].c_str(),
+                     static_cast<unsigned long long>(reader.offset()), reader.error().c_str());
+    }
+
+    FILE* out = stdout;
+    if (!seriesPath.empty() && !(out = std::fopen(seriesPath.c_str(), "w"))) {
+        std::perror(seriesPath.c_str());
+        return 1;
+    }
+    writeSeries(out, simulator, intervalNs);
+    if (out != stdout) {
+        std::fclose(out);
+    }
+
+    const TraceSource::Stats& stats = trace->stats();
+    const PacketClassifier::Stats& classified = classifier.stats();
+    const double traceSec = (stats.lastNs - stats.firstNs) / 1e9;
+    std::fprintf(stderr, "%llu packets (%llu unparsed, %llu unclassified, %llu flow lookups), %.1f s of trace\n",
+                 static_cast<unsigned long long>(stats.packets), static_cast<unsigned long long>(stats.unparsed),
+                 static_cast<unsigned long long>(classified.unclassified),
+                 static_cast<unsigned long long>(classified.ruleEvaluations), traceSec);
+    std::fprintf(stderr, "replayed in %.2f s: %.2f Mpackets/s (%.1f Gpackets/hour), %.0f MB/s of capture\n", wallSec,
+                 stats.packets / wallSec / 1e6, stats.packets / wallSec * 3600 / 1e9,
+                 reader.fileSize() / wallSec / (1024.0 * 1024.0));
+    std::fprintf(stderr, "%-8s %-9s %12s %12s %8s %12s %10s %10s\n", "pid", "direction", "offered MB", "sent MB",
+                 "dropped", "sent MB/s", "delay ms", "max ms");
+    const double replaySec = std::max(traceSec / speed, 1e-9);
+    for (const TrafficSimulator::ClassStats& classStats : simulator.classes()) {
+        uint64_t units = 0;
+        uint64_t delaySumNs = 0;
+        uint64_t delayMaxNs = 0;
+        for (const TrafficSimulator::SeriesPoint& point : classStats.series) {
+            units += point.sentUnits;
+            delaySumNs += point.delaySumNs;
+            delayMaxNs = std::max(delayMaxNs, point.delayMaxNs);
+        }
+        std::fprintf(stderr, "%-8u %-9s %12.2f %12.2f %7.2f%% %12.3f %10.3f %10.3f\n", classStats.pid,
+                     directionName(classStats.direction), classStats.offeredBytes / (1024.0 * 1024.0),
+                     classStats.sentBytes / (1024.0 * 1024.0),
+                     classStats.offeredBytes ? 100.0 * classStats.droppedBytes / classStats.offeredBytes : 0.0,
+                     classStats.sentBytes / replaySec / (1024.0 * 1024.0),
+                     units ? delaySumNs / 1e6 / units : 0.0, delayMaxNs / 1e6);
+    }
+    return reader.error().empty() ? 0 : 1;
+}
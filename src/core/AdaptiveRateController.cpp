@@ -0,0 +1,66 @@
+#include "AdaptiveRateController.h"
+
+#include <algorithm>
+
+namespace {
+
+// Elapsed time credited to one increase; a long gap between samples is not a long headroom
+constexpr uint64_t MAX_INCREASE_INTERVAL_NS = 500000000ULL;
+
+} // namespace
+
+AdaptiveRateController::AdaptiveRateController(uint64_t ceiling, const Config& config)
+    : config_(config), ceiling_(ceiling), rate_(ceiling), lastNs_(0), lastDelayNs_(0), lastDecreaseNs_(0),
+      started_(false), decreased_(false), lastAction_(Action::Hold) {}
+
+uint64_t AdaptiveRateController::clamp(double rate) const {
+    const double floor = static_cast<double>(std::min(config_.minRate, ceiling_));
+    return static_cast<uint64_t>(std::min(std::max(rate, floor), static_cast<double>(ceiling_)));
+}
+
+void AdaptiveRateController::setCeiling(uint64_t ceiling) {
+    ceiling_ = ceiling;
+    rate_ = ceiling == 0 ? 0 : clamp(static_cast<double>(rate_ == 0 ? ceiling : rate_));
+}
+
+uint64_t AdaptiveRateController::update(const Sample& sample) {
+    lastAction_ = Action::Hold;
+    if (ceiling_ == 0) {
+        return rate_;
+    }
+    if (!started_) {
+        started_ = true;
+        lastNs_ = sample.nowNs;
+        lastDelayNs_ = sample.pathDelayNs;
+    }
+    const uint64_t elapsedNs = std::min(sample.nowNs - lastNs_, MAX_INCREASE_INTERVAL_NS);
+    const bool rising = sample.pathDelayNs > lastDelayNs_;
+    lastNs_ = sample.nowNs;
+    lastDelayNs_ = sample.pathDelayNs;
+
+    if (sample.pathDelayNs > config_.targetDelayNs) {
+        if (!decreased_ || sample.nowNs - lastDecreaseNs_ >= config_.decreaseHoldNs) {
+            // Cut from what the process actually sends when that is the smaller, or a
+            // rate it does not use would take several cuts to bite
+            const uint64_t base = sample.throughput > 0 ? std::min(rate_, sample.throughput) : rate_;
+            rate_ = clamp(base * config_.decreaseFactor);
+            lastDecreaseNs_ = sample.nowNs;
+            decreased_ = true;
+            lastAction_ = Action::Decrease;
+        }
+        return rate_;
+    }
+    if (rising && sample.pathDelayNs > config_.targetDelayNs / 2) {
+        return rate_;
+    }
+    const bool limited = sample.shaperDelayNs > 0 || sample.throughput >= config_.usedFraction * rate_;
+    if (limited && rate_ < ceiling_) {
+        const double step = config_.increasePerSec != 0 ? static_cast<double>(config_.increasePerSec)
+                                                        : ceiling_ / 100.0 + rate_ / 8.0;
+        // Slower as the delay approaches the target
+        const double headroom = 1.0 - static_cast<double>(sample.pathDelayNs) / config_.targetDelayNs;
+        rate_ = clamp(rate_ + step * headroom * elapsedNs / 1e9);
+        lastAction_ = Action::Increase;
+    }
+    return rate_;
+}
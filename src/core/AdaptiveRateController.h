@@ -0,0 +1,78 @@
+#ifndef CORE_ADAPTIVERATECONTROLLER_H
+#define CORE_ADAPTIVERATECONTROLLER_H
+
+#include <cstdint>
+
+// Tunes one direction of a process's limit so that the queueing its traffic meets on the
+// path stays under a target delay, between a floor and the limit the user set (the ceiling).
+//
+// Each update() takes one sample and applies AIMD with a delay-gradient guard:
+//  - path delay above the target: multiplicative decrease, from the process's measured
+//    throughput when that is below the current rate, at most once per hold time so that
+//    one standing queue, which takes a few samples to drain, is not cut for repeatedly;
+//  - path delay above half the target and rising: hold, the queue is building;
+//  - otherwise, if the process is using its rate (traffic is held in the shaper, or its
+//    throughput is close to the rate): an increase in proportion to the elapsed time and to
+//    how far the delay is below the target. The default step is a small fixed part of the
+//    ceiling plus an eighth of the rate per second, so the rate recovers quickly after a
+//    capacity change yet grows by only a few percent between samples taken 0.5 s apart.
+// A process that is not using its rate is left alone, so an idle process does not drift up
+// to its ceiling and then burst into a queue.
+//
+// Path delay is the smoothed RTT above the connection's minimum RTT. Delay in the shaper is
+// the limit itself at work, not congestion, and only tells whether the process wants more.
+// Not thread-safe; callers serialize access.
+class AdaptiveRateController {
+public:
+    static constexpr uint64_t DEFAULT_TARGET_DELAY_NS = 20000000ULL;
+
+    struct Config {
+        uint64_t targetDelayNs;
+        uint64_t minRate;          // bytes/sec; never tuned below this
+        uint64_t increasePerSec;   // fixed step in bytes/sec per second; 0 = the default step
+        double decreaseFactor;     // fraction of the rate kept on a decrease
+        uint64_t decreaseHoldNs;   // minimum time between decreases
+        double usedFraction;       // throughput/rate at which the process counts as limited
+
+        Config(uint64_t targetDelay = DEFAULT_TARGET_DELAY_NS, uint64_t floor = 16 * 1024)
+            : targetDelayNs(targetDelay), minRate(floor), increasePerSec(0), decreaseFactor(0.85),
+              decreaseHoldNs(500000000ULL), usedFraction(0.8) {}
+    };
+
+    struct Sample {
+        uint64_t nowNs;
+        uint64_t pathDelayNs;
+        uint64_t shaperDelayNs;
+        uint64_t throughput; // bytes/sec over the last interval
+    };
+
+    enum class Action { Increase, Decrease, Hold };
+
+    // Starts at the ceiling. A ceiling of 0 (unlimited) leaves nothing to tune.
+    explicit AdaptiveRateController(uint64_t ceiling, const Config& config = Config());
+
+    // Returns the rate to apply from now on
+    uint64_t update(const Sample& sample);
+    // Changes the ceiling; the rate is clamped into the new range
+    void setCeiling(uint64_t ceiling);
+
+    uint64_t rate() const { return rate_; }
+    uint64_t ceiling() const { return ceiling_; }
+    Action lastAction() const { return lastAction_; }
+    const Config& config() const { return config_; }
+
+private:
+    uint64_t clamp(double rate) const;
+
+    Config config_;
+    uint64_t ceiling_;
+    uint64_t rate_;
+    uint64_t lastNs_;
+    uint64_t lastDelayNs_;
+    uint64_t lastDecreaseNs_;
+    bool started_;
+    bool decreased_;
+    Action lastAction_;
+};
+
+#endif // CORE_ADAPTIVERATECONTROLLER_H
@@ -0,0 +1,100 @@
+#include "BufferPool.h"
+
+BufferPool::BufferPool(size_t segmentCount, size_t segmentSize)
+    : segmentCount_(segmentCount), segmentSize_(segmentSize),
+      storage_(new uint8_t[segmentCount * segmentSize]), slots_(new Slot[segmentCount]),
+      freeHead_(pack(INVALID_SEGMENT, 0)), inUse_(0), highWatermark_(0), exhausted_(0) {
+    // Thread every slot onto the free stack, lowest index on top
+    for (size_t i = 0; i < segmentCount_; ++i) {
+        const uint32_t next = i + 1 < segmentCount_ ? static_cast<uint32_t>(i + 1) : INVALID_SEGMENT;
+        slots_[i].next.store(next, std::memory_order_relaxed);
+        slots_[i].length = 0;
+        slots_[i].tag = 0;
+    }
+    if (segmentCount_ > 0) {
+        freeHead_.store(pack(0, 0), std::memory_order_release);
+    }
+}
+
+uint32_t BufferPool::acquire() {
+    uint64_t head = freeHead_.load(std::memory_order_acquire);
+    for (;;) {
+        const uint32_t index = static_cast<uint32_t>(head);
+        if (index == INVALID_SEGMENT) {
+            exhausted_.fetch_add(1, std::memory_order_relaxed);
+            return INVALID_SEGMENT;
+        }
+        const uint32_t next = slots_[index].next.load(std::memory_order_relaxed);
+        const uint64_t replacement = pack(next, static_cast<uint32_t>(head >> 32) + 1);
+        if (freeHead_.compare_exchange_weak(head, replacement, std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+            slots_[index].next.store(INVALID_SEGMENT, std::memory_order_relaxed);
+            slots_[index].length = 0;
+            slots_[index].tag = 0;
+
+            const size_t used = inUse_.fetch_add(1, std::memory_order_relaxed) + 1;
+            size_t peak = highWatermark_.load(std::memory_order_relaxed);
+            while (used > peak && !highWatermark_.compare_exchange_weak(peak, used,
+                                                                        std::memory_order_relaxed)) {
+            }
+            return index;
+        }
+    }
+}
+
+void BufferPool::release(uint32_t segment) {
+    if (segment >= segmentCount_) {
+        return;
+    }
+    uint64_t head = freeHead_.load(std::memory_order_acquire);
+    for (;;) {
+        slots_[segment].next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        const uint64_t replacement = pack(segment, static_cast<uint32_t>(head >> 32) + 1);
+        if (freeHead_.compare_exchange_weak(head, replacement, std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+            inUse_.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+BufferPool::Stats BufferPool::stats() const {
+    Stats stats;
+    stats.capacity = segmentCount_;
+    stats.inUse = inUse_.load(std::memory_order_relaxed);
+    stats.highWatermark = highWatermark_.load(std::memory_order_relaxed);
+    stats.exhausted = exhausted_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void SegmentQueue::push(BufferPool& pool, uint32_t segment) {
+    pool.setNext(segment, BufferPool::INVALID_SEGMENT);
+    if (tail_ == BufferPool::INVALID_SEGMENT) {
+        head_ = segment;
+    } else {
+        pool.setNext(tail_, segment);
+    }
+    tail_ = segment;
+    ++count_;
+    bytes_ += pool.length(segment);
+}
+
+uint32_t SegmentQueue::pop(BufferPool& pool) {
+    const uint32_t segment = head_;
+    if (segment == BufferPool::INVALID_SEGMENT) {
+        return segment;
+    }
+    head_ = pool.next(segment);
+    if (head_ == BufferPool::INVALID_SEGMENT) {
+        tail_ = BufferPool::INVALID_SEGMENT;
+    }
+    --count_;
+    bytes_ -= pool.length(segment);
+    return segment;
+}
+
+void SegmentQueue::clear(BufferPool& pool) {
+    while (!empty()) {
+        pool.release(pop(pool));
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef CORE_BUFFERPOOL_H
+#define CORE_BUFFERPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Fixed-size slab of packet/segment buffers allocated once up front.
+//
+// Held traffic is written straight into a slot and handed around by index, so holding and
+// releasing a segment never allocates or copies. Free slots form a lock-free stack (with
+// an ABA tag), so any thread may acquire or release. A slot's `next` link doubles as the
+// intrusive link of SegmentQueue while the segment is held.
+class BufferPool {
+public:
+    static constexpr uint32_t INVALID_SEGMENT = UINT32_MAX;
+    static constexpr size_t DEFAULT_SEGMENT_SIZE = 2048; // one MTU-sized packet
+    static constexpr size_t DEFAULT_SEGMENT_COUNT = 4096;
+
+    struct Stats {
+        size_t capacity;      // segments
+        size_t inUse;
+        size_t highWatermark;
+        uint64_t exhausted;   // failed acquires
+    };
+
+    explicit BufferPool(size_t segmentCount = DEFAULT_SEGMENT_COUNT,
+                        size_t segmentSize = DEFAULT_SEGMENT_SIZE);
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Returns a free segment or INVALID_SEGMENT when the pool is exhausted.
+    uint32_t acquire();
+    void release(uint32_t segment);
+
+    uint8_t* data(uint32_t segment) { return storage_.get() + segment * segmentSize_; }
+    const uint8_t* data(uint32_t segment) const { return storage_.get() + segment * segmentSize_; }
+
+    // Payload length and an opaque caller tag (e.g. a socket or packet id)
+    void setLength(uint32_t segment, uint32_t length) { slots_[segment].length = length; }
+    uint32_t length(uint32_t segment) const { return slots_[segment].length; }
+    void setTag(uint32_t segment, uint64_t tag) { slots_[segment].tag = tag; }
+    uint64_t tag(uint32_t segment) const { return slots_[segment].tag; }
+
+    uint32_t next(uint32_t segment) const {
+        return slots_[segment].next.load(std::memory_order_relaxed);
+    }
+    void setNext(uint32_t segment, uint32_t next) {
+        slots_[segment].next.store(next, std::memory_order_relaxed);
+    }
+
+    size_t segmentSize() const { return segmentSize_; }
+    size_t capacity() const { return segmentCount_; }
+    Stats stats() const;
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> next;
+        uint32_t length;
+        uint64_t tag;
+    };
+
+    static uint64_t pack(uint32_t index, uint32_t aba) {
+        return (static_cast<uint64_t>(aba) << 32) | index;
+    }
+
+    size_t segmentCount_;
+    size_t segmentSize_;
+    std::unique_ptr<uint8_t[]> storage_;
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<uint64_t> freeHead_; // ABA tag << 32 | index
+    std::atomic<size_t> inUse_;
+    std::atomic<size_t> highWatermark_;
+    std::atomic<uint64_t> exhausted_;
+};
+
+// What to do when a held queue is over its byte cap.
+enum class DropPolicy {
+    TailDrop, // reject the arriving segment
+    HeadDrop  // discard the oldest held segments to make room
+};
+
+// Intrusive FIFO of pool segments for one flow; links live inside the pool slots.
+// Not thread-safe; the owner serializes access.
+class SegmentQueue {
+public:
+    SegmentQueue() : head_(BufferPool::INVALID_SEGMENT), tail_(BufferPool::INVALID_SEGMENT),
+                     count_(0), bytes_(0) {}
+
+    void push(BufferPool& pool, uint32_t segment);
+    uint32_t pop(BufferPool& pool);
+    // Returns every queued segment to the pool.
+    void clear(BufferPool& pool);
+
+    uint32_t front() const { return head_; }
+    bool empty() const { return count_ == 0; }
+    size_t size() const { return count_; }
+    uint64_t bytes() const { return bytes_; }
+
+private:
+    uint32_t head_;
+    uint32_t tail_;
+    size_t count_;
+    uint64_t bytes_;
+};
+
+#endif // CORE_BUFFERPOOL_H
@@ -0,0 +1,203 @@
+#include "DrrScheduler.h"
+
+#include <algorithm>
+
+DrrScheduler::DrrScheduler(uint32_t quantumBytes)
+    : quantum_(std::max<uint32_t>(quantumBytes, 1)), head_(INVALID_FLOW), tail_(INVALID_FLOW),
+      headCredited_(false), activeCount_(0), flowCount_(0) {}
+
+uint32_t DrrScheduler::clampWeight(uint32_t weight) {
+    return std::min(std::max<uint32_t>(weight, 1), MAX_WEIGHT);
+}
+
+uint32_t DrrScheduler::addFlow(uint32_t weight) {
+    uint32_t id;
+    if (!freeIds_.empty()) {
+        id = freeIds_.back();
+        freeIds_.pop_back();
+        flows_[id] = Flow();
+    } else {
+        id = static_cast<uint32_t>(flows_.size());
+        flows_.emplace_back();
+    }
+    Flow& flow = flows_[id];
+    flow.used = true;
+    flow.weight = clampWeight(weight);
+    ++flowCount_;
+    return id;
+}
+
+bool DrrScheduler::setWeight(uint32_t flowId, uint32_t weight) {
+    if (!hasFlow(flowId)) {
+        return false;
+    }
+    // Takes effect from the flow's next visit
+    flows_[flowId].weight = clampWeight(weight);
+    return true;
+}
+
+bool DrrScheduler::removeFlow(uint32_t flowId) {
+    if (!hasFlow(flowId)) {
+        return false;
+    }
+    unlink(flowId);
+    flows_[flowId] = Flow();
+    freeIds_.push_back(flowId);
+    --flowCount_;
+    return true;
+}
+
+bool DrrScheduler::hasFlow(uint32_t flowId) const {
+    return flowId < flows_.size() && flows_[flowId].used;
+}
+
+bool DrrScheduler::enqueue(uint32_t flowId, uint32_t bytes) {
+    if (!hasFlow(flowId)) {
+        return false;
+    }
+    Flow& flow = flows_[flowId];
+    flow.queue.push_back(bytes);
+    flow.backlog += bytes;
+    if (!flow.linked && !flow.suspended) {
+        link(flowId);
+    }
+    return true;
+}
+
+uint32_t DrrScheduler::selectFront() {
+    while (head_ != INVALID_FLOW) {
+        Flow& flow = flows_[head_];
+        if (!headCredited_) {
+            flow.deficit += quantum_ * flow.weight;
+            headCredited_ = true;
+        }
+        if (flow.queue.front() <= flow.deficit) {
+            return head_;
+        }
+        // Not enough credit for the head unit: keep the remainder and wait a round
+        const uint32_t id = head_;
+        unlink(id);
+        link(id);
+    }
+    return INVALID_FLOW;
+}
+
+bool DrrScheduler::peek(Dequeued& out) {
+    const uint32_t id = selectFront();
+    if (id == INVALID_FLOW) {
+        return false;
+    }
+    out.flowId = id;
+    out.bytes = flows_[id].queue.front();
+    return true;
+}
+
+bool DrrScheduler::dequeue(Dequeued& out) {
+    const uint32_t id = selectFront();
+    if (id == INVALID_FLOW) {
+        return false;
+    }
+    Flow& flow = flows_[id];
+    const uint32_t bytes = flow.queue.front();
+    flow.queue.pop_front();
+    flow.backlog -= bytes;
+    flow.sent += bytes;
+    flow.deficit -= bytes;
+    if (flow.queue.empty()) {
+        // An idle flow does not bank credit
+        unlink(id);
+        flow.deficit = 0;
+    } else if (flow.queue.front() > flow.deficit) {
+        unlink(id);
+        link(id);
+    }
+
+    out.flowId = id;
+    out.bytes = bytes;
+    return true;
+}
+
+uint32_t DrrScheduler::dropFront(uint32_t flowId) {
+    if (!hasFlow(flowId) || flows_[flowId].queue.empty()) {
+        return 0;
+    }
+    Flow& flow = flows_[flowId];
+    const uint32_t bytes = flow.queue.front();
+    flow.queue.pop_front();
+    flow.backlog -= bytes;
+    if (flow.queue.empty()) {
+        unlink(flowId);
+        flow.deficit = 0;
+    }
+    return bytes;
+}
+
+bool DrrScheduler::suspend(uint32_t flowId) {
+    if (!hasFlow(flowId)) {
+        return false;
+    }
+    unlink(flowId);
+    flows_[flowId].suspended = true;
+    return true;
+}
+
+bool DrrScheduler::resume(uint32_t flowId) {
+    if (!hasFlow(flowId)) {
+        return false;
+    }
+    Flow& flow = flows_[flowId];
+    flow.suspended = false;
+    if (!flow.linked && !flow.queue.empty()) {
+        link(flowId);
+    }
+    return true;
+}
+
+bool DrrScheduler::isSuspended(uint32_t flowId) const {
+    return hasFlow(flowId) && flows_[flowId].suspended;
+}
+
+uint64_t DrrScheduler::backlogBytes(uint32_t flowId) const {
+    return hasFlow(flowId) ? flows_[flowId].backlog : 0;
+}
+
+uint64_t DrrScheduler::sentBytes(uint32_t flowId) const {
+    return hasFlow(flowId) ? flows_[flowId].sent : 0;
+}
+
+void DrrScheduler::link(uint32_t flowId) {
+    Flow& flow = flows_[flowId];
+    flow.prev = tail_;
+    flow.next = INVALID_FLOW;
+    if (tail_ != INVALID_FLOW) {
+        flows_[tail_].next = flowId;
+    } else {
+        head_ = flowId;
+        headCredited_ = false;
+    }
+    tail_ = flowId;
+    flow.linked = true;
+    ++activeCount_;
+}
+
+void DrrScheduler::unlink(uint32_t flowId) {
+    Flow& flow = flows_[flowId];
+    if (!flow.linked) {
+        return;
+    }
+    if (flow.prev != INVALID_FLOW) {
+        flows_[flow.prev].next = flow.next;
+    } else {
+        head_ = flow.next;
+        headCredited_ = false; // the new front starts a fresh visit
+    }
+    if (flow.next != INVALID_FLOW) {
+        flows_[flow.next].prev = flow.prev;
+    } else {
+        tail_ = flow.prev;
+    }
+    flow.prev = INVALID_FLOW;
+    flow.next = INVALID_FLOW;
+    flow.linked = false;
+    --activeCount_;
+}
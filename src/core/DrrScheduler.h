@@ -0,0 +1,93 @@
+#ifndef CORE_DRRSCHEDULER_H
+#define CORE_DRRSCHEDULER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Weighted deficit round robin (DRR) over flows that share one budget.
+//
+// Backlogged flows wait in a FIFO ring. The flow at the front is credited weight * quantum
+// bytes once per visit and sends while its head unit fits in its credit, then moves to
+// the back keeping the remainder. Over a round every backlogged flow therefore sends in
+// proportion to its weight, however often or in what sizes it queues. With a quantum at
+// least as large as the largest unit, every visit sends something and a decision is O(1).
+//
+// The scheduler only decides the order; rates are the caller's. peek() names the unit
+// that goes next without committing, so the caller can check its shared bucket and call
+// dequeue() only once the unit is admitted. A flow that must wait on a limit of its own
+// is suspend()ed, which takes it out of the ring without touching its queue, so it never
+// blocks the flows behind it. Not thread-safe; callers serialize access.
+class DrrScheduler {
+public:
+    static constexpr uint32_t INVALID_FLOW = UINT32_MAX;
+    static constexpr uint32_t DEFAULT_QUANTUM = 2048; // one pool segment
+    static constexpr uint32_t MAX_WEIGHT = 1u << 16;
+
+    struct Dequeued {
+        uint32_t flowId;
+        uint32_t bytes;
+    };
+
+    explicit DrrScheduler(uint32_t quantumBytes = DEFAULT_QUANTUM);
+
+    // Weights are clamped to [1, MAX_WEIGHT]
+    uint32_t addFlow(uint32_t weight = 1);
+    bool setWeight(uint32_t flowId, uint32_t weight);
+    // Removes a flow, dropping anything still queued in it.
+    bool removeFlow(uint32_t flowId);
+    bool hasFlow(uint32_t flowId) const;
+
+    // Queues a unit of `bytes` on a flow.
+    bool enqueue(uint32_t flowId, uint32_t bytes);
+    // The unit dequeue() would release next; false when no flow in the ring has work.
+    bool peek(Dequeued& out);
+    bool dequeue(Dequeued& out);
+    // Discards a flow's oldest unit (head drop); returns its size, or 0 if none was queued.
+    uint32_t dropFront(uint32_t flowId);
+
+    // Takes a backlogged flow out of the rotation until resume(); its queue and credit
+    // are kept. Units queued while suspended wait too.
+    bool suspend(uint32_t flowId);
+    bool resume(uint32_t flowId);
+    bool isSuspended(uint32_t flowId) const;
+
+    // Flows in the ring, i.e. backlogged and not suspended
+    size_t activeFlows() const { return activeCount_; }
+    bool idle() const { return activeCount_ == 0; }
+    size_t flowCount() const { return flowCount_; }
+    uint64_t backlogBytes(uint32_t flowId) const;
+    uint64_t sentBytes(uint32_t flowId) const;
+
+private:
+    struct Flow {
+        std::deque<uint32_t> queue;
+        uint64_t backlog = 0;
+        uint64_t sent = 0;
+        uint64_t deficit = 0;
+        uint32_t weight = 1;
+        uint32_t prev = INVALID_FLOW;
+        uint32_t next = INVALID_FLOW;
+        bool used = false;
+        bool linked = false;
+        bool suspended = false;
+    };
+
+    static uint32_t clampWeight(uint32_t weight);
+    void link(uint32_t flowId);
+    void unlink(uint32_t flowId);
+    // Front of the ring once it has been credited enough to send its head unit
+    uint32_t selectFront();
+
+    uint64_t quantum_;
+    std::vector<Flow> flows_;
+    std::vector<uint32_t> freeIds_;
+    uint32_t head_;
+    uint32_t tail_;
+    bool headCredited_; // the front flow already got its quantum for this visit
+    size_t activeCount_;
+    size_t flowCount_;
+};
+
+#endif // CORE_DRRSCHEDULER_H
@@ -0,0 +1,296 @@
+#include "FlowCache.h"
+
+#include <functional>
+#include <thread>
+
+namespace {
+
+constexpr uint64_t IPV4_MAPPED_PREFIX = 0x0000FFFFULL; // ::ffff:0:0/96, upper half of word 1
+
+uint64_t loadBigEndian(const uint8_t* bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+uint64_t mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+uint64_t portsWord(uint8_t protocol, uint16_t localPort, uint16_t remotePort) {
+    return (static_cast<uint64_t>(protocol) << 32) | (static_cast<uint64_t>(localPort) << 16) | remotePort;
+}
+
+size_t roundUpToPowerOfTwo(size_t value) {
+    size_t result = 2;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // namespace
+
+FlowKey FlowKey::ipv4(uint8_t protocol, uint32_t localAddress, uint16_t localPort,
+                      uint32_t remoteAddress, uint16_t remotePort) {
+    FlowKey key;
+    key.words[0] = 0;
+    key.words[1] = (IPV4_MAPPED_PREFIX << 32) | localAddress;
+    key.words[2] = 0;
+    key.words[3] = (IPV4_MAPPED_PREFIX << 32) | remoteAddress;
+    key.words[4] = portsWord(protocol, localPort, remotePort);
+    return key;
+}
+
+FlowKey FlowKey::ipv6(uint8_t protocol, const uint8_t localAddress[16], uint16_t localPort,
+                      const uint8_t remoteAddress[16], uint16_t remotePort) {
+    FlowKey key;
+    key.words[0] = loadBigEndian(localAddress);
+    key.words[1] = loadBigEndian(localAddress + 8);
+    key.words[2] = loadBigEndian(remoteAddress);
+    key.words[3] = loadBigEndian(remoteAddress + 8);
+    key.words[4] = portsWord(protocol, localPort, remotePort);
+    return key;
+}
+
+FlowCache::FlowCache(size_t capacity)
+    : capacity_(roundUpToPowerOfTwo(capacity)), mask_(capacity_ - 1), slots_(new Slot[capacity_]),
+      generation_(1), counters_(new CounterStripe[COUNTER_STRIPES]), occupied_(0), inserts_(0),
+      removals_(0), invalidations_(0) {
+    for (size_t i = 0; i < capacity_; ++i) {
+        Slot& slot = slots_[i];
+        slot.sequence.store(0, std::memory_order_relaxed);
+        slot.generation.store(EMPTY, std::memory_order_relaxed);
+        for (size_t w = 0; w < FlowKey::WORDS; ++w) {
+            slot.key[w].store(0, std::memory_order_relaxed);
+        }
+        slot.value.store(0, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < COUNTER_STRIPES; ++i) {
+        counters_[i].lookups.store(0, std::memory_order_relaxed);
+        counters_[i].misses.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t FlowCache::hash(const FlowKey& key) {
+    // One multiply per word and a single finalizer; enough to spread ports and addresses
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < FlowKey::WORDS; ++i) {
+        h = (h ^ key.words[i]) * 0x9fb21c651e98df25ULL;
+    }
+    return mix(h);
+}
+
+FlowCache::CounterStripe& FlowCache::stripe() const {
+    static thread_local const size_t index = std::hash<std::thread::id>()(std::this_thread::get_id()) % COUNTER_STRIPES;
+    return counters_[index];
+}
+
+void FlowCache::read(const Slot& slot, SlotView& view) {
+    for (;;) {
+        const uint32_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue; // writer in progress
+        }
+        view.generation = slot.generation.load(std::memory_order_relaxed);
+        for (size_t w = 0; w < FlowKey::WORDS; ++w) {
+            view.key.words[w] = slot.key[w].load(std::memory_order_relaxed);
+        }
+        view.value = slot.value.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == before) {
+            return;
+        }
+    }
+}
+
+void FlowCache::write(size_t index, uint32_t generation, const FlowKey& key, uint64_t value) {
+    Slot& slot = slots_[index];
+    const uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.generation.store(generation, std::memory_order_relaxed);
+    for (size_t w = 0; w < FlowKey::WORDS; ++w) {
+        slot.key[w].store(key.words[w], std::memory_order_relaxed);
+    }
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool FlowCache::lookup(const FlowKey& key, FlowEntry& entry) const {
+    CounterStripe& counters = stripe();
+    counters.lookups.fetch_add(1, std::memory_order_relaxed);
+
+    const uint32_t generation = generation_.load(std::memory_order_acquire);
+    SlotView view;
+    for (size_t probe = 0, index = home(key); probe < capacity_; ++probe, index = (index + 1) & mask_) {
+        read(slots_[index], view);
+        if (view.generation == EMPTY) {
+            break;
+        }
+        if (view.generation == generation && view.key == key) {
+            entry.pid = static_cast<uint32_t>(view.value >> 32);
+            entry.classId = static_cast<uint32_t>(view.value);
+            return true;
+        }
+    }
+    counters.misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool FlowCache::insert(const FlowKey& key, const FlowEntry& entry) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    const uint64_t value = (static_cast<uint64_t>(entry.pid) << 32) | entry.classId;
+    if (insertLocked(key, value)) {
+        return true;
+    }
+    compact();
+    return insertLocked(key, value);
+}
+
+bool FlowCache::insertLocked(const FlowKey& key, uint64_t value) {
+    const uint32_t generation = generation_.load(std::memory_order_relaxed);
+
+    // Replace the key wherever it sits in its chain, else reuse the first retired slot
+    size_t reusable = capacity_;
+    size_t index = home(key);
+    SlotView view;
+    for (size_t probe = 0; probe < capacity_; ++probe, index = (index + 1) & mask_) {
+        read(slots_[index], view);
+        if (view.generation == EMPTY) {
+            break;
+        }
+        if (view.key == key) {
+            write(index, generation, key, value);
+            inserts_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        if (view.generation != generation && reusable == capacity_) {
+            reusable = index;
+        }
+    }
+    if (reusable != capacity_) {
+        write(reusable, generation, key, value);
+        inserts_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Keep the load factor at or below one half so probe chains stay short
+    if ((occupied_.load(std::memory_order_relaxed) + 1) * 2 > capacity_) {
+        return false;
+    }
+    write(index, generation, key, value);
+    occupied_.fetch_add(1, std::memory_order_relaxed);
+    inserts_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool FlowCache::remove(const FlowKey& key) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    SlotView view;
+    size_t index = home(key);
+    for (size_t probe = 0; probe < capacity_; ++probe, index = (index + 1) & mask_) {
+        read(slots_[index], view);
+        if (view.generation == EMPTY) {
+            return false;
+        }
+        if (view.key == key) {
+            eraseAt(index);
+            removals_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t FlowCache::removeProcess(uint32_t pid) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    if (occupied_.load(std::memory_order_relaxed) == 0) {
+        return 0; // skips the full scan on hosts where nothing populates the cache
+    }
+    size_t removed = 0;
+    SlotView view;
+    for (size_t index = 0; index < capacity_;) {
+        read(slots_[index], view);
+        if (view.generation != EMPTY && static_cast<uint32_t>(view.value >> 32) == pid) {
+            eraseAt(index); // a later entry may have shifted into this slot; look again
+            ++removed;
+        } else {
+            ++index;
+        }
+    }
+    removals_.fetch_add(removed, std::memory_order_relaxed);
+    return removed;
+}
+
+void FlowCache::invalidateAll() {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    uint32_t next = generation_.load(std::memory_order_relaxed) + 1;
+    if (next == EMPTY) {
+        // Wrapped: clear for real so no entry from 2^32 generations ago comes back
+        for (size_t index = 0; index < capacity_; ++index) {
+            write(index, EMPTY, FlowKey(), 0);
+        }
+        occupied_.store(0, std::memory_order_relaxed);
+        next = 1;
+    }
+    generation_.store(next, std::memory_order_release);
+    invalidations_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FlowCache::eraseAt(size_t index) {
+    // Backward-shift deletion: pull later chain members into the hole so lookups never
+    // need tombstones
+    SlotView view;
+    size_t hole = index;
+    for (size_t next = (hole + 1) & mask_;; next = (next + 1) & mask_) {
+        read(slots_[next], view);
+        if (view.generation == EMPTY) {
+            break;
+        }
+        const size_t desired = home(view.key);
+        if (((next - desired) & mask_) >= ((next - hole) & mask_)) {
+            write(hole, view.generation, view.key, view.value);
+            hole = next;
+        }
+    }
+    write(hole, EMPTY, FlowKey(), 0);
+    occupied_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void FlowCache::compact() {
+    const uint32_t generation = generation_.load(std::memory_order_relaxed);
+    SlotView view;
+    for (size_t index = 0; index < capacity_;) {
+        read(slots_[index], view);
+        if (view.generation != EMPTY && view.generation != generation) {
+            eraseAt(index);
+        } else {
+            ++index;
+        }
+    }
+}
+
+FlowCache::Stats FlowCache::stats() const {
+    Stats stats;
+    stats.lookups = 0;
+    uint64_t misses = 0;
+    for (size_t i = 0; i < COUNTER_STRIPES; ++i) {
+        stats.lookups += counters_[i].lookups.load(std::memory_order_relaxed);
+        misses += counters_[i].misses.load(std::memory_order_relaxed);
+    }
+    stats.hits = stats.lookups > misses ? stats.lookups - misses : 0;
+    stats.inserts = inserts_.load(std::memory_order_relaxed);
+    stats.removals = removals_.load(std::memory_order_relaxed);
+    stats.invalidations = invalidations_.load(std::memory_order_relaxed);
+    stats.size = occupied_.load(std::memory_order_relaxed);
+    stats.capacity = capacity_;
+    return stats;
+}
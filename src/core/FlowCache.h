@@ -0,0 +1,134 @@
+#ifndef CORE_FLOWCACHE_H
+#define CORE_FLOWCACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Transport 5-tuple as seen from the local host. IPv4 addresses are stored IPv4-mapped
+// (::ffff:a.b.c.d) so both families share one key layout.
+struct FlowKey {
+    static constexpr size_t WORDS = 5;
+    uint64_t words[WORDS]; // local address, remote address, ports and protocol
+
+    // Addresses and ports in host byte order
+    static FlowKey ipv4(uint8_t protocol, uint32_t localAddress, uint16_t localPort,
+                        uint32_t remoteAddress, uint16_t remotePort);
+    // Addresses in network byte order (as in in6_addr), ports in host byte order
+    static FlowKey ipv6(uint8_t protocol, const uint8_t localAddress[16], uint16_t localPort,
+                        const uint8_t remoteAddress[16], uint16_t remotePort);
+
+    bool operator==(const FlowKey& other) const {
+        for (size_t i = 0; i < WORDS; ++i) {
+            if (words[i] != other.words[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Owner of a flow: the process and the throttle class (group) it is shaped under
+struct FlowEntry {
+    uint32_t pid;
+    uint32_t classId;
+};
+
+// Fixed-capacity open-addressing (linear probing) map from flows to their owners, read
+// on every packet by the data path.
+//
+// Lookups are lock-free: every slot carries a sequence number that writers make odd
+// while they rewrite it, and readers retry a slot whose sequence changed under them, so
+// a lookup never returns a torn entry. Writers (connection open/close, throttle changes)
+// are rare and serialize on a mutex. Removal shifts later entries back instead of leaving
+// tombstones; a lookup racing with it may miss, which callers treat like any miss and
+// classify through the slow path.
+//
+// Every entry records the cache generation it was inserted in. invalidateAll() bumps the
+// generation, which retires all entries in O(1); retired slots are reused by inserts and
+// compacted away when the table fills up.
+class FlowCache {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+
+    struct Stats {
+        uint64_t lookups;
+        uint64_t hits;
+        uint64_t inserts;
+        uint64_t removals;
+        uint64_t invalidations;
+        size_t size;     // occupied slots, including retired entries
+        size_t capacity; // slots; at most half are filled
+
+        double hitRate() const { return lookups ? static_cast<double>(hits) / lookups : 0.0; }
+    };
+
+    // Capacity is rounded up to a power of two.
+    explicit FlowCache(size_t capacity = DEFAULT_CAPACITY);
+
+    FlowCache(const FlowCache&) = delete;
+    FlowCache& operator=(const FlowCache&) = delete;
+
+    // Lock-free; safe to call from any number of threads.
+    bool lookup(const FlowKey& key, FlowEntry& entry) const;
+
+    // Adds or replaces a flow. Fails only when the table is full of live entries.
+    bool insert(const FlowKey& key, const FlowEntry& entry);
+    // Call when the socket closes.
+    bool remove(const FlowKey& key);
+    // Drops every flow owned by a process; returns how many were removed.
+    size_t removeProcess(uint32_t pid);
+    // Retires all entries, e.g. after throttle classes were reassigned.
+    void invalidateAll();
+
+    Stats stats() const;
+
+private:
+    static constexpr uint32_t EMPTY = 0; // slot generation of a free slot
+    static constexpr size_t COUNTER_STRIPES = 16;
+
+    struct alignas(64) Slot {
+        std::atomic<uint32_t> sequence;   // odd while a writer is updating the slot
+        std::atomic<uint32_t> generation; // EMPTY, or the cache generation at insert
+        std::atomic<uint64_t> key[FlowKey::WORDS];
+        std::atomic<uint64_t> value;      // pid << 32 | classId
+    };
+
+    struct SlotView {
+        uint32_t generation;
+        FlowKey key;
+        uint64_t value;
+    };
+
+    // Lookup counters are striped per thread so readers do not share a cache line.
+    // Hits are derived (lookups - misses) to keep one atomic add on the hit path.
+    struct alignas(64) CounterStripe {
+        std::atomic<uint64_t> lookups;
+        std::atomic<uint64_t> misses;
+    };
+
+    static uint64_t hash(const FlowKey& key);
+    size_t home(const FlowKey& key) const { return static_cast<size_t>(hash(key)) & mask_; }
+    static void read(const Slot& slot, SlotView& view);
+    void write(size_t index, uint32_t generation, const FlowKey& key, uint64_t value);
+    bool insertLocked(const FlowKey& key, uint64_t value);
+    void eraseAt(size_t index);
+    void compact();
+    CounterStripe& stripe() const;
+
+    size_t capacity_;
+    size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<uint32_t> generation_;
+    mutable std::unique_ptr<CounterStripe[]> counters_;
+
+    std::mutex writeMutex_;
+    std::atomic<size_t> occupied_; // written under writeMutex_
+    std::atomic<uint64_t> inserts_;
+    std::atomic<uint64_t> removals_;
+    std::atomic<uint64_t> invalidations_;
+};
+
+#endif // CORE_FLOWCACHE_H
@@ -0,0 +1,293 @@
+#include "HtbScheduler.h"
+#include "TokenBucket.h"
+
+#include <algorithm>
+#include <cmath>
+
+void HtbScheduler::Bucket::configure(uint64_t rateBytesPerSec) {
+    if (rateBytesPerSec == 0) {
+        ticksPerByte = 0.0;
+        burstTicks = 0;
+        return;
+    }
+
+    const uint64_t burstBytes = std::max(rateBytesPerSec / TokenBucket::DEFAULT_BURST_DIVISOR,
+                                         TokenBucket::MIN_BURST_BYTES);
+    ticksPerByte =
+        static_cast<double>(1000000000ULL << TICK_SHIFT) / static_cast<double>(rateBytesPerSec);
+    burstTicks = static_cast<uint64_t>(std::llround(static_cast<double>(burstBytes) * ticksPerByte));
+}
+
+void HtbScheduler::Bucket::charge(uint64_t now, uint32_t bytes) {
+    if (ticksPerByte == 0.0) {
+        return;
+    }
+    tat = std::max(tat, now) +
+          static_cast<uint64_t>(std::llround(static_cast<double>(bytes) * ticksPerByte));
+}
+
+uint64_t HtbScheduler::Bucket::readyAt() const {
+    if (ticksPerByte == 0.0) {
+        return 0;
+    }
+    // Tokens are non-negative again once the debt fits inside the burst
+    return tat > burstTicks ? tat - burstTicks : 0;
+}
+
+HtbScheduler::HtbScheduler(uint64_t linkRateBytesPerSec) : classCount_(1), serviceSeq_(0) {
+    nodes_.resize(1);
+    nodes_[ROOT_CLASS].used = true;
+    setLinkRate(linkRateBytesPerSec);
+}
+
+void HtbScheduler::setLinkRate(uint64_t rateBytesPerSec) {
+    // The root can never borrow, so its assured rate and ceil are both the link capacity
+    applyRates(nodes_[ROOT_CLASS], ShapingRates(rateBytesPerSec, rateBytesPerSec));
+}
+
+uint64_t HtbScheduler::linkRate() const {
+    return nodes_[ROOT_CLASS].rates.ceil;
+}
+
+void HtbScheduler::applyRates(Node& node, const ShapingRates& rates) {
+    node.rates = rates;
+    node.assured = rates.rate != 0;
+    node.rateBucket.configure(rates.rate);
+    node.ceilBucket.configure(rates.ceil);
+}
+
+uint32_t HtbScheduler::addClass(uint32_t parentId, const ShapingRates& rates) {
+    if (!hasClass(parentId)) {
+        return INVALID_CLASS;
+    }
+    if (parentId != ROOT_CLASS && !nodes_[parentId].queue.empty()) {
+        return INVALID_CLASS;
+    }
+
+    uint32_t id;
+    if (!freeIds_.empty()) {
+        id = freeIds_.back();
+        freeIds_.pop_back();
+        nodes_[id] = Node();
+    } else {
+        id = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+    }
+
+    Node& node = nodes_[id];
+    node.used = true;
+    node.parent = parentId;
+    applyRates(node, rates);
+    nodes_[parentId].children.push_back(id);
+    ++classCount_;
+    return id;
+}
+
+bool HtbScheduler::setClassRates(uint32_t classId, const ShapingRates& rates) {
+    if (classId == ROOT_CLASS || !hasClass(classId)) {
+        return false;
+    }
+    applyRates(nodes_[classId], rates);
+    refreshUpwards(classId);
+    return true;
+}
+
+bool HtbScheduler::removeClass(uint32_t classId) {
+    if (classId == ROOT_CLASS || !hasClass(classId) || !nodes_[classId].children.empty()) {
+        return false;
+    }
+
+    Node& node = nodes_[classId];
+    node.queue.clear();
+    node.backlog = 0;
+    detachFromParent(classId);
+
+    const uint32_t parentId = node.parent;
+    auto& siblings = nodes_[parentId].children;
+    siblings.erase(std::remove(siblings.begin(), siblings.end(), classId), siblings.end());
+    refreshUpwards(parentId);
+
+    node = Node();
+    freeIds_.push_back(classId);
+    --classCount_;
+    return true;
+}
+
+bool HtbScheduler::hasClass(uint32_t classId) const {
+    return classId < nodes_.size() && nodes_[classId].used;
+}
+
+bool HtbScheduler::enqueue(uint32_t classId, uint32_t bytes) {
+    if (classId == ROOT_CLASS || !hasClass(classId) || !isLeaf(nodes_[classId])) {
+        return false;
+    }
+
+    Node& node = nodes_[classId];
+    const bool wasIdle = node.queue.empty();
+    node.queue.push_back(bytes);
+    node.backlog += bytes;
+    if (wasIdle) {
+        refreshUpwards(classId);
+    }
+    return true;
+}
+
+bool HtbScheduler::dequeue(uint64_t nowNs, Dequeued& out) {
+    const uint64_t now = nowNs << TICK_SHIFT;
+    const Node& root = nodes_[ROOT_CLASS];
+    if (root.readySet.empty() || root.ceilBucket.readyAt() > now) {
+        return false;
+    }
+
+    // Descend preferring children within their assured rate, then any child that may
+    // borrow. The root is the lender of last resort, so a non-RED path is always allowed.
+    uint32_t id = ROOT_CLASS;
+    while (!isLeaf(nodes_[id])) {
+        const Node& node = nodes_[id];
+        if (!node.greenSet.empty() && node.greenSet.begin()->ready <= now) {
+            id = node.greenSet.begin()->id;
+        } else if (!node.readySet.empty() && node.readySet.begin()->ready <= now) {
+            id = node.readySet.begin()->id;
+        } else {
+            return false;
+        }
+    }
+
+    Node& leaf = nodes_[id];
+    const uint32_t bytes = leaf.queue.front();
+    leaf.queue.pop_front();
+    leaf.backlog -= bytes;
+    charge(id, bytes, now);
+
+    out.classId = id;
+    out.bytes = bytes;
+    return true;
+}
+
+bool HtbScheduler::trySend(uint32_t classId, uint32_t bytes, uint64_t nowNs) {
+    if (classId == ROOT_CLASS || !hasClass(classId) || !isLeaf(nodes_[classId]) ||
+        !nodes_[classId].queue.empty()) {
+        return false;
+    }
+    // A GREEN leaf may send on any path that is not RED; one that would borrow only while
+    // nothing is queued anywhere, so that it does not jump ahead of GREEN classes waiting
+    const uint64_t now = nowNs << TICK_SHIFT;
+    const Node& leaf = nodes_[classId];
+    const bool green = leaf.assured && leaf.rateBucket.readyAt() <= now;
+    if (!green && !nodes_[ROOT_CLASS].readySet.empty()) {
+        return false;
+    }
+    for (uint32_t c = classId; c != INVALID_CLASS; c = nodes_[c].parent) {
+        if (nodes_[c].ceilBucket.readyAt() > now) {
+            return false;
+        }
+    }
+    charge(classId, bytes, now);
+    return true;
+}
+
+uint32_t HtbScheduler::dropFront(uint32_t classId) {
+    if (!hasClass(classId) || nodes_[classId].queue.empty()) {
+        return 0;
+    }
+    Node& node = nodes_[classId];
+    const uint32_t bytes = node.queue.front();
+    node.queue.pop_front();
+    node.backlog -= bytes;
+    if (node.queue.empty()) {
+        refreshUpwards(classId);
+    }
+    return bytes;
+}
+
+void HtbScheduler::charge(uint32_t classId, uint32_t bytes, uint64_t now) {
+    nodes_[classId].sent += bytes;
+    // Keys embed the bucket state, so pull the path out of the ordered sets before charging
+    for (uint32_t c = classId; c != ROOT_CLASS; c = nodes_[c].parent) {
+        detachFromParent(c);
+    }
+    const uint64_t seq = ++serviceSeq_;
+    for (uint32_t c = classId; c != INVALID_CLASS; c = nodes_[c].parent) {
+        nodes_[c].rateBucket.charge(now, bytes);
+        nodes_[c].ceilBucket.charge(now, bytes);
+        nodes_[c].served = seq;
+        nodes_[c].servedAt = now;
+    }
+    refreshUpwards(classId);
+}
+
+uint64_t HtbScheduler::nextDequeueTime() const {
+    const Node& root = nodes_[ROOT_CLASS];
+    if (root.readySet.empty()) {
+        return UINT64_MAX;
+    }
+    const uint64_t ready = std::max(root.ceilBucket.readyAt(), root.readySet.begin()->ready);
+    return (ready + (1ULL << TICK_SHIFT) - 1) >> TICK_SHIFT;
+}
+
+uint64_t HtbScheduler::backlogBytes(uint32_t classId) const {
+    return hasClass(classId) ? nodes_[classId].backlog : 0;
+}
+
+uint64_t HtbScheduler::sentBytes(uint32_t classId) const {
+    return hasClass(classId) ? nodes_[classId].sent : 0;
+}
+
+uint64_t HtbScheduler::pathCeil(uint32_t classId) const {
+    if (!hasClass(classId)) {
+        return 0;
+    }
+    uint64_t ceil = 0;
+    for (uint32_t c = classId; c != INVALID_CLASS; c = nodes_[c].parent) {
+        const uint64_t own = nodes_[c].rates.ceil;
+        if (own != 0 && (ceil == 0 || own < ceil)) {
+            ceil = own;
+        }
+    }
+    return ceil;
+}
+
+bool HtbScheduler::hasWork(const Node& node) const {
+    return isLeaf(node) ? !node.queue.empty() : !node.readySet.empty();
+}
+
+void HtbScheduler::computeKeys(const Node& node, uint64_t& greenKey, uint64_t& readyKey) const {
+    // A subtree can send once this class and some active descendant path are not RED
+    uint64_t subtree = node.ceilBucket.readyAt();
+    if (!isLeaf(node)) {
+        subtree = std::max(subtree, node.readySet.begin()->ready);
+    }
+    // Flooring the ready key at the last service time never delays an eligible class (that
+    // time is already in the past) but rotates borrowers whose ceilings differ
+    readyKey = std::max(subtree, node.servedAt);
+    greenKey = node.assured ? std::max(node.rateBucket.readyAt(), subtree) : NEVER;
+}
+
+void HtbScheduler::detachFromParent(uint32_t classId) {
+    Node& node = nodes_[classId];
+    if (!node.active) {
+        return;
+    }
+    Node& parent = nodes_[node.parent];
+    parent.greenSet.erase(Key{node.greenKey, node.served, classId});
+    parent.readySet.erase(Key{node.readyKey, node.served, classId});
+    node.active = false;
+}
+
+void HtbScheduler::refreshUpwards(uint32_t classId) {
+    for (uint32_t id = classId; id != ROOT_CLASS; id = nodes_[id].parent) {
+        detachFromParent(id);
+
+        Node& node = nodes_[id];
+        if (!hasWork(node)) {
+            continue;
+        }
+        computeKeys(node, node.greenKey, node.readyKey);
+        Node& parent = nodes_[node.parent];
+        if (node.greenKey != NEVER) {
+            parent.greenSet.insert(Key{node.greenKey, node.served, id});
+        }
+        parent.readySet.insert(Key{node.readyKey, node.served, id});
+        node.active = true;
+    }
+}
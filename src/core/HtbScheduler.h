@@ -0,0 +1,142 @@
+#ifndef CORE_HTBSCHEDULER_H
+#define CORE_HTBSCHEDULER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <set>
+#include <vector>
+
+// Assured rate and ceiling of a shaping class, in bytes per second.
+// rate == 0 means no assured share (the class only borrows); ceil == 0 means the class is
+// bounded only by its ancestors.
+struct ShapingRates {
+    uint64_t rate;
+    uint64_t ceil;
+
+    ShapingRates(uint64_t r = 0, uint64_t c = 0) : rate(r), ceil(c) {}
+};
+
+// Hierarchical token bucket (HTB) scheduler for one traffic direction.
+//
+// Classes form a tree under a root whose rate is the link capacity. Leaves hold queued
+// units (packets or writes). A class is GREEN while it is within its assured rate and RED
+// once it exceeds its ceil; in between it may borrow tokens that idle siblings leave
+// unused. Sending charges the leaf and every ancestor, as in Linux HTB.
+//
+// Every inner class keeps its active children in two ordered sets: one keyed by the time
+// the child turns GREEN and one keyed by the time its subtree has a leaf that is not RED.
+// dequeue() descends from the root preferring GREEN children, so a decision costs
+// O(depth * log fanout). Borrowing children are served least-recently-served first.
+// Not thread-safe; callers serialize access.
+class HtbScheduler {
+public:
+    static constexpr uint32_t ROOT_CLASS = 0;
+    static constexpr uint32_t INVALID_CLASS = UINT32_MAX;
+
+    struct Dequeued {
+        uint32_t classId;
+        uint32_t bytes;
+    };
+
+    explicit HtbScheduler(uint64_t linkRateBytesPerSec = 0);
+
+    // Link capacity enforced at the root (0 = unlimited)
+    void setLinkRate(uint64_t rateBytesPerSec);
+    uint64_t linkRate() const;
+
+    // Adds a class under parentId; returns its id or INVALID_CLASS.
+    // A class that holds queued traffic cannot become a parent.
+    uint32_t addClass(uint32_t parentId, const ShapingRates& rates);
+    bool setClassRates(uint32_t classId, const ShapingRates& rates);
+    // Removes a class without children, dropping anything still queued in it.
+    bool removeClass(uint32_t classId);
+    bool hasClass(uint32_t classId) const;
+
+    // Queues a unit of `bytes` on a leaf class.
+    bool enqueue(uint32_t classId, uint32_t bytes);
+    // Releases the next unit allowed at nowNs, charging its class and all ancestors.
+    bool dequeue(uint64_t nowNs, Dequeued& out);
+    // Sends a unit at once, without queueing it, when the leaf has nothing queued, it and
+    // every ancestor are within their ceilings, and it is within its rate or no other class
+    // has anything queued; charges them as dequeue() does.
+    bool trySend(uint32_t classId, uint32_t bytes, uint64_t nowNs);
+    // Discards a leaf's oldest unit (head drop); returns its size, or 0 if none was queued.
+    uint32_t dropFront(uint32_t classId);
+    // Earliest time (ns) at which dequeue() can succeed; UINT64_MAX when nothing is queued.
+    uint64_t nextDequeueTime() const;
+
+    uint64_t backlogBytes(uint32_t classId) const;
+    uint64_t sentBytes(uint32_t classId) const;
+    // Lowest ceiling on the path from a class to the root (0 = unlimited), i.e. the most
+    // the class could send on its own
+    uint64_t pathCeil(uint32_t classId) const;
+    size_t classCount() const { return classCount_; }
+
+private:
+    static constexpr unsigned TICK_SHIFT = 4; // 1/16 ns, as in TokenBucket
+    static constexpr uint64_t NEVER = UINT64_MAX;
+
+    struct Key {
+        uint64_t ready;  // tick at which the child becomes eligible
+        uint64_t served; // service sequence number, for round-robin among ties
+        uint32_t id;
+
+        bool operator<(const Key& other) const {
+            if (ready != other.ready) return ready < other.ready;
+            if (served != other.served) return served < other.served;
+            return id < other.id;
+        }
+    };
+
+    struct Bucket {
+        double ticksPerByte = 0.0; // 0 = unlimited
+        uint64_t burstTicks = 0;
+        uint64_t tat = 0;
+
+        void configure(uint64_t rateBytesPerSec);
+        void charge(uint64_t now, uint32_t bytes);
+        uint64_t readyAt() const; // tick at which the bucket holds tokens again
+    };
+
+    struct Node {
+        bool used = false;
+        uint32_t parent = INVALID_CLASS;
+        std::vector<uint32_t> children;
+        ShapingRates rates;
+        bool assured = false; // rate > 0
+        Bucket rateBucket;
+        Bucket ceilBucket;
+
+        // Leaf queue
+        std::deque<uint32_t> queue;
+        uint64_t backlog = 0;
+        uint64_t sent = 0;
+
+        // Active children, ordered by GREEN time and by subtree ready time
+        std::set<Key> greenSet;
+        std::set<Key> readySet;
+
+        // This node's keys as currently stored in its parent's sets
+        bool active = false;
+        uint64_t greenKey = NEVER;
+        uint64_t readyKey = NEVER;
+        uint64_t served = 0;   // service sequence number of the last dequeue
+        uint64_t servedAt = 0; // tick of the last dequeue
+    };
+
+    bool isLeaf(const Node& node) const { return node.children.empty(); }
+    bool hasWork(const Node& node) const;
+    void applyRates(Node& node, const ShapingRates& rates);
+    void computeKeys(const Node& node, uint64_t& greenKey, uint64_t& readyKey) const;
+    void refreshUpwards(uint32_t classId);
+    void charge(uint32_t classId, uint32_t bytes, uint64_t now);
+    void detachFromParent(uint32_t classId);
+
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> freeIds_;
+    size_t classCount_;
+    uint64_t serviceSeq_;
+};
+
+#endif // CORE_HTBSCHEDULER_H
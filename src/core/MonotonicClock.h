@@ -0,0 +1,17 @@
+#ifndef CORE_MONOTONICCLOCK_H
+#define CORE_MONOTONICCLOCK_H
+
+#include <chrono>
+#include <cstdint>
+
+// Nanosecond monotonic time source shared by the rate limiting core.
+// steady_clock maps to CLOCK_MONOTONIC on Linux and QueryPerformanceCounter on Windows.
+struct MonotonicClock {
+    static uint64_t nowNs() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::steady_clock::now().time_since_epoch())
+                                         .count());
+    }
+};
+
+#endif // CORE_MONOTONICCLOCK_H
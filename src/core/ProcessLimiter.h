@@ -0,0 +1,28 @@
+#ifndef CORE_PROCESSLIMITER_H
+#define CORE_PROCESSLIMITER_H
+
+#include "TokenBucket.h"
+#include <cstdint>
+
+enum class TrafficDirection { Download, Upload };
+
+// Per-process pair of token buckets. Instances are shared (via shared_ptr) between the
+// throttler that configures them and the enforcement path that consumes from them, so
+// the hot path never needs the throttler's lock.
+struct ProcessLimiter {
+    uint32_t pid;
+    TokenBucket download;
+    TokenBucket upload;
+
+    ProcessLimiter(uint32_t p, uint64_t downloadLimitBytesPerSec, uint64_t uploadLimitBytesPerSec)
+        : pid(p), download(downloadLimitBytesPerSec), upload(uploadLimitBytesPerSec) {}
+
+    TokenBucket& bucket(TrafficDirection direction) {
+        return direction == TrafficDirection::Download ? download : upload;
+    }
+    const TokenBucket& bucket(TrafficDirection direction) const {
+        return direction == TrafficDirection::Download ? download : upload;
+    }
+};
+
+#endif // CORE_PROCESSLIMITER_H
@@ -0,0 +1,41 @@
+#ifndef CORE_SAMPLINGBUDGET_H
+#define CORE_SAMPLINGBUDGET_H
+
+#include <cstdint>
+
+// Paces an expensive periodic job so that it uses at most a fraction of one core.
+//
+// After a run that took C ns, the next run is due C / fraction ns after the previous one
+// started, but never later than maxDeferNs, so results cannot go stale indefinitely on a
+// slow host. The first run is not charged: it warms caches that later runs reuse.
+class SamplingBudget {
+public:
+    static constexpr double DEFAULT_CPU_FRACTION = 0.005;
+    static constexpr uint64_t DEFAULT_MAX_DEFER_NS = 15000000000ULL;
+
+    explicit SamplingBudget(double cpuFraction = DEFAULT_CPU_FRACTION,
+                            uint64_t maxDeferNs = DEFAULT_MAX_DEFER_NS)
+        : cpuFraction_(cpuFraction > 0.0 ? cpuFraction : DEFAULT_CPU_FRACTION),
+          maxDeferNs_(maxDeferNs), nextDueNs_(0), runs_(0) {}
+
+    bool due(uint64_t nowNs) const { return nowNs >= nextDueNs_; }
+
+    void spent(uint64_t startNs, uint64_t endNs) {
+        if (runs_++ == 0) {
+            return;
+        }
+        const double cost = static_cast<double>(endNs - startNs);
+        const double deferNs = cost / cpuFraction_;
+        nextDueNs_ = startNs + (deferNs < static_cast<double>(maxDeferNs_)
+                                    ? static_cast<uint64_t>(deferNs)
+                                    : maxDeferNs_);
+    }
+
+private:
+    double cpuFraction_;
+    uint64_t maxDeferNs_;
+    uint64_t nextDueNs_;
+    uint64_t runs_;
+};
+
+#endif // CORE_SAMPLINGBUDGET_H
@@ -0,0 +1,462 @@
+#include "SearchIndex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace {
+
+constexpr size_t MIN_REBUILD_DEAD = 1024;
+constexpr size_t MIN_GRAM_SLOTS = 1024;
+
+size_t homeSlot(uint32_t gram, size_t mask) {
+    // Fibonacci multiply, high half: grams differing in their last byte spread out
+    return static_cast<size_t>((static_cast<uint64_t>(gram) * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+}
+
+// Simple lowercase mapping of the code points that have one in the covered blocks
+uint32_t foldCodePoint(uint32_t cp) {
+    if ((cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) || (cp >= 0x391 && cp <= 0x3AB && cp != 0x3A2) ||
+        (cp >= 0x410 && cp <= 0x42F)) {
+        return cp + 0x20;
+    }
+    if (cp >= 0x400 && cp <= 0x40F) {
+        return cp + 0x50;
+    }
+    if (((cp >= 0x100 && cp <= 0x137) || (cp >= 0x14A && cp <= 0x177)) && (cp & 1) == 0) {
+        return cp + 1;
+    }
+    if (((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) && (cp & 1) == 1) {
+        return cp + 1;
+    }
+    if (cp == 0x178) {
+        return 0xFF;
+    }
+    return cp;
+}
+
+void appendFolded(const std::string& text, std::string& out) {
+    const size_t size = text.size();
+    for (size_t i = 0; i < size; ++i) {
+        const unsigned char byte = static_cast<unsigned char>(text[i]);
+        if (byte < 0x80) {
+            out.push_back(byte >= 'A' && byte <= 'Z' ? static_cast<char>(byte + ('a' - 'A')) : static_cast<char>(byte));
+            continue;
+        }
+        // Two-byte sequences hold every code point folded here (all below U+0800)
+        const unsigned char next = i + 1 < size ? static_cast<unsigned char>(text[i + 1]) : 0;
+        if ((byte & 0xE0) == 0xC0 && (next & 0xC0) == 0x80) {
+            const uint32_t cp = foldCodePoint((static_cast<uint32_t>(byte & 0x1F) << 6) | (next & 0x3F));
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            ++i;
+            continue;
+        }
+        out.push_back(static_cast<char>(byte));
+    }
+}
+
+// Key of the `length`-byte gram at text (2 or 3): the bytes, tagged with the length
+uint32_t gramAt(const char* text, size_t length) {
+    uint32_t gram = static_cast<uint32_t>(length) << 24;
+    for (size_t i = 0; i < length; ++i) {
+        gram |= static_cast<uint32_t>(static_cast<unsigned char>(text[i])) << (8 * (length - 1 - i));
+    }
+    return gram;
+}
+
+} // namespace
+
+SearchIndex::SearchIndex() : live_(0), dead_(0), gramSlots_(MIN_GRAM_SLOTS, GramSlot{0, 0}), resultsStale_(true) {}
+
+void SearchIndex::foldCase(const std::string& text, std::string& folded) {
+    folded.clear();
+    appendFolded(text, folded);
+}
+
+void SearchIndex::set(uint32_t key, const std::string* fields, size_t fieldCount) {
+    folded_.clear();
+    for (size_t i = 0; i < fieldCount; ++i) {
+        appendFolded(fields[i], folded_);
+        folded_.push_back(FIELD_SEPARATOR);
+    }
+    const uint32_t id = idOf(key);
+    if (id != NO_ID) {
+        const Document& document = documents_[id];
+        if (texts_.compare(document.offset, document.length, folded_) == 0) {
+            return;
+        }
+        remove(key);
+    }
+    addDocument(key);
+}
+
+void SearchIndex::addDocument(uint32_t key) {
+    if (documents_.size() == MAX_DOCUMENTS && dead_ != 0) {
+        rebuild(); // ids must fit their postings
+    }
+    const uint32_t id = static_cast<uint32_t>(documents_.size());
+    documents_.push_back(Document{key, static_cast<uint32_t>(texts_.size()), static_cast<uint32_t>(folded_.size()), true});
+    texts_ += folded_;
+    if (key >= ids_.size()) {
+        ids_.resize(key + 1, NO_ID);
+    }
+    ids_[key] = id;
+    ++live_;
+    addPostings(id);
+    // Ids only grow, so appending keeps the matches in order
+    uint32_t at = 0;
+    const bool match = !query_.empty() && find(documents_[id], query_, at);
+    matched_.push_back(match ? 1 : 0);
+    if (match) {
+        matches_.push_back(Match{id, at});
+    }
+    resultsStale_ = true;
+}
+
+void SearchIndex::addPostings(uint32_t id) {
+    const Document& document = documents_[id];
+    const char* text = texts_.data() + document.offset;
+    bytes_.resize(bytes_.size() + BYTE_WORDS, 0);
+    uint64_t* bytes = &bytes_[bytes_.size() - BYTE_WORDS];
+    uint32_t run = 0; // bytes since the last field separator
+    for (uint32_t i = 0; i < document.length; ++i) {
+        const unsigned char byte = static_cast<unsigned char>(text[i]);
+        if (text[i] == FIELD_SEPARATOR) {
+            run = 0;
+            continue;
+        }
+        bytes[byte / 64] |= uint64_t(1) << (byte % 64);
+        ++run;
+        for (uint32_t length = 2; length <= std::min<uint32_t>(run, 3); ++length) {
+            // Grams are met in text order, so a list already ending in this document
+            // has the first occurrence
+            const uint32_t at = i + 1 - length;
+            Postings& postings = postingsFor(gramAt(text + at, length));
+            if (postings.empty() || (postings.back() >> POSTING_AT_BITS) != id) {
+                postings.push_back(id << POSTING_AT_BITS | std::min(at, MAX_POSTING_AT));
+            }
+        }
+    }
+}
+
+void SearchIndex::remove(uint32_t key) {
+    const uint32_t id = idOf(key);
+    if (id == NO_ID) {
+        return;
+    }
+    documents_[id].alive = false;
+    matched_[id] = 0;
+    ids_[key] = NO_ID;
+    --live_;
+    ++dead_;
+    resultsStale_ = true;
+    if (dead_ >= MIN_REBUILD_DEAD && dead_ > live_) {
+        rebuild();
+    }
+}
+
+void SearchIndex::clear() {
+    texts_.clear();
+    documents_.clear();
+    bytes_.clear();
+    ids_.clear();
+    live_ = 0;
+    dead_ = 0;
+    clearPostings();
+    matched_.clear();
+    matches_.clear();
+    history_.clear();
+    results_.clear();
+    resultsStale_ = true;
+}
+
+void SearchIndex::rebuild() {
+    // Live documents get consecutive ids in their old order, so matches stay in order
+    std::vector<uint32_t> renumbered(documents_.size(), NO_ID);
+    std::string texts;
+    texts.reserve(texts_.size() / 2);
+    size_t next = 0;
+    for (uint32_t id = 0; id < documents_.size(); ++id) {
+        Document document = documents_[id];
+        if (!document.alive) {
+            continue;
+        }
+        renumbered[id] = static_cast<uint32_t>(next);
+        matched_[next] = matched_[id];
+        texts.append(texts_, document.offset, document.length);
+        document.offset = static_cast<uint32_t>(texts.size() - document.length);
+        documents_[next++] = document;
+    }
+    documents_.resize(next);
+    matched_.resize(next);
+    texts_.swap(texts);
+    size_t kept = 0;
+    for (const Match& match : matches_) {
+        if (renumbered[match.id] != NO_ID) {
+            matches_[kept++] = Match{renumbered[match.id], match.at};
+        }
+    }
+    matches_.resize(kept);
+    history_.clear(); // its ids are the old ones
+
+    dead_ = 0;
+    bytes_.clear();
+    clearPostings();
+    for (uint32_t id = 0; id < documents_.size(); ++id) {
+        ids_[documents_[id].key] = id;
+        addPostings(id);
+    }
+}
+
+bool SearchIndex::find(const Document& document, const std::string& query, uint32_t& at) const {
+    // Most often the query is right where the shorter one was found
+    const char* text = texts_.data() + document.offset;
+    if (at + query.size() <= document.length && std::memcmp(text + at, query.data(), query.size()) == 0) {
+        return true;
+    }
+    const size_t found = std::string_view(text, document.length).find(query, at + 1);
+    if (found == std::string_view::npos) {
+        return false;
+    }
+    at = static_cast<uint32_t>(found);
+    return true;
+}
+
+size_t SearchIndex::search(const std::string& query) {
+    foldCase(query, folded_);
+    if (folded_ == query_) {
+        return query_.empty() ? live_ : results().size();
+    }
+    for (const Match& match : matches_) {
+        matched_[match.id] = 0;
+    }
+    resultsStale_ = true;
+
+    // Typing on: whatever matches the longer query matched the shorter one, at most
+    // `shift` bytes after where the longer one does
+    const size_t shift = query_.empty() ? std::string::npos : folded_.find(query_);
+    if (shift != std::string::npos) {
+        history_.push_back(Step{query_, matches_, static_cast<uint32_t>(documents_.size())});
+    } else {
+        size_t step = history_.size();
+        while (step > 0 && history_[step - 1].query != folded_) {
+            --step;
+        }
+        if (step > 0) {
+            restore(history_[step - 1]);
+            history_.resize(step - 1);
+            query_.swap(folded_);
+            return markMatches();
+        }
+        history_.clear();
+    }
+    query_.swap(folded_);
+
+    if (query_.empty()) {
+        matches_.clear();
+        return live_;
+    }
+    if (query_.size() == 1) {
+        matchBytes();
+    } else if (query_.size() <= 3) {
+        matchPostings();
+    } else {
+        if (shift != std::string::npos) {
+            candidates_.swap(matches_);
+            for (Match& candidate : candidates_) {
+                candidate.at = candidate.at > shift ? static_cast<uint32_t>(candidate.at - shift) : 0;
+            }
+        } else {
+            intersectCandidates();
+        }
+        checkCandidates();
+    }
+    return markMatches();
+}
+
+void SearchIndex::restore(Step& step) {
+    // The matches of then, and whatever was set since, checked against that query
+    matches_.swap(step.matches);
+    for (uint32_t id = step.documents; id < documents_.size(); ++id) {
+        uint32_t at = 0;
+        if (documents_[id].alive && find(documents_[id], step.query, at)) {
+            matches_.push_back(Match{id, at});
+        }
+    }
+}
+
+void SearchIndex::matchBytes() {
+    const unsigned char byte = static_cast<unsigned char>(query_[0]);
+    const uint64_t bit = uint64_t(1) << (byte % 64);
+    matches_.clear();
+    for (uint32_t id = 0; id < documents_.size(); ++id) {
+        if (bytes_[id * BYTE_WORDS + byte / 64] & bit) {
+            matches_.push_back(Match{id, 0});
+        }
+    }
+}
+
+void SearchIndex::matchPostings() {
+    // A gram list is exactly the documents holding the gram (the query), and where
+    matches_.clear();
+    const Postings* found = findPostings(gramAt(query_.data(), query_.size()));
+    if (!found) {
+        return;
+    }
+    matches_.resize(found->size());
+    for (size_t i = 0; i < found->size(); ++i) {
+        matches_[i] = Match{(*found)[i] >> POSTING_AT_BITS, (*found)[i] & MAX_POSTING_AT};
+    }
+}
+
+void SearchIndex::intersectCandidates() {
+    candidates_.clear();
+    grams_.clear();
+    for (uint32_t i = 0; i + 3 <= query_.size(); ++i) {
+        grams_.emplace_back(gramAt(query_.data() + i, 3), i);
+    }
+    std::sort(grams_.begin(), grams_.end());
+    grams_.erase(std::unique(grams_.begin(), grams_.end(),
+                             [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) {
+                                 return a.first == b.first;
+                             }),
+                 grams_.end());
+    std::vector<std::pair<const Postings*, uint32_t>> lists; // and the gram's offset in the query
+    lists.reserve(grams_.size());
+    for (const std::pair<uint32_t, uint32_t>& gram : grams_) {
+        const Postings* postings = findPostings(gram.first);
+        if (!postings) {
+            return; // some trigram occurs nowhere (or spans a field separator)
+        }
+        lists.emplace_back(postings, gram.second);
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](const std::pair<const Postings*, uint32_t>& a, const std::pair<const Postings*, uint32_t>& b) {
+                  return a.first->size() < b.first->size();
+              });
+
+    // Shortest list first; where its gram first occurs bounds where the query can. Each
+    // further list only has to be searched for the survivors.
+    const Postings& shortest = *lists[0].first;
+    const uint32_t offset = lists[0].second;
+    candidates_.resize(shortest.size());
+    for (size_t i = 0; i < shortest.size(); ++i) {
+        const uint32_t at = shortest[i] & MAX_POSTING_AT;
+        candidates_[i] = Match{shortest[i] >> POSTING_AT_BITS, at > offset ? at - offset : 0};
+    }
+    for (size_t i = 1; i < lists.size() && !candidates_.empty(); ++i) {
+        const Postings& list = *lists[i].first;
+        scratch_.clear();
+        auto from = list.begin();
+        for (const Match& candidate : candidates_) {
+            from = std::lower_bound(from, list.end(), candidate.id << POSTING_AT_BITS);
+            if (from == list.end()) {
+                break;
+            }
+            if ((*from >> POSTING_AT_BITS) == candidate.id) {
+                scratch_.push_back(candidate);
+            }
+        }
+        candidates_.swap(scratch_);
+    }
+}
+
+void SearchIndex::checkCandidates() {
+    matches_.clear();
+    for (Match candidate : candidates_) {
+        const Document& document = documents_[candidate.id];
+        if (document.alive && find(document, query_, candidate.at)) {
+            matches_.push_back(candidate);
+        }
+    }
+}
+
+size_t SearchIndex::markMatches() {
+    size_t count = 0;
+    for (const Match& match : matches_) {
+        if (documents_[match.id].alive) {
+            matched_[match.id] = 1;
+            ++count;
+        }
+    }
+    return count;
+}
+
+const std::vector<uint32_t>& SearchIndex::results() {
+    if (resultsStale_) {
+        results_.clear();
+        if (query_.empty()) {
+            for (const Document& document : documents_) {
+                if (document.alive) {
+                    results_.push_back(document.key);
+                }
+            }
+        } else {
+            // Documents removed or replaced since leave dead ids behind
+            size_t kept = 0;
+            for (const Match& match : matches_) {
+                if (documents_[match.id].alive) {
+                    matches_[kept++] = match;
+                    results_.push_back(documents_[match.id].key);
+                }
+            }
+            matches_.resize(kept);
+        }
+        resultsStale_ = false;
+    }
+    return results_;
+}
+
+bool SearchIndex::matches(uint32_t key) const {
+    const uint32_t id = idOf(key);
+    return id != NO_ID && (query_.empty() || matched_[id] != 0);
+}
+
+SearchIndex::Postings& SearchIndex::postingsFor(uint32_t gram) {
+    const size_t mask = gramSlots_.size() - 1;
+    size_t slot = homeSlot(gram, mask);
+    while (gramSlots_[slot].gram != 0) {
+        if (gramSlots_[slot].gram == gram) {
+            return postings_[gramSlots_[slot].list];
+        }
+        slot = (slot + 1) & mask;
+    }
+    gramSlots_[slot] = GramSlot{gram, static_cast<uint32_t>(postings_.size())};
+    postings_.emplace_back();
+    if (postings_.size() * 2 > gramSlots_.size()) {
+        growGramSlots();
+    }
+    return postings_.back();
+}
+
+const SearchIndex::Postings* SearchIndex::findPostings(uint32_t gram) const {
+    const size_t mask = gramSlots_.size() - 1;
+    for (size_t slot = homeSlot(gram, mask); gramSlots_[slot].gram != 0; slot = (slot + 1) & mask) {
+        if (gramSlots_[slot].gram == gram) {
+            return &postings_[gramSlots_[slot].list];
+        }
+    }
+    return nullptr;
+}
+
+void SearchIndex::growGramSlots() {
+    std::vector<GramSlot> old(gramSlots_.size() * 2, GramSlot{0, 0});
+    old.swap(gramSlots_);
+    const size_t mask = gramSlots_.size() - 1;
+    for (const GramSlot& entry : old) {
+        if (entry.gram == 0) {
+            continue;
+        }
+        size_t slot = homeSlot(entry.gram, mask);
+        while (gramSlots_[slot].gram != 0) {
+            slot = (slot + 1) & mask;
+        }
+        gramSlots_[slot] = entry;
+    }
+}
+
+void SearchIndex::clearPostings() {
+    postings_.clear();
+    gramSlots_.assign(MIN_GRAM_SLOTS, GramSlot{0, 0});
+}
@@ -0,0 +1,131 @@
+#ifndef CORE_SEARCHINDEX_H
+#define CORE_SEARCHINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Case-insensitive substring search over a few text fields per key (a process's name,
+// path and PID). Keys index a table directly, so they should be small and dense, such as
+// row slots that are reused once free.
+//
+// Each document's fields are case-folded once, when they are set, and appended to one
+// buffer with a separator after each field. The bytes it holds are kept as a bitmap, and
+// its two- and three-byte substrings (grams) go into posting lists with the offset of
+// their first occurrence. A query of up to three bytes is answered by its bitmap bit or
+// gram list alone. A longer one is answered by intersecting the lists of its trigrams,
+// shortest first, and checking the candidates for the whole query from where their
+// trigram occurs; if it extends the previous query (typing on), only the previous matches
+// are checked, from where that query matched, which is usually one compare per document.
+// The matches of the queries typed on from are kept, so deleting back to one restores its
+// matches. Matches are kept as flags and ids; the text is never copied out.
+//
+// Documents get increasing ids, so posting lists stay sorted by appending. Removing or
+// replacing a document only marks it dead; its text and postings are dropped when the
+// index is rebuilt, once dead documents outnumber live ones. The active query is kept
+// current: documents set while it is active are matched against it at once, so matches()
+// is always up to date, and two array reads, as it is asked for every row of a table.
+//
+// Folding covers ASCII and the Latin-1, Latin Extended-A, Greek and Cyrillic capitals in
+// UTF-8; other text matches byte for byte. Not thread-safe.
+class SearchIndex {
+public:
+    SearchIndex();
+
+    // Adds or replaces a document; unchanged text costs one fold and compare
+    void set(uint32_t key, const std::string* fields, size_t fieldCount);
+    void remove(uint32_t key);
+    void clear();
+    size_t size() const { return live_; }
+
+    // Makes `query` the active query (an empty one matches everything); returns the
+    // number of matching documents
+    size_t search(const std::string& query);
+    bool matches(uint32_t key) const;
+    // Keys matching the active query, in the order their documents were set
+    const std::vector<uint32_t>& results();
+
+    static void foldCase(const std::string& text, std::string& folded);
+
+private:
+    struct Document {
+        uint32_t key;
+        uint32_t offset; // of its text in texts_
+        uint32_t length;
+        bool alive;
+    };
+
+    // A document and where the query first occurs in its text, or a lower bound of that
+    struct Match {
+        uint32_t id;
+        uint32_t at;
+    };
+
+    // Documents holding a gram, ascending, each packed with where the gram first occurs
+    // (id << POSTING_AT_BITS | offset, the offset capped, so a lower bound)
+    using Postings = std::vector<uint32_t>;
+
+    struct GramSlot {
+        uint32_t gram; // 0 if empty; grams carry their length, so are never 0
+        uint32_t list; // in postings_
+    };
+
+    // Matches of a query that a later one extended
+    struct Step {
+        std::string query;
+        std::vector<Match> matches;
+        uint32_t documents; // ids from here on were set after it
+    };
+
+    static constexpr char FIELD_SEPARATOR = '\x1f';
+    static constexpr uint32_t NO_ID = UINT32_MAX;
+    static constexpr size_t BYTE_WORDS = 256 / 64;
+    static constexpr uint32_t POSTING_AT_BITS = 8;
+    static constexpr uint32_t MAX_POSTING_AT = (1u << POSTING_AT_BITS) - 1;
+    static constexpr size_t MAX_DOCUMENTS = size_t(1) << (32 - POSTING_AT_BITS); // ids, dead included
+
+    void addDocument(uint32_t key);
+    void addPostings(uint32_t id);
+    bool find(const Document& document, const std::string& query, uint32_t& at) const;
+    void restore(Step& step);
+    void matchBytes();
+    void matchPostings();
+    void intersectCandidates();
+    void checkCandidates();
+    size_t markMatches();
+    void rebuild();
+
+    Postings& postingsFor(uint32_t gram);
+    const Postings* findPostings(uint32_t gram) const;
+    void growGramSlots();
+    void clearPostings();
+
+    uint32_t idOf(uint32_t key) const { return key < ids_.size() ? ids_[key] : NO_ID; }
+
+    std::string texts_; // folded fields of every document, dead ones included, by id
+    std::vector<Document> documents_; // by id
+    std::vector<uint64_t> bytes_; // by id, BYTE_WORDS each: the bytes its text holds
+    std::vector<uint32_t> ids_; // by key: id of its live document, or NO_ID
+    size_t live_;
+    size_t dead_;
+    // Lists by gram, found through an open-addressing (linear probing) table
+    std::vector<Postings> postings_;
+    std::vector<GramSlot> gramSlots_; // at most half full
+
+    std::string query_; // folded
+    std::vector<uint8_t> matched_; // by id, for a non-empty active query
+    std::vector<Match> matches_; // ascending ids; may hold dead ones
+    std::vector<Step> history_; // the queries the active one extends, shortest first
+    std::vector<uint32_t> results_; // keys
+    bool resultsStale_;
+
+    // Per call, reused
+    std::string folded_;
+    std::vector<std::pair<uint32_t, uint32_t>> grams_; // gram, offset
+    std::vector<Match> candidates_;
+    std::vector<Match> scratch_;
+};
+
+#endif // CORE_SEARCHINDEX_H
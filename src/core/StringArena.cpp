@@ -0,0 +1,42 @@
+#include "StringArena.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+} // namespace
+
+StringArena::StringArena() : bytes_(0) {}
+
+std::string_view StringArena::intern(std::string_view text) {
+    if (text.empty()) {
+        return std::string_view();
+    }
+    auto it = strings_.find(text);
+    if (it != strings_.end()) {
+        return *it;
+    }
+    if (!newest_ || newest_->capacity - newest_->used < text.size()) {
+        addBlock(text.size());
+    }
+    char* data = newest_->data.get() + newest_->used;
+    std::memcpy(data, text.data(), text.size());
+    newest_->used += text.size();
+    bytes_ += text.size();
+    const std::string_view stored(data, text.size());
+    strings_.insert(stored);
+    return stored;
+}
+
+void StringArena::addBlock(size_t minimum) {
+    // What is left of the current block goes unused; strings are far smaller than a block
+    auto block = std::make_shared<Block>();
+    block->capacity = std::max(BLOCK_SIZE, minimum);
+    block->data.reset(new char[block->capacity]);
+    block->used = 0;
+    block->previous = std::move(newest_);
+    newest_ = std::move(block);
+}
@@ -0,0 +1,55 @@
+#ifndef CORE_STRINGARENA_H
+#define CORE_STRINGARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+
+// Interned strings, stored once each in large blocks that never move.
+//
+// intern() returns a view of the arena's copy of a string, the same view for the same
+// bytes however often it is asked for, so strings that recur (process names, executable
+// paths) cost one copy for as long as the arena lives, and equal views compare by their
+// bytes as usual. Strings are never freed one by one: an owner that drops many of them
+// moves the ones it still uses to a new arena and drops the old one.
+//
+// Views stay valid while the arena, or any pin() of it, lives. A pin is shared ownership
+// of the blocks holding every string interned so far (each block owns the ones before
+// it), so data handed to other threads can carry its strings along and outlive the arena.
+// Blocks are only appended to, past what any view covers, so readers of pinned strings
+// never race the owner interning more. Interning is not thread-safe.
+class StringArena {
+public:
+    using Pin = std::shared_ptr<const void>;
+
+    StringArena();
+    StringArena(StringArena&&) = default;
+    StringArena& operator=(StringArena&&) = default;
+
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    std::string_view intern(std::string_view text);
+    Pin pin() const { return newest_; }
+
+    // Distinct strings, and the bytes they take
+    size_t size() const { return strings_.size(); }
+    size_t bytes() const { return bytes_; }
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t capacity;
+        size_t used;
+        std::shared_ptr<const Block> previous; // kept alive by this one
+    };
+
+    void addBlock(size_t minimum);
+
+    std::shared_ptr<Block> newest_;
+    std::unordered_set<std::string_view> strings_;
+    size_t bytes_;
+};
+
+#endif // CORE_STRINGARENA_H
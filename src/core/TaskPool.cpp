@@ -0,0 +1,81 @@
+#include "TaskPool.h"
+
+#include <algorithm>
+
+size_t TaskPool::defaultWorkers() {
+    const unsigned cores = std::thread::hardware_concurrency();
+    return cores > 1 ? std::min<size_t>(cores - 1, MAX_DEFAULT_WORKERS) : 0;
+}
+
+TaskPool::TaskPool(size_t workers)
+    : stopping_(false), generation_(0), busy_(0), task_(nullptr), count_(0), next_(0) {
+    workers_.reserve(workers);
+    for (size_t i = 0; i < workers; ++i) {
+        workers_.emplace_back(&TaskPool::workerLoop, this, i + 1);
+    }
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void TaskPool::run(size_t count, const std::function<void(size_t, size_t)>& task) {
+    if (workers_.empty() || count <= BATCH) {
+        for (size_t i = 0; i < count; ++i) {
+            task(i, 0);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        count_ = count;
+        next_.store(0, std::memory_order_relaxed);
+        busy_ = workers_.size();
+        ++generation_;
+    }
+    wake_.notify_all();
+    work(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return busy_ == 0; });
+    task_ = nullptr;
+}
+
+void TaskPool::workerLoop(size_t slot) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        wake_.wait(lock, [this, seen]() { return stopping_ || generation_ != seen; });
+        if (stopping_) {
+            return;
+        }
+        seen = generation_;
+        lock.unlock();
+        work(slot);
+        lock.lock();
+        if (--busy_ == 0) {
+            done_.notify_one();
+        }
+    }
+}
+
+void TaskPool::work(size_t slot) {
+    for (;;) {
+        const size_t begin = next_.fetch_add(BATCH, std::memory_order_relaxed);
+        if (begin >= count_) {
+            return;
+        }
+        const size_t end = std::min(begin + BATCH, count_);
+        for (size_t i = begin; i < end; ++i) {
+            (*task_)(i, slot);
+        }
+    }
+}
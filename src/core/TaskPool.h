@@ -0,0 +1,57 @@
+#ifndef CORE_TASKPOOL_H
+#define CORE_TASKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for splitting a loop of independent, blocking calls (procfs
+// reads, process handle queries) across cores.
+//
+// run() hands out indices in small batches to the workers and to the calling thread, which
+// works along, and returns once every index was processed. Each call of the task gets the
+// slot of the thread running it (0 for the caller, below concurrency()), so tasks can keep
+// per-thread scratch buffers without locking. With no workers, run() is a plain loop.
+// One run() at a time; it is not reentrant.
+class TaskPool {
+public:
+    // One thread per core beyond the caller's, at most MAX_DEFAULT_WORKERS
+    static constexpr size_t MAX_DEFAULT_WORKERS = 7;
+    static size_t defaultWorkers();
+
+    explicit TaskPool(size_t workers = defaultWorkers());
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    // Threads that may run a task: the workers and the caller
+    size_t concurrency() const { return workers_.size() + 1; }
+
+    // Calls task(index, slot) for every index below count
+    void run(size_t count, const std::function<void(size_t index, size_t slot)>& task);
+
+private:
+    static constexpr size_t BATCH = 8;
+
+    void workerLoop(size_t slot);
+    void work(size_t slot);
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    bool stopping_;
+    uint64_t generation_; // run() calls so far; a change wakes the workers
+    size_t busy_;         // workers not yet done with the current run
+    const std::function<void(size_t, size_t)>* task_;
+    size_t count_;
+    std::atomic<size_t> next_;
+};
+
+#endif // CORE_TASKPOOL_H
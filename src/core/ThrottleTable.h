@@ -0,0 +1,234 @@
+#ifndef CORE_THROTTLETABLE_H
+#define CORE_THROTTLETABLE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// PID -> per-throttle state, for thousands of concurrent throttles with frequent start and
+// stop churn.
+//
+// The table is split into shards by PID hash, each an open-addressing (linear probing)
+// array with its own mutex, so operations on different PIDs rarely contend. A shard grows
+// by doubling at half load, and removal shifts later entries back instead of leaving
+// tombstones. Callers that need a multi-step update for one PID (stop if present, then
+// start) hold that PID's shard mutex across the steps; the convenience methods lock it
+// themselves. PID 0 is reserved for empty slots.
+template <typename Value>
+class ThrottleTable {
+public:
+    static constexpr size_t SHARD_COUNT = 64;
+
+    class Shard {
+    public:
+        // Every method below requires the mutex to be held
+        mutable std::mutex mutex;
+
+        Value* find(uint32_t pid) {
+            const size_t index = locate(pid);
+            return index == NOT_FOUND ? nullptr : &slots_[index].value;
+        }
+        const Value* find(uint32_t pid) const {
+            const size_t index = locate(pid);
+            return index == NOT_FOUND ? nullptr : &slots_[index].value;
+        }
+
+        // Adds or replaces; true if the PID was not present
+        bool insert(uint32_t pid, Value value) {
+            if (pid == EMPTY) {
+                return false;
+            }
+            if (Value* existing = find(pid)) {
+                *existing = std::move(value);
+                return false;
+            }
+            if ((size_ + 1) * 2 > slots_.size()) {
+                grow();
+            }
+            place(pid, std::move(value));
+            ++size_;
+            return true;
+        }
+
+        bool erase(uint32_t pid) {
+            size_t hole = locate(pid);
+            if (hole == NOT_FOUND) {
+                return false;
+            }
+            // Backward-shift deletion: pull later chain members into the hole
+            const size_t mask = slots_.size() - 1;
+            for (size_t next = (hole + 1) & mask; slots_[next].pid != EMPTY; next = (next + 1) & mask) {
+                const size_t desired = home(slots_[next].pid, mask);
+                if (((next - desired) & mask) >= ((next - hole) & mask)) {
+                    slots_[hole] = std::move(slots_[next]);
+                    hole = next;
+                }
+            }
+            slots_[hole].pid = EMPTY;
+            slots_[hole].value = Value();
+            --size_;
+            return true;
+        }
+
+        size_t size() const { return size_; }
+
+        template <typename Fn>
+        void forEach(Fn&& fn) const {
+            for (const Slot& slot : slots_) {
+                if (slot.pid != EMPTY) {
+                    fn(slot.pid, slot.value);
+                }
+            }
+        }
+
+    private:
+        static constexpr uint32_t EMPTY = 0;
+        static constexpr size_t NOT_FOUND = SIZE_MAX;
+        static constexpr size_t INITIAL_CAPACITY = 16;
+
+        struct Slot {
+            uint32_t pid = EMPTY;
+            Value value = Value();
+        };
+
+        // The shard was chosen by the top bits of the same hash; slots use the low ones
+        static size_t home(uint32_t pid, size_t mask) { return static_cast<size_t>(hash(pid)) & mask; }
+
+        size_t locate(uint32_t pid) const {
+            if (pid == EMPTY || slots_.empty()) {
+                return NOT_FOUND;
+            }
+            const size_t mask = slots_.size() - 1;
+            for (size_t index = home(pid, mask);; index = (index + 1) & mask) {
+                if (slots_[index].pid == pid) {
+                    return index;
+                }
+                if (slots_[index].pid == EMPTY) {
+                    return NOT_FOUND;
+                }
+            }
+        }
+
+        void place(uint32_t pid, Value value) {
+            const size_t mask = slots_.size() - 1;
+            size_t index = home(pid, mask);
+            while (slots_[index].pid != EMPTY) {
+                index = (index + 1) & mask;
+            }
+            slots_[index].pid = pid;
+            slots_[index].value = std::move(value);
+        }
+
+        void grow() {
+            std::vector<Slot> old(slots_.empty() ? INITIAL_CAPACITY : slots_.size() * 2);
+            old.swap(slots_);
+            for (Slot& slot : old) {
+                if (slot.pid != EMPTY) {
+                    place(slot.pid, std::move(slot.value));
+                }
+            }
+        }
+
+        std::vector<Slot> slots_;
+        size_t size_ = 0;
+    };
+
+    ThrottleTable() = default;
+    ThrottleTable(const ThrottleTable&) = delete;
+    ThrottleTable& operator=(const ThrottleTable&) = delete;
+
+    Shard& shard(uint32_t pid) { return shards_[shardIndex(pid)].shard; }
+    const Shard& shard(uint32_t pid) const { return shards_[shardIndex(pid)].shard; }
+
+    // Locks the shards of all the PIDs in shard order, so that concurrent batches cannot
+    // deadlock; single-PID operations lock only one shard and never wait on a second
+    std::vector<std::unique_lock<std::mutex>> lockShards(const std::vector<uint32_t>& pids) {
+        std::vector<size_t> indexes;
+        indexes.reserve(pids.size());
+        for (uint32_t pid : pids) {
+            indexes.push_back(shardIndex(pid));
+        }
+        std::sort(indexes.begin(), indexes.end());
+        indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+        std::vector<std::unique_lock<std::mutex>> locks;
+        locks.reserve(indexes.size());
+        for (size_t index : indexes) {
+            locks.emplace_back(shards_[index].shard.mutex);
+        }
+        return locks;
+    }
+
+    bool find(uint32_t pid, Value& value) const {
+        const Shard& owner = shard(pid);
+        std::lock_guard<std::mutex> lock(owner.mutex);
+        const Value* found = owner.find(pid);
+        if (found) {
+            value = *found;
+        }
+        return found != nullptr;
+    }
+
+    bool contains(uint32_t pid) const {
+        const Shard& owner = shard(pid);
+        std::lock_guard<std::mutex> lock(owner.mutex);
+        return owner.find(pid) != nullptr;
+    }
+
+    bool insert(uint32_t pid, Value value) {
+        Shard& owner = shard(pid);
+        std::lock_guard<std::mutex> lock(owner.mutex);
+        return owner.insert(pid, std::move(value));
+    }
+
+    bool erase(uint32_t pid) {
+        Shard& owner = shard(pid);
+        std::lock_guard<std::mutex> lock(owner.mutex);
+        return owner.erase(pid);
+    }
+
+    // Locks one shard at a time, so the result is not an atomic snapshot of the table
+    size_t size() const {
+        size_t total = 0;
+        for (const PaddedShard& padded : shards_) {
+            std::lock_guard<std::mutex> lock(padded.shard.mutex);
+            total += padded.shard.size();
+        }
+        return total;
+    }
+
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (const PaddedShard& padded : shards_) {
+            std::lock_guard<std::mutex> lock(padded.shard.mutex);
+            padded.shard.forEach(fn);
+        }
+    }
+
+    std::vector<uint32_t> pids() const {
+        std::vector<uint32_t> result;
+        forEach([&result](uint32_t pid, const Value&) { result.push_back(pid); });
+        return result;
+    }
+
+private:
+    static constexpr unsigned SHARD_BITS = 6;
+    static_assert(SHARD_COUNT == size_t(1) << SHARD_BITS, "shard count must match its bits");
+
+    static uint64_t hash(uint32_t pid) {
+        // Consecutive PIDs are common; a Fibonacci multiply spreads them across shards
+        return static_cast<uint64_t>(pid) * 0x9e3779b97f4a7c15ULL;
+    }
+    static size_t shardIndex(uint32_t pid) { return static_cast<size_t>(hash(pid) >> (64 - SHARD_BITS)); }
+
+    // Each shard's mutex gets its own cache line
+    struct alignas(64) PaddedShard {
+        Shard shard;
+    };
+
+    PaddedShard shards_[SHARD_COUNT];
+};
+
+#endif // CORE_THROTTLETABLE_H
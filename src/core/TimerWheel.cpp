@@ -0,0 +1,222 @@
+#include "TimerWheel.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+unsigned highestBit(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    return 63u - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+}
+
+unsigned lowestBit(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(value));
+#endif
+}
+
+} // namespace
+
+TimerWheel::TimerWheel(uint64_t startNs)
+    : heads_(LEVELS * SLOTS + 1, NIL), current_(startNs / 1000), size_(0) {
+    std::memset(occupied_, 0, sizeof(occupied_));
+}
+
+TimerWheel::TimerId TimerWheel::schedule(uint64_t deadlineNs, uint64_t cookie) {
+    uint32_t index;
+    if (!freeList_.empty()) {
+        index = freeList_.back();
+        freeList_.pop_back();
+    } else {
+        index = static_cast<uint32_t>(entries_.size());
+        entries_.push_back(Entry{0, 0, 0, NIL, NIL, NIL, 1});
+    }
+
+    Entry& entry = entries_[index];
+    entry.expiry = std::max(toTickCeil(deadlineNs), current_);
+    entry.deadlineNs = deadlineNs;
+    entry.cookie = cookie;
+    insert(index);
+    ++size_;
+    return makeId(index, entry.generation);
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    const uint32_t index = static_cast<uint32_t>(id & 0xFFFFFFFFu);
+    const uint32_t generation = static_cast<uint32_t>(id >> 32);
+    if (index >= entries_.size() || entries_[index].generation != generation ||
+        entries_[index].list == NIL) {
+        return false;
+    }
+    unlink(index);
+    release(index);
+    return true;
+}
+
+size_t TimerWheel::advance(uint64_t nowNs, std::vector<Expired>& expired) {
+    const uint64_t target = nowNs / 1000;
+    size_t fired = 0;
+
+    while (size_ != 0 && current_ <= target) {
+        const uint64_t tick = nextEventTick();
+        if (tick > target) {
+            break;
+        }
+        current_ = tick;
+
+        // Cascade from the highest level whose slot boundary was reached, so timers land
+        // in the right lower level before that level is looked at.
+        if ((current_ & ((1ULL << (SLOT_BITS * LEVELS)) - 1)) == 0) {
+            cascade(OVERFLOW_LIST);
+        }
+        for (unsigned level = LEVELS - 1; level >= 1; --level) {
+            if ((current_ & ((1ULL << (SLOT_BITS * level)) - 1)) == 0) {
+                cascade(level * SLOTS + ((current_ >> (SLOT_BITS * level)) & (SLOTS - 1)));
+            }
+        }
+
+        const uint32_t slot = static_cast<uint32_t>(current_ & (SLOTS - 1));
+        uint32_t index = heads_[slot];
+        while (index != NIL) {
+            const uint32_t next = entries_[index].next;
+            expired.push_back(Expired{entries_[index].cookie, entries_[index].deadlineNs});
+            entries_[index].list = NIL;
+            release(index);
+            ++fired;
+            index = next;
+        }
+        heads_[slot] = NIL;
+        occupied_[0][slot / 64] &= ~(1ULL << (slot % 64));
+
+        ++current_;
+    }
+
+    current_ = std::max(current_, target + 1);
+    return fired;
+}
+
+uint64_t TimerWheel::nextExpiry() const {
+    if (size_ == 0) {
+        return UINT64_MAX;
+    }
+    return nextEventTick() * 1000;
+}
+
+bool TimerWheel::rebase(uint64_t nowNs) {
+    if (size_ != 0) {
+        return false;
+    }
+    current_ = nowNs / 1000;
+    return true;
+}
+
+void TimerWheel::insert(uint32_t index) {
+    const uint64_t expiry = entries_[index].expiry;
+    const uint64_t diff = expiry ^ current_;
+    const unsigned level = diff == 0 ? 0 : highestBit(diff) / SLOT_BITS;
+    if (level >= LEVELS) {
+        link(index, OVERFLOW_LIST);
+        return;
+    }
+    link(index, level * SLOTS + static_cast<uint32_t>((expiry >> (SLOT_BITS * level)) & (SLOTS - 1)));
+}
+
+void TimerWheel::link(uint32_t index, uint32_t list) {
+    Entry& entry = entries_[index];
+    entry.list = list;
+    entry.prev = NIL;
+    entry.next = heads_[list];
+    if (entry.next != NIL) {
+        entries_[entry.next].prev = index;
+    }
+    heads_[list] = index;
+    if (list != OVERFLOW_LIST) {
+        const unsigned slot = list % SLOTS;
+        occupied_[list / SLOTS][slot / 64] |= 1ULL << (slot % 64);
+    }
+}
+
+void TimerWheel::unlink(uint32_t index) {
+    Entry& entry = entries_[index];
+    if (entry.prev != NIL) {
+        entries_[entry.prev].next = entry.next;
+    } else {
+        heads_[entry.list] = entry.next;
+    }
+    if (entry.next != NIL) {
+        entries_[entry.next].prev = entry.prev;
+    }
+    if (heads_[entry.list] == NIL && entry.list != OVERFLOW_LIST) {
+        const unsigned slot = entry.list % SLOTS;
+        occupied_[entry.list / SLOTS][slot / 64] &= ~(1ULL << (slot % 64));
+    }
+    entry.list = NIL;
+}
+
+void TimerWheel::release(uint32_t index) {
+    Entry& entry = entries_[index];
+    entry.list = NIL;
+    ++entry.generation;
+    if (entry.generation == 0) {
+        entry.generation = 1; // keep ids distinct from INVALID_TIMER
+    }
+    freeList_.push_back(index);
+    --size_;
+}
+
+void TimerWheel::cascade(uint32_t list) {
+    uint32_t index = heads_[list];
+    heads_[list] = NIL;
+    if (list != OVERFLOW_LIST) {
+        const unsigned slot = list % SLOTS;
+        occupied_[list / SLOTS][slot / 64] &= ~(1ULL << (slot % 64));
+    }
+    while (index != NIL) {
+        const uint32_t next = entries_[index].next;
+        insert(index);
+        index = next;
+    }
+}
+
+int TimerWheel::findSlot(unsigned level, unsigned from) const {
+    for (unsigned word = from / 64; word < WORDS; ++word) {
+        uint64_t bits = occupied_[level][word];
+        if (word == from / 64) {
+            bits &= ~0ULL << (from % 64);
+        }
+        if (bits != 0) {
+            return static_cast<int>(word * 64 + lowestBit(bits));
+        }
+    }
+    return -1;
+}
+
+uint64_t TimerWheel::nextEventTick() const {
+    // Level 0 slots fire at their own tick; higher levels only need attention when the
+    // wheel reaches an occupied slot boundary; the overflow list at the next 2^32 boundary.
+    uint64_t best = NONE;
+    for (unsigned level = 0; level < LEVELS; ++level) {
+        const unsigned shift = SLOT_BITS * level;
+        const unsigned from = static_cast<unsigned>((current_ >> shift) & (SLOTS - 1));
+        const int slot = findSlot(level, from);
+        if (slot >= 0) {
+            const uint64_t above = current_ & ~((1ULL << (shift + SLOT_BITS)) - 1);
+            best = std::min(best, above | (static_cast<uint64_t>(slot) << shift));
+        }
+    }
+    if (heads_[OVERFLOW_LIST] != NIL) {
+        const uint64_t span = 1ULL << (SLOT_BITS * LEVELS);
+        best = std::min(best, (current_ & ~(span - 1)) + span);
+    }
+    return best;
+}
@@ -0,0 +1,87 @@
+#ifndef CORE_TIMERWHEEL_H
+#define CORE_TIMERWHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hierarchical timing wheel with microsecond resolution.
+//
+// Four levels of 256 slots cover 2^32 us (about 71 minutes) ahead of the current tick;
+// later deadlines wait in an overflow list. A timer lives in the level selected by the
+// highest bit in which its expiry differs from the current tick and moves down one level
+// each time the wheel reaches its slot, so schedule/cancel are O(1) and each timer is
+// touched at most once per level before it fires. Per-level occupancy bitmaps let
+// advance() jump over empty stretches instead of walking every microsecond.
+//
+// Timers never fire early: deadlines are rounded up to the next microsecond.
+// Not thread-safe; callers serialize access.
+class TimerWheel {
+public:
+    using TimerId = uint64_t;
+    static constexpr TimerId INVALID_TIMER = 0;
+
+    struct Expired {
+        uint64_t cookie;
+        uint64_t deadlineNs;
+    };
+
+    explicit TimerWheel(uint64_t startNs = 0);
+
+    // Registers a timer; deadlines in the past fire on the next advance().
+    TimerId schedule(uint64_t deadlineNs, uint64_t cookie);
+    bool cancel(TimerId id);
+
+    // Fires every timer due at nowNs, appending them to `expired`; returns the count.
+    size_t advance(uint64_t nowNs, std::vector<Expired>& expired);
+
+    // Lower bound (ns) on the next deadline; UINT64_MAX when no timers are pending.
+    uint64_t nextExpiry() const;
+
+    // Moves an empty wheel to a new time base (e.g. when switching to a virtual clock).
+    bool rebase(uint64_t nowNs);
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+private:
+    static constexpr unsigned LEVELS = 4;
+    static constexpr unsigned SLOT_BITS = 8;
+    static constexpr unsigned SLOTS = 1u << SLOT_BITS;
+    static constexpr unsigned WORDS = SLOTS / 64;
+    static constexpr uint32_t OVERFLOW_LIST = LEVELS * SLOTS;
+    static constexpr uint32_t NIL = UINT32_MAX;
+    static constexpr uint64_t NONE = UINT64_MAX;
+
+    struct Entry {
+        uint64_t expiry; // tick (us)
+        uint64_t deadlineNs;
+        uint64_t cookie;
+        uint32_t prev;
+        uint32_t next;
+        uint32_t list; // slot index or OVERFLOW_LIST while scheduled, NIL while free
+        uint32_t generation;
+    };
+
+    static uint64_t toTickCeil(uint64_t ns) { return ns / 1000 + (ns % 1000 != 0 ? 1 : 0); }
+    static TimerId makeId(uint32_t index, uint32_t generation) {
+        return (static_cast<uint64_t>(generation) << 32) | index;
+    }
+
+    void insert(uint32_t index);
+    void link(uint32_t index, uint32_t list);
+    void unlink(uint32_t index);
+    void release(uint32_t index);
+    void cascade(uint32_t list);
+    uint64_t nextEventTick() const;
+    int findSlot(unsigned level, unsigned from) const;
+
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> freeList_;
+    std::vector<uint32_t> heads_; // LEVELS * SLOTS slot lists plus the overflow list
+    uint64_t occupied_[LEVELS][WORDS];
+    uint64_t current_; // first tick not yet processed
+    size_t size_;
+};
+
+#endif // CORE_TIMERWHEEL_H
@@ -0,0 +1,126 @@
+#include "TokenBucket.h"
+#include "MonotonicClock.h"
+
+#include <algorithm>
+#include <cmath>
+
+TokenBucket::TokenBucket()
+    : tat_(0), rate_(0), burst_(0), burstTicks_(0), ticksPerByte_(0.0) {}
+
+TokenBucket::TokenBucket(uint64_t rateBytesPerSec, uint64_t burstBytes) : TokenBucket() {
+    configure(rateBytesPerSec, burstBytes);
+}
+
+void TokenBucket::configure(uint64_t rateBytesPerSec, uint64_t burstBytes) {
+    if (rateBytesPerSec == 0) {
+        ticksPerByte_.store(0.0, std::memory_order_relaxed);
+        rate_.store(0, std::memory_order_relaxed);
+        burst_.store(0, std::memory_order_relaxed);
+        burstTicks_.store(0, std::memory_order_relaxed);
+        tat_.store(0, std::memory_order_release);
+        return;
+    }
+
+    if (burstBytes == 0) {
+        burstBytes = std::max(rateBytesPerSec / DEFAULT_BURST_DIVISOR, MIN_BURST_BYTES);
+    }
+
+    const double ticksPerByte =
+        static_cast<double>(1000000000ULL << TICK_SHIFT) / static_cast<double>(rateBytesPerSec);
+
+    rate_.store(rateBytesPerSec, std::memory_order_relaxed);
+    burst_.store(burstBytes, std::memory_order_relaxed);
+    ticksPerByte_.store(ticksPerByte, std::memory_order_relaxed);
+    burstTicks_.store(costTicks(burstBytes), std::memory_order_relaxed);
+    // A TAT in the past means a full bucket
+    tat_.store(0, std::memory_order_release);
+}
+
+void TokenBucket::setRate(uint64_t rateBytesPerSec, uint64_t nowNs) {
+    if (isUnlimited() || rateBytesPerSec == 0) {
+        configure(rateBytesPerSec);
+        return;
+    }
+    const uint64_t tokens = availableTokens(nowNs);
+    configure(rateBytesPerSec);
+    const uint64_t burstTicks = burstTicks_.load(std::memory_order_relaxed);
+    const uint64_t keptTicks = std::min(costTicks(tokens), burstTicks);
+    tat_.store(toTicks(nowNs) + burstTicks - keptTicks, std::memory_order_release);
+}
+
+uint64_t TokenBucket::costTicks(uint64_t bytes) const {
+    return static_cast<uint64_t>(
+        std::llround(static_cast<double>(bytes) * ticksPerByte_.load(std::memory_order_relaxed)));
+}
+
+bool TokenBucket::tryConsume(uint64_t bytes) {
+    return tryConsume(bytes, MonotonicClock::nowNs());
+}
+
+bool TokenBucket::tryConsume(uint64_t bytes, uint64_t nowNs) {
+    if (ticksPerByte_.load(std::memory_order_relaxed) == 0.0) {
+        return true;
+    }
+
+    const uint64_t now = toTicks(nowNs);
+    const uint64_t cost = costTicks(bytes);
+    const uint64_t burstTicks = burstTicks_.load(std::memory_order_relaxed);
+
+    uint64_t tat = tat_.load(std::memory_order_acquire);
+    for (;;) {
+        const uint64_t base = std::max(tat, now);
+        // Reject when the new arrival time would exceed the burst window. A request larger
+        // than the whole burst is still admitted against a full bucket so it cannot starve.
+        if (base > now && base + cost > now + burstTicks) {
+            return false;
+        }
+        if (tat_.compare_exchange_weak(tat, base + cost, std::memory_order_acq_rel,
+                                       std::memory_order_acquire)) {
+            return true;
+        }
+    }
+}
+
+uint64_t TokenBucket::nextAvailableAt(uint64_t bytes) const {
+    return nextAvailableAt(bytes, MonotonicClock::nowNs());
+}
+
+uint64_t TokenBucket::nextAvailableAt(uint64_t bytes, uint64_t nowNs) const {
+    if (ticksPerByte_.load(std::memory_order_relaxed) == 0.0) {
+        return nowNs;
+    }
+
+    const uint64_t now = toTicks(nowNs);
+    const uint64_t tat = tat_.load(std::memory_order_acquire);
+    if (tat <= now) {
+        return nowNs;
+    }
+
+    const uint64_t cost = costTicks(bytes);
+    const uint64_t burstTicks = burstTicks_.load(std::memory_order_relaxed);
+
+    // Oversized requests wait for a full bucket, everything else for enough headroom
+    if (cost > burstTicks) {
+        return toNsCeil(tat);
+    }
+    if (tat + cost <= now + burstTicks) {
+        return nowNs;
+    }
+    return toNsCeil(tat + cost - burstTicks);
+}
+
+uint64_t TokenBucket::availableTokens(uint64_t nowNs) const {
+    const double ticksPerByte = ticksPerByte_.load(std::memory_order_relaxed);
+    if (ticksPerByte == 0.0) {
+        return UINT64_MAX;
+    }
+
+    const uint64_t now = toTicks(nowNs);
+    const uint64_t tat = tat_.load(std::memory_order_acquire);
+    const uint64_t burstTicks = burstTicks_.load(std::memory_order_relaxed);
+    const uint64_t debt = tat > now ? tat - now : 0;
+    if (debt >= burstTicks) {
+        return 0;
+    }
+    return static_cast<uint64_t>(static_cast<double>(burstTicks - debt) / ticksPerByte);
+}
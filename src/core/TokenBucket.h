@@ -0,0 +1,63 @@
+#ifndef CORE_TOKENBUCKET_H
+#define CORE_TOKENBUCKET_H
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free token bucket implemented as a generic cell rate algorithm (GCRA).
+// The whole bucket state is one "theoretical arrival time" (TAT) that advances by the
+// cost of every admitted byte, so refill is continuous at nanosecond resolution and a
+// decision is a single compare-and-swap. A rate of 0 means unlimited.
+class TokenBucket {
+public:
+    static constexpr uint64_t MIN_BURST_BYTES = 1500; // one Ethernet MTU
+    static constexpr uint64_t DEFAULT_BURST_DIVISOR = 10; // 100 ms worth of tokens
+
+    TokenBucket();
+    explicit TokenBucket(uint64_t rateBytesPerSec, uint64_t burstBytes = 0);
+
+    TokenBucket(const TokenBucket&) = delete;
+    TokenBucket& operator=(const TokenBucket&) = delete;
+
+    // Changes the rate and burst size and refills the bucket.
+    // burstBytes == 0 selects a default of 100 ms worth of traffic (at least one MTU).
+    void configure(uint64_t rateBytesPerSec, uint64_t burstBytes = 0);
+    // Changes the rate (with the default burst) but keeps the tokens currently in the
+    // bucket, up to the new burst, so frequent retuning neither refills nor drains it.
+    void setRate(uint64_t rateBytesPerSec, uint64_t nowNs);
+
+    // Admits `bytes` if enough tokens are available and consumes them.
+    bool tryConsume(uint64_t bytes);
+    bool tryConsume(uint64_t bytes, uint64_t nowNs);
+
+    // Monotonic time (ns) at which tryConsume(bytes) is expected to succeed.
+    // Returns nowNs when the request could be admitted immediately.
+    uint64_t nextAvailableAt(uint64_t bytes) const;
+    uint64_t nextAvailableAt(uint64_t bytes, uint64_t nowNs) const;
+
+    // Tokens currently in the bucket (bytes).
+    uint64_t availableTokens(uint64_t nowNs) const;
+
+    uint64_t rate() const { return rate_.load(std::memory_order_relaxed); }
+    uint64_t burst() const { return burst_.load(std::memory_order_relaxed); }
+    bool isUnlimited() const { return rate() == 0; }
+
+private:
+    // Time is kept in 1/16 ns ticks so that tiny per-byte costs at high rates do not
+    // accumulate rounding error; 60 bits of ticks still cover decades of uptime.
+    static constexpr unsigned TICK_SHIFT = 4;
+
+    static uint64_t toTicks(uint64_t ns) { return ns << TICK_SHIFT; }
+    static uint64_t toNsCeil(uint64_t ticks) {
+        return (ticks + (1ULL << TICK_SHIFT) - 1) >> TICK_SHIFT;
+    }
+    uint64_t costTicks(uint64_t bytes) const;
+
+    std::atomic<uint64_t> tat_;
+    std::atomic<uint64_t> rate_;
+    std::atomic<uint64_t> burst_;
+    std::atomic<uint64_t> burstTicks_;
+    std::atomic<double> ticksPerByte_;
+};
+
+#endif // CORE_TOKENBUCKET_H
@@ -0,0 +1,122 @@
+#include "TrafficAccountant.h"
+
+#include <algorithm>
+#include <cmath>
+
+TrafficAccountant::TrafficAccountant(uint64_t timeConstantNs)
+    : timeConstantNs_(timeConstantNs > 0 ? timeConstantNs : 1), generation_(0), sampleNs_(0),
+      lastSampleNs_(0) {}
+
+void TrafficAccountant::beginSample(uint64_t nowNs) {
+    ++generation_;
+    sampleNs_ = nowNs;
+}
+
+void TrafficAccountant::record(const SocketCounters& socket) {
+    auto inserted = sockets_.try_emplace(socket.socketId);
+    SocketState& state = inserted.first->second;
+
+    uint64_t received = 0;
+    uint64_t sent = 0;
+    if (inserted.second) {
+        state.pendingReceived = 0;
+        state.pendingSent = 0;
+        if (generation_ > 1) {
+            // Opened since the previous sample: everything it carried is new
+            received = socket.bytesReceived;
+            sent = socket.bytesSent;
+        }
+    } else if (socket.bytesReceived < state.bytesReceived || socket.bytesSent < state.bytesSent) {
+        // Counters went backwards: the id now names a different socket
+        received = socket.bytesReceived;
+        sent = socket.bytesSent;
+    } else {
+        received = socket.bytesReceived - state.bytesReceived;
+        sent = socket.bytesSent - state.bytesSent;
+    }
+
+    state.bytesReceived = socket.bytesReceived;
+    state.bytesSent = socket.bytesSent;
+    state.pid = socket.pid;
+    state.generation = generation_;
+
+    if (socket.pid == UNKNOWN_PID) {
+        state.pendingReceived += received;
+        state.pendingSent += sent;
+        return;
+    }
+    credit(socket.pid, received + state.pendingReceived, sent + state.pendingSent, socket);
+    state.pendingReceived = 0;
+    state.pendingSent = 0;
+}
+
+void TrafficAccountant::credit(uint32_t pid, uint64_t received, uint64_t sent,
+                               const SocketCounters& socket) {
+    auto inserted = processes_.try_emplace(pid);
+    ProcessState& process = inserted.first->second;
+    if (inserted.second) {
+        process.traffic = ProcessTraffic{0, 0, 0.0, 0.0, 0, 0};
+        process.intervalReceived = 0;
+        process.intervalSent = 0;
+        process.intervalRttUs = 0;
+        process.intervalMinRttUs = 0;
+    }
+    process.traffic.totalDownloaded += received;
+    process.traffic.totalUploaded += sent;
+    process.intervalReceived += received;
+    process.intervalSent += sent;
+
+    // Idle connections keep a stale RTT, so only sockets that moved data count
+    if ((received != 0 || sent != 0) && socket.rttUs != 0) {
+        process.intervalRttUs = std::max(process.intervalRttUs, socket.rttUs);
+        const uint32_t minRtt = socket.minRttUs != 0 ? socket.minRttUs : socket.rttUs;
+        process.intervalMinRttUs =
+            process.intervalMinRttUs == 0 ? minRtt : std::min(process.intervalMinRttUs, minRtt);
+    }
+}
+
+void TrafficAccountant::endSample() {
+    for (auto it = sockets_.begin(); it != sockets_.end();) {
+        if (it->second.generation != generation_) {
+            it = sockets_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // The first sample only establishes baselines
+    if (generation_ > 1 && sampleNs_ > lastSampleNs_) {
+        const double intervalNs = static_cast<double>(sampleNs_ - lastSampleNs_);
+        const double alpha = 1.0 - std::exp(-intervalNs / static_cast<double>(timeConstantNs_));
+        for (auto& entry : processes_) {
+            ProcessState& process = entry.second;
+            const double down = static_cast<double>(process.intervalReceived) * 1e9 / intervalNs;
+            const double up = static_cast<double>(process.intervalSent) * 1e9 / intervalNs;
+            process.traffic.downloadRate += alpha * (down - process.traffic.downloadRate);
+            process.traffic.uploadRate += alpha * (up - process.traffic.uploadRate);
+            process.intervalReceived = 0;
+            process.intervalSent = 0;
+        }
+    }
+    for (auto& entry : processes_) {
+        ProcessState& process = entry.second;
+        process.traffic.rttUs = process.intervalRttUs;
+        process.traffic.minRttUs = process.intervalMinRttUs;
+        process.intervalRttUs = 0;
+        process.intervalMinRttUs = 0;
+    }
+    lastSampleNs_ = sampleNs_;
+}
+
+bool TrafficAccountant::processTraffic(uint32_t pid, ProcessTraffic& traffic) const {
+    auto it = processes_.find(pid);
+    if (it == processes_.end()) {
+        return false;
+    }
+    traffic = it->second.traffic;
+    return true;
+}
+
+void TrafficAccountant::removeProcess(uint32_t pid) {
+    processes_.erase(pid);
+}
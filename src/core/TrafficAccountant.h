@@ -0,0 +1,90 @@
+#ifndef CORE_TRAFFICACCOUNTANT_H
+#define CORE_TRAFFICACCOUNTANT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// Cumulative byte counters of one socket as reported by the platform collector.
+struct SocketCounters {
+    uint64_t socketId;      // socket inode on Linux, connection hash on Windows
+    uint32_t pid;           // owning process, or TrafficAccountant::UNKNOWN_PID
+    uint64_t bytesReceived;
+    uint64_t bytesSent;
+    uint32_t rttUs;    // smoothed RTT; 0 where the platform does not report it
+    uint32_t minRttUs; // lowest RTT seen on the connection
+};
+
+// Attributes per-socket byte counters to processes.
+//
+// Each sample records the cumulative counters of every live socket; the accountant keeps
+// the previous value per socket and credits only the difference to the owning process, so
+// per-process totals stay monotonic even as sockets come and go. Rates are an EWMA of the
+// per-interval throughput with a fixed time constant, which keeps them independent of
+// how irregularly samples are taken.
+//
+// Latency is taken from the sockets that carried traffic in the last sample: the largest
+// smoothed RTT among them and the smallest minimum RTT, whose difference estimates how much
+// queueing the process's traffic currently meets on the path.
+//
+// Sockets present in the first sample start from their current counters (their history
+// predates monitoring). Sockets that appear later are credited from zero. Bytes of a
+// socket whose owner is not known yet are held on the socket and credited once it is.
+// Not thread-safe; callers serialize access.
+class TrafficAccountant {
+public:
+    static constexpr uint32_t UNKNOWN_PID = UINT32_MAX;
+    static constexpr uint64_t DEFAULT_TIME_CONSTANT_NS = 2000000000ULL;
+
+    struct ProcessTraffic {
+        uint64_t totalDownloaded;
+        uint64_t totalUploaded;
+        double downloadRate; // bytes/sec
+        double uploadRate;
+        uint32_t rttUs;    // 0 if no active socket reported an RTT in the last sample
+        uint32_t minRttUs;
+    };
+
+    explicit TrafficAccountant(uint64_t timeConstantNs = DEFAULT_TIME_CONSTANT_NS);
+
+    void beginSample(uint64_t nowNs);
+    void record(const SocketCounters& socket);
+    // Forgets sockets missing from this sample and updates every process's rates
+    void endSample();
+
+    bool processTraffic(uint32_t pid, ProcessTraffic& traffic) const;
+    // Drops a process's history, e.g. when it exits (its PID may be reused)
+    void removeProcess(uint32_t pid);
+
+    size_t socketCount() const { return sockets_.size(); }
+    size_t processCount() const { return processes_.size(); }
+
+private:
+    struct SocketState {
+        uint64_t bytesReceived;
+        uint64_t bytesSent;
+        uint64_t pendingReceived; // accrued while the owner was unknown
+        uint64_t pendingSent;
+        uint32_t pid;
+        uint64_t generation;
+    };
+
+    struct ProcessState {
+        ProcessTraffic traffic;
+        uint64_t intervalReceived;
+        uint64_t intervalSent;
+        uint32_t intervalRttUs;
+        uint32_t intervalMinRttUs;
+    };
+
+    void credit(uint32_t pid, uint64_t received, uint64_t sent, const SocketCounters& socket);
+
+    uint64_t timeConstantNs_;
+    uint64_t generation_;
+    uint64_t sampleNs_;
+    uint64_t lastSampleNs_;
+    std::unordered_map<uint64_t, SocketState> sockets_;
+    std::unordered_map<uint32_t, ProcessState> processes_;
+};
+
+#endif // CORE_TRAFFICACCOUNTANT_H
@@ -0,0 +1,677 @@
+#include "TrafficShaper.h"
+
+#include <algorithm>
+
+TrafficShaper::TrafficShaper(size_t segmentCount, size_t segmentSize)
+    : nextGroupId_(LINK_GROUP + 1), nextFairQueueId_(0), pool_(segmentCount, segmentSize),
+      heldSince_(pool_.capacity()), heldSegments_(0), heldBytes_(0), droppedSegments_(0),
+      droppedBytes_(0) {
+    groups_[LINK_GROUP] = ClassPair{HtbScheduler::ROOT_CLASS, HtbScheduler::ROOT_CLASS};
+}
+
+void TrafficShaper::setLinkCapacity(uint64_t downloadBytesPerSec, uint64_t uploadBytesPerSec) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    downloadTree_.setLinkRate(downloadBytesPerSec);
+    uploadTree_.setLinkRate(uploadBytesPerSec);
+    refreshLimiters();
+}
+
+uint32_t TrafficShaper::createGroup(uint32_t parentGroupId, const ShapingRates& download,
+                                    const ShapingRates& upload) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto parent = groups_.find(parentGroupId);
+    if (parent == groups_.end()) {
+        return INVALID_GROUP;
+    }
+
+    ClassPair classes;
+    classes.download = downloadTree_.addClass(parent->second.download, download);
+    classes.upload = uploadTree_.addClass(parent->second.upload, upload);
+    if (classes.download == HtbScheduler::INVALID_CLASS ||
+        classes.upload == HtbScheduler::INVALID_CLASS) {
+        downloadTree_.removeClass(classes.download);
+        uploadTree_.removeClass(classes.upload);
+        return INVALID_GROUP;
+    }
+
+    const uint32_t groupId = nextGroupId_++;
+    groups_[groupId] = classes;
+    return groupId;
+}
+
+bool TrafficShaper::setGroupRates(uint32_t groupId, const ShapingRates& download,
+                                  const ShapingRates& upload) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = groups_.find(groupId);
+    if (it == groups_.end() || groupId == LINK_GROUP) {
+        return false;
+    }
+    if (!downloadTree_.setClassRates(it->second.download, download) ||
+        !uploadTree_.setClassRates(it->second.upload, upload)) {
+        return false;
+    }
+    refreshLimiters();
+    return true;
+}
+
+bool TrafficShaper::removeGroup(uint32_t groupId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = groups_.find(groupId);
+    if (it == groups_.end() || groupId == LINK_GROUP) {
+        return false;
+    }
+    // removeClass refuses classes that still have children (members or subgroups)
+    if (!downloadTree_.removeClass(it->second.download)) {
+        return false;
+    }
+    uploadTree_.removeClass(it->second.upload);
+    groups_.erase(it);
+    return true;
+}
+
+bool TrafficShaper::hasGroup(uint32_t groupId) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return groups_.find(groupId) != groups_.end();
+}
+
+bool TrafficShaper::attachProcess(uint32_t pid, uint32_t groupId, const ShapingRates& download,
+                                  const ShapingRates& upload, std::shared_ptr<ProcessLimiter> limiter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto group = groups_.find(groupId);
+    if (group == groups_.end()) {
+        return false;
+    }
+    detachProcessLocked(pid);
+
+    ClassPair leaves;
+    leaves.download = downloadTree_.addClass(group->second.download, download);
+    leaves.upload = uploadTree_.addClass(group->second.upload, upload);
+    if (leaves.download == HtbScheduler::INVALID_CLASS ||
+        leaves.upload == HtbScheduler::INVALID_CLASS) {
+        downloadTree_.removeClass(leaves.download);
+        uploadTree_.removeClass(leaves.upload);
+        return false;
+    }
+
+    ProcessEntry& entry = processes_[pid];
+    entry.group = groupId;
+    entry.leaves = leaves;
+    entry.downloadRates = download;
+    entry.uploadRates = upload;
+    const bool shared = limiter != nullptr;
+    // A ceil of 0 leaves the process bounded by its group, so that is what its buckets hold
+    entry.limiter = shared ? std::move(limiter)
+                           : std::make_shared<ProcessLimiter>(pid, limiterRate(entry, TrafficDirection::Download),
+                                                              limiterRate(entry, TrafficDirection::Upload));
+    if (shared) {
+        entry.fairQueue = joinFairQueue(pid, entry);
+    }
+    downloadOwners_[leaves.download] = pid;
+    uploadOwners_[leaves.upload] = pid;
+    return true;
+}
+
+uint32_t TrafficShaper::joinFairQueue(uint32_t pid, ProcessEntry& entry) {
+    uint32_t queueId;
+    auto known = fairQueueIds_.find(entry.limiter.get());
+    if (known != fairQueueIds_.end()) {
+        queueId = known->second;
+    } else {
+        queueId = nextFairQueueId_++;
+        FairQueue queue(static_cast<uint32_t>(pool_.segmentSize()));
+        queue.limiter = entry.limiter;
+        fairQueues_.emplace(queueId, std::move(queue));
+        fairQueueIds_[entry.limiter.get()] = queueId;
+    }
+
+    FairQueue& queue = fairQueues_.at(queueId);
+    for (TrafficDirection direction : {TrafficDirection::Download, TrafficDirection::Upload}) {
+        HeldFlow& flow = entry.flow(direction);
+        flow.fairFlow = queue.scheduler(direction).addFlow(entry.share.weight);
+        queue.owners(direction)[flow.fairFlow] = pid;
+    }
+    return queueId;
+}
+
+void TrafficShaper::leaveFairQueue(ProcessEntry& entry) {
+    auto it = fairQueues_.find(entry.fairQueue);
+    entry.fairQueue = NO_FAIR_QUEUE;
+    if (it == fairQueues_.end()) {
+        return;
+    }
+    FairQueue& queue = it->second;
+    for (TrafficDirection direction : {TrafficDirection::Download, TrafficDirection::Upload}) {
+        HeldFlow& flow = entry.flow(direction);
+        queue.scheduler(direction).removeFlow(flow.fairFlow);
+        queue.owners(direction).erase(flow.fairFlow);
+        flow.fairFlow = DrrScheduler::INVALID_FLOW;
+    }
+    if (queue.download.flowCount() == 0) {
+        wheel_.cancel(queue.downloadTimer);
+        wheel_.cancel(queue.uploadTimer);
+        fairQueueIds_.erase(queue.limiter.get());
+        fairQueues_.erase(it);
+    }
+}
+
+bool TrafficShaper::detachProcess(uint32_t pid) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return detachProcessLocked(pid);
+}
+
+uint64_t TrafficShaper::limiterRate(const ProcessEntry& entry, TrafficDirection direction) const {
+    const uint64_t own = entry.rates(direction).ceil;
+    const uint64_t ancestors = tree(direction).pathCeil(classOf(groups_.at(entry.group), direction));
+    return own != 0 && (ancestors == 0 || own < ancestors) ? own : ancestors;
+}
+
+void TrafficShaper::refreshLimiters() {
+    for (auto& process : processes_) {
+        ProcessEntry& entry = process.second;
+        if (entry.fairQueue != NO_FAIR_QUEUE) {
+            continue;
+        }
+        for (TrafficDirection direction : {TrafficDirection::Download, TrafficDirection::Upload}) {
+            TokenBucket& bucket = entry.limiter->bucket(direction);
+            const uint64_t rate = limiterRate(entry, direction);
+            if (bucket.rate() != rate) {
+                bucket.configure(rate);
+            }
+        }
+    }
+}
+
+bool TrafficShaper::detachProcessLocked(uint32_t pid) {
+    auto it = processes_.find(pid);
+    if (it == processes_.end()) {
+        return false;
+    }
+    ProcessEntry& entry = it->second;
+    for (HeldFlow* flow : {&entry.download, &entry.upload}) {
+        wheel_.cancel(flow->timer);
+        heldSegments_ -= flow->size();
+        heldBytes_ -= flow->bytes();
+        flow->gated.clear(pool_);
+        flow->queued.clear(pool_);
+    }
+    leaveFairQueue(entry);
+    downloadTree_.removeClass(entry.leaves.download);
+    uploadTree_.removeClass(entry.leaves.upload);
+    downloadOwners_.erase(entry.leaves.download);
+    uploadOwners_.erase(entry.leaves.upload);
+    processes_.erase(it);
+    return true;
+}
+
+bool TrafficShaper::setProcessRates(uint32_t pid, const ShapingRates& download,
+                                    const ShapingRates& upload, uint64_t nowNs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = processes_.find(pid);
+    if (it == processes_.end()) {
+        return false;
+    }
+    ProcessEntry& entry = it->second;
+    // A policed direction keeps its leaf unlimited; the new rates apply once it is cleared
+    if (!downloadTree_.setClassRates(entry.leaves.download, entry.downloadPolicer ? ShapingRates() : download) ||
+        !uploadTree_.setClassRates(entry.leaves.upload, entry.uploadPolicer ? ShapingRates() : upload)) {
+        return false;
+    }
+    entry.downloadRates = download;
+    entry.uploadRates = upload;
+    if (entry.fairQueue == NO_FAIR_QUEUE) {
+        entry.limiter->download.setRate(limiterRate(entry, TrafficDirection::Download), nowNs);
+        entry.limiter->upload.setRate(limiterRate(entry, TrafficDirection::Upload), nowNs);
+    }
+    return true;
+}
+
+bool TrafficShaper::setPolicer(uint32_t pid, TrafficDirection direction,
+                               const TrtcmPolicer::Config& config, uint64_t nowNs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = processes_.find(pid);
+    if (it == processes_.end() || it->second.fairQueue != NO_FAIR_QUEUE) {
+        return false;
+    }
+    ProcessEntry& entry = it->second;
+    auto policer = std::make_unique<TrtcmPolicer>();
+    if (!policer->configure(config, nowNs)) {
+        return false;
+    }
+    entry.policer(direction) = std::move(policer);
+    // The policer stands in for the leaf's own rate and ceil; its group and the link still apply
+    tree(direction).setClassRates(classOf(entry.leaves, direction), ShapingRates());
+    rearmTimer(pid, direction, entry, nowNs);
+    return true;
+}
+
+bool TrafficShaper::clearPolicer(uint32_t pid, TrafficDirection direction) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = processes_.find(pid);
+    if (it == processes_.end() || !it->second.policer(direction)) {
+        return false;
+    }
+    ProcessEntry& entry = it->second;
+    HeldFlow& flow = entry.flow(direction);
+    entry.policer(direction).reset();
+    wheel_.cancel(flow.timer);
+    flow.timer = TimerWheel::INVALID_TIMER;
+    const uint32_t leaf = classOf(entry.leaves, direction);
+    tree(direction).setClassRates(leaf, entry.rates(direction));
+    // Delayed traffic queues in the leaf behind what it already holds
+    while (!flow.gated.empty()) {
+        const uint32_t segment = flow.gated.pop(pool_);
+        flow.queued.push(pool_, segment);
+        tree(direction).enqueue(leaf, pool_.length(segment));
+    }
+    return true;
+}
+
+bool TrafficShaper::policerStats(uint32_t pid, TrafficDirection direction,
+                                 TrtcmPolicer::Stats& stats) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = processes_.find(pid);
+    if (it == processes_.end()) {
+        return false;
+    }
+    const ProcessEntry& entry = it->second;
+    const TrtcmPolicer* policer = direction == TrafficDirection::Download ? entry.downloadPolicer.get()
+                                                                          : entry.uploadPolicer.get();
+    if (!policer) {
+        return false;
+    }
+    stats = policer->stats();
+    return true;
+}
+
+bool TrafficShaper::hasProcess(uint32_t pid) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return processes_.find(pid) != processes_.end();
+}
+
+uint64_t TrafficShaper::sentBytes(uint32_t pid, TrafficDirection direction) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = processes_.find(pid);
+    if (it == processes_.end()) {
+        return 0;
+    }
+    return tree(direction).sentBytes(classOf(it->second.leaves, direction));
+}
+
+std::shared_ptr<ProcessLimiter> TrafficShaper::limiter(uint32_t pid) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = processes_.find(pid);
+    if (it == processes_.end()) {
+        return nullptr;
+    }
+    return it->second.limiter;
+}
+
+bool TrafficShaper::setQueueLimits(uint32_t pid, const QueueLimits& limits) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = processes_.find(pid);
+    if (it == processes_.end()) {
+        return false;
+    }
+    it->second.limits = limits;
+    return true;
+}
+
+bool TrafficShaper::setFairShare(uint32_t pid, const FairShare& share) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = processes_.find(pid);
+    if (it == processes_.end() || it->second.fairQueue == NO_FAIR_QUEUE) {
+        return false;
+    }
+    ProcessEntry& entry = it->second;
+    entry.share = share;
+    if (share.downloadCeil == 0 && share.uploadCeil == 0) {
+        entry.ceiling.reset();
+    } else if (entry.ceiling) {
+        entry.ceiling->download.configure(share.downloadCeil);
+        entry.ceiling->upload.configure(share.uploadCeil);
+    } else {
+        entry.ceiling = std::make_unique<ProcessLimiter>(pid, share.downloadCeil, share.uploadCeil);
+    }
+    // A member waiting on its old ceiling is checked against the new one when the wait ends
+    FairQueue& queue = fairQueues_.at(entry.fairQueue);
+    queue.download.setWeight(entry.download.fairFlow, share.weight);
+    queue.upload.setWeight(entry.upload.fairFlow, share.weight);
+    return true;
+}
+
+bool TrafficShaper::fairShare(uint32_t pid, FairShare& share) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = processes_.find(pid);
+    if (it == processes_.end() || it->second.fairQueue == NO_FAIR_QUEUE) {
+        return false;
+    }
+    share = it->second.share;
+    return true;
+}
+
+TrafficShaper::Verdict TrafficShaper::submit(uint32_t pid, TrafficDirection direction,
+                                             uint32_t segment, uint64_t nowNs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = processes_.find(pid);
+    if (it == processes_.end()) {
+        return Verdict::Pass;
+    }
+
+    ProcessEntry& entry = it->second;
+    HeldFlow& flow = entry.flow(direction);
+    const uint32_t bytes = pool_.length(segment);
+    FairQueue* fair = entry.fairQueue != NO_FAIR_QUEUE ? &fairQueues_.at(entry.fairQueue) : nullptr;
+    TrtcmPolicer* policer = entry.policer(direction).get();
+    // Units behind delayed traffic, or behind what other members of a shared budget hold,
+    // wait at the gate with it; anything else goes on to the leaf
+    bool gate = false;
+    Verdict passed = Verdict::Pass;
+    if (policer && flow.gated.empty()) {
+        const PolicerColor color = policer->mark(bytes, nowNs);
+        switch (policer->action(color)) {
+        case PolicerAction::Pass:
+            break;
+        case PolicerAction::Mark:
+            passed = Verdict::Marked;
+            break;
+        case PolicerAction::Drop:
+            dropSegment(entry, segment);
+            return Verdict::Dropped;
+        case PolicerAction::Delay:
+            // Metered again when it is released
+            policer->refund(bytes, color);
+            gate = true;
+            break;
+        }
+    } else if (policer) {
+        gate = true;
+    } else if (fair) {
+        gate = !flow.gated.empty() || !fair->scheduler(direction).idle() ||
+               !ceilingAdmits(entry, direction, bytes, nowNs) ||
+               !fair->limiter->bucket(direction).tryConsume(bytes, nowNs);
+        if (!gate && entry.ceiling) {
+            entry.ceiling->bucket(direction).tryConsume(bytes, nowNs);
+        }
+    }
+    const uint32_t leaf = classOf(entry.leaves, direction);
+    // Anything already queued in the leaf goes first, so only an idle leaf may bypass it
+    if (!gate && flow.queued.empty() && tree(direction).trySend(leaf, bytes, nowNs)) {
+        return passed;
+    }
+
+    if (entry.heldBytes() + bytes > entry.limits.maxHeldBytes) {
+        if (entry.limits.policy == DropPolicy::TailDrop || flow.size() == 0) {
+            dropSegment(entry, segment);
+            return Verdict::Dropped;
+        }
+        // Head drop: discard the oldest segments of this flow until the new one fits, those
+        // in the leaf first
+        bool gatedHeadDropped = false;
+        while (flow.size() != 0 && entry.heldBytes() + bytes > entry.limits.maxHeldBytes) {
+            uint32_t oldest;
+            if (!flow.queued.empty()) {
+                oldest = flow.queued.pop(pool_);
+                tree(direction).dropFront(leaf);
+            } else {
+                oldest = flow.gated.pop(pool_);
+                if (fair) {
+                    fair->scheduler(direction).dropFront(flow.fairFlow);
+                }
+                gatedHeadDropped = true;
+            }
+            --heldSegments_;
+            heldBytes_ -= pool_.length(oldest);
+            dropSegment(entry, oldest);
+        }
+        if (entry.heldBytes() + bytes > entry.limits.maxHeldBytes) {
+            dropSegment(entry, segment);
+            return Verdict::Dropped;
+        }
+        // The gated head changed, so its green time may have too (a fair queue member's own
+        // timer only ends a ceiling wait, which is re-checked when it fires)
+        if (gatedHeadDropped && !fair) {
+            wheel_.cancel(flow.timer);
+            flow.timer = TimerWheel::INVALID_TIMER;
+        }
+    }
+
+    heldSince_[segment] = nowNs;
+    ++heldSegments_;
+    heldBytes_ += bytes;
+    if (!gate) {
+        flow.queued.push(pool_, segment);
+        tree(direction).enqueue(leaf, bytes);
+        return Verdict::Held;
+    }
+
+    flow.gated.push(pool_, segment);
+    if (fair) {
+        fair->scheduler(direction).enqueue(flow.fairFlow, bytes);
+    }
+    // One timer per gated flow, or per direction of a fair queue
+    if ((fair ? fair->timer(direction) : flow.timer) == TimerWheel::INVALID_TIMER) {
+        if (wheel_.empty()) {
+            wheel_.rebase(nowNs);
+        }
+        if (fair) {
+            armFairTimer(entry.fairQueue, direction, nowNs);
+        } else {
+            armTimer(pid, direction, entry, nowNs);
+        }
+    }
+    return Verdict::Held;
+}
+
+size_t TrafficShaper::releaseDue(uint64_t nowNs, std::vector<ReleasedUnit>& released) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    expired_.clear();
+    wheel_.advance(nowNs, expired_);
+
+    // Gates first, so what they let through competes in the trees at once
+    size_t count = 0;
+    for (const auto& timer : expired_) {
+        const uint32_t id = static_cast<uint32_t>(timer.cookie >> 2);
+        const TrafficDirection direction =
+            (timer.cookie & 1) != 0 ? TrafficDirection::Upload : TrafficDirection::Download;
+        if ((timer.cookie & FAIR_QUEUE_TIMER) != 0) {
+            count += serveFairQueue(id, direction, nowNs, released);
+            continue;
+        }
+
+        const uint32_t pid = id;
+        auto it = processes_.find(pid);
+        if (it == processes_.end()) {
+            continue;
+        }
+        ProcessEntry& entry = it->second;
+        HeldFlow& flow = entry.flow(direction);
+        flow.timer = TimerWheel::INVALID_TIMER;
+        if (entry.fairQueue != NO_FAIR_QUEUE) {
+            // A member's ceiling wait is over; it rejoins the rotation at the back
+            fairQueues_.at(entry.fairQueue).scheduler(direction).resume(flow.fairFlow);
+            count += serveFairQueue(entry.fairQueue, direction, nowNs, released);
+            continue;
+        }
+
+        TrtcmPolicer* policer = entry.policer(direction).get();
+        while (policer && !flow.gated.empty() && policer->tryGreen(pool_.length(flow.gated.front()), nowNs)) {
+            count += enterTree(pid, direction, entry, flow.gated.pop(pool_), nowNs, released);
+        }
+        if (policer && !flow.gated.empty()) {
+            armTimer(pid, direction, entry, nowNs);
+        }
+    }
+    count += serveTree(TrafficDirection::Download, nowNs, released);
+    count += serveTree(TrafficDirection::Upload, nowNs, released);
+    return count;
+}
+
+void TrafficShaper::armTimer(uint32_t pid, TrafficDirection direction, ProcessEntry& entry,
+                             uint64_t nowNs) {
+    HeldFlow& flow = entry.flow(direction);
+    const uint32_t bytes = pool_.length(flow.gated.front());
+    const uint64_t releaseAt = entry.policer(direction)->greenAt(bytes, nowNs);
+    flow.timer = wheel_.schedule(releaseAt, flowCookie(pid, direction));
+}
+
+void TrafficShaper::rearmTimer(uint32_t pid, TrafficDirection direction, ProcessEntry& entry,
+                               uint64_t nowNs) {
+    HeldFlow& flow = entry.flow(direction);
+    if (flow.timer != TimerWheel::INVALID_TIMER) {
+        wheel_.cancel(flow.timer);
+        armTimer(pid, direction, entry, nowNs);
+    }
+}
+
+size_t TrafficShaper::enterTree(uint32_t pid, TrafficDirection direction, ProcessEntry& entry,
+                                uint32_t segment, uint64_t nowNs, std::vector<ReleasedUnit>& released) {
+    HeldFlow& flow = entry.flow(direction);
+    const uint32_t leaf = classOf(entry.leaves, direction);
+    const uint32_t bytes = pool_.length(segment);
+    if (flow.queued.empty() && tree(direction).trySend(leaf, bytes, nowNs)) {
+        releaseSegment(pid, direction, flow, segment, nowNs, released);
+        return 1;
+    }
+    flow.queued.push(pool_, segment);
+    tree(direction).enqueue(leaf, bytes);
+    return 0;
+}
+
+size_t TrafficShaper::serveTree(TrafficDirection direction, uint64_t nowNs,
+                                std::vector<ReleasedUnit>& released) {
+    const auto& owners = direction == TrafficDirection::Download ? downloadOwners_ : uploadOwners_;
+    size_t count = 0;
+    HtbScheduler::Dequeued unit;
+    while (tree(direction).dequeue(nowNs, unit)) {
+        const uint32_t pid = owners.at(unit.classId);
+        HeldFlow& flow = processes_.at(pid).flow(direction);
+        releaseSegment(pid, direction, flow, flow.queued.pop(pool_), nowNs, released);
+        ++count;
+    }
+    return count;
+}
+
+void TrafficShaper::releaseSegment(uint32_t pid, TrafficDirection direction, HeldFlow& flow,
+                                   uint32_t segment, uint64_t nowNs, std::vector<ReleasedUnit>& released) {
+    const uint32_t bytes = pool_.length(segment);
+    // Gain 1/8, as for TCP's smoothed RTT
+    const uint64_t held = nowNs - std::min(heldSince_[segment], nowNs);
+    flow.delayNs = flow.delayNs - flow.delayNs / 8 + held / 8;
+    released.push_back(ReleasedUnit{pid, direction, segment, bytes});
+    --heldSegments_;
+    heldBytes_ -= bytes;
+}
+
+bool TrafficShaper::ceilingAdmits(const ProcessEntry& entry, TrafficDirection direction,
+                                  uint32_t bytes, uint64_t nowNs) const {
+    return !entry.ceiling || entry.ceiling->bucket(direction).nextAvailableAt(bytes, nowNs) <= nowNs;
+}
+
+size_t TrafficShaper::serveFairQueue(uint32_t queueId, TrafficDirection direction, uint64_t nowNs,
+                                     std::vector<ReleasedUnit>& released) {
+    auto it = fairQueues_.find(queueId);
+    if (it == fairQueues_.end()) {
+        return 0;
+    }
+    FairQueue& queue = it->second;
+    wheel_.cancel(queue.timer(direction));
+    queue.timer(direction) = TimerWheel::INVALID_TIMER;
+
+    DrrScheduler& scheduler = queue.scheduler(direction);
+    TokenBucket& budget = queue.limiter->bucket(direction);
+    size_t count = 0;
+    DrrScheduler::Dequeued next;
+    while (scheduler.peek(next)) {
+        const uint32_t pid = queue.owners(direction).at(next.flowId);
+        ProcessEntry& entry = processes_.at(pid);
+        HeldFlow& flow = entry.flow(direction);
+        if (!ceilingAdmits(entry, direction, next.bytes, nowNs)) {
+            // Waits out its own ceiling without holding up the members behind it
+            scheduler.suspend(next.flowId);
+            const uint64_t releaseAt = entry.ceiling->bucket(direction).nextAvailableAt(next.bytes, nowNs);
+            flow.timer = wheel_.schedule(releaseAt, flowCookie(pid, direction));
+            continue;
+        }
+        if (!budget.tryConsume(next.bytes, nowNs)) {
+            break;
+        }
+        if (entry.ceiling) {
+            entry.ceiling->bucket(direction).tryConsume(next.bytes, nowNs);
+        }
+        scheduler.dequeue(next);
+        count += enterTree(pid, direction, entry, flow.gated.pop(pool_), nowNs, released);
+    }
+    armFairTimer(queueId, direction, nowNs);
+    return count;
+}
+
+void TrafficShaper::armFairTimer(uint32_t queueId, TrafficDirection direction, uint64_t nowNs) {
+    FairQueue& queue = fairQueues_.at(queueId);
+    DrrScheduler::Dequeued next;
+    if (!queue.scheduler(direction).peek(next)) {
+        return; // nothing held, or every backlogged member waits on its own ceiling
+    }
+    const uint64_t releaseAt = queue.limiter->bucket(direction).nextAvailableAt(next.bytes, nowNs);
+    queue.timer(direction) = wheel_.schedule(releaseAt, fairCookie(queueId, direction));
+}
+
+uint64_t TrafficShaper::nextWakeup() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::min({wheel_.nextExpiry(), downloadTree_.nextDequeueTime(),
+                     uploadTree_.nextDequeueTime()});
+}
+
+void TrafficShaper::dropSegment(ProcessEntry& entry, uint32_t segment) {
+    const uint32_t bytes = pool_.length(segment);
+    ++entry.droppedSegments;
+    entry.droppedBytes += bytes;
+    ++droppedSegments_;
+    droppedBytes_ += bytes;
+    pool_.release(segment);
+}
+
+bool TrafficShaper::queueStats(uint32_t pid, QueueStats& stats) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = processes_.find(pid);
+    if (it == processes_.end()) {
+        return false;
+    }
+    const ProcessEntry& entry = it->second;
+    stats.heldSegments = entry.download.size() + entry.upload.size();
+    stats.heldBytes = entry.heldBytes();
+    stats.droppedSegments = entry.droppedSegments;
+    stats.droppedBytes = entry.droppedBytes;
+    stats.downloadDelayNs = entry.download.delayNs;
+    stats.uploadDelayNs = entry.upload.delayNs;
+    return true;
+}
+
+TrafficShaper::Stats TrafficShaper::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Stats stats;
+    stats.pool = pool_.stats();
+    stats.queues.heldSegments = heldSegments_;
+    stats.queues.heldBytes = heldBytes_;
+    stats.queues.droppedSegments = droppedSegments_;
+    stats.queues.droppedBytes = droppedBytes_;
+    stats.queues.downloadDelayNs = 0;
+    stats.queues.uploadDelayNs = 0;
+    return stats;
+}
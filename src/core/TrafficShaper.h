@@ -0,0 +1,290 @@
+#ifndef CORE_TRAFFICSHAPER_H
+#define CORE_TRAFFICSHAPER_H
+
+#include "BufferPool.h"
+#include "DrrScheduler.h"
+#include "HtbScheduler.h"
+#include "ProcessLimiter.h"
+#include "TimerWheel.h"
+#include "TrtcmPolicer.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Class tree shared by the platform throttlers: a machine-wide link budget at the root,
+// throttle groups below it (e.g. "backup jobs", "browsers") and one leaf per throttled
+// process. Download and upload are scheduled by separate HTB trees that share group ids.
+//
+// Every unit goes through its process's leaf: it passes at once if the leaf has nothing
+// queued and neither the leaf nor any ancestor is over its ceiling, and is otherwise held
+// as a pooled segment in a per-flow FIFO, up to a per-process byte cap, while the tree
+// queues its size. releaseDue() dequeues from the tree, which charges the leaf, its
+// groups and the link, so group ceilings and borrowing apply to real traffic. A leaf with
+// a ceil of 0 is bounded by its group alone.
+//
+// Processes attached with a shared limiter (a throttle tree) charge one budget together
+// before they reach the tree. Their held traffic first waits in a weighted deficit round
+// robin over the members, so the budget is split by weight rather than going to whoever
+// asks most often, and only the shared queue has a timer, on a hierarchical timing wheel,
+// for the budget. A member may also have a ceiling of its own.
+//
+// A process may instead be policed per direction by a two-rate three-color marker, which
+// takes the place of its leaf's own rate and ceil. Each unit is then colored on submit and
+// its color's action applies; delayed units wait, with one timer per flow, until they
+// would be green, and then go through the tree like any other.
+//
+// Each process also has a ProcessLimiter for enforcers outside the shaper (the proxy, the
+// preload shim), which see no tree: its buckets hold the lowest ceiling on the path from
+// the leaf to the link. The shaper itself does not charge them.
+class TrafficShaper {
+public:
+    static constexpr uint32_t LINK_GROUP = 0;
+    static constexpr uint32_t INVALID_GROUP = UINT32_MAX;
+
+    static constexpr uint64_t DEFAULT_MAX_HELD_BYTES = 1024 * 1024;
+
+    // Pass: the caller sends the segment and releases it to the pool.
+    // Marked: as Pass, but a policer found the segment over its committed rate; callers
+    // that can mark packets (e.g. with a lower DSCP class) should.
+    // Held: the shaper owns the segment until releaseDue() hands it back.
+    // Dropped: the segment was over the process's cap, or policed away, and is already
+    // back in the pool.
+    enum class Verdict { Pass, Marked, Held, Dropped };
+
+    struct ReleasedUnit {
+        uint32_t pid;
+        TrafficDirection direction;
+        uint32_t segment; // caller sends it and releases it to pool()
+        uint32_t bytes;
+    };
+
+    // Hard cap on the bytes held for one process (both directions together)
+    struct QueueLimits {
+        uint64_t maxHeldBytes;
+        DropPolicy policy;
+
+        QueueLimits(uint64_t maxBytes = DEFAULT_MAX_HELD_BYTES, DropPolicy p = DropPolicy::TailDrop)
+            : maxHeldBytes(maxBytes), policy(p) {}
+    };
+
+    // A member's claim on a shared budget: its weight against the other backlogged members
+    // and an optional ceiling of its own per direction (0 = only the shared budget)
+    struct FairShare {
+        uint32_t weight;
+        uint64_t downloadCeil;
+        uint64_t uploadCeil;
+
+        FairShare(uint32_t w = 1, uint64_t download = 0, uint64_t upload = 0)
+            : weight(w), downloadCeil(download), uploadCeil(upload) {}
+    };
+
+    struct QueueStats {
+        uint64_t heldSegments;
+        uint64_t heldBytes;
+        uint64_t droppedSegments;
+        uint64_t droppedBytes;
+        // Smoothed time released segments spent held (per process only; 0 in the totals)
+        uint64_t downloadDelayNs;
+        uint64_t uploadDelayNs;
+    };
+
+    struct Stats {
+        BufferPool::Stats pool;
+        QueueStats queues; // totals over all processes
+    };
+
+    explicit TrafficShaper(size_t segmentCount = BufferPool::DEFAULT_SEGMENT_COUNT,
+                           size_t segmentSize = BufferPool::DEFAULT_SEGMENT_SIZE);
+
+    // Machine-wide budget (0 = unlimited)
+    void setLinkCapacity(uint64_t downloadBytesPerSec, uint64_t uploadBytesPerSec);
+
+    // Returns the new group id or INVALID_GROUP if the parent does not exist.
+    uint32_t createGroup(uint32_t parentGroupId, const ShapingRates& download,
+                         const ShapingRates& upload);
+    bool setGroupRates(uint32_t groupId, const ShapingRates& download, const ShapingRates& upload);
+    // Fails while the group still has member processes or subgroups.
+    bool removeGroup(uint32_t groupId);
+    bool hasGroup(uint32_t groupId) const;
+
+    // Places a process under a group, replacing any previous placement. A given limiter is
+    // charged instead of new buckets, so processes can share one budget (a throttle tree).
+    bool attachProcess(uint32_t pid, uint32_t groupId, const ShapingRates& download,
+                       const ShapingRates& upload, std::shared_ptr<ProcessLimiter> limiter = nullptr);
+    bool detachProcess(uint32_t pid);
+    // Changes a process's rates in place: held traffic stays queued and its buckets keep
+    // their fill (members of a shared budget keep charging the shared limiter)
+    bool setProcessRates(uint32_t pid, const ShapingRates& download, const ShapingRates& upload,
+                         uint64_t nowNs);
+    bool hasProcess(uint32_t pid) const;
+    std::shared_ptr<ProcessLimiter> limiter(uint32_t pid) const;
+
+    bool setQueueLimits(uint32_t pid, const QueueLimits& limits);
+    // Only for processes attached with a shared limiter; members start with weight 1 and
+    // no ceiling of their own
+    bool setFairShare(uint32_t pid, const FairShare& share);
+    bool fairShare(uint32_t pid, FairShare& share) const;
+    // Polices one direction of a process (not for members of a shared budget) in place of
+    // its leaf's rate and ceil. Units a flow submits while it holds delayed traffic queue
+    // behind it unmetered and are metered on release, so the flow stays in order.
+    bool setPolicer(uint32_t pid, TrafficDirection direction, const TrtcmPolicer::Config& config,
+                    uint64_t nowNs);
+    // Delayed traffic moves on to the leaf, which gets its own rates back
+    bool clearPolicer(uint32_t pid, TrafficDirection direction);
+    bool policerStats(uint32_t pid, TrafficDirection direction, TrtcmPolicer::Stats& stats) const;
+
+    // Release path. Callers fill a segment acquired from pool() in place and submit it;
+    // it either passes now or is held until the class tree releases it. Untracked PIDs pass.
+    BufferPool& pool() { return pool_; }
+    Verdict submit(uint32_t pid, TrafficDirection direction, uint32_t segment, uint64_t nowNs);
+    // Appends every held segment the tree allows at nowNs, in per-flow FIFO order; members
+    // of a shared budget are interleaved by weight.
+    size_t releaseDue(uint64_t nowNs, std::vector<ReleasedUnit>& released);
+    // Earliest time (ns) the caller should call releaseDue() again.
+    uint64_t nextWakeup() const;
+
+    bool queueStats(uint32_t pid, QueueStats& stats) const;
+    Stats stats() const;
+
+    // Bytes a process has sent through its leaf, passed or released
+    uint64_t sentBytes(uint32_t pid, TrafficDirection direction) const;
+
+private:
+    static constexpr uint32_t NO_FAIR_QUEUE = UINT32_MAX;
+    static constexpr uint64_t FAIR_QUEUE_TIMER = 2;
+
+    struct ClassPair {
+        uint32_t download;
+        uint32_t upload;
+    };
+
+    struct HeldFlow {
+        SegmentQueue gated;  // waiting on the process's policer or shared budget
+        SegmentQueue queued; // waiting in the class tree, in the order the tree holds them
+        // Green time of the gated head, or for a fair queue member the end of a ceiling wait
+        TimerWheel::TimerId timer = TimerWheel::INVALID_TIMER;
+        uint32_t fairFlow = DrrScheduler::INVALID_FLOW;
+        uint64_t delayNs = 0; // EWMA of the time released segments were held
+
+        size_t size() const { return gated.size() + queued.size(); }
+        uint64_t bytes() const { return gated.bytes() + queued.bytes(); }
+    };
+
+    // Held traffic of every process charging one shared limiter
+    struct FairQueue {
+        std::shared_ptr<ProcessLimiter> limiter;
+        DrrScheduler download;
+        DrrScheduler upload;
+        TimerWheel::TimerId downloadTimer = TimerWheel::INVALID_TIMER;
+        TimerWheel::TimerId uploadTimer = TimerWheel::INVALID_TIMER;
+        std::unordered_map<uint32_t, uint32_t> downloadOwners; // flow -> pid
+        std::unordered_map<uint32_t, uint32_t> uploadOwners;
+
+        explicit FairQueue(uint32_t quantum) : download(quantum), upload(quantum) {}
+
+        DrrScheduler& scheduler(TrafficDirection direction) {
+            return direction == TrafficDirection::Download ? download : upload;
+        }
+        TimerWheel::TimerId& timer(TrafficDirection direction) {
+            return direction == TrafficDirection::Download ? downloadTimer : uploadTimer;
+        }
+        std::unordered_map<uint32_t, uint32_t>& owners(TrafficDirection direction) {
+            return direction == TrafficDirection::Download ? downloadOwners : uploadOwners;
+        }
+    };
+
+    struct ProcessEntry {
+        uint32_t group = LINK_GROUP;
+        ClassPair leaves;
+        ShapingRates downloadRates; // the leaves' rates, unless a policer stands in for them
+        ShapingRates uploadRates;
+        std::shared_ptr<ProcessLimiter> limiter;
+        uint32_t fairQueue = NO_FAIR_QUEUE;
+        FairShare share;
+        std::unique_ptr<ProcessLimiter> ceiling; // the share's own ceilings, if any
+        std::unique_ptr<TrtcmPolicer> downloadPolicer; // replace the leaves' rates
+        std::unique_ptr<TrtcmPolicer> uploadPolicer;
+        HeldFlow download;
+        HeldFlow upload;
+        QueueLimits limits;
+        uint64_t droppedSegments = 0;
+        uint64_t droppedBytes = 0;
+
+        uint64_t heldBytes() const { return download.bytes() + upload.bytes(); }
+
+        HeldFlow& flow(TrafficDirection direction) {
+            return direction == TrafficDirection::Download ? download : upload;
+        }
+        const ShapingRates& rates(TrafficDirection direction) const {
+            return direction == TrafficDirection::Download ? downloadRates : uploadRates;
+        }
+        std::unique_ptr<TrtcmPolicer>& policer(TrafficDirection direction) {
+            return direction == TrafficDirection::Download ? downloadPolicer : uploadPolicer;
+        }
+    };
+
+    HtbScheduler& tree(TrafficDirection direction) {
+        return direction == TrafficDirection::Download ? downloadTree_ : uploadTree_;
+    }
+    const HtbScheduler& tree(TrafficDirection direction) const {
+        return direction == TrafficDirection::Download ? downloadTree_ : uploadTree_;
+    }
+    uint32_t classOf(const ClassPair& pair, TrafficDirection direction) const {
+        return direction == TrafficDirection::Download ? pair.download : pair.upload;
+    }
+    bool detachProcessLocked(uint32_t pid);
+    // The ceiling the process's limiter holds: its own under its ancestors'
+    uint64_t limiterRate(const ProcessEntry& entry, TrafficDirection direction) const;
+    void refreshLimiters();
+    // A policed flow's gated head, once it would be green
+    void armTimer(uint32_t pid, TrafficDirection direction, ProcessEntry& entry, uint64_t nowNs);
+    void rearmTimer(uint32_t pid, TrafficDirection direction, ProcessEntry& entry, uint64_t nowNs);
+    // Passes a segment through the process's leaf, or queues it there; returns 1 if it was
+    // released
+    size_t enterTree(uint32_t pid, TrafficDirection direction, ProcessEntry& entry, uint32_t segment,
+                     uint64_t nowNs, std::vector<ReleasedUnit>& released);
+    size_t serveTree(TrafficDirection direction, uint64_t nowNs, std::vector<ReleasedUnit>& released);
+    void releaseSegment(uint32_t pid, TrafficDirection direction, HeldFlow& flow, uint32_t segment,
+                        uint64_t nowNs, std::vector<ReleasedUnit>& released);
+    void dropSegment(ProcessEntry& entry, uint32_t segment);
+    uint32_t joinFairQueue(uint32_t pid, ProcessEntry& entry);
+    void leaveFairQueue(ProcessEntry& entry);
+    bool ceilingAdmits(const ProcessEntry& entry, TrafficDirection direction, uint32_t bytes,
+                       uint64_t nowNs) const;
+    size_t serveFairQueue(uint32_t queueId, TrafficDirection direction, uint64_t nowNs,
+                          std::vector<ReleasedUnit>& released);
+    void armFairTimer(uint32_t queueId, TrafficDirection direction, uint64_t nowNs);
+
+    // Timer cookies: bit 0 is the direction, bit 1 tells a fair queue from a process flow
+    static uint64_t flowCookie(uint32_t pid, TrafficDirection direction) {
+        return (static_cast<uint64_t>(pid) << 2) | (direction == TrafficDirection::Upload ? 1 : 0);
+    }
+    static uint64_t fairCookie(uint32_t queueId, TrafficDirection direction) {
+        return flowCookie(queueId, direction) | FAIR_QUEUE_TIMER;
+    }
+
+    mutable std::mutex mutex_;
+    HtbScheduler downloadTree_;
+    HtbScheduler uploadTree_;
+    std::unordered_map<uint32_t, ClassPair> groups_;    // group id -> inner classes
+    std::unordered_map<uint32_t, ProcessEntry> processes_;
+    std::unordered_map<uint32_t, uint32_t> downloadOwners_; // leaf class -> pid
+    std::unordered_map<uint32_t, uint32_t> uploadOwners_;
+    uint32_t nextGroupId_;
+    std::unordered_map<uint32_t, FairQueue> fairQueues_;
+    std::unordered_map<const ProcessLimiter*, uint32_t> fairQueueIds_;
+    uint32_t nextFairQueueId_;
+
+    BufferPool pool_;
+    TimerWheel wheel_;
+    std::vector<TimerWheel::Expired> expired_; // scratch for releaseDue
+    std::vector<uint64_t> heldSince_; // per pool segment, while it is held
+    uint64_t heldSegments_;
+    uint64_t heldBytes_;
+    uint64_t droppedSegments_;
+    uint64_t droppedBytes_;
+};
+
+#endif // CORE_TRAFFICSHAPER_H
@@ -0,0 +1,53 @@
+#ifndef CORE_TRIPLEBUFFER_H
+#define CORE_TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Hands the latest value from one writer thread to one reader thread without locks.
+//
+// Three slots rotate between the writer (back), the reader (front) and a middle slot
+// holding the most recent publication. The writer fills back() and publishes it by
+// swapping it into the middle; the reader, when the middle is newer than what it has,
+// swaps it out into front. Neither side ever waits for the other or sees a slot the other
+// is using, and values skipped by a slow reader are simply overwritten. Slots are reused,
+// so a writer that refills its slot in place (assigning into existing containers) does not
+// allocate in steady state; it must refill it completely, since a slot comes back holding
+// an older value.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : middle_(1), back_(2), front_(0) {}
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Writer: the slot to fill next
+    T& back() { return slots_[back_]; }
+    // Writer: makes back() the latest value and takes another slot to fill
+    void publish() {
+        back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & SLOT_MASK;
+    }
+
+    // Reader: moves to the latest published value; false if there was nothing newer
+    bool update() {
+        if ((middle_.load(std::memory_order_relaxed) & FRESH) == 0) {
+            return false;
+        }
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & SLOT_MASK;
+        return true;
+    }
+    // Reader: the value taken by the last successful update() (a default T before that)
+    const T& front() const { return slots_[front_]; }
+
+private:
+    static constexpr uint8_t SLOT_MASK = 3;
+    static constexpr uint8_t FRESH = 4; // middle holds a value the reader has not taken
+
+    T slots_[3];
+    alignas(64) std::atomic<uint8_t> middle_; // slot index | FRESH
+    alignas(64) uint8_t back_;                // writer's own
+    alignas(64) uint8_t front_;               // reader's own
+};
+
+#endif // CORE_TRIPLEBUFFER_H
@@ -0,0 +1,111 @@
+#include "TrtcmPolicer.h"
+
+#include <algorithm>
+
+namespace {
+
+// Keeps min(elapsed, fillNs) * rate within 64 bits next to a full bucket
+constexpr uint64_t MAX_RATE_BYTES_PER_SEC = 1ULL << 40;
+
+uint64_t defaultBurst(uint64_t rateBytesPerSec) {
+    return std::max(rateBytesPerSec / TrtcmPolicer::DEFAULT_BURST_DIVISOR, TrtcmPolicer::MIN_BURST_BYTES);
+}
+
+} // namespace
+
+bool TrtcmPolicer::Config::isValid() const {
+    return committedRate > 0 && committedRate <= peakRate && peakRate <= MAX_RATE_BYTES_PER_SEC &&
+           committedBurst <= MAX_BURST_BYTES && peakBurst <= MAX_BURST_BYTES;
+}
+
+TrtcmPolicer::TrtcmPolicer() : lastNs_(0), stats_() {}
+
+void TrtcmPolicer::Bucket::configure(uint64_t rateBytesPerSec, uint64_t burstBytes) {
+    rate = rateBytesPerSec;
+    capacity = std::min(burstBytes, MAX_BURST_BYTES) * SCALE;
+    fillNs = (capacity + rate - 1) / rate;
+    tokens = capacity;
+}
+
+uint64_t TrtcmPolicer::Bucket::waitNs(uint64_t needed, uint64_t elapsedNs) const {
+    const uint64_t target = std::min(needed, capacity);
+    const uint64_t available = refilled(elapsedNs);
+    return available >= target ? 0 : (target - available + rate - 1) / rate;
+}
+
+bool TrtcmPolicer::configure(const Config& config, uint64_t nowNs) {
+    if (!config.isValid()) {
+        return false;
+    }
+    config_ = config;
+    const uint64_t committedBurst = config.committedBurst != 0 ? config.committedBurst
+                                                               : defaultBurst(config.committedRate);
+    const uint64_t peakBurst = config.peakBurst != 0
+                                   ? config.peakBurst
+                                   : std::max(defaultBurst(config.peakRate), committedBurst);
+    committed_.configure(config.committedRate, committedBurst);
+    peak_.configure(config.peakRate, peakBurst);
+    lastNs_ = nowNs;
+    return true;
+}
+
+void TrtcmPolicer::refill(uint64_t nowNs) {
+    const uint64_t elapsedNs = elapsedSince(nowNs);
+    committed_.tokens = committed_.refilled(elapsedNs);
+    peak_.tokens = peak_.refilled(elapsedNs);
+    lastNs_ = std::max(lastNs_, nowNs);
+}
+
+PolicerColor TrtcmPolicer::mark(uint32_t bytes, uint64_t nowNs, PolicerColor precolor) {
+    refill(nowNs);
+    const uint64_t needed = static_cast<uint64_t>(bytes) * SCALE;
+    // Flags as 0/1 and masks instead of branches: the outcome depends on the traffic, so
+    // it would mispredict exactly when policing matters
+    const uint64_t peakFits = static_cast<uint64_t>(precolor != PolicerColor::Red) & (peak_.tokens >= needed);
+    const uint64_t committedFits =
+        peakFits & static_cast<uint64_t>(precolor == PolicerColor::Green) & (committed_.tokens >= needed);
+    peak_.tokens -= needed & (0 - peakFits);
+    committed_.tokens -= needed & (0 - committedFits);
+
+    const size_t color = 2 - peakFits - committedFits;
+    ++stats_.packets[color];
+    stats_.bytes[color] += bytes;
+    return static_cast<PolicerColor>(color);
+}
+
+void TrtcmPolicer::refund(uint32_t bytes, PolicerColor color) {
+    const uint64_t returned = static_cast<uint64_t>(bytes) * SCALE;
+    if (color != PolicerColor::Red) {
+        peak_.tokens = std::min(peak_.tokens + returned, peak_.capacity);
+    }
+    if (color == PolicerColor::Green) {
+        committed_.tokens = std::min(committed_.tokens + returned, committed_.capacity);
+    }
+}
+
+bool TrtcmPolicer::tryGreen(uint32_t bytes, uint64_t nowNs) {
+    refill(nowNs);
+    const uint64_t needed = static_cast<uint64_t>(bytes) * SCALE;
+    const uint64_t committedTaken = std::min(needed, committed_.capacity);
+    const uint64_t peakTaken = std::min(needed, peak_.capacity);
+    if (committed_.tokens < committedTaken || peak_.tokens < peakTaken) {
+        return false;
+    }
+    committed_.tokens -= committedTaken;
+    peak_.tokens -= peakTaken;
+    return true;
+}
+
+uint64_t TrtcmPolicer::greenAt(uint32_t bytes, uint64_t nowNs) const {
+    const uint64_t needed = static_cast<uint64_t>(bytes) * SCALE;
+    const uint64_t elapsedNs = elapsedSince(nowNs);
+    return nowNs + std::max(committed_.waitNs(needed, elapsedNs), peak_.waitNs(needed, elapsedNs));
+}
+
+uint64_t TrtcmPolicer::committedTokens(uint64_t nowNs) const {
+    return committed_.refilled(elapsedSince(nowNs)) / SCALE;
+}
+
+uint64_t TrtcmPolicer::peakTokens(uint64_t nowNs) const {
+    return peak_.refilled(elapsedSince(nowNs)) / SCALE;
+}
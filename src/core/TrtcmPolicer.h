@@ -0,0 +1,106 @@
+#ifndef CORE_TRTCMPOLICER_H
+#define CORE_TRTCMPOLICER_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum class PolicerColor : uint8_t { Green = 0, Yellow = 1, Red = 2 };
+enum class PolicerAction : uint8_t { Pass, Delay, Mark, Drop };
+
+// Two-rate three-color marker (RFC 2698).
+//
+// A committed bucket of CBS bytes fills at the committed rate (CIR) and a peak bucket of
+// PBS bytes at the peak rate (PIR). A unit that does not fit in the peak bucket is red; one
+// that fits there but not in the committed bucket is yellow and takes peak tokens only;
+// anything else is green and takes from both. What happens to each color is the caller's
+// choice of action; typically green passes, yellow is marked or delayed and red dropped,
+// so short bursts (up to CBS at once, PBS beyond the committed rate) get through while
+// sustained traffic is held to the committed rate.
+//
+// Tokens are kept in bytes * 10^9, so refill is exact integer arithmetic at nanosecond
+// resolution and colors match the RFC's algorithm bit for bit. mark() has no branches on
+// the token state. Not thread-safe; callers serialize access.
+class TrtcmPolicer {
+public:
+    static constexpr uint64_t MAX_BURST_BYTES = 1ULL << 32; // keeps scaled tokens in 64 bits
+    static constexpr uint64_t MIN_BURST_BYTES = 1500;
+    static constexpr uint64_t DEFAULT_BURST_DIVISOR = 10; // 100 ms of the bucket's rate
+
+    struct Config {
+        uint64_t committedRate;  // CIR, bytes/sec
+        uint64_t peakRate;       // PIR, bytes/sec; at least CIR
+        uint64_t committedBurst; // CBS, bytes; 0 = 100 ms at CIR (at least one MTU)
+        uint64_t peakBurst;      // PBS, bytes; 0 = 100 ms at PIR, and never below CBS
+        PolicerAction actions[3]; // by color
+
+        Config(uint64_t cir = 0, uint64_t pir = 0, uint64_t cbs = 0, uint64_t pbs = 0)
+            : committedRate(cir), peakRate(pir), committedBurst(cbs), peakBurst(pbs),
+              actions{PolicerAction::Pass, PolicerAction::Mark, PolicerAction::Drop} {}
+
+        PolicerAction& action(PolicerColor color) { return actions[static_cast<size_t>(color)]; }
+        PolicerAction action(PolicerColor color) const { return actions[static_cast<size_t>(color)]; }
+        // 0 < CIR <= PIR and bursts within MAX_BURST_BYTES
+        bool isValid() const;
+    };
+
+    struct Stats {
+        uint64_t packets[3]; // by color
+        uint64_t bytes[3];
+    };
+
+    TrtcmPolicer();
+
+    // Applies the configuration and fills both buckets; false (nothing changes) if invalid
+    bool configure(const Config& config, uint64_t nowNs);
+    const Config& config() const { return config_; }
+    PolicerAction action(PolicerColor color) const { return config_.action(color); }
+
+    // Color-blind marking
+    PolicerColor mark(uint32_t bytes, uint64_t nowNs) { return mark(bytes, nowNs, PolicerColor::Green); }
+    // Color-aware marking: a unit is never marked better than its precolor
+    PolicerColor mark(uint32_t bytes, uint64_t nowNs, PolicerColor precolor);
+    // Gives back the tokens mark() just took for a unit of that color, e.g. when the unit is
+    // delayed and will be metered again on release
+    void refund(uint32_t bytes, PolicerColor color);
+
+    // Release path for delayed units: takes from both buckets only if the unit is green
+    // now. A unit larger than a bucket counts as fitting once that bucket is full, so it
+    // is delayed rather than stuck.
+    bool tryGreen(uint32_t bytes, uint64_t nowNs);
+    // Monotonic time (ns) at which tryGreen(bytes) is expected to succeed
+    uint64_t greenAt(uint32_t bytes, uint64_t nowNs) const;
+
+    // Tokens currently in each bucket (bytes)
+    uint64_t committedTokens(uint64_t nowNs) const;
+    uint64_t peakTokens(uint64_t nowNs) const;
+    const Stats& stats() const { return stats_; }
+
+private:
+    static constexpr uint64_t SCALE = 1000000000ULL; // token units per byte
+
+    struct Bucket {
+        uint64_t tokens = 0;   // bytes * SCALE
+        uint64_t capacity = 0; // burst * SCALE
+        uint64_t rate = 0;     // bytes/sec, i.e. token units per ns
+        uint64_t fillNs = 0;   // time to fill from empty; longer gaps add nothing
+
+        uint64_t refilled(uint64_t elapsedNs) const {
+            const uint64_t gained = (elapsedNs < fillNs ? elapsedNs : fillNs) * rate;
+            const uint64_t filled = tokens + gained;
+            return filled < capacity ? filled : capacity;
+        }
+        void configure(uint64_t rateBytesPerSec, uint64_t burstBytes);
+        uint64_t waitNs(uint64_t needed, uint64_t elapsedNs) const;
+    };
+
+    uint64_t elapsedSince(uint64_t nowNs) const { return nowNs > lastNs_ ? nowNs - lastNs_ : 0; }
+    void refill(uint64_t nowNs);
+
+    Config config_;
+    Bucket committed_;
+    Bucket peak_;
+    uint64_t lastNs_;
+    Stats stats_;
+};
+
+#endif // CORE_TRTCMPOLICER_H
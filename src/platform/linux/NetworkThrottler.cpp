@@ -0,0 +1,457 @@
+#include "NetworkThrottler.h"
+#include "core/MonotonicClock.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <signal.h>
+#include <sys/types.h>
+
+namespace {
+
+// The shaper class of a policed direction: CIR guaranteed, up to PIR borrowed
+ShapingRates committedToPeak(const TrtcmPolicer::Config& config) {
+    return ShapingRates(config.committedRate, config.peakRate);
+}
+
+// Long-run rate a policer lets through: yellow traffic counts unless it is held or dropped
+uint64_t sustainedRate(const TrtcmPolicer::Config& config) {
+    const PolicerAction yellow = config.action(PolicerColor::Yellow);
+    return yellow == PolicerAction::Pass || yellow == PolicerAction::Mark ? config.peakRate : config.committedRate;
+}
+
+} // namespace
+
+NetworkThrottler::NetworkThrottler() {
+    // Only one controller per table publishes to the shim; a second one (the proxy next
+    // to the GUI, say) gets a private table rather than clearing the first one's limits.
+    // Without shared memory the shim has no limits, but the table still serves this
+    // process's lock-free readers.
+    if (!sharedLimits_.create()) {
+        sharedLimits_.createAnonymous();
+    }
+}
+
+NetworkThrottler::~NetworkThrottler() {
+    stopAll();
+}
+
+bool NetworkThrottler::processExists(uint32_t pid) {
+    // Signal 0 only checks existence; EPERM still means the PID is alive
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+}
+
+bool NetworkThrottler::startThrottling(uint32_t pid, uint64_t downloadLimitBytesPerSec, uint64_t uploadLimitBytesPerSec) {
+    // A flat limit is a leaf directly under the link with rate == ceil (no borrowing)
+    return startThrottling(pid, TrafficShaper::LINK_GROUP,
+                           ShapingRates(downloadLimitBytesPerSec, downloadLimitBytesPerSec),
+                           ShapingRates(uploadLimitBytesPerSec, uploadLimitBytesPerSec));
+}
+
+bool NetworkThrottler::startThrottling(uint32_t pid, uint32_t groupId, const ShapingRates& download, const ShapingRates& upload) {
+    if (pid == 0 || !processExists(pid)) {
+        return false;
+    }
+    
+    auto& shard = throttles_.shard(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const ThrottleInfo* existing = shard.find(pid);
+    if (existing && existing->treeRoot != 0) {
+        return false;
+    }
+    return startThrottlingLocked(shard, pid, groupId, download, upload);
+}
+
+bool NetworkThrottler::startThrottlingLocked(ThrottleTable<ThrottleInfo>::Shard& shard, uint32_t pid, uint32_t groupId,
+                                             const ShapingRates& download, const ShapingRates& upload, uint32_t treeRoot,
+                                             std::shared_ptr<ProcessLimiter> limiter) {
+    // Check if already throttling this PID
+    if (shard.find(pid)) {
+        stopThrottlingLocked(shard, pid);
+    }
+    
+    if (!shaper_.attachProcess(pid, groupId, download, upload, std::move(limiter))) {
+        return false;
+    }
+    
+    ThrottleInfo info;
+    info.treeRoot = treeRoot;
+    info.groupId = groupId;
+    info.download = download;
+    info.upload = upload;
+    info.limiter = shaper_.limiter(pid);
+    info.policed = false;
+    // The table is what readers see, so a throttle it cannot hold is not started
+    if (!publishLimits(pid, info)) {
+        shaper_.detachProcess(pid);
+        return false;
+    }
+    shard.insert(pid, info);
+    return true;
+}
+
+bool NetworkThrottler::startPolicing(uint32_t pid, const TrtcmPolicer::Config& download,
+                                     const TrtcmPolicer::Config& upload) {
+    if (pid == 0 || !download.isValid() || !upload.isValid() || !processExists(pid)) {
+        return false;
+    }
+    
+    auto& shard = throttles_.shard(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const ThrottleInfo* existing = shard.find(pid);
+    if (existing && existing->treeRoot != 0) {
+        return false;
+    }
+    if (!startThrottlingLocked(shard, pid, TrafficShaper::LINK_GROUP, committedToPeak(download),
+                               committedToPeak(upload))) {
+        return false;
+    }
+    ThrottleInfo* info = shard.find(pid);
+    info->policed = true;
+    info->downloadPolicer = download;
+    info->uploadPolicer = upload;
+    if (!applyPolicers(pid, *info)) {
+        stopThrottlingLocked(shard, pid);
+        return false;
+    }
+    publishLimits(pid, *info);
+    return true;
+}
+
+bool NetworkThrottler::applyPolicers(uint32_t pid, const ThrottleInfo& info) {
+    const uint64_t nowNs = MonotonicClock::nowNs();
+    return shaper_.setPolicer(pid, TrafficDirection::Download, info.downloadPolicer, nowNs) &&
+           shaper_.setPolicer(pid, TrafficDirection::Upload, info.uploadPolicer, nowNs);
+}
+
+bool NetworkThrottler::publishLimits(uint32_t pid, const ThrottleInfo& info) {
+    // The shim gets what the process's own buckets enforce: its ceil capped by its group's
+    // and the link's. It meters one bucket per direction, so a policed direction is also
+    // capped at what the policer's actions let through over time.
+    auto limit = [&info](TrafficDirection direction, const TrtcmPolicer::Config& policer) {
+        const uint64_t rate = info.limiter->bucket(direction).rate();
+        if (!info.policed) {
+            return rate;
+        }
+        const uint64_t sustained = sustainedRate(policer);
+        return rate == 0 || (sustained != 0 && sustained < rate) ? sustained : rate;
+    };
+    return sharedLimits_.publish(pid, limit(TrafficDirection::Download, info.downloadPolicer),
+                                 limit(TrafficDirection::Upload, info.uploadPolicer), info.treeRoot);
+}
+
+void NetworkThrottler::republishAll() {
+    // Link and group changes move the ceilings of processes that were not touched
+    throttles_.forEach([this](uint32_t pid, const ThrottleInfo& info) { publishLimits(pid, info); });
+}
+
+bool NetworkThrottler::updateLimits(uint32_t pid, const ShapingRates& download, const ShapingRates& upload) {
+    auto& shard = throttles_.shard(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    ThrottleInfo* info = shard.find(pid);
+    if (!info || info->treeRoot != 0 || info->policed) {
+        return false;
+    }
+    // In place: held traffic, bucket fill and the shim's entry (with its counters) stay
+    if (!shaper_.setProcessRates(pid, download, upload, MonotonicClock::nowNs())) {
+        return false;
+    }
+    info->download = download;
+    info->upload = upload;
+    publishLimits(pid, *info);
+    return true;
+}
+
+bool NetworkThrottler::applyBatch(const std::vector<ThrottleRequest>& requests) {
+    // Validate the whole set before anything changes
+    std::vector<uint32_t> pids;
+    pids.reserve(requests.size());
+    for (const ThrottleRequest& request : requests) {
+        if (request.pid == 0 || !processExists(request.pid)) {
+            return false;
+        }
+        pids.push_back(request.pid);
+    }
+    std::sort(pids.begin(), pids.end());
+    if (std::adjacent_find(pids.begin(), pids.end()) != pids.end()) {
+        return false;
+    }
+    
+    auto locks = throttles_.lockShards(pids);
+    size_t added = 0;
+    for (uint32_t pid : pids) {
+        const ThrottleInfo* existing = throttles_.shard(pid).find(pid);
+        if (existing && existing->treeRoot != 0) {
+            return false;
+        }
+        added += existing ? 0 : 1;
+    }
+    if (added > sharedLimits_.available()) {
+        return false;
+    }
+    
+    // Apply, remembering what each PID had so that a failure can put it back
+    std::vector<Undo> undo;
+    undo.reserve(requests.size());
+    for (const ThrottleRequest& request : requests) {
+        auto& shard = throttles_.shard(request.pid);
+        const ThrottleInfo* previous = shard.find(request.pid);
+        undo.push_back(Undo{request.pid, previous != nullptr, previous ? *previous : ThrottleInfo()});
+        if (!startThrottlingLocked(shard, request.pid, TrafficShaper::LINK_GROUP,
+                                   ShapingRates(request.downloadLimit, request.downloadLimit),
+                                   ShapingRates(request.uploadLimit, request.uploadLimit))) {
+            rollback(undo);
+            return false;
+        }
+    }
+    return true;
+}
+
+void NetworkThrottler::rollback(const std::vector<Undo>& undo) {
+    // Restored throttles start with full buckets and no held traffic
+    for (auto it = undo.rbegin(); it != undo.rend(); ++it) {
+        auto& shard = throttles_.shard(it->pid);
+        stopThrottlingLocked(shard, it->pid);
+        if (it->existed &&
+            startThrottlingLocked(shard, it->pid, it->previous.groupId, it->previous.download, it->previous.upload) &&
+            it->previous.policed) {
+            ThrottleInfo* info = shard.find(it->pid);
+            info->policed = true;
+            info->downloadPolicer = it->previous.downloadPolicer;
+            info->uploadPolicer = it->previous.uploadPolicer;
+            applyPolicers(it->pid, *info);
+            publishLimits(it->pid, *info);
+        }
+    }
+}
+
+bool NetworkThrottler::removeBatch(const std::vector<uint32_t>& pids) {
+    std::vector<uint32_t> sorted(pids);
+    std::sort(sorted.begin(), sorted.end());
+    if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+        return false;
+    }
+    
+    // Every PID must be throttled on its own, or nothing is removed; once validated,
+    // removal cannot fail
+    auto locks = throttles_.lockShards(sorted);
+    for (uint32_t pid : sorted) {
+        const ThrottleInfo* existing = throttles_.shard(pid).find(pid);
+        if (!existing || existing->treeRoot != 0) {
+            return false;
+        }
+    }
+    for (uint32_t pid : pids) {
+        stopThrottlingLocked(throttles_.shard(pid), pid);
+    }
+    return true;
+}
+
+bool NetworkThrottler::startThrottlingTree(uint32_t rootPid, uint64_t downloadLimitBytesPerSec,
+                                           uint64_t uploadLimitBytesPerSec) {
+    if (rootPid == 0 || !processExists(rootPid)) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> treesLock(treesMutex_);
+    stopTreeLocked(rootPid);
+    ThrottleInfo existing;
+    if (throttles_.find(rootPid, existing) && existing.treeRoot != 0) {
+        return false; // already inside another tree
+    }
+    // Subscribing before the scan below means no fork is missed in between; without the
+    // process connector, updateTrees() rescans instead
+    treeWatcher_.start();
+    
+    // The group carries the aggregate limits; members only borrow from it
+    TreeInfo tree;
+    tree.downloadLimit = downloadLimitBytesPerSec;
+    tree.uploadLimit = uploadLimitBytesPerSec;
+    tree.groupId = shaper_.createGroup(TrafficShaper::LINK_GROUP,
+                                       ShapingRates(downloadLimitBytesPerSec, downloadLimitBytesPerSec),
+                                       ShapingRates(uploadLimitBytesPerSec, uploadLimitBytesPerSec));
+    if (tree.groupId == TrafficShaper::INVALID_GROUP) {
+        return false;
+    }
+    // Every member, the root included, is attached with the same limiter, so the shaper
+    // splits the tree's budget between them by weight
+    tree.limiter = std::make_shared<ProcessLimiter>(rootPid, downloadLimitBytesPerSec, uploadLimitBytesPerSec);
+    {
+        // The root's shared-table entry is the one the whole tree charges
+        auto& shard = throttles_.shard(rootPid);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (!startThrottlingLocked(shard, rootPid, tree.groupId, ShapingRates(0, downloadLimitBytesPerSec),
+                                   ShapingRates(0, uploadLimitBytesPerSec), rootPid, tree.limiter)) {
+            shaper_.removeGroup(tree.groupId);
+            return false;
+        }
+    }
+    tree.members.insert(rootPid);
+    TreeInfo& stored = trees_.emplace(rootPid, std::move(tree)).first->second;
+    
+    std::vector<uint32_t> descendants;
+    treeWatcher_.trackTree(rootPid, descendants);
+    for (uint32_t pid : descendants) {
+        if (joinTreeLocked(pid, rootPid, stored)) {
+            stored.members.insert(pid);
+        } else {
+            treeWatcher_.untrack(pid);
+        }
+    }
+    return true;
+}
+
+bool NetworkThrottler::joinTreeLocked(uint32_t pid, uint32_t root, const TreeInfo& tree) {
+    auto& shard = throttles_.shard(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const ThrottleInfo* existing = shard.find(pid);
+    if (existing && existing->treeRoot != 0) {
+        return false;
+    }
+    return startThrottlingLocked(shard, pid, tree.groupId, ShapingRates(0, tree.downloadLimit),
+                                 ShapingRates(0, tree.uploadLimit), root, tree.limiter);
+}
+
+void NetworkThrottler::leaveTreeLocked(uint32_t pid, uint32_t root) {
+    auto& shard = throttles_.shard(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const ThrottleInfo* existing = shard.find(pid);
+    if (existing && existing->treeRoot == root) {
+        stopThrottlingLocked(shard, pid);
+    }
+}
+
+bool NetworkThrottler::stopTreeLocked(uint32_t root) {
+    auto it = trees_.find(root);
+    if (it == trees_.end()) {
+        return false;
+    }
+    for (uint32_t pid : it->second.members) {
+        if (pid != root) {
+            leaveTreeLocked(pid, root);
+        }
+    }
+    // The root goes last: members' shims charge its entry until their own are removed
+    leaveTreeLocked(root, root);
+    treeWatcher_.untrackTree(root);
+    shaper_.removeGroup(it->second.groupId);
+    trees_.erase(it);
+    return true;
+}
+
+size_t NetworkThrottler::updateTrees() {
+    std::lock_guard<std::mutex> treesLock(treesMutex_);
+    treeChanges_.clear();
+    // Drained even without trees, so that the connector's socket never overflows
+    treeWatcher_.poll(treeChanges_);
+    size_t changed = 0;
+    for (const ProcessTreeWatcher::Change& change : treeChanges_) {
+        auto it = trees_.find(change.root);
+        if (it == trees_.end()) {
+            continue;
+        }
+        TreeInfo& tree = it->second;
+        if (change.kind == ProcessTreeWatcher::Change::Joined) {
+            if (joinTreeLocked(change.pid, change.root, tree)) {
+                tree.members.insert(change.pid);
+                ++changed;
+            } else {
+                treeWatcher_.untrack(change.pid);
+            }
+            continue;
+        }
+        tree.members.erase(change.pid);
+        ++changed;
+        if (tree.members.empty()) {
+            stopTreeLocked(change.root);
+        } else if (change.pid != change.root) {
+            leaveTreeLocked(change.pid, change.root);
+        }
+    }
+    return changed;
+}
+
+std::vector<uint32_t> NetworkThrottler::treeMembers(uint32_t rootPid) const {
+    std::lock_guard<std::mutex> treesLock(treesMutex_);
+    auto it = trees_.find(rootPid);
+    if (it == trees_.end()) {
+        return {};
+    }
+    std::vector<uint32_t> members(it->second.members.begin(), it->second.members.end());
+    std::sort(members.begin(), members.end());
+    return members;
+}
+
+bool NetworkThrottler::stopThrottling(uint32_t pid) {
+    ThrottleInfo info;
+    if (throttles_.find(pid, info) && info.treeRoot != 0) {
+        std::lock_guard<std::mutex> treesLock(treesMutex_);
+        return stopTreeLocked(info.treeRoot);
+    }
+    
+    auto& shard = throttles_.shard(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return stopThrottlingLocked(shard, pid);
+}
+
+bool NetworkThrottler::stopThrottlingLocked(ThrottleTable<ThrottleInfo>::Shard& shard, uint32_t pid) {
+    if (!shard.find(pid)) {
+        return false;
+    }
+    
+    shaper_.detachProcess(pid);
+    flowCache_.removeProcess(pid);
+    sharedLimits_.remove(pid);
+    shard.erase(pid);
+    return true;
+}
+
+size_t NetworkThrottler::stopAll() {
+    size_t stopped = 0;
+    for (uint32_t pid : throttles_.pids()) {
+        stopped += stopThrottling(pid) ? 1 : 0;
+    }
+    return stopped;
+}
+
+std::vector<ThrottleStatus> NetworkThrottler::activeThrottles() const {
+    std::vector<ThrottleStatus> result;
+    throttles_.forEach([&result](uint32_t pid, const ThrottleInfo& info) {
+        result.emplace_back(pid, info.download.ceil, info.upload.ceil, info.treeRoot);
+    });
+    return result;
+}
+
+bool NetworkThrottler::isThrottlingActive(uint32_t pid) const {
+    // Lock-free: every active throttle has an entry in the shared table
+    return sharedLimits_.find(pid) != nullptr;
+}
+
+bool NetworkThrottler::getThrottleStatus(uint32_t pid, SharedLimitSnapshot& status) const {
+    return sharedLimits_.read(pid, status);
+}
+
+std::shared_ptr<ProcessLimiter> NetworkThrottler::getLimiter(uint32_t pid) const {
+    ThrottleInfo info;
+    return throttles_.find(pid, info) ? info.limiter : nullptr;
+}
+
+void NetworkThrottler::setLinkCapacity(uint64_t downloadBytesPerSec, uint64_t uploadBytesPerSec) {
+    shaper_.setLinkCapacity(downloadBytesPerSec, uploadBytesPerSec);
+    republishAll();
+}
+
+uint32_t NetworkThrottler::createGroup(uint32_t parentGroupId, const ShapingRates& download, const ShapingRates& upload) {
+    const uint32_t groupId = shaper_.createGroup(parentGroupId, download, upload);
+    if (groupId != TrafficShaper::INVALID_GROUP) {
+        republishAll();
+    }
+    return groupId;
+}
+
+bool NetworkThrottler::removeGroup(uint32_t groupId) {
+    if (!shaper_.removeGroup(groupId)) {
+        return false;
+    }
+    republishAll();
+    return true;
+}
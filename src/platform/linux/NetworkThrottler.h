@@ -0,0 +1,144 @@
+#ifndef LINUX_NETWORKTHROTTLER_H
+#define LINUX_NETWORKTHROTTLER_H
+
+#include "core/FlowCache.h"
+#include "core/ProcessLimiter.h"
+#include "core/ThrottleTable.h"
+#include "core/TrafficShaper.h"
+#include "core/TrtcmPolicer.h"
+#include "../../ProcessInfo.h"
+#include "ProcessTreeWatcher.h"
+#include "SharedLimits.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Linux throttler. Limits live in the shared TrafficShaper and per-process token buckets;
+// enforcement happens in user space wherever traffic is intercepted. Process ceilings are
+// also published to a shared-memory table, which the LD_PRELOAD shim (libbandwidthshim.so)
+// enforces and which answers status queries without taking the throttler lock.
+class NetworkThrottler {
+public:
+    NetworkThrottler();
+    ~NetworkThrottler();
+    
+    // Limits are enforced inside the throttled processes (shim) or by the proxy, and the
+    // shared table lives in the user's own /dev/shm, so no step needs root
+    static bool requiresElevation() { return false; }
+    
+    bool startThrottling(uint32_t pid, uint64_t downloadLimitBytesPerSec, uint64_t uploadLimitBytesPerSec);
+    bool startThrottling(uint32_t pid, uint32_t groupId, const ShapingRates& download, const ShapingRates& upload);
+    // Stopping any member of a throttle tree stops the whole tree
+    bool stopThrottling(uint32_t pid);
+    bool isThrottlingActive(uint32_t pid) const;
+    // Two-rate three-color policing (RFC 2698) instead of a single limit per direction:
+    // CIR/PIR, CBS/PBS and an action per color. The process's shaper class guarantees
+    // CIR and may borrow up to PIR. The shim meters a single bucket per direction, so it
+    // enforces PIR where yellow traffic passes (or is marked) and CIR otherwise.
+    bool startPolicing(uint32_t pid, const TrtcmPolicer::Config& download, const TrtcmPolicer::Config& upload);
+    // Changes the limits of a running throttle without restarting it: traffic already
+    // held stays queued and the buckets keep their fill. Fails for throttle tree members
+    // and policed processes.
+    bool updateLimits(uint32_t pid, const ShapingRates& download, const ShapingRates& upload);
+    
+    // Throttle tree: rootPid and all of its descendants, including processes forked later,
+    // share one download and one upload bucket with the given limits. Descendants that
+    // were throttled on their own are folded into the tree. Members of a tree cannot be
+    // given their own limits (startThrottling and applyBatch fail for them); instead each
+    // gets a weight and optional ceiling within the tree from shaper().setFairShare().
+    bool startThrottlingTree(uint32_t rootPid, uint64_t downloadLimitBytesPerSec, uint64_t uploadLimitBytesPerSec);
+    // Adds processes forked into trees and drops exited ones since the last call; returns
+    // the number of changes. The shim charges new children to their tree at once, so
+    // this only has to keep up for status and the user-space shaping paths.
+    size_t updateTrees();
+    std::vector<uint32_t> treeMembers(uint32_t rootPid) const;
+    
+    // All-or-nothing: the whole set is validated first (live, distinct PIDs; room in the
+    // shared table), then applied with the PIDs' shard locks held throughout. If any
+    // throttle fails to start, the ones already applied are undone and PIDs that were
+    // throttled before get their previous limits back. removeBatch fails, removing
+    // nothing, unless every PID is throttled on its own (not as a tree member).
+    bool applyBatch(const std::vector<ThrottleRequest>& requests);
+    bool removeBatch(const std::vector<uint32_t>& pids);
+    
+    // Every active throttle, shard by shard (not an atomic snapshot)
+    std::vector<ThrottleStatus> activeThrottles() const;
+    size_t stopAll();
+    // Limits and bytes charged so far, read without locks; false if the PID is not throttled
+    bool getThrottleStatus(uint32_t pid, SharedLimitSnapshot& status) const;
+    
+    // Token buckets configured by startThrottling; the enforcement path consumes from
+    // them without taking the throttler lock. Returns nullptr if the PID is not throttled.
+    std::shared_ptr<ProcessLimiter> getLimiter(uint32_t pid) const;
+    
+    // Hierarchical limits: link budget -> groups -> processes
+    void setLinkCapacity(uint64_t downloadBytesPerSec, uint64_t uploadBytesPerSec);
+    uint32_t createGroup(uint32_t parentGroupId, const ShapingRates& download, const ShapingRates& upload);
+    bool removeGroup(uint32_t groupId);
+    TrafficShaper& shaper() { return shaper_; }
+    const TrafficShaper& shaper() const { return shaper_; }
+    
+    // 5-tuple -> (pid, group) for per-packet classification. Lookups are lock-free;
+    // flows of a process are dropped when its throttle stops.
+    FlowCache& flowCache() { return flowCache_; }
+    
+    // False if the shared-memory table could not be created; the shim then has no limits
+    bool sharedLimitsAvailable() const { return sharedLimits_.isShared(); }
+    const SharedLimits& sharedLimits() const { return sharedLimits_; }
+
+private:
+    struct ThrottleInfo {
+        uint32_t treeRoot; // 0 unless the process belongs to a throttle tree
+        uint32_t groupId;
+        ShapingRates download;
+        ShapingRates upload;
+        std::shared_ptr<ProcessLimiter> limiter;
+        bool policed;
+        TrtcmPolicer::Config downloadPolicer;
+        TrtcmPolicer::Config uploadPolicer;
+    };
+    
+    struct TreeInfo {
+        uint32_t groupId; // holds the aggregate limits in the shaper
+        uint64_t downloadLimit;
+        uint64_t uploadLimit;
+        std::shared_ptr<ProcessLimiter> limiter; // the buckets every member charges
+        std::unordered_set<uint32_t> members; // live processes; the root's throttle outlives it
+    };
+    
+    struct Undo {
+        uint32_t pid;
+        bool existed;
+        ThrottleInfo previous;
+    };
+    
+    // Start and stop hold the PID's shard lock throughout, so operations on one PID are
+    // serialized while different PIDs proceed in parallel
+    ThrottleTable<ThrottleInfo> throttles_;
+    TrafficShaper shaper_;
+    FlowCache flowCache_;
+    SharedLimits sharedLimits_;
+    // Taken before any shard lock
+    mutable std::mutex treesMutex_;
+    std::unordered_map<uint32_t, TreeInfo> trees_;
+    ProcessTreeWatcher treeWatcher_;
+    std::vector<ProcessTreeWatcher::Change> treeChanges_; // scratch for updateTrees
+    
+    bool startThrottlingLocked(ThrottleTable<ThrottleInfo>::Shard& shard, uint32_t pid, uint32_t groupId,
+                               const ShapingRates& download, const ShapingRates& upload, uint32_t treeRoot = 0,
+                               std::shared_ptr<ProcessLimiter> limiter = nullptr);
+    bool stopThrottlingLocked(ThrottleTable<ThrottleInfo>::Shard& shard, uint32_t pid);
+    void rollback(const std::vector<Undo>& undo);
+    bool applyPolicers(uint32_t pid, const ThrottleInfo& info);
+    bool publishLimits(uint32_t pid, const ThrottleInfo& info);
+    void republishAll();
+    bool joinTreeLocked(uint32_t pid, uint32_t root, const TreeInfo& tree);
+    void leaveTreeLocked(uint32_t pid, uint32_t root);
+    bool stopTreeLocked(uint32_t root);
+    static bool processExists(uint32_t pid);
+};
+
+#endif // LINUX_NETWORKTHROTTLER_H
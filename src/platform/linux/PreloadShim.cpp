@@ -0,0 +1,598 @@
+// LD_PRELOAD shim that enforces the limits NetworkThrottler publishes in shared memory,
+// for machines where the throttler cannot get the privileges to shape traffic itself:
+//
+//     LD_PRELOAD=/path/to/libbandwidthshim.so some-application
+//
+// The send and receive entry points of libc are wrapped. Each call on an IPv4/IPv6 socket
+// is charged to the calling process's token bucket, which lives in the shared table, so
+// the controller never has to be asked. Sends wait for tokens before the call and get
+// back those for whatever it did not take; receives pay for what arrived after it. A
+// thread that has run out of tokens sleeps until the bucket refills, which also applies
+// to non-blocking sockets. Stream transfers are cut to one burst per call so pacing stays
+// smooth.
+//
+// A process that is not throttled pays one generation compare per call. A throttled one
+// additionally looks up the descriptor in a per-process cache (filled by one getsockopt
+// per descriptor) and spends tokens from a per-thread grant; only when the grant runs out
+// does it read the clock and take a new one from the shared bucket. No syscalls are made
+// while the process is under its limit.
+//
+// Members of a throttle tree charge the tree root's buckets. A process that is not in the
+// table yet is charged to the tree of the process it was forked from (remembered across
+// fork in memory, and across exec through its parent PID), so children are limited from
+// their first call rather than from when the controller learns about them.
+
+#include "SharedLimits.h"
+#include "core/MonotonicClock.h"
+#include "core/ProcessLimiter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <mutex>
+#include <pthread.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define SHIM_EXPORT extern "C" __attribute__((visibility("default")))
+
+namespace {
+
+using SendFn = ssize_t (*)(int, const void*, size_t, int);
+using RecvFn = ssize_t (*)(int, void*, size_t, int);
+using SendToFn = ssize_t (*)(int, const void*, size_t, int, const sockaddr*, socklen_t);
+using RecvFromFn = ssize_t (*)(int, void*, size_t, int, sockaddr*, socklen_t*);
+using SendMsgFn = ssize_t (*)(int, const msghdr*, int);
+using RecvMsgFn = ssize_t (*)(int, msghdr*, int);
+using WriteFn = ssize_t (*)(int, const void*, size_t);
+using ReadFn = ssize_t (*)(int, void*, size_t);
+using SendFileFn = ssize_t (*)(int, int, off_t*, size_t);
+using SpliceFn = ssize_t (*)(int, loff_t*, int, loff_t*, size_t, unsigned int);
+using CloseFn = int (*)(int);
+using CloseRangeFn = int (*)(unsigned int, unsigned int, int);
+using FcloseFn = int (*)(FILE*);
+using DupFn = int (*)(int);
+using Dup2Fn = int (*)(int, int);
+using Dup3Fn = int (*)(int, int, int);
+using FcntlFn = int (*)(int, int, ...);
+using SocketFn = int (*)(int, int, int);
+using SocketPairFn = int (*)(int, int, int, int*);
+using AcceptFn = int (*)(int, sockaddr*, socklen_t*);
+using Accept4Fn = int (*)(int, sockaddr*, socklen_t*, int);
+using OpenFn = int (*)(const char*, int, ...);
+using OpenAtFn = int (*)(int, const char*, int, ...);
+
+struct RealCalls {
+    SendFn send;
+    RecvFn recv;
+    SendToFn sendto;
+    RecvFromFn recvfrom;
+    SendMsgFn sendmsg;
+    RecvMsgFn recvmsg;
+    WriteFn write;
+    ReadFn read;
+    SendFileFn sendfile;
+    SpliceFn splice;
+    CloseFn close;
+    CloseRangeFn close_range;
+    FcloseFn fclose;
+    DupFn dup;
+    Dup2Fn dup2;
+    Dup3Fn dup3;
+    FcntlFn fcntl;
+    SocketFn socket;
+    SocketPairFn socketpair;
+    AcceptFn accept;
+    Accept4Fn accept4;
+    OpenFn open;
+    OpenFn open64;
+    OpenAtFn openat;
+    OpenAtFn openat64;
+};
+
+RealCalls real;
+
+template <typename Fn>
+Fn resolve(Fn& slot, const char* name) {
+    // Calls can arrive from other libraries' constructors before ours has run
+    if (!slot) {
+        slot = reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+    }
+    return slot;
+}
+
+#define REAL(name) resolve(real.name, #name)
+
+// Descriptor kinds, cached per process. Entries are reset when a wrapped call closes,
+// replaces or hands out the descriptor, so a number reused behind the shim's back (by a raw
+// syscall) keeps its old kind only until the next wrapped call returns it; descriptors above
+// the cache size are classified per call.
+constexpr int FD_CACHE_SIZE = 65536;
+enum : uint8_t { FD_UNKNOWN = 0, FD_OTHER = 1, FD_STREAM = 2, FD_DATAGRAM = 3 };
+std::atomic<uint8_t> fdKinds[FD_CACHE_SIZE];
+
+constexpr uint64_t REOPEN_INTERVAL_NS = 1000000000ULL;
+constexpr size_t MIN_CHUNK = 1500;
+constexpr uint64_t GRANT_DIVISOR = 16;
+
+std::atomic<SharedLimitTable*> sharedTable(nullptr);
+std::atomic<uint64_t> nextOpenNs(0);
+std::atomic<uint32_t> currentPid(0);
+std::atomic<uint32_t> parentPid(0);
+std::atomic<uint32_t> inheritedRoot(0); // tree of the process this one was forked from
+std::mutex openMutex;
+
+// Per-thread result of the last table lookup, valid while the generation and PID match,
+// and the tokens this thread has taken from the entry's buckets but not spent yet
+struct LookupCache {
+    uint64_t generation; // 0 = nothing cached (table generations start at 1)
+    uint32_t pid;
+    SharedLimitEntry* entry;
+    uint64_t uploadCredit;
+    uint64_t downloadCredit;
+};
+__thread LookupCache lookupCache __attribute__((tls_model("initial-exec")));
+
+SharedLimitTable* openTable() {
+    const uint64_t now = MonotonicClock::nowNs();
+    if (now < nextOpenNs.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(openMutex);
+    SharedLimitTable* table = sharedTable.load(std::memory_order_acquire);
+    if (table) {
+        return table;
+    }
+    // Retried once per interval, so processes started before the controller pick it up
+    nextOpenNs.store(now + REOPEN_INTERVAL_NS, std::memory_order_relaxed);
+    static SharedLimits* limits = new SharedLimits();
+    if (!limits->open()) {
+        return nullptr;
+    }
+    table = limits->table();
+    sharedTable.store(table, std::memory_order_release);
+    return table;
+}
+
+// The entry a process charges: its own or its tree root's, else the tree it was forked into
+SharedLimitEntry* chargedEntry(SharedLimitTable& table, uint32_t pid) {
+    if (SharedLimitEntry* entry = SharedLimits::findCharged(table, pid)) {
+        return entry;
+    }
+    const uint32_t root = inheritedRoot.load(std::memory_order_relaxed);
+    if (root != 0) {
+        SharedLimitEntry* entry = SharedLimits::findCharged(table, root);
+        if (entry && entry->treeRoot.load(std::memory_order_relaxed) == root) {
+            return entry;
+        }
+    }
+    const uint32_t parent = parentPid.load(std::memory_order_relaxed);
+    if (parent != 0) {
+        SharedLimitEntry* entry = SharedLimits::findCharged(table, parent);
+        if (entry && entry->treeRoot.load(std::memory_order_relaxed) != 0) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+SharedLimitEntry* currentEntry() {
+    SharedLimitTable* table = sharedTable.load(std::memory_order_acquire);
+    if (!table && !(table = openTable())) {
+        return nullptr;
+    }
+    const uint64_t generation = table->generation.load(std::memory_order_acquire);
+    const uint32_t pid = currentPid.load(std::memory_order_relaxed);
+    LookupCache& cache = lookupCache;
+    if (cache.generation == generation && cache.pid == pid) {
+        return cache.entry;
+    }
+
+    SharedLimitEntry* found = chargedEntry(*table, pid);
+    cache.generation = generation;
+    cache.pid = pid;
+    cache.entry = found;
+    cache.uploadCredit = 0;
+    cache.downloadCredit = 0;
+    return found;
+}
+
+uint8_t classify(int fd) {
+    if (fd < 0) {
+        return FD_OTHER;
+    }
+    if (fd < FD_CACHE_SIZE) {
+        const uint8_t kind = fdKinds[fd].load(std::memory_order_relaxed);
+        if (kind != FD_UNKNOWN) {
+            return kind;
+        }
+    }
+
+    // Only network sockets are shaped; Unix sockets, pipes and files pass through
+    uint8_t kind = FD_OTHER;
+    int domain = 0;
+    int type = 0;
+    socklen_t length = sizeof(domain);
+    if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &length) == 0 &&
+        (domain == AF_INET || domain == AF_INET6)) {
+        length = sizeof(type);
+        getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &length);
+        kind = type == SOCK_STREAM ? FD_STREAM : FD_DATAGRAM;
+    }
+    if (fd < FD_CACHE_SIZE) {
+        fdKinds[fd].store(kind, std::memory_order_relaxed);
+    }
+    return kind;
+}
+
+void forget(int fd) {
+    if (fd >= 0 && fd < FD_CACHE_SIZE) {
+        fdKinds[fd].store(FD_UNKNOWN, std::memory_order_relaxed);
+    }
+}
+
+// For calls that return a new descriptor; the errno of the call is preserved
+int forgetNew(int fd) {
+    forget(fd);
+    return fd;
+}
+
+// open() and openat() take a mode only when they may create a file
+bool takesMode(int flags) {
+    return (flags & O_CREAT) != 0 || (flags & O_TMPFILE) == O_TMPFILE;
+}
+
+// Bucket and counter for a call on fd, or nullptr if the call is not shaped
+SharedLimitLane* laneFor(int fd, TrafficDirection direction, uint8_t& kind) {
+    SharedLimitEntry* entry = currentEntry();
+    if (!entry) {
+        return nullptr;
+    }
+    SharedLimitLane& lane = direction == TrafficDirection::Download ? entry->download : entry->upload;
+    if (lane.bucket.isUnlimited()) {
+        return nullptr;
+    }
+    kind = classify(fd);
+    return kind == FD_STREAM || kind == FD_DATAGRAM ? &lane : nullptr;
+}
+
+// Stream transfers are cut to one burst; datagrams keep their size
+size_t chunk(const SharedLimitLane& lane, uint8_t kind, size_t length) {
+    if (kind != FD_STREAM) {
+        return length;
+    }
+    return std::min(length, static_cast<size_t>(std::max<uint64_t>(lane.bucket.burst(), MIN_CHUNK)));
+}
+
+void waitForTokens(TokenBucket& bucket, size_t bytes) {
+    for (;;) {
+        const uint64_t now = MonotonicClock::nowNs();
+        if (bucket.tryConsume(bytes, now)) {
+            return;
+        }
+        const uint64_t due = bucket.nextAvailableAt(bytes, now);
+        timespec until;
+        until.tv_sec = static_cast<time_t>(due / 1000000000ULL);
+        until.tv_nsec = static_cast<long>(due % 1000000000ULL);
+        // steady_clock is CLOCK_MONOTONIC, the clock the buckets run on
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr);
+    }
+}
+
+// Tokens are taken from the shared bucket in grants of a sixteenth of the burst and spent
+// locally, so most calls under the limit touch neither the clock nor the shared cache
+// line. Each thread can run ahead of the bucket by at most one grant per direction, and
+// the shared byte counter is advanced by whole grants, so it leads by as much.
+void spend(SharedLimitLane& lane, TrafficDirection direction, size_t bytes) {
+    uint64_t& credit = direction == TrafficDirection::Download ? lookupCache.downloadCredit
+                                                               : lookupCache.uploadCredit;
+    if (credit >= bytes) {
+        credit -= bytes;
+        return;
+    }
+    const uint64_t grant = std::max<uint64_t>(bytes - credit, lane.bucket.burst() / GRANT_DIVISOR);
+    waitForTokens(lane.bucket, grant);
+    lane.bytes.fetch_add(grant, std::memory_order_relaxed);
+    credit = credit + grant - bytes;
+}
+
+// Receives are charged after the fact; the errno of the call is preserved for callers
+ssize_t payForReceived(SharedLimitLane* lane, ssize_t received) {
+    if (lane && received > 0) {
+        const int saved = errno;
+        spend(*lane, TrafficDirection::Download, static_cast<size_t>(received));
+        errno = saved;
+    }
+    return received;
+}
+
+// Sends are charged before the call; tokens for bytes it did not take (a short write, an
+// error or EAGAIN) go back to this thread's grant
+ssize_t refundUnsent(SharedLimitLane* lane, size_t charged, ssize_t sent) {
+    const size_t taken = sent > 0 ? static_cast<size_t>(sent) : 0;
+    if (lane && taken < charged) {
+        lookupCache.uploadCredit += charged - taken;
+    }
+    return sent;
+}
+
+size_t messageLength(const msghdr* message) {
+    size_t total = 0;
+    for (size_t i = 0; message && i < message->msg_iovlen; ++i) {
+        total += message->msg_iov[i].iov_len;
+    }
+    return total;
+}
+
+__attribute__((constructor)) void initialize() {
+    currentPid.store(static_cast<uint32_t>(getpid()), std::memory_order_relaxed);
+    parentPid.store(static_cast<uint32_t>(getppid()), std::memory_order_relaxed);
+    // Children inherit the mapping but are limited under their own PID, or share the
+    // budget of the tree their parent is in
+    pthread_atfork(nullptr, nullptr, []() {
+        const uint32_t parent = currentPid.load(std::memory_order_relaxed);
+        SharedLimitTable* table = sharedTable.load(std::memory_order_acquire);
+        SharedLimitEntry* charged = table ? chargedEntry(*table, parent) : nullptr;
+        inheritedRoot.store(charged ? charged->treeRoot.load(std::memory_order_relaxed) : 0, std::memory_order_relaxed);
+        parentPid.store(parent, std::memory_order_relaxed);
+        currentPid.store(static_cast<uint32_t>(getpid()), std::memory_order_relaxed);
+        lookupCache.generation = 0; // also drops the parent's unspent grants
+    });
+    REAL(send);
+    REAL(recv);
+    REAL(sendto);
+    REAL(recvfrom);
+    REAL(sendmsg);
+    REAL(recvmsg);
+    REAL(write);
+    REAL(read);
+    REAL(sendfile);
+    REAL(splice);
+    REAL(close);
+    REAL(close_range);
+    REAL(fclose);
+    REAL(dup);
+    REAL(dup2);
+    REAL(dup3);
+    REAL(fcntl);
+    REAL(socket);
+    REAL(socketpair);
+    REAL(accept);
+    REAL(accept4);
+    REAL(open);
+    REAL(open64);
+    REAL(openat);
+    REAL(openat64);
+    openTable();
+}
+
+} // namespace
+
+// True once the shim has mapped the controller's table (for diagnostics and benchmarks)
+SHIM_EXPORT int bandwidth_shim_attached() {
+    return sharedTable.load(std::memory_order_acquire) != nullptr;
+}
+
+SHIM_EXPORT ssize_t send(int fd, const void* buffer, size_t length, int flags) {
+    uint8_t kind = FD_UNKNOWN;
+    SharedLimitLane* lane = laneFor(fd, TrafficDirection::Upload, kind);
+    if (lane) {
+        length = chunk(*lane, kind, length);
+        spend(*lane, TrafficDirection::Upload, length);
+    }
+    return refundUnsent(lane, length, REAL(send)(fd, buffer, length, flags));
+}
+
+SHIM_EXPORT ssize_t sendto(int fd, const void* buffer, size_t length, int flags, const sockaddr* address,
+                           socklen_t addressLength) {
+    uint8_t kind = FD_UNKNOWN;
+    SharedLimitLane* lane = laneFor(fd, TrafficDirection::Upload, kind);
+    if (lane) {
+        length = chunk(*lane, kind, length);
+        spend(*lane, TrafficDirection::Upload, length);
+    }
+    return refundUnsent(lane, length, REAL(sendto)(fd, buffer, length, flags, address, addressLength));
+}
+
+SHIM_EXPORT ssize_t write(int fd, const void* buffer, size_t length) {
+    uint8_t kind = FD_UNKNOWN;
+    SharedLimitLane* lane = laneFor(fd, TrafficDirection::Upload, kind);
+    if (lane) {
+        length = chunk(*lane, kind, length);
+        spend(*lane, TrafficDirection::Upload, length);
+    }
+    return refundUnsent(lane, length, REAL(write)(fd, buffer, length));
+}
+
+SHIM_EXPORT ssize_t sendmsg(int fd, const msghdr* message, int flags) {
+    // Scatter lists are not split; a message larger than the burst waits for a full bucket
+    uint8_t kind = FD_UNKNOWN;
+    SharedLimitLane* lane = laneFor(fd, TrafficDirection::Upload, kind);
+    const size_t length = lane ? messageLength(message) : 0;
+    if (lane) {
+        spend(*lane, TrafficDirection::Upload, length);
+    }
+    return refundUnsent(lane, length, REAL(sendmsg)(fd, message, flags));
+}
+
+SHIM_EXPORT ssize_t sendfile(int outFd, int inFd, off_t* offset, size_t count) {
+    uint8_t kind = FD_UNKNOWN;
+    SharedLimitLane* lane = laneFor(outFd, TrafficDirection::Upload, kind);
+    if (lane) {
+        count = chunk(*lane, kind, count);
+        spend(*lane, TrafficDirection::Upload, count);
+    }
+    return refundUnsent(lane, count, REAL(sendfile)(outFd, inFd, offset, count));
+}
+
+SHIM_EXPORT ssize_t recv(int fd, void* buffer, size_t length, int flags) {
+    uint8_t kind = FD_UNKNOWN;
+    SharedLimitLane* lane = (flags & MSG_PEEK) ? nullptr : laneFor(fd, TrafficDirection::Download, kind);
+    if (lane) {
+        length = chunk(*lane, kind, length);
+    }
+    return payForReceived(lane, REAL(recv)(fd, buffer, length, flags));
+}
+
+SHIM_EXPORT ssize_t recvfrom(int fd, void* buffer, size_t length, int flags, sockaddr* address,
+                             socklen_t* addressLength) {
+    uint8_t kind = FD_UNKNOWN;
+    SharedLimitLane* lane = (flags & MSG_PEEK) ? nullptr : laneFor(fd, TrafficDirection::Download, kind);
+    if (lane) {
+        length = chunk(*lane, kind, length);
+    }
+    return payForReceived(lane, REAL(recvfrom)(fd, buffer, length, flags, address, addressLength));
+}
+
+SHIM_EXPORT ssize_t read(int fd, void* buffer, size_t length) {
+    uint8_t kind = FD_UNKNOWN;
+    SharedLimitLane* lane = laneFor(fd, TrafficDirection::Download, kind);
+    if (lane) {
+        length = chunk(*lane, kind, length);
+    }
+    return payForReceived(lane, REAL(read)(fd, buffer, length));
+}
+
+SHIM_EXPORT ssize_t recvmsg(int fd, msghdr* message, int flags) {
+    uint8_t kind = FD_UNKNOWN;
+    SharedLimitLane* lane = (flags & MSG_PEEK) ? nullptr : laneFor(fd, TrafficDirection::Download, kind);
+    return payForReceived(lane, REAL(recvmsg)(fd, message, flags));
+}
+
+SHIM_EXPORT ssize_t splice(int inFd, loff_t* inOffset, int outFd, loff_t* outOffset, size_t length,
+                           unsigned int flags) {
+    uint8_t outKind = FD_UNKNOWN;
+    uint8_t inKind = FD_UNKNOWN;
+    SharedLimitLane* upload = laneFor(outFd, TrafficDirection::Upload, outKind);
+    SharedLimitLane* download = laneFor(inFd, TrafficDirection::Download, inKind);
+    if (download) {
+        length = chunk(*download, inKind, length);
+    }
+    if (upload) {
+        length = chunk(*upload, outKind, length);
+        spend(*upload, TrafficDirection::Upload, length);
+    }
+    const ssize_t moved = REAL(splice)(inFd, inOffset, outFd, outOffset, length, flags);
+    return payForReceived(download, refundUnsent(upload, length, moved));
+}
+
+SHIM_EXPORT int close(int fd) {
+    forget(fd);
+    return REAL(close)(fd);
+}
+
+SHIM_EXPORT int close_range(unsigned int first, unsigned int last, int flags) {
+    if (!REAL(close_range)) {
+        errno = ENOSYS;
+        return -1;
+    }
+    if ((flags & CLOSE_RANGE_CLOEXEC) == 0) {
+        for (unsigned int fd = first; fd <= last && fd < static_cast<unsigned int>(FD_CACHE_SIZE); ++fd) {
+            forget(static_cast<int>(fd));
+        }
+    }
+    return REAL(close_range)(first, last, flags);
+}
+
+SHIM_EXPORT int fclose(FILE* stream) {
+    if (stream) {
+        forget(fileno(stream));
+    }
+    return REAL(fclose)(stream);
+}
+
+SHIM_EXPORT int dup(int oldFd) {
+    return forgetNew(REAL(dup)(oldFd));
+}
+
+SHIM_EXPORT int dup2(int oldFd, int newFd) {
+    forget(newFd);
+    return REAL(dup2)(oldFd, newFd);
+}
+
+SHIM_EXPORT int dup3(int oldFd, int newFd, int flags) {
+    forget(newFd);
+    return REAL(dup3)(oldFd, newFd, flags);
+}
+
+SHIM_EXPORT int fcntl(int fd, int command, ...) {
+    // Every fcntl argument is an int or a pointer, and both are passed the same way
+    va_list arguments;
+    va_start(arguments, command);
+    void* argument = va_arg(arguments, void*);
+    va_end(arguments);
+    const int result = REAL(fcntl)(fd, command, argument);
+    return command == F_DUPFD || command == F_DUPFD_CLOEXEC ? forgetNew(result) : result;
+}
+
+SHIM_EXPORT int socket(int domain, int type, int protocol) {
+    return forgetNew(REAL(socket)(domain, type, protocol));
+}
+
+SHIM_EXPORT int socketpair(int domain, int type, int protocol, int fds[2]) {
+    const int result = REAL(socketpair)(domain, type, protocol, fds);
+    if (result == 0) {
+        forget(fds[0]);
+        forget(fds[1]);
+    }
+    return result;
+}
+
+SHIM_EXPORT int accept(int fd, sockaddr* address, socklen_t* addressLength) {
+    return forgetNew(REAL(accept)(fd, address, addressLength));
+}
+
+SHIM_EXPORT int accept4(int fd, sockaddr* address, socklen_t* addressLength, int flags) {
+    return forgetNew(REAL(accept4)(fd, address, addressLength, flags));
+}
+
+SHIM_EXPORT int open(const char* path, int flags, ...) {
+    mode_t mode = 0;
+    if (takesMode(flags)) {
+        va_list arguments;
+        va_start(arguments, flags);
+        mode = va_arg(arguments, mode_t);
+        va_end(arguments);
+    }
+    return forgetNew(REAL(open)(path, flags, mode));
+}
+
+SHIM_EXPORT int open64(const char* path, int flags, ...) {
+    mode_t mode = 0;
+    if (takesMode(flags)) {
+        va_list arguments;
+        va_start(arguments, flags);
+        mode = va_arg(arguments, mode_t);
+        va_end(arguments);
+    }
+    return forgetNew(REAL(open64)(path, flags, mode));
+}
+
+SHIM_EXPORT int openat(int directoryFd, const char* path, int flags, ...) {
+    mode_t mode = 0;
+    if (takesMode(flags)) {
+        va_list arguments;
+        va_start(arguments, flags);
+        mode = va_arg(arguments, mode_t);
+        va_end(arguments);
+    }
+    return forgetNew(REAL(openat)(directoryFd, path, flags, mode));
+}
+
+SHIM_EXPORT int openat64(int directoryFd, const char* path, int flags, ...) {
+    mode_t mode = 0;
+    if (takesMode(flags)) {
+        va_list arguments;
+        va_start(arguments, flags);
+        mode = va_arg(arguments, mode_t);
+        va_end(arguments);
+    }
+    return forgetNew(REAL(openat64)(directoryFd, path, flags, mode));
+}
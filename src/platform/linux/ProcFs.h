@@ -0,0 +1,67 @@
+#ifndef LINUX_PROCFS_H
+#define LINUX_PROCFS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Small helpers shared by the procfs scanners. Directories are read with raw getdents64
+// into caller-owned buffers and paths are built relative to an open /proc descriptor, so
+// a scan neither allocates nor resolves absolute paths per entry.
+namespace procfs {
+
+// Layout of the records returned by getdents64 (glibc does not export it)
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+inline long readDirectory(int fd, char* buffer, size_t size) {
+    return syscall(SYS_getdents64, fd, buffer, size);
+}
+
+inline bool parsePid(const char* name, uint32_t& pid) {
+    if (*name == '\0') {
+        return false;
+    }
+    uint32_t value = 0;
+    for (const char* p = name; *p; ++p) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        value = value * 10 + static_cast<uint32_t>(*p - '0');
+    }
+    pid = value;
+    return true;
+}
+
+// Writes "<pid>/<leaf>" into out, returning false if it does not fit
+inline bool pidPath(char* out, size_t size, uint32_t pid, const char* leaf) {
+    char digits[16];
+    size_t n = 0;
+    do {
+        digits[n++] = static_cast<char>('0' + pid % 10);
+        pid /= 10;
+    } while (pid != 0);
+
+    const size_t leafLen = std::strlen(leaf);
+    if (n + 1 + leafLen + 1 > size) {
+        return false;
+    }
+    size_t pos = 0;
+    while (n > 0) {
+        out[pos++] = digits[--n];
+    }
+    out[pos++] = '/';
+    std::memcpy(out + pos, leaf, leafLen + 1);
+    return true;
+}
+
+} // namespace procfs
+
+#endif // LINUX_PROCFS_H
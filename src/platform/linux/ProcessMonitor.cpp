@@ -0,0 +1,336 @@
+#include "ProcessMonitor.h"
+#include "ProcessInfo.h"
+#include "ProcFs.h"
+#include "core/MonotonicClock.h"
+
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t DIRENT_BUFFER_SIZE = 64 * 1024;
+constexpr size_t READ_BUFFER_SIZE = 4096;
+constexpr size_t LINK_BUFFER_SIZE = 4096;
+constexpr int STARTTIME_FIELD = 22;
+constexpr size_t MIN_STRING_BYTES = 256 * 1024; // before compacting the arena
+
+} // namespace
+
+ProcessMonitor::ProcessMonitor(const std::string& procRoot, size_t workers)
+    : procRoot_(procRoot), procFd_(-1), generation_(0), pool_(workers), direntBuffer_(DIRENT_BUFFER_SIZE),
+      readBuffers_(pool_.concurrency(), std::vector<char>(READ_BUFFER_SIZE)),
+      linkBuffers_(pool_.concurrency(), std::vector<char>(LINK_BUFFER_SIZE)), stringsLimit_(MIN_STRING_BYTES),
+      listStale_(true), orderStale_(true), socketOwners_(procRoot), sampleCount_(0) {}
+
+ProcessMonitor::~ProcessMonitor() {
+    if (procFd_ >= 0) {
+        close(procFd_);
+    }
+}
+
+std::shared_ptr<const ProcessList> ProcessMonitor::getRunningProcesses() {
+    if (listStale_) {
+        buildList();
+    }
+    return list_;
+}
+
+void ProcessMonitor::buildList() {
+    // Records stay where they are in cache_ until they are erased, so the order holds
+    // until the processes themselves change, not just their traffic
+    if (orderStale_) {
+        order_.clear();
+        order_.reserve(cache_.size());
+        for (const auto& entry : cache_) {
+            order_.emplace_back(entry.first, &entry.second.record);
+        }
+        std::sort(order_.begin(), order_.end());
+        orderStale_ = false;
+    }
+    // Only views are copied; the list pins the arena blocks they point into
+    std::shared_ptr<ProcessList> list = listPool_.acquire();
+    list->reserve(order_.size());
+    for (const auto& entry : order_) {
+        list->append(*entry.second);
+    }
+    list->strings = strings_.pin();
+    list_ = std::move(list);
+    listStale_ = false;
+}
+
+void ProcessMonitor::compactStrings() {
+    // Lists handed out keep the old blocks for as long as they are held
+    StringArena strings;
+    for (auto& entry : cache_) {
+        ProcessRecord& record = entry.second.record;
+        record.name = strings.intern(record.name);
+        record.path = strings.intern(record.path);
+    }
+    strings_ = std::move(strings);
+    stringsLimit_ = std::max(MIN_STRING_BYTES, 2 * strings_.bytes());
+}
+
+bool ProcessMonitor::openProcRoot() {
+    if (procFd_ >= 0) {
+        return lseek(procFd_, 0, SEEK_SET) == 0;
+    }
+    procFd_ = open(procRoot_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return procFd_ >= 0;
+}
+
+bool ProcessMonitor::refresh() {
+    return refresh(scratchDelta_);
+}
+
+bool ProcessMonitor::refresh(ProcessDelta& delta) {
+    delta.clear();
+    if (!openProcRoot()) {
+        return false;
+    }
+
+    ++generation_;
+
+    // The PIDs, from the directory alone
+    stats_.clear();
+    for (;;) {
+        const long bytes = procfs::readDirectory(procFd_, direntBuffer_.data(), direntBuffer_.size());
+        if (bytes < 0) {
+            return false;
+        }
+        if (bytes == 0) {
+            break;
+        }
+
+        for (long offset = 0; offset < bytes;) {
+            const auto* entry = reinterpret_cast<const procfs::LinuxDirent64*>(direntBuffer_.data() + offset);
+            offset += entry->d_reclen;
+
+            uint32_t pid;
+            if ((entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN) || !procfs::parsePid(entry->d_name, pid)) {
+                continue;
+            }
+            stats_.emplace_back();
+            stats_.back().pid = pid;
+        }
+    }
+
+    // Their stat files, read in parallel
+    pool_.run(stats_.size(), [this](size_t index, size_t slot) {
+        StatRead& stat = stats_[index];
+        stat.valid = readStat(stat.pid, readBuffers_[slot], stat.startTime, stat.comm);
+    });
+
+    for (const StatRead& stat : stats_) {
+        if (!stat.valid) {
+            continue; // exited while we were scanning
+        }
+        const uint32_t pid = stat.pid;
+        auto inserted = cache_.try_emplace(pid);
+        CachedProcess& cached = inserted.first->second;
+        if (inserted.second || cached.startTime != stat.startTime) {
+            // New process or recycled PID; the path waits until someone asks for it
+            if (!inserted.second) {
+                accountant_.removeProcess(pid);
+                delta.removed.push_back(cached.record.info());
+            }
+            cached.startTime = stat.startTime;
+            cached.pathResolved = false;
+            cached.comm = stat.comm;
+            cached.record = ProcessRecord(pid, strings_.intern(stat.comm));
+            cached.record.creationTime = stat.startTime;
+            delta.added.push_back(cached.record.info());
+        } else if (cached.comm != stat.comm) {
+            // exec() or a PR_SET_NAME rename; only a new image counts as a change
+            cached.comm = stat.comm;
+            const ProcessRecord previous = cached.record;
+            if (cached.pathResolved) {
+                ImageRead image;
+                image.found = readImage(pid, linkBuffers_[0], image.path);
+                setImage(cached, image);
+            } else {
+                cached.record.name = strings_.intern(stat.comm);
+            }
+            if (cached.record.path != previous.path || cached.record.name != previous.name) {
+                delta.changed.push_back(cached.record.info());
+            }
+        }
+        cached.generation = generation_;
+    }
+
+    for (auto it = cache_.begin(); it != cache_.end();) {
+        if (it->second.generation != generation_) {
+            accountant_.removeProcess(it->first);
+            delta.removed.push_back(it->second.record.info());
+            it = cache_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (!delta.empty()) {
+        listStale_ = true;
+        orderStale_ = true;
+    }
+    if (strings_.bytes() > stringsLimit_) {
+        compactStrings();
+    }
+    return true;
+}
+
+bool ProcessMonitor::readStat(uint32_t pid, std::vector<char>& buffer, uint64_t& startTime, std::string& comm) const {
+    char path[64];
+    if (!procfs::pidPath(path, sizeof(path), pid, "stat")) {
+        return false;
+    }
+
+    const int fd = openat(procFd_, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const ssize_t length = read(fd, buffer.data(), buffer.size() - 1);
+    close(fd);
+    if (length <= 0) {
+        return false;
+    }
+    buffer[length] = '\0';
+
+    // "pid (comm) state ppid ..." - comm may itself contain spaces or ')'
+    const char* openParen = std::strchr(buffer.data(), '(');
+    const char* closeParen = std::strrchr(buffer.data(), ')');
+    if (!openParen || !closeParen || closeParen < openParen) {
+        return false;
+    }
+    comm.assign(openParen + 1, closeParen);
+
+    // The space after ")" precedes field 3; walk to the one before starttime
+    const char* p = closeParen + 1;
+    for (int field = 3; field < STARTTIME_FIELD; ++field) {
+        p = std::strchr(p + 1, ' ');
+        if (!p) {
+            return false;
+        }
+    }
+    uint64_t value = 0;
+    for (++p; *p >= '0' && *p <= '9'; ++p) {
+        value = value * 10 + static_cast<uint64_t>(*p - '0');
+    }
+    startTime = value;
+    return true;
+}
+
+bool ProcessMonitor::readImage(uint32_t pid, std::vector<char>& buffer, std::string& path) const {
+    char link[64];
+    ssize_t length = -1;
+    if (procfs::pidPath(link, sizeof(link), pid, "exe")) {
+        length = readlinkat(procFd_, link, buffer.data(), buffer.size() - 1);
+    }
+    if (length <= 0) {
+        return false;
+    }
+
+    path.assign(buffer.data(), static_cast<size_t>(length));
+    static const char DELETED_SUFFIX[] = " (deleted)";
+    const size_t suffixLen = sizeof(DELETED_SUFFIX) - 1;
+    if (path.size() > suffixLen && path.compare(path.size() - suffixLen, suffixLen, DELETED_SUFFIX) == 0) {
+        path.resize(path.size() - suffixLen);
+    }
+    return true;
+}
+
+void ProcessMonitor::setImage(CachedProcess& cached, const ImageRead& image) {
+    ProcessRecord& record = cached.record;
+    if (!image.found) {
+        // Kernel threads and processes we may not inspect only expose comm
+        record.name = strings_.intern(cached.comm);
+        record.path = std::string_view();
+        return;
+    }
+    record.path = strings_.intern(image.path);
+    const size_t lastSlash = record.path.find_last_of('/');
+    record.name =
+        strings_.intern(lastSlash != std::string_view::npos ? record.path.substr(lastSlash + 1) : record.path);
+}
+
+size_t ProcessMonitor::resolvePaths(const std::vector<uint32_t>& pids) {
+    pending_.clear();
+    for (uint32_t pid : pids) {
+        auto it = cache_.find(pid);
+        if (it != cache_.end() && !it->second.pathResolved) {
+            pending_.push_back(&it->second);
+        }
+    }
+    return resolvePending();
+}
+
+size_t ProcessMonitor::resolveAllPaths() {
+    pending_.clear();
+    for (auto& entry : cache_) {
+        if (!entry.second.pathResolved) {
+            pending_.push_back(&entry.second);
+        }
+    }
+    return resolvePending();
+}
+
+size_t ProcessMonitor::resolvePending() {
+    if (pending_.empty() || procFd_ < 0) {
+        return 0;
+    }
+    // Links are read in parallel, each into its own entry; interning is serial
+    if (images_.size() < pending_.size()) {
+        images_.resize(pending_.size());
+    }
+    pool_.run(pending_.size(), [this](size_t index, size_t slot) {
+        ImageRead& image = images_[index];
+        image.found = readImage(pending_[index]->record.pid, linkBuffers_[slot], image.path);
+    });
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        setImage(*pending_[i], images_[i]);
+        pending_[i]->pathResolved = true;
+    }
+    listStale_ = true;
+    if (strings_.bytes() > stringsLimit_) {
+        compactStrings();
+    }
+    return pending_.size();
+}
+
+bool ProcessMonitor::updateNetworkStats() {
+    const uint64_t nowNs = MonotonicClock::nowNs();
+    if (!statsBudget_.due(nowNs)) {
+        return true; // keep the last rates until the budget allows another sample
+    }
+    if (!socketStats_.collect(sockets_)) {
+        return false;
+    }
+    socketOwners_.resolve(sockets_, nowNs);
+
+    accountant_.beginSample(nowNs);
+    for (const SocketCounters& socket : sockets_) {
+        accountant_.record(socket);
+    }
+    accountant_.endSample();
+
+    for (auto& entry : cache_) {
+        ProcessRecord& record = entry.second.record;
+        TrafficAccountant::ProcessTraffic traffic;
+        if (!accountant_.processTraffic(entry.first, traffic)) {
+            continue;
+        }
+        record.downloadSpeed = static_cast<uint64_t>(traffic.downloadRate + 0.5);
+        record.uploadSpeed = static_cast<uint64_t>(traffic.uploadRate + 0.5);
+        record.totalDownloaded = traffic.totalDownloaded;
+        record.totalUploaded = traffic.totalUploaded;
+    }
+    listStale_ = true;
+    ++sampleCount_;
+    statsBudget_.spent(nowNs, MonotonicClock::nowNs());
+    return true;
+}
+
+bool ProcessMonitor::getTraffic(uint32_t pid, TrafficAccountant::ProcessTraffic& traffic) const {
+    return accountant_.processTraffic(pid, traffic);
+}
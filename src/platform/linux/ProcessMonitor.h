@@ -0,0 +1,121 @@
+#ifndef LINUX_PROCESSMONITOR_H
+#define LINUX_PROCESSMONITOR_H
+
+#include "../../ProcessInfo.h"
+#include "../../ProcessList.h"
+#include "SocketOwnerMap.h"
+#include "SocketStatsCollector.h"
+#include "core/SamplingBudget.h"
+#include "core/StringArena.h"
+#include "core/TaskPool.h"
+#include "core/TrafficAccountant.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Linux process enumeration over procfs.
+//
+// refresh() lists the PIDs with getdents64 on a directory fd that stays open, then reads
+// /proc/<pid>/stat for each of them through openat() into per-thread buffers, spread over
+// a TaskPool, and merges the results serially. A new process is named after its comm; its
+// executable path (and the untruncated name that comes with it) is left for
+// resolvePaths(), which readlinks /proc/<pid>/exe, again in parallel, only for the PIDs
+// asked for, and once per process lifetime: a PID counts as new when its starttime changed
+// (it was recycled), and a resolved one is re-read when its comm changes (exec). Each
+// refresh reports what changed as a ProcessDelta.
+//
+// Names and paths are interned in a StringArena that lives across refreshes, so a process
+// seen again costs no string copies, and getRunningProcesses() shares one immutable
+// ProcessList until something changes. Once the arena holds twice the strings it held
+// after the last compaction, the ones still in use move to a new arena.
+//
+// updateNetworkStats() samples per-socket TCP counters over sock_diag, joins them to PIDs
+// through SocketOwnerMap and lets a TrafficAccountant turn them into totals and rates.
+// Sampling backs off so that it stays within SamplingBudget's share of one core.
+class ProcessMonitor {
+public:
+    // procRoot may point at a synthetic procfs tree (used for benchmarking); workers are
+    // the threads that read it besides the caller's
+    explicit ProcessMonitor(const std::string& procRoot = "/proc", size_t workers = TaskPool::defaultWorkers());
+    ~ProcessMonitor();
+    
+    // Sorted by PID, as of the last refresh() and network sample. The first refresh() is
+    // up to the caller; a new monitor knows no processes. The list never changes; calls
+    // in between changes return the same one.
+    std::shared_ptr<const ProcessList> getRunningProcesses();
+    bool refresh();
+    // Rescans and fills `delta` with the difference from the previous snapshot
+    bool refresh(ProcessDelta& delta);
+    // Resolves the executable paths of these processes, where not known yet; returns how
+    // many were looked up
+    size_t resolvePaths(const std::vector<uint32_t>& pids);
+    size_t resolveAllPaths();
+    bool updateNetworkStats();
+    // Rates and connection RTTs of a process as of the last network sample
+    bool getTraffic(uint32_t pid, TrafficAccountant::ProcessTraffic& traffic) const;
+    // Network samples taken so far; updateNetworkStats() skips sampling while over budget
+    uint64_t sampleCount() const { return sampleCount_; }
+
+private:
+    struct CachedProcess {
+        uint64_t startTime; // clock ticks since boot, field 22 of /proc/<pid>/stat
+        uint64_t generation; // refresh pass that last saw the PID
+        bool pathResolved;
+        std::string comm;
+        ProcessRecord record;
+    };
+    
+    // One PID's stat as read by the parallel pass
+    struct StatRead {
+        uint32_t pid;
+        bool valid; // false if the process exited while we were scanning
+        uint64_t startTime;
+        std::string comm;
+    };
+    
+    // One executable link as read by the parallel pass
+    struct ImageRead {
+        bool found; // false for kernel threads and processes we may not inspect
+        std::string path;
+    };
+    
+    bool openProcRoot();
+    bool readStat(uint32_t pid, std::vector<char>& buffer, uint64_t& startTime, std::string& comm) const;
+    bool readImage(uint32_t pid, std::vector<char>& buffer, std::string& path) const;
+    void setImage(CachedProcess& cached, const ImageRead& image);
+    size_t resolvePending();
+    void buildList();
+    void compactStrings();
+    
+    std::string procRoot_;
+    int procFd_;
+    uint64_t generation_;
+    TaskPool pool_;
+    std::vector<char> direntBuffer_;
+    std::vector<std::vector<char>> readBuffers_; // per pool slot
+    std::vector<std::vector<char>> linkBuffers_;
+    std::vector<StatRead> stats_;
+    std::vector<CachedProcess*> pending_; // paths to resolve
+    std::vector<ImageRead> images_; // by pending_ entry
+    ProcessDelta scratchDelta_;
+    std::unordered_map<uint32_t, CachedProcess> cache_;
+    StringArena strings_; // names and paths of cache_
+    size_t stringsLimit_; // compact beyond this many bytes
+    ProcessListPool listPool_;
+    std::shared_ptr<const ProcessList> list_;
+    bool listStale_;
+    std::vector<std::pair<uint32_t, const ProcessRecord*>> order_; // cache_ by PID
+    bool orderStale_;
+    
+    SocketStatsCollector socketStats_;
+    SocketOwnerMap socketOwners_;
+    TrafficAccountant accountant_;
+    SamplingBudget statsBudget_;
+    std::vector<SocketCounters> sockets_;
+    uint64_t sampleCount_;
+};
+
+#endif // LINUX_PROCESSMONITOR_H
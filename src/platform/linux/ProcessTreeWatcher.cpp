@@ -0,0 +1,279 @@
+#include "ProcessTreeWatcher.h"
+#include "ProcFs.h"
+
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iterator>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+constexpr size_t DIRENT_BUFFER_SIZE = 64 * 1024;
+constexpr size_t READ_BUFFER_SIZE = 4096;
+constexpr size_t EVENT_BUFFER_SIZE = 64 * 1024;
+constexpr int SOCKET_BUFFER_SIZE = 4 * 1024 * 1024; // a fork storm of ~50k events
+
+// Walks down from the tracked processes; returns the untracked descendants with the root
+// of the tracked ancestor they hang under
+void collectDescendants(const std::unordered_map<uint32_t, uint32_t>& parents,
+                        const std::unordered_map<uint32_t, uint32_t>& members,
+                        std::vector<std::pair<uint32_t, uint32_t>>& found) {
+    std::unordered_map<uint32_t, std::vector<uint32_t>> children;
+    for (const auto& entry : parents) {
+        children[entry.second].push_back(entry.first);
+    }
+    std::vector<std::pair<uint32_t, uint32_t>> frontier(members.begin(), members.end());
+    while (!frontier.empty()) {
+        const std::pair<uint32_t, uint32_t> node = frontier.back();
+        frontier.pop_back();
+        auto it = children.find(node.first);
+        if (it == children.end()) {
+            continue;
+        }
+        for (uint32_t child : it->second) {
+            // Tracked children are walked from their own entry in the frontier
+            if (members.count(child) == 0) {
+                found.emplace_back(child, node.second);
+                frontier.emplace_back(child, node.second);
+            }
+        }
+    }
+}
+
+} // namespace
+
+ProcessTreeWatcher::ProcessTreeWatcher(const std::string& procRoot)
+    : procRoot_(procRoot), procFd_(-1), socket_(-1), lost_(false), direntBuffer_(DIRENT_BUFFER_SIZE),
+      readBuffer_(READ_BUFFER_SIZE) {}
+
+ProcessTreeWatcher::~ProcessTreeWatcher() {
+    if (socket_ >= 0) {
+        close(socket_);
+    }
+    if (procFd_ >= 0) {
+        close(procFd_);
+    }
+}
+
+bool ProcessTreeWatcher::start() {
+    if (socket_ >= 0) {
+        return true;
+    }
+    const int fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (fd < 0) {
+        return false;
+    }
+    sockaddr_nl address = {};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = CN_IDX_PROC;
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return false;
+    }
+    // The force variant ignores rmem_max but needs CAP_NET_ADMIN, which subscribing needs too
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &SOCKET_BUFFER_SIZE, sizeof(SOCKET_BUFFER_SIZE)) != 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &SOCKET_BUFFER_SIZE, sizeof(SOCKET_BUFFER_SIZE));
+    }
+
+    alignas(nlmsghdr) char request[NLMSG_SPACE(sizeof(cn_msg) + sizeof(proc_cn_mcast_op))] = {};
+    auto* header = reinterpret_cast<nlmsghdr*>(request);
+    header->nlmsg_len = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(proc_cn_mcast_op));
+    header->nlmsg_type = NLMSG_DONE;
+    header->nlmsg_pid = 0;
+    auto* message = static_cast<cn_msg*>(NLMSG_DATA(header));
+    message->id.idx = CN_IDX_PROC;
+    message->id.val = CN_VAL_PROC;
+    message->len = sizeof(proc_cn_mcast_op);
+    const proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+    std::memcpy(message->data, &op, sizeof(op));
+    if (send(fd, request, header->nlmsg_len, 0) != static_cast<ssize_t>(header->nlmsg_len)) {
+        close(fd);
+        return false;
+    }
+    socket_ = fd;
+    eventBuffer_.resize(EVENT_BUFFER_SIZE);
+    return true;
+}
+
+size_t ProcessTreeWatcher::trackTree(uint32_t root, std::vector<uint32_t>& descendants) {
+    members_[root] = root;
+    std::unordered_map<uint32_t, uint32_t> parents;
+    if (!scanParents(parents)) {
+        return 0;
+    }
+    // Starting from every tracked process keeps subtrees of other trees out of this one
+    std::vector<std::pair<uint32_t, uint32_t>> found;
+    collectDescendants(parents, members_, found);
+    size_t added = 0;
+    for (const auto& entry : found) {
+        if (entry.second == root && members_.emplace(entry.first, root).second) {
+            descendants.push_back(entry.first);
+            ++added;
+        }
+    }
+    return added;
+}
+
+void ProcessTreeWatcher::untrackTree(uint32_t root) {
+    for (auto it = members_.begin(); it != members_.end();) {
+        it = it->second == root ? members_.erase(it) : std::next(it);
+    }
+}
+
+size_t ProcessTreeWatcher::poll(std::vector<Change>& changes) {
+    const size_t before = changes.size();
+    while (socket_ >= 0) {
+        const ssize_t length = recv(socket_, eventBuffer_.data(), eventBuffer_.size(), 0);
+        if (length < 0) {
+            if (errno == ENOBUFS) {
+                lost_ = true; // the kernel dropped events; keep draining, then rescan
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        int remaining = static_cast<int>(length);
+        for (auto* header = reinterpret_cast<nlmsghdr*>(eventBuffer_.data()); NLMSG_OK(header, remaining);
+             header = NLMSG_NEXT(header, remaining)) {
+            if (header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_NOOP) {
+                continue;
+            }
+            const auto* message = static_cast<const cn_msg*>(NLMSG_DATA(header));
+            if (message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC) {
+                continue;
+            }
+            const auto* event = reinterpret_cast<const proc_event*>(message->data);
+            if (event->what == proc_event::PROC_EVENT_FORK) {
+                const auto& fork = event->event_data.fork;
+                // New threads are forks too; only new processes join
+                if (fork.child_pid != fork.child_tgid) {
+                    continue;
+                }
+                auto parent = members_.find(static_cast<uint32_t>(fork.parent_tgid));
+                if (parent != members_.end()) {
+                    const uint32_t root = parent->second;
+                    if (members_.emplace(static_cast<uint32_t>(fork.child_tgid), root).second) {
+                        changes.push_back(Change{Change::Joined, static_cast<uint32_t>(fork.child_tgid), root});
+                    }
+                }
+            } else if (event->what == proc_event::PROC_EVENT_EXIT) {
+                const auto& exit = event->event_data.exit;
+                if (exit.process_pid != exit.process_tgid) {
+                    continue;
+                }
+                auto member = members_.find(static_cast<uint32_t>(exit.process_tgid));
+                if (member != members_.end()) {
+                    changes.push_back(Change{Change::Exited, member->first, member->second});
+                    members_.erase(member);
+                }
+            }
+        }
+    }
+    if (socket_ < 0 || lost_) {
+        resync(changes);
+    }
+    return changes.size() - before;
+}
+
+void ProcessTreeWatcher::resync(std::vector<Change>& changes) {
+    if (members_.empty()) {
+        lost_ = false;
+        return;
+    }
+    std::unordered_map<uint32_t, uint32_t> parents;
+    if (!scanParents(parents)) {
+        return;
+    }
+    lost_ = false;
+    for (auto it = members_.begin(); it != members_.end();) {
+        if (parents.count(it->first) == 0) {
+            changes.push_back(Change{Change::Exited, it->first, it->second});
+            it = members_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    std::vector<std::pair<uint32_t, uint32_t>> found;
+    collectDescendants(parents, members_, found);
+    for (const auto& entry : found) {
+        if (members_.emplace(entry.first, entry.second).second) {
+            changes.push_back(Change{Change::Joined, entry.first, entry.second});
+        }
+    }
+}
+
+bool ProcessTreeWatcher::openProcRoot() {
+    if (procFd_ >= 0) {
+        return lseek(procFd_, 0, SEEK_SET) == 0;
+    }
+    procFd_ = open(procRoot_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return procFd_ >= 0;
+}
+
+bool ProcessTreeWatcher::scanParents(std::unordered_map<uint32_t, uint32_t>& parents) {
+    if (!openProcRoot()) {
+        return false;
+    }
+    for (;;) {
+        const long bytes = procfs::readDirectory(procFd_, direntBuffer_.data(), direntBuffer_.size());
+        if (bytes < 0) {
+            return false;
+        }
+        if (bytes == 0) {
+            return true;
+        }
+        for (long offset = 0; offset < bytes;) {
+            const auto* entry = reinterpret_cast<const procfs::LinuxDirent64*>(direntBuffer_.data() + offset);
+            offset += entry->d_reclen;
+
+            uint32_t pid;
+            uint32_t parent;
+            if ((entry->d_type == DT_DIR || entry->d_type == DT_UNKNOWN) && procfs::parsePid(entry->d_name, pid) &&
+                readParent(pid, parent)) {
+                parents[pid] = parent;
+            }
+        }
+    }
+}
+
+bool ProcessTreeWatcher::readParent(uint32_t pid, uint32_t& parent) {
+    char path[64];
+    if (!procfs::pidPath(path, sizeof(path), pid, "stat")) {
+        return false;
+    }
+    const int fd = openat(procFd_, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const ssize_t length = read(fd, readBuffer_.data(), readBuffer_.size() - 1);
+    close(fd);
+    if (length <= 0) {
+        return false;
+    }
+    readBuffer_[length] = '\0';
+
+    // "pid (comm) state ppid ..." - comm may itself contain spaces or ')'
+    const char* closeParen = std::strrchr(readBuffer_.data(), ')');
+    if (!closeParen || closeParen[1] != ' ' || closeParen[2] == '\0' || closeParen[3] != ' ') {
+        return false;
+    }
+    uint32_t value = 0;
+    const char* p = closeParen + 4;
+    if (*p < '0' || *p > '9') {
+        return false;
+    }
+    for (; *p >= '0' && *p <= '9'; ++p) {
+        value = value * 10 + static_cast<uint32_t>(*p - '0');
+    }
+    parent = value;
+    return true;
+}
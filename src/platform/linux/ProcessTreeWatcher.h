@@ -0,0 +1,68 @@
+#ifndef LINUX_PROCESSTREEWATCHER_H
+#define LINUX_PROCESSTREEWATCHER_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Follows the descendants of tracked processes for throttle trees.
+//
+// Fork and exit notifications come from the kernel's process connector (a netlink socket,
+// which needs CAP_NET_ADMIN), so a new child is seen from one event, without scanning
+// /proc. Events name the parent of each new process; a child whose parent is tracked is
+// tracked under the same root. When the connector is unavailable, or its socket overflowed
+// and events were lost, poll() resynchronizes with one pass over /proc that reads only the
+// parent PID from each /proc/<pid>/stat.
+//
+// Not thread-safe; NetworkThrottler serializes access.
+class ProcessTreeWatcher {
+public:
+    struct Change {
+        enum Kind { Joined, Exited };
+        Kind kind;
+        uint32_t pid;
+        uint32_t root;
+    };
+
+    explicit ProcessTreeWatcher(const std::string& procRoot = "/proc");
+    ~ProcessTreeWatcher();
+
+    ProcessTreeWatcher(const ProcessTreeWatcher&) = delete;
+    ProcessTreeWatcher& operator=(const ProcessTreeWatcher&) = delete;
+
+    // Subscribes to process events; false if only polling is available. Processes forked
+    // after this returns true are never missed.
+    bool start();
+    bool eventDriven() const { return socket_ >= 0; }
+    // Readable when events are pending (-1 without the connector)
+    int fd() const { return socket_; }
+
+    // Tracks root and appends its live descendants (one /proc pass), tracking them too
+    size_t trackTree(uint32_t root, std::vector<uint32_t>& descendants);
+    void track(uint32_t pid, uint32_t root) { members_[pid] = root; }
+    void untrack(uint32_t pid) { members_.erase(pid); }
+    void untrackTree(uint32_t root);
+    bool isTracked(uint32_t pid) const { return members_.count(pid) != 0; }
+
+    // Collects membership changes since the last call without blocking
+    size_t poll(std::vector<Change>& changes);
+
+private:
+    bool openProcRoot();
+    bool readParent(uint32_t pid, uint32_t& parent);
+    // pid -> parent PID of every live process
+    bool scanParents(std::unordered_map<uint32_t, uint32_t>& parents);
+    void resync(std::vector<Change>& changes);
+
+    std::string procRoot_;
+    int procFd_;
+    int socket_;
+    bool lost_; // events were dropped; the next poll rescans
+    std::unordered_map<uint32_t, uint32_t> members_; // pid -> tree root
+    std::vector<char> direntBuffer_;
+    std::vector<char> readBuffer_;
+    std::vector<char> eventBuffer_;
+};
+
+#endif // LINUX_PROCESSTREEWATCHER_H
@@ -0,0 +1,725 @@
+#include "ShapingProxy.h"
+#include "core/MonotonicClock.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <initializer_list>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int MAX_EVENTS = 256;
+constexpr int MAX_POLL_MS = 1000;
+constexpr size_t MAX_HANDSHAKE = 512;
+// Registered masks keep a marker bit so an fd with no interest stays in the set
+constexpr uint32_t INTEREST_ADDED = 1u << 31;
+
+constexpr uint8_t SOCKS_VERSION = 5;
+constexpr uint8_t SOCKS_NO_AUTH = 0x00;
+constexpr uint8_t SOCKS_NO_ACCEPTABLE_METHOD = 0xFF;
+constexpr uint8_t SOCKS_CONNECT = 0x01;
+constexpr uint8_t SOCKS_IPV4 = 0x01;
+constexpr uint8_t SOCKS_DOMAIN = 0x03;
+constexpr uint8_t SOCKS_IPV6 = 0x04;
+constexpr uint8_t SOCKS_SUCCEEDED = 0x00;
+constexpr uint8_t SOCKS_GENERAL_FAILURE = 0x01;
+constexpr uint8_t SOCKS_HOST_UNREACHABLE = 0x04;
+constexpr uint8_t SOCKS_CONNECTION_REFUSED = 0x05;
+constexpr uint8_t SOCKS_COMMAND_NOT_SUPPORTED = 0x07;
+constexpr uint8_t SOCKS_ADDRESS_NOT_SUPPORTED = 0x08;
+
+uint64_t token(uint64_t id, bool upstream) {
+    return (id << 1) | (upstream ? 1 : 0);
+}
+
+bool isLoopback(const sockaddr_storage& address) {
+    if (address.ss_family == AF_INET) {
+        const auto& v4 = reinterpret_cast<const sockaddr_in&>(address);
+        return (ntohl(v4.sin_addr.s_addr) >> 24) == 127;
+    }
+    if (address.ss_family == AF_INET6) {
+        const auto& v6 = reinterpret_cast<const sockaddr_in6&>(address);
+        if (IN6_IS_ADDR_LOOPBACK(&v6.sin6_addr)) {
+            return true;
+        }
+        return IN6_IS_ADDR_V4MAPPED(&v6.sin6_addr) && v6.sin6_addr.s6_addr[12] == 127;
+    }
+    return false;
+}
+
+// Numeric addresses only; host names go through resolveHost
+bool parseAddress(const std::string& host, uint16_t port, sockaddr_storage& address, socklen_t& length) {
+    std::memset(&address, 0, sizeof(address));
+    auto& v4 = reinterpret_cast<sockaddr_in&>(address);
+    if (inet_pton(AF_INET, host.c_str(), &v4.sin_addr) == 1) {
+        v4.sin_family = AF_INET;
+        v4.sin_port = htons(port);
+        length = sizeof(sockaddr_in);
+        return true;
+    }
+    auto& v6 = reinterpret_cast<sockaddr_in6&>(address);
+    if (inet_pton(AF_INET6, host.c_str(), &v6.sin6_addr) == 1) {
+        v6.sin6_family = AF_INET6;
+        v6.sin6_port = htons(port);
+        length = sizeof(sockaddr_in6);
+        return true;
+    }
+    return false;
+}
+
+bool resolveHost(const std::string& host, uint16_t port, sockaddr_storage& address, socklen_t& length) {
+    if (parseAddress(host, port, address, length)) {
+        return true;
+    }
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || !result) {
+        return false;
+    }
+    std::memcpy(&address, result->ai_addr, result->ai_addrlen);
+    length = result->ai_addrlen;
+    freeaddrinfo(result);
+    if (address.ss_family == AF_INET) {
+        reinterpret_cast<sockaddr_in&>(address).sin_port = htons(port);
+    } else {
+        reinterpret_cast<sockaddr_in6&>(address).sin6_port = htons(port);
+    }
+    return true;
+}
+
+void closeFd(int& fd) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+// Handshake replies are a few bytes on a fresh socket, so they always fit the send buffer
+bool sendAll(int fd, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        const ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool sendSocksReply(int fd, uint8_t status) {
+    const uint8_t reply[] = {SOCKS_VERSION, status, 0, SOCKS_IPV4, 0, 0, 0, 0, 0, 0};
+    return sendAll(fd, reply, sizeof(reply));
+}
+
+} // namespace
+
+ShapingProxy::ShapingProxy(NetworkThrottler& throttler, const Config& config)
+    : throttler_(throttler), config_(config), listenFd_(-1), epollFd_(-1), wakeFd_(-1), port_(0),
+      stopping_(false), socketOwners_("/proc", 0), timers_(MonotonicClock::nowNs()), nextId_(1),
+      acceptedCount_(0), activeCount_(0), identifiedCount_(0), bytesUp_(0), bytesDown_(0),
+      throttleWaits_(0) {}
+
+ShapingProxy::~ShapingProxy() {
+    while (!connections_.empty()) {
+        closeConnection(connections_.begin()->first);
+    }
+    closeFd(listenFd_);
+    closeFd(wakeFd_);
+    closeFd(epollFd_);
+}
+
+bool ShapingProxy::start() {
+    if (listenFd_ >= 0) {
+        return true;
+    }
+    sockaddr_storage address;
+    socklen_t length = 0;
+    if (!parseAddress(config_.listenAddress, config_.listenPort, address, length)) {
+        return false;
+    }
+
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    listenFd_ = socket(address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    const int reuse = 1;
+    if (epollFd_ < 0 || wakeFd_ < 0 || listenFd_ < 0 ||
+        setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+        bind(listenFd_, reinterpret_cast<sockaddr*>(&address), length) != 0 ||
+        listen(listenFd_, SOMAXCONN) != 0 ||
+        getsockname(listenFd_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        closeFd(listenFd_);
+        closeFd(wakeFd_);
+        closeFd(epollFd_);
+        return false;
+    }
+    port_ = ntohs(address.ss_family == AF_INET ? reinterpret_cast<sockaddr_in&>(address).sin_port
+                                               : reinterpret_cast<sockaddr_in6&>(address).sin6_port);
+
+    // splice() into a socket the peer has reset raises SIGPIPE; the error is handled per
+    // connection instead
+    signal(SIGPIPE, SIG_IGN);
+
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = LISTENER_TOKEN;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &event);
+    event.data.u64 = WAKE_TOKEN;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &event);
+    return true;
+}
+
+bool ShapingProxy::run() {
+    if (epollFd_ < 0) {
+        return false;
+    }
+    while (!stopping_.load()) {
+        if (!poll(-1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ShapingProxy::stop() {
+    stopping_.store(true);
+    if (wakeFd_ >= 0) {
+        const uint64_t one = 1;
+        ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+ShapingProxy::Stats ShapingProxy::stats() const {
+    Stats stats;
+    stats.connections = acceptedCount_.load(std::memory_order_relaxed);
+    stats.activeConnections = activeCount_.load(std::memory_order_relaxed);
+    stats.identifiedClients = identifiedCount_.load(std::memory_order_relaxed);
+    stats.bytesUploaded = bytesUp_.load(std::memory_order_relaxed);
+    stats.bytesDownloaded = bytesDown_.load(std::memory_order_relaxed);
+    stats.throttleWaits = throttleWaits_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool ShapingProxy::poll(int timeoutMs) {
+    if (epollFd_ < 0) {
+        return false;
+    }
+
+    // Sleep no longer than the earliest pacing timer
+    const uint64_t next = timers_.nextExpiry();
+    if (next != UINT64_MAX) {
+        const uint64_t now = MonotonicClock::nowNs();
+        const uint64_t waitMs = next > now ? (next - now + 999999) / 1000000 : 0;
+        if (timeoutMs < 0 || waitMs < static_cast<uint64_t>(timeoutMs)) {
+            timeoutMs = static_cast<int>(waitMs < MAX_POLL_MS ? waitMs : MAX_POLL_MS);
+        }
+    }
+
+    epoll_event events[MAX_EVENTS];
+    const int count = epoll_wait(epollFd_, events, MAX_EVENTS, timeoutMs);
+    if (count < 0 && errno != EINTR) {
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        handleEvent(events[i].data.u64, events[i].events);
+    }
+    handleTimers();
+    return true;
+}
+
+void ShapingProxy::handleEvent(uint64_t eventToken, uint32_t events) {
+    if (eventToken == LISTENER_TOKEN) {
+        acceptClients();
+        return;
+    }
+    if (eventToken == WAKE_TOKEN) {
+        uint64_t value;
+        ssize_t ignored = read(wakeFd_, &value, sizeof(value));
+        (void)ignored;
+        return;
+    }
+
+    const uint64_t id = eventToken >> 1;
+    auto it = connections_.find(id);
+    if (it == connections_.end()) {
+        return; // closed earlier in this batch
+    }
+    Connection& connection = *it->second;
+    const bool fromUpstream = (eventToken & 1) != 0;
+
+    bool ok = true;
+    switch (connection.state) {
+    case State::Greeting:
+    case State::Request:
+        ok = !fromUpstream && readHandshake(connection);
+        break;
+    case State::Connecting:
+        ok = fromUpstream ? finishConnect(connection) : (events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) == 0;
+        break;
+    case State::Relaying:
+        ok = ((events & (EPOLLERR | EPOLLHUP)) == 0 || handleHangup(connection, fromUpstream, events)) &&
+             pump(connection, connection.up, connection.client, connection.upstream) &&
+             pump(connection, connection.down, connection.upstream, connection.client);
+        break;
+    }
+
+    if (!ok || (connection.up.done() && connection.down.done())) {
+        closeConnection(id);
+    } else {
+        updateInterest(connection);
+    }
+}
+
+// EPOLLERR and EPOLLHUP are reported whatever the registered mask, so they come even while
+// both directions wait on pacing timers. A socket error ends the connection. A hangup
+// without one (the peer's FIN after our own shutdown) leaves only data already received
+// to relay, which reads return until EOF; updateInterest() takes the socket out of the
+// set whenever nothing is wanted from it, so the hangup does not wake every poll.
+bool ShapingProxy::handleHangup(Connection& connection, bool upstream, uint32_t events) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    const int fd = upstream ? connection.upstream : connection.client;
+    if ((events & EPOLLERR) || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+        return false;
+    }
+    (upstream ? connection.upstreamHungUp : connection.clientHungUp) = true;
+    return true;
+}
+
+void ShapingProxy::handleTimers() {
+    expired_.clear();
+    if (timers_.advance(MonotonicClock::nowNs(), expired_) == 0) {
+        return;
+    }
+    for (const TimerWheel::Expired& timer : expired_) {
+        auto it = connections_.find(timer.cookie >> 1);
+        if (it == connections_.end()) {
+            continue;
+        }
+        Connection& connection = *it->second;
+        const bool upload = (timer.cookie & 1) == 0;
+        Direction& direction = upload ? connection.up : connection.down;
+        direction.timer = TimerWheel::INVALID_TIMER;
+        const bool ok = upload ? pump(connection, connection.up, connection.client, connection.upstream)
+                               : pump(connection, connection.down, connection.upstream, connection.client);
+        if (!ok || (connection.up.done() && connection.down.done())) {
+            closeConnection(connection.id);
+        } else {
+            updateInterest(connection);
+        }
+    }
+}
+
+void ShapingProxy::acceptClients() {
+    for (;;) {
+        sockaddr_storage peer;
+        socklen_t length = sizeof(peer);
+        const int fd = accept4(listenFd_, reinterpret_cast<sockaddr*>(&peer), &length,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return; // EAGAIN, or out of descriptors until connections close
+        }
+
+        std::unique_ptr<Connection> connection(new Connection());
+        connection->id = nextId_++;
+        connection->client = fd;
+        connection->pid = isLoopback(peer) ? resolveClientPid(fd, peer) : 0;
+        if (connection->pid != 0) {
+            identifiedCount_.fetch_add(1, std::memory_order_relaxed);
+            attachThrottle(*connection);
+        }
+        acceptedCount_.fetch_add(1, std::memory_order_relaxed);
+        activeCount_.fetch_add(1, std::memory_order_relaxed);
+
+        Connection& added = *connection;
+        connections_[added.id] = std::move(connection);
+
+        bool ok = true;
+        if (config_.mode == Mode::Socks5) {
+            added.state = State::Greeting;
+            ok = setInterest(added.client, added.clientEvents, EPOLLIN, token(added.id, false));
+        } else {
+            sockaddr_storage upstream;
+            socklen_t upstreamLength = 0;
+            ok = resolveHost(config_.upstreamAddress, config_.upstreamPort, upstream, upstreamLength) &&
+                 connectUpstream(added, upstream, upstreamLength);
+        }
+        if (!ok) {
+            closeConnection(added.id);
+        }
+    }
+}
+
+uint32_t ShapingProxy::resolveClientPid(int fd, const sockaddr_storage& peer) {
+    sockaddr_storage local;
+    socklen_t length = sizeof(local);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&local), &length) != 0) {
+        return 0;
+    }
+
+    // The client's socket has the peer address as its local end
+    uint64_t inode = 0;
+    if (!socketStats_.findInode(peer, local, inode)) {
+        return 0;
+    }
+    std::vector<SocketCounters> sockets(1);
+    sockets[0].socketId = inode;
+    sockets[0].pid = TrafficAccountant::UNKNOWN_PID;
+    sockets[0].bytesReceived = 0;
+    sockets[0].bytesSent = 0;
+    socketOwners_.resolve(sockets, MonotonicClock::nowNs());
+
+    const uint32_t pid = sockets[0].pid;
+    return pid == TrafficAccountant::UNKNOWN_PID ? 0 : pid;
+}
+
+void ShapingProxy::attachThrottle(Connection& connection) {
+    if (config_.clientDownloadLimit == 0 && config_.clientUploadLimit == 0) {
+        return;
+    }
+    auto it = proxyThrottles_.find(connection.pid);
+    if (it != proxyThrottles_.end()) {
+        ++it->second;
+        connection.ownsThrottle = true;
+        return;
+    }
+    // Throttles set up elsewhere (the UI, another tool) take precedence
+    if (throttler_.isThrottlingActive(connection.pid)) {
+        return;
+    }
+    if (throttler_.startThrottling(connection.pid, config_.clientDownloadLimit, config_.clientUploadLimit)) {
+        proxyThrottles_[connection.pid] = 1;
+        connection.ownsThrottle = true;
+    }
+}
+
+bool ShapingProxy::readHandshake(Connection& connection) {
+    uint8_t buffer[MAX_HANDSHAKE];
+    const ssize_t n = recv(connection.client, buffer, sizeof(buffer), 0);
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    if (n == 0 || connection.handshake.size() + static_cast<size_t>(n) > MAX_HANDSHAKE) {
+        return false;
+    }
+    connection.handshake.insert(connection.handshake.end(), buffer, buffer + n);
+
+    if (connection.state == State::Greeting && !handleGreeting(connection)) {
+        return false;
+    }
+    if (connection.state == State::Request) {
+        return handleRequest(connection);
+    }
+    return true;
+}
+
+bool ShapingProxy::handleGreeting(Connection& connection) {
+    const std::vector<uint8_t>& data = connection.handshake;
+    if (data.size() < 2) {
+        return true;
+    }
+    if (data[0] != SOCKS_VERSION) {
+        return false;
+    }
+    const size_t length = 2 + data[1];
+    if (data.size() < length) {
+        return true;
+    }
+
+    bool noAuth = false;
+    for (size_t i = 2; i < length; ++i) {
+        noAuth = noAuth || data[i] == SOCKS_NO_AUTH;
+    }
+    const uint8_t reply[] = {SOCKS_VERSION, noAuth ? SOCKS_NO_AUTH : SOCKS_NO_ACCEPTABLE_METHOD};
+    if (!sendAll(connection.client, reply, sizeof(reply)) || !noAuth) {
+        return false;
+    }
+    connection.handshake.erase(connection.handshake.begin(), connection.handshake.begin() + length);
+    connection.state = State::Request;
+    return true;
+}
+
+bool ShapingProxy::handleRequest(Connection& connection) {
+    const std::vector<uint8_t>& data = connection.handshake;
+    if (data.size() < 5) {
+        return true;
+    }
+    if (data[0] != SOCKS_VERSION) {
+        return false;
+    }
+    if (data[1] != SOCKS_CONNECT) {
+        sendSocksReply(connection.client, SOCKS_COMMAND_NOT_SUPPORTED);
+        return false;
+    }
+
+    size_t addressLength = 0;
+    switch (data[3]) {
+    case SOCKS_IPV4:
+        addressLength = 4;
+        break;
+    case SOCKS_IPV6:
+        addressLength = 16;
+        break;
+    case SOCKS_DOMAIN:
+        addressLength = 1 + data[4];
+        break;
+    default:
+        sendSocksReply(connection.client, SOCKS_ADDRESS_NOT_SUPPORTED);
+        return false;
+    }
+    const size_t length = 4 + addressLength + 2;
+    if (data.size() < length) {
+        return true;
+    }
+    // Clients wait for the reply before sending payload
+    if (data.size() > length) {
+        return false;
+    }
+
+    const uint16_t port = static_cast<uint16_t>((data[length - 2] << 8) | data[length - 1]);
+    sockaddr_storage address;
+    std::memset(&address, 0, sizeof(address));
+    socklen_t addressSize = 0;
+    if (data[3] == SOCKS_IPV4) {
+        auto& v4 = reinterpret_cast<sockaddr_in&>(address);
+        v4.sin_family = AF_INET;
+        v4.sin_port = htons(port);
+        std::memcpy(&v4.sin_addr, &data[4], 4);
+        addressSize = sizeof(sockaddr_in);
+    } else if (data[3] == SOCKS_IPV6) {
+        auto& v6 = reinterpret_cast<sockaddr_in6&>(address);
+        v6.sin6_family = AF_INET6;
+        v6.sin6_port = htons(port);
+        std::memcpy(&v6.sin6_addr, &data[4], 16);
+        addressSize = sizeof(sockaddr_in6);
+    } else {
+        // Resolved synchronously; proxied applications usually resolve names themselves
+        const std::string host(reinterpret_cast<const char*>(&data[5]), data[4]);
+        if (!resolveHost(host, port, address, addressSize)) {
+            sendSocksReply(connection.client, SOCKS_HOST_UNREACHABLE);
+            return false;
+        }
+    }
+
+    connection.handshake.clear();
+    connection.handshake.shrink_to_fit();
+    if (!connectUpstream(connection, address, addressSize)) {
+        sendSocksReply(connection.client, SOCKS_GENERAL_FAILURE);
+        return false;
+    }
+    return true;
+}
+
+bool ShapingProxy::connectUpstream(Connection& connection, const sockaddr_storage& address, socklen_t length) {
+    connection.upstream = socket(address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (connection.upstream < 0) {
+        return false;
+    }
+    connection.state = State::Connecting;
+    if (connect(connection.upstream, reinterpret_cast<const sockaddr*>(&address), length) == 0) {
+        return startRelaying(connection);
+    }
+    if (errno != EINPROGRESS) {
+        return false;
+    }
+    // Watch the client for hangups only until the upstream answers
+    return setInterest(connection.client, connection.clientEvents, EPOLLRDHUP, token(connection.id, false)) &&
+           setInterest(connection.upstream, connection.upstreamEvents, EPOLLOUT, token(connection.id, true));
+}
+
+bool ShapingProxy::finishConnect(Connection& connection) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(connection.upstream, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+        if (config_.mode == Mode::Socks5) {
+            sendSocksReply(connection.client, error == ECONNREFUSED ? SOCKS_CONNECTION_REFUSED
+                                                                    : SOCKS_HOST_UNREACHABLE);
+        }
+        return false;
+    }
+    return startRelaying(connection);
+}
+
+bool ShapingProxy::startRelaying(Connection& connection) {
+    if (config_.mode == Mode::Socks5 && !sendSocksReply(connection.client, SOCKS_SUCCEEDED)) {
+        return false;
+    }
+    const int noDelay = 1;
+    setsockopt(connection.upstream, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    for (Direction* direction : {&connection.up, &connection.down}) {
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+            return false;
+        }
+        direction->pipeRead = fds[0];
+        direction->pipeWrite = fds[1];
+        fcntl(direction->pipeWrite, F_SETPIPE_SZ, static_cast<int>(PIPE_CAPACITY));
+        direction->wantRead = true;
+    }
+    connection.state = State::Relaying;
+    updateInterest(connection);
+    return true;
+}
+
+// Moves data from -> pipe -> to until a socket would block, the bucket runs dry or the
+// per-wakeup chunk budget is used up (level-triggered epoll brings us back for the rest).
+bool ShapingProxy::pump(Connection& connection, Direction& direction, int from, int to) {
+    direction.wantRead = false;
+    direction.wantWrite = false;
+    if (direction.done()) {
+        return true;
+    }
+
+    // Looked up on every wakeup so that limits changed in the UI apply to open connections
+    std::shared_ptr<ProcessLimiter> limiter = connection.pid ? throttler_.getLimiter(connection.pid) : nullptr;
+    TokenBucket* bucket = limiter ? &limiter->bucket(direction.traffic) : nullptr;
+    if (bucket && bucket->isUnlimited()) {
+        bucket = nullptr;
+    }
+    std::atomic<uint64_t>& counter = direction.traffic == TrafficDirection::Upload ? bytesUp_ : bytesDown_;
+
+    for (int chunks = 0;;) {
+        if (direction.admitted > 0) {
+            const ssize_t n = splice(direction.pipeRead, nullptr, to, nullptr, direction.admitted,
+                                     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                direction.admitted -= static_cast<size_t>(n);
+                counter.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                direction.wantWrite = true;
+                return true;
+            }
+            return false;
+        }
+
+        if (direction.held > 0) {
+            const uint64_t now = MonotonicClock::nowNs();
+            if (!bucket || bucket->tryConsume(direction.held, now)) {
+                direction.admitted = direction.held;
+                direction.held = 0;
+                continue;
+            }
+            if (direction.timer == TimerWheel::INVALID_TIMER) {
+                const bool upload = direction.traffic == TrafficDirection::Upload;
+                direction.timer = timers_.schedule(bucket->nextAvailableAt(direction.held, now),
+                                                   token(connection.id, !upload));
+                throttleWaits_.fetch_add(1, std::memory_order_relaxed);
+            }
+            return true;
+        }
+
+        if (direction.eof) {
+            shutdown(to, SHUT_WR);
+            direction.shutdownSent = true;
+            return true;
+        }
+        if (chunks++ == CHUNKS_PER_WAKEUP) {
+            direction.wantRead = true;
+            return true;
+        }
+
+        // A throttled direction reads one burst at a time so the bucket paces it smoothly
+        size_t chunk = PIPE_CAPACITY;
+        if (bucket) {
+            const uint64_t burst = bucket->burst();
+            chunk = burst < MIN_THROTTLED_CHUNK ? MIN_THROTTLED_CHUNK
+                                                : (burst < PIPE_CAPACITY ? static_cast<size_t>(burst) : PIPE_CAPACITY);
+        }
+        const ssize_t n = splice(from, nullptr, direction.pipeWrite, nullptr, chunk,
+                                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            direction.held = static_cast<size_t>(n);
+        } else if (n == 0) {
+            direction.eof = true;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            direction.wantRead = true;
+            return true;
+        } else {
+            return false;
+        }
+    }
+}
+
+void ShapingProxy::updateInterest(Connection& connection) {
+    if (connection.state != State::Relaying) {
+        return;
+    }
+    const uint32_t in = EPOLLIN;
+    const uint32_t out = EPOLLOUT;
+    const uint32_t clientEvents = (connection.up.wantRead ? in : 0u) | (connection.down.wantWrite ? out : 0u);
+    const uint32_t upstreamEvents = (connection.down.wantRead ? in : 0u) | (connection.up.wantWrite ? out : 0u);
+    if (connection.clientHungUp && clientEvents == 0) {
+        dropInterest(connection.client, connection.clientEvents);
+    } else {
+        setInterest(connection.client, connection.clientEvents, clientEvents, token(connection.id, false));
+    }
+    if (connection.upstreamHungUp && upstreamEvents == 0) {
+        dropInterest(connection.upstream, connection.upstreamEvents);
+    } else {
+        setInterest(connection.upstream, connection.upstreamEvents, upstreamEvents, token(connection.id, true));
+    }
+}
+
+bool ShapingProxy::setInterest(int fd, uint32_t& registered, uint32_t events, uint64_t eventToken) {
+    if ((registered & INTEREST_ADDED) && (registered & ~INTEREST_ADDED) == events) {
+        return true;
+    }
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = eventToken;
+    const int op = (registered & INTEREST_ADDED) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(epollFd_, op, fd, &event) != 0) {
+        return false;
+    }
+    registered = events | INTEREST_ADDED;
+    return true;
+}
+
+void ShapingProxy::dropInterest(int fd, uint32_t& registered) {
+    if (registered & INTEREST_ADDED) {
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+        registered = 0;
+    }
+}
+
+void ShapingProxy::closeConnection(uint64_t id) {
+    auto it = connections_.find(id);
+    if (it == connections_.end()) {
+        return;
+    }
+    Connection& connection = *it->second;
+    for (Direction* direction : {&connection.up, &connection.down}) {
+        if (direction->timer != TimerWheel::INVALID_TIMER) {
+            timers_.cancel(direction->timer);
+        }
+        closeFd(direction->pipeRead);
+        closeFd(direction->pipeWrite);
+    }
+    closeFd(connection.client);
+    closeFd(connection.upstream);
+
+    if (connection.ownsThrottle) {
+        auto owned = proxyThrottles_.find(connection.pid);
+        if (owned != proxyThrottles_.end() && --owned->second == 0) {
+            throttler_.stopThrottling(connection.pid);
+            proxyThrottles_.erase(owned);
+        }
+    }
+    connections_.erase(it);
+    activeCount_.fetch_sub(1, std::memory_order_relaxed);
+}
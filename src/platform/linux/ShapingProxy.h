@@ -0,0 +1,170 @@
+#ifndef LINUX_SHAPINGPROXY_H
+#define LINUX_SHAPINGPROXY_H
+
+#include "NetworkThrottler.h"
+#include "SocketOwnerMap.h"
+#include "SocketStatsCollector.h"
+#include "core/TimerWheel.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <unordered_map>
+#include <vector>
+
+// Local TCP proxy that shapes the connections passing through it, for applications that
+// can be pointed at a proxy (SOCKS5) or a fixed forward port.
+//
+// Bytes are never copied into user space: each direction of a connection owns a pipe, and
+// splice() moves data socket -> pipe -> socket. After a chunk enters the pipe it is
+// charged to the client process's token bucket (upload for client -> upstream, download
+// for upstream -> client). If the bucket cannot admit it, the chunk stays in the pipe, the
+// source socket is dropped from the epoll interest set and a timer on the wheel fires when
+// the bucket can; TCP flow control then pushes back on the sender. Chunks are sized to
+// the bucket's burst so a throttled connection is paced smoothly rather than in bursts.
+//
+// Clients on loopback are identified by process: the proxy looks up the client's socket
+// inode with sock_diag and its owner in /proc, then applies whatever limits the
+// NetworkThrottler holds for that PID, re-reading them on every wakeup so changes take
+// effect on open connections. With per-client rates set, every client process that is not
+// throttled already gets its own limiter for as long as it has connections open.
+//
+// Single-threaded: start() and run()/poll() belong to one thread; stop() and stats() may
+// be called from any thread.
+class ShapingProxy {
+public:
+    enum class Mode { Forward, Socks5 };
+
+    struct Config {
+        Mode mode;
+        std::string listenAddress;   // numeric IPv4 or IPv6
+        uint16_t listenPort;         // 0 picks a free port, see port()
+        std::string upstreamAddress; // Forward mode: numeric address or host name
+        uint16_t upstreamPort;
+        uint64_t clientDownloadLimit; // bytes/s for clients without a throttle; 0 = none
+        uint64_t clientUploadLimit;
+
+        Config()
+            : mode(Mode::Socks5), listenAddress("127.0.0.1"), listenPort(1080), upstreamPort(0),
+              clientDownloadLimit(0), clientUploadLimit(0) {}
+    };
+
+    struct Stats {
+        uint64_t connections;       // accepted since start
+        uint64_t activeConnections;
+        uint64_t identifiedClients; // connections whose client PID was resolved
+        uint64_t bytesUploaded;     // client -> upstream
+        uint64_t bytesDownloaded;   // upstream -> client
+        uint64_t throttleWaits;     // times a chunk had to wait for tokens
+    };
+
+    ShapingProxy(NetworkThrottler& throttler, const Config& config = Config());
+    ~ShapingProxy();
+
+    ShapingProxy(const ShapingProxy&) = delete;
+    ShapingProxy& operator=(const ShapingProxy&) = delete;
+
+    // Binds the listening socket
+    bool start();
+    // Serves connections until stop(); false if the proxy was not started or epoll failed
+    bool run();
+    // Handles the events that arrive within timeoutMs (-1 waits indefinitely)
+    bool poll(int timeoutMs);
+    void stop();
+
+    uint16_t port() const { return port_; }
+    Stats stats() const;
+
+private:
+    enum class State { Greeting, Request, Connecting, Relaying };
+
+    struct Direction {
+        TrafficDirection traffic;
+        int pipeRead;
+        int pipeWrite;
+        size_t held;     // bytes in the pipe waiting for tokens
+        size_t admitted; // bytes in the pipe cleared to send
+        bool eof;
+        bool shutdownSent;
+        bool wantRead;
+        bool wantWrite;
+        TimerWheel::TimerId timer;
+
+        explicit Direction(TrafficDirection t)
+            : traffic(t), pipeRead(-1), pipeWrite(-1), held(0), admitted(0), eof(false),
+              shutdownSent(false), wantRead(false), wantWrite(false), timer(TimerWheel::INVALID_TIMER) {}
+
+        bool done() const { return shutdownSent; }
+    };
+
+    struct Connection {
+        uint64_t id;
+        State state;
+        int client;
+        int upstream;
+        uint32_t clientEvents;   // registered epoll masks
+        uint32_t upstreamEvents;
+        bool clientHungUp;       // EPOLLHUP seen without a socket error
+        bool upstreamHungUp;
+        uint32_t pid;            // 0 if unknown
+        bool ownsThrottle;       // throttle created for this client by the proxy
+        Direction up;            // client -> upstream
+        Direction down;          // upstream -> client
+        std::vector<uint8_t> handshake;
+
+        Connection()
+            : id(0), state(State::Relaying), client(-1), upstream(-1), clientEvents(0),
+              upstreamEvents(0), clientHungUp(false), upstreamHungUp(false), pid(0), ownsThrottle(false), up(TrafficDirection::Upload),
+              down(TrafficDirection::Download) {}
+    };
+
+    static constexpr uint64_t LISTENER_TOKEN = UINT64_MAX;
+    static constexpr uint64_t WAKE_TOKEN = UINT64_MAX - 1;
+    static constexpr size_t PIPE_CAPACITY = 64 * 1024;
+    static constexpr size_t MIN_THROTTLED_CHUNK = 1500;
+    static constexpr int CHUNKS_PER_WAKEUP = 16;
+
+    void acceptClients();
+    uint32_t resolveClientPid(int fd, const sockaddr_storage& peer);
+    void attachThrottle(Connection& connection);
+    bool readHandshake(Connection& connection);
+    bool handleGreeting(Connection& connection);
+    bool handleRequest(Connection& connection);
+    bool connectUpstream(Connection& connection, const sockaddr_storage& address, socklen_t length);
+    bool finishConnect(Connection& connection);
+    bool startRelaying(Connection& connection);
+    bool pump(Connection& connection, Direction& direction, int from, int to);
+    void handleEvent(uint64_t token, uint32_t events);
+    bool handleHangup(Connection& connection, bool upstream, uint32_t events);
+    void handleTimers();
+    void updateInterest(Connection& connection);
+    bool setInterest(int fd, uint32_t& registered, uint32_t events, uint64_t token);
+    void dropInterest(int fd, uint32_t& registered);
+    void closeConnection(uint64_t id);
+
+    NetworkThrottler& throttler_;
+    Config config_;
+    int listenFd_;
+    int epollFd_;
+    int wakeFd_;
+    uint16_t port_;
+    std::atomic<bool> stopping_;
+
+    SocketStatsCollector socketStats_;
+    SocketOwnerMap socketOwners_;
+    TimerWheel timers_;
+    std::vector<TimerWheel::Expired> expired_;
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections_;
+    std::unordered_map<uint32_t, size_t> proxyThrottles_; // pid -> connections using it
+    uint64_t nextId_;
+
+    std::atomic<uint64_t> acceptedCount_;
+    std::atomic<uint64_t> activeCount_;
+    std::atomic<uint64_t> identifiedCount_;
+    std::atomic<uint64_t> bytesUp_;
+    std::atomic<uint64_t> bytesDown_;
+    std::atomic<uint64_t> throttleWaits_;
+};
+
+#endif // LINUX_SHAPINGPROXY_H
@@ -0,0 +1,328 @@
+#include "SharedLimits.h"
+#include "core/MonotonicClock.h"
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <new>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Buckets are shared between processes, which needs address-free (lock-free) atomics
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "64-bit atomics must be lock-free");
+static_assert(std::atomic<double>::is_always_lock_free, "double atomics must be lock-free");
+
+namespace {
+
+constexpr size_t MASK = SharedLimitTable::CAPACITY - 1;
+
+bool isLive(uint32_t pid) {
+    return pid != SharedLimitEntry::FREE && pid != SharedLimitEntry::REMOVED;
+}
+
+} // namespace
+
+SharedLimits::SharedLimits() : table_(nullptr), shared_(false), ownerFd_(-1) {}
+
+SharedLimits::~SharedLimits() {
+    close();
+}
+
+std::string SharedLimits::defaultName() {
+    const char* name = std::getenv("BANDWIDTH_THROTTLER_SHM");
+    if (name && name[0] == '/') {
+        return name;
+    }
+    return "/bandwidth-throttler-" + std::to_string(getuid());
+}
+
+bool SharedLimits::map(int fd) {
+    void* memory = mmap(nullptr, sizeof(SharedLimitTable), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    table_ = static_cast<SharedLimitTable*>(memory);
+    shared_ = true;
+    return true;
+}
+
+void SharedLimits::initialize() {
+    // Rebuilt in place (not unlinked) so that mappings made by running processes stay
+    // valid; they see the generation move on and look their entries up again
+    const uint64_t generation = table_->magic == SharedLimitTable::MAGIC ? table_->generation.load() : 0;
+    table_->magic = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    for (SharedLimitEntry& entry : table_->entries) {
+        new (&entry.sequence) std::atomic<uint32_t>(0);
+        new (&entry.pid) std::atomic<uint32_t>(SharedLimitEntry::FREE);
+        new (&entry.downloadLimit) std::atomic<uint64_t>(0);
+        new (&entry.uploadLimit) std::atomic<uint64_t>(0);
+        new (&entry.treeRoot) std::atomic<uint32_t>(0);
+        new (&entry.download.bucket) TokenBucket();
+        new (&entry.download.bytes) std::atomic<uint64_t>(0);
+        new (&entry.upload.bucket) TokenBucket();
+        new (&entry.upload.bytes) std::atomic<uint64_t>(0);
+    }
+    new (&table_->count) std::atomic<uint32_t>(0);
+    new (&table_->generation) std::atomic<uint64_t>(generation + 1);
+    table_->version = SharedLimitTable::VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    table_->magic = SharedLimitTable::MAGIC;
+}
+
+bool SharedLimits::create(const std::string& name) {
+    close();
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        return false;
+    }
+    // The owner keeps an exclusive lock for as long as it has the table open; the kernel
+    // drops it when the owner exits, so a table nobody holds is safe to clear
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0 || ftruncate(fd, sizeof(SharedLimitTable)) != 0 || !map(fd)) {
+        ::close(fd);
+        return false;
+    }
+    ownerFd_ = fd;
+    initialize();
+    return true;
+}
+
+bool SharedLimits::createAnonymous() {
+    close();
+    void* memory = mmap(nullptr, sizeof(SharedLimitTable), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    table_ = static_cast<SharedLimitTable*>(memory);
+    shared_ = false;
+    initialize();
+    return true;
+}
+
+bool SharedLimits::open(const std::string& name) {
+    close();
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    const bool mapped = fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(SharedLimitTable) && map(fd);
+    ::close(fd);
+    if (!mapped) {
+        return false;
+    }
+    if (table_->magic != SharedLimitTable::MAGIC || table_->version != SharedLimitTable::VERSION) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SharedLimits::close() {
+    if (table_) {
+        munmap(table_, sizeof(SharedLimitTable));
+        table_ = nullptr;
+    }
+    if (ownerFd_ >= 0) {
+        ::close(ownerFd_);
+        ownerFd_ = -1;
+    }
+}
+
+uint32_t SharedLimits::readEntry(const SharedLimitEntry& entry, SharedLimitSnapshot& snapshot) {
+    for (;;) {
+        const uint32_t before = entry.sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue; // writer in progress
+        }
+        snapshot.pid = entry.pid.load(std::memory_order_relaxed);
+        snapshot.downloadLimit = entry.downloadLimit.load(std::memory_order_relaxed);
+        snapshot.uploadLimit = entry.uploadLimit.load(std::memory_order_relaxed);
+        snapshot.treeRoot = entry.treeRoot.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.sequence.load(std::memory_order_relaxed) == before) {
+            break;
+        }
+    }
+    // The counters have many writers (every thread of the process), so they are plain
+    // monotonic atomics outside the seqlock
+    snapshot.bytesDownloaded = entry.download.bytes.load(std::memory_order_relaxed);
+    snapshot.bytesUploaded = entry.upload.bytes.load(std::memory_order_relaxed);
+    return snapshot.pid;
+}
+
+void SharedLimits::beginWrite(SharedLimitEntry& entry) {
+    entry.sequence.store(entry.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void SharedLimits::endWrite(SharedLimitEntry& entry) {
+    entry.sequence.store(entry.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+SharedLimitEntry* SharedLimits::find(SharedLimitTable& table, uint32_t pid) {
+    if (!isLive(pid)) {
+        return nullptr;
+    }
+    for (size_t probe = 0, index = home(pid); probe < SharedLimitTable::CAPACITY; ++probe, index = (index + 1) & MASK) {
+        const uint32_t owner = table.entries[index].pid.load(std::memory_order_acquire);
+        if (owner == pid) {
+            return &table.entries[index];
+        }
+        if (owner == SharedLimitEntry::FREE) {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+SharedLimitEntry* SharedLimits::findCharged(SharedLimitTable& table, uint32_t pid) {
+    SharedLimitEntry* entry = find(table, pid);
+    const uint32_t root = entry ? entry->treeRoot.load(std::memory_order_relaxed) : 0;
+    if (root == 0 || root == pid) {
+        return entry;
+    }
+    SharedLimitEntry* rootEntry = find(table, root);
+    // A root that has been removed or republished on its own no longer holds the tree's budget
+    return rootEntry && rootEntry->treeRoot.load(std::memory_order_relaxed) == root ? rootEntry : nullptr;
+}
+
+SharedLimitEntry* SharedLimits::find(uint32_t pid) const {
+    return table_ ? find(*table_, pid) : nullptr;
+}
+
+bool SharedLimits::read(uint32_t pid, SharedLimitSnapshot& snapshot) const {
+    if (!table_ || !isLive(pid)) {
+        return false;
+    }
+    for (size_t probe = 0, index = home(pid); probe < SharedLimitTable::CAPACITY; ++probe, index = (index + 1) & MASK) {
+        const uint32_t owner = readEntry(table_->entries[index], snapshot);
+        if (owner == pid) {
+            return true;
+        }
+        if (owner == SharedLimitEntry::FREE) {
+            break;
+        }
+    }
+    return false;
+}
+
+size_t SharedLimits::readAll(std::vector<SharedLimitSnapshot>& snapshots) const {
+    snapshots.clear();
+    if (!table_) {
+        return 0;
+    }
+    SharedLimitSnapshot snapshot;
+    for (const SharedLimitEntry& entry : table_->entries) {
+        if (isLive(entry.pid.load(std::memory_order_relaxed)) && isLive(readEntry(entry, snapshot))) {
+            snapshots.push_back(snapshot);
+        }
+    }
+    return snapshots.size();
+}
+
+bool SharedLimits::publish(uint32_t pid, uint64_t downloadLimitBytesPerSec, uint64_t uploadLimitBytesPerSec,
+                           uint32_t treeRoot) {
+    if (!table_ || !isLive(pid)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    // Update the PID wherever it sits in its chain, else take the first tombstone or the
+    // free slot that ends the chain
+    SharedLimitEntry* entry = nullptr;
+    SharedLimitEntry* vacant = nullptr;
+    for (size_t probe = 0, index = home(pid); probe < SharedLimitTable::CAPACITY; ++probe, index = (index + 1) & MASK) {
+        SharedLimitEntry& candidate = table_->entries[index];
+        const uint32_t owner = candidate.pid.load(std::memory_order_relaxed);
+        if (owner == pid) {
+            entry = &candidate;
+            break;
+        }
+        if (owner == SharedLimitEntry::REMOVED && !vacant) {
+            vacant = &candidate;
+        }
+        if (owner == SharedLimitEntry::FREE) {
+            vacant = vacant ? vacant : &candidate;
+            break;
+        }
+    }
+    const bool added = entry == nullptr;
+    if (added) {
+        if (!vacant || table_->count.load(std::memory_order_relaxed) >= SharedLimitTable::MAX_ENTRIES) {
+            return false;
+        }
+        entry = vacant;
+    }
+
+    beginWrite(*entry);
+    if (added) {
+        entry->download.bytes.store(0, std::memory_order_relaxed);
+        entry->upload.bytes.store(0, std::memory_order_relaxed);
+        entry->download.bucket.configure(downloadLimitBytesPerSec);
+        entry->upload.bucket.configure(uploadLimitBytesPerSec);
+    } else {
+        // A limit change keeps what is left in the buckets instead of granting a fresh burst
+        const uint64_t nowNs = MonotonicClock::nowNs();
+        entry->download.bucket.setRate(downloadLimitBytesPerSec, nowNs);
+        entry->upload.bucket.setRate(uploadLimitBytesPerSec, nowNs);
+    }
+    entry->downloadLimit.store(downloadLimitBytesPerSec, std::memory_order_relaxed);
+    entry->uploadLimit.store(uploadLimitBytesPerSec, std::memory_order_relaxed);
+    entry->treeRoot.store(treeRoot, std::memory_order_relaxed);
+    // Buckets are configured before the PID appears, so enforcement code that finds the
+    // entry without the seqlock never sees the previous owner's limits
+    entry->pid.store(pid, std::memory_order_release);
+    endWrite(*entry);
+
+    if (added) {
+        table_->count.fetch_add(1, std::memory_order_relaxed);
+    }
+    table_->generation.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool SharedLimits::remove(uint32_t pid) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    SharedLimitEntry* entry = find(pid);
+    if (!entry) {
+        return false;
+    }
+    // A slot that ends its chain becomes free, and so do the tombstones right before it;
+    // anywhere else it becomes a tombstone so that later chain members stay reachable
+    const size_t index = static_cast<size_t>(entry - table_->entries);
+    const bool endsChain = table_->entries[(index + 1) & MASK].pid.load(std::memory_order_relaxed) ==
+                           SharedLimitEntry::FREE;
+
+    beginWrite(*entry);
+    // Unlimited at once, even for threads still holding a pointer to the entry
+    entry->download.bucket.configure(0);
+    entry->upload.bucket.configure(0);
+    entry->downloadLimit.store(0, std::memory_order_relaxed);
+    entry->uploadLimit.store(0, std::memory_order_relaxed);
+    entry->treeRoot.store(0, std::memory_order_relaxed);
+    entry->pid.store(endsChain ? SharedLimitEntry::FREE : SharedLimitEntry::REMOVED, std::memory_order_release);
+    endWrite(*entry);
+
+    if (endsChain) {
+        for (size_t previous = (index - 1) & MASK;
+             table_->entries[previous].pid.load(std::memory_order_relaxed) == SharedLimitEntry::REMOVED;
+             previous = (previous - 1) & MASK) {
+            SharedLimitEntry& tombstone = table_->entries[previous];
+            beginWrite(tombstone);
+            tombstone.pid.store(SharedLimitEntry::FREE, std::memory_order_release);
+            endWrite(tombstone);
+        }
+    }
+    table_->count.fetch_sub(1, std::memory_order_relaxed);
+    table_->generation.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+size_t SharedLimits::available() const {
+    if (!table_) {
+        return 0;
+    }
+    const size_t used = table_->count.load(std::memory_order_relaxed);
+    return used >= SharedLimitTable::MAX_ENTRIES ? 0 : SharedLimitTable::MAX_ENTRIES - used;
+}
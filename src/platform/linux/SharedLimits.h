@@ -0,0 +1,139 @@
+#ifndef LINUX_SHAREDLIMITS_H
+#define LINUX_SHAREDLIMITS_H
+
+#include "core/TokenBucket.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Per-process limits and live byte counters published in POSIX shared memory, so that
+// code running inside the throttled processes (the LD_PRELOAD shim), the UI and exporters
+// can read them without locks or syscalls. Each entry also holds the process's token
+// buckets: the shim consumes from them in place, and every thread of the process shares
+// one budget.
+//
+// The layout is fixed and cache-line aligned. NetworkThrottler is the only writer of the
+// control fields (its threads serialize on a mutex here) and updates each entry under a
+// seqlock; readers retry while a write is in progress. Entries are found by hashing the
+// PID with linear probing; a removed entry leaves a tombstone, so a live entry never moves
+// and enforcement code may keep a pointer to it until the table generation (bumped by
+// every publish and remove) changes.
+//
+// Processes of a throttle tree each have an entry naming the tree's root; they all charge
+// the root's buckets, and processes they fork are charged there too before the controller
+// has seen them.
+struct SharedLimitSnapshot {
+    uint32_t pid;
+    uint64_t downloadLimit; // bytes/sec, 0 = unlimited
+    uint64_t uploadLimit;
+    uint32_t treeRoot; // 0 unless the process belongs to a throttle tree
+    uint64_t bytesDownloaded; // charged by the enforcing process since the throttle started
+    uint64_t bytesUploaded;   // (for a tree, the root's counters hold the whole tree's bytes)
+};
+
+// One direction of a process: written by the process itself on every grant, so each
+// direction gets its own cache line
+struct alignas(64) SharedLimitLane {
+    TokenBucket bucket;
+    std::atomic<uint64_t> bytes;
+};
+
+struct alignas(64) SharedLimitEntry {
+    static constexpr uint32_t FREE = 0;
+    static constexpr uint32_t REMOVED = 0xffffffffu; // tombstone; probing continues past it
+
+    // Control line, written by the controller only
+    std::atomic<uint32_t> sequence; // odd while the controller updates the entry
+    std::atomic<uint32_t> pid;
+    std::atomic<uint64_t> downloadLimit;
+    std::atomic<uint64_t> uploadLimit;
+    std::atomic<uint32_t> treeRoot; // PID whose lanes are charged (a tree's root names itself), or 0
+
+    SharedLimitLane download;
+    SharedLimitLane upload;
+};
+
+struct SharedLimitTable {
+    static constexpr uint32_t MAGIC = 0x42574c54; // "BWLT"
+    static constexpr uint32_t VERSION = 3;
+    static constexpr unsigned CAPACITY_BITS = 15;
+    static constexpr size_t CAPACITY = size_t(1) << CAPACITY_BITS;
+    static constexpr size_t MAX_ENTRIES = CAPACITY / 2; // keeps probe chains short
+
+    // Header line, read on every shim call and written only with the control fields
+    alignas(64) uint32_t magic;
+    uint32_t version;
+    std::atomic<uint64_t> generation;
+    std::atomic<uint32_t> count; // live entries
+    SharedLimitEntry entries[CAPACITY];
+};
+
+static_assert(sizeof(SharedLimitEntry) == 3 * 64, "entry must be three cache lines");
+
+class SharedLimits {
+public:
+    SharedLimits();
+    ~SharedLimits();
+
+    SharedLimits(const SharedLimits&) = delete;
+    SharedLimits& operator=(const SharedLimits&) = delete;
+
+    // $BANDWIDTH_THROTTLER_SHM, or a per-user name under /dev/shm
+    static std::string defaultName();
+
+    // Controller side: creates the table and owns it until close(). A table left by a
+    // controller that has exited is taken over and cleared in place, so that processes
+    // which already mapped it keep seeing the current limits; while another controller
+    // owns it, fails without touching it.
+    bool create(const std::string& name = defaultName());
+    // Controller side, when shared memory is unavailable: an anonymous table that only
+    // this process and its children can see
+    bool createAnonymous();
+    // Enforcement side: maps an existing table read-write
+    bool open(const std::string& name = defaultName());
+    void close();
+    bool isOpen() const { return table_ != nullptr; }
+    bool isShared() const { return table_ != nullptr && shared_; }
+
+    // Writer side. Adds or updates a process and returns false if the table is full or
+    // not open. Counters restart when a PID is added; an update keeps the buckets' current
+    // fill. treeRoot makes the process a member of that PID's tree (the root is published
+    // first, with treeRoot == pid).
+    bool publish(uint32_t pid, uint64_t downloadLimitBytesPerSec, uint64_t uploadLimitBytesPerSec,
+                 uint32_t treeRoot = 0);
+    bool remove(uint32_t pid);
+    // Entries that can still be added; concurrent publishers may take them first
+    size_t available() const;
+
+    // Reader side; lock-free and safe from any thread or process
+    SharedLimitEntry* find(uint32_t pid) const;
+    bool read(uint32_t pid, SharedLimitSnapshot& snapshot) const;
+    // Every live entry. Walks the whole table, so meant for exporters, not hot paths.
+    size_t readAll(std::vector<SharedLimitSnapshot>& snapshots) const;
+
+    SharedLimitTable* table() const { return table_; }
+    static SharedLimitEntry* find(SharedLimitTable& table, uint32_t pid);
+    // The entry whose buckets a process is charged to: its tree root's, else its own
+    static SharedLimitEntry* findCharged(SharedLimitTable& table, uint32_t pid);
+
+private:
+    static size_t home(uint32_t pid) {
+        return static_cast<size_t>((pid * 0x9e3779b1u) >> (32 - SharedLimitTable::CAPACITY_BITS));
+    }
+    // Consistent copy of one entry's control fields and counters
+    static uint32_t readEntry(const SharedLimitEntry& entry, SharedLimitSnapshot& snapshot);
+    static void beginWrite(SharedLimitEntry& entry);
+    static void endWrite(SharedLimitEntry& entry);
+    bool map(int fd);
+    void initialize();
+
+    SharedLimitTable* table_;
+    bool shared_;
+    int ownerFd_; // holds the owner's lock on a created table, else -1
+    std::mutex writeMutex_;
+};
+
+#endif // LINUX_SHAREDLIMITS_H
@@ -0,0 +1,169 @@
+#include "SocketOwnerMap.h"
+#include "ProcFs.h"
+
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t DIRENT_BUFFER_SIZE = 64 * 1024;
+constexpr char SOCKET_PREFIX[] = "socket:[";
+constexpr size_t SOCKET_PREFIX_LEN = sizeof(SOCKET_PREFIX) - 1;
+
+// Parses "socket:[12345]"; anything else (files, pipes, anon inodes) is rejected
+bool parseSocketLink(const char* link, size_t length, uint64_t& inode) {
+    if (length <= SOCKET_PREFIX_LEN + 1 || std::memcmp(link, SOCKET_PREFIX, SOCKET_PREFIX_LEN) != 0 ||
+        link[length - 1] != ']') {
+        return false;
+    }
+    uint64_t value = 0;
+    for (size_t i = SOCKET_PREFIX_LEN; i + 1 < length; ++i) {
+        if (link[i] < '0' || link[i] > '9') {
+            return false;
+        }
+        value = value * 10 + static_cast<uint64_t>(link[i] - '0');
+    }
+    inode = value;
+    return true;
+}
+
+} // namespace
+
+SocketOwnerMap::SocketOwnerMap(const std::string& procRoot, uint64_t rescanIntervalNs)
+    : procRoot_(procRoot), procFd_(-1), rescanIntervalNs_(rescanIntervalNs), lastScanNs_(0),
+      scanned_(false), generation_(0), scans_(0), direntBuffer_(DIRENT_BUFFER_SIZE),
+      fdBuffer_(DIRENT_BUFFER_SIZE) {}
+
+SocketOwnerMap::~SocketOwnerMap() {
+    if (procFd_ >= 0) {
+        close(procFd_);
+    }
+}
+
+void SocketOwnerMap::resolve(std::vector<SocketCounters>& sockets, uint64_t nowNs) {
+    ++generation_;
+    unknown_.clear();
+    for (SocketCounters& socket : sockets) {
+        auto it = owners_.find(socket.socketId);
+        if (it != owners_.end()) {
+            socket.pid = it->second.pid;
+            it->second.generation = generation_;
+        } else {
+            unknown_.insert(socket.socketId);
+        }
+    }
+
+    if (!unknown_.empty() && (!scanned_ || nowNs - lastScanNs_ >= rescanIntervalNs_)) {
+        scan(unknown_);
+        scanned_ = true;
+        lastScanNs_ = nowNs;
+        ++scans_;
+
+        for (SocketCounters& socket : sockets) {
+            if (socket.pid != TrafficAccountant::UNKNOWN_PID) {
+                continue;
+            }
+            auto it = owners_.find(socket.socketId);
+            if (it != owners_.end()) {
+                socket.pid = it->second.pid;
+            }
+        }
+    }
+
+    for (auto it = owners_.begin(); it != owners_.end();) {
+        if (it->second.generation != generation_) {
+            it = owners_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool SocketOwnerMap::openProcRoot() {
+    if (procFd_ >= 0) {
+        return lseek(procFd_, 0, SEEK_SET) == 0;
+    }
+    procFd_ = open(procRoot_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return procFd_ >= 0;
+}
+
+void SocketOwnerMap::scan(std::unordered_set<uint64_t>& unknown) {
+    if (!openProcRoot()) {
+        return;
+    }
+
+    // Processes that already own sockets are the likeliest owners of new ones
+    std::unordered_set<uint32_t> visited;
+    recentOwners_.clear();
+    for (const auto& entry : owners_) {
+        if (visited.insert(entry.second.pid).second) {
+            recentOwners_.push_back(entry.second.pid);
+        }
+    }
+    for (uint32_t pid : recentOwners_) {
+        scanProcess(pid, unknown);
+        if (unknown.empty()) {
+            return;
+        }
+    }
+
+    for (;;) {
+        const long bytes = procfs::readDirectory(procFd_, direntBuffer_.data(), direntBuffer_.size());
+        if (bytes <= 0) {
+            return;
+        }
+        for (long offset = 0; offset < bytes;) {
+            const auto* entry = reinterpret_cast<const procfs::LinuxDirent64*>(direntBuffer_.data() + offset);
+            offset += entry->d_reclen;
+
+            uint32_t pid;
+            if ((entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN) ||
+                !procfs::parsePid(entry->d_name, pid) || visited.count(pid) != 0) {
+                continue;
+            }
+            scanProcess(pid, unknown);
+            if (unknown.empty()) {
+                return;
+            }
+        }
+    }
+}
+
+bool SocketOwnerMap::scanProcess(uint32_t pid, std::unordered_set<uint64_t>& unknown) {
+    char path[32];
+    if (!procfs::pidPath(path, sizeof(path), pid, "fd")) {
+        return false;
+    }
+    const int dirFd = openat(procFd_, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0) {
+        return false; // exited, or not ours to inspect
+    }
+
+    char link[64];
+    for (;;) {
+        const long bytes = procfs::readDirectory(dirFd, fdBuffer_.data(), fdBuffer_.size());
+        if (bytes <= 0) {
+            break;
+        }
+        for (long offset = 0; offset < bytes;) {
+            const auto* entry = reinterpret_cast<const procfs::LinuxDirent64*>(fdBuffer_.data() + offset);
+            offset += entry->d_reclen;
+            if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+                continue;
+            }
+
+            const ssize_t length = readlinkat(dirFd, entry->d_name, link, sizeof(link));
+            uint64_t inode;
+            if (length <= 0 || !parseSocketLink(link, static_cast<size_t>(length), inode)) {
+                continue;
+            }
+            // Every socket found is recorded; only the unknown ones end the scan early
+            owners_[inode] = Owner{pid, generation_};
+            unknown.erase(inode);
+        }
+    }
+    close(dirFd);
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef LINUX_SOCKETOWNERMAP_H
+#define LINUX_SOCKETOWNERMAP_H
+
+#include "core/TrafficAccountant.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Maps socket inodes to the PIDs holding them, from the "socket:[inode]" links in
+// /proc/<pid>/fd.
+//
+// Reading every descriptor of every process costs one readlink per open file, so the map
+// is only rescanned when a collected socket has no known owner, and then at most once per
+// rescan interval. Processes that owned sockets before are scanned first and the scan
+// stops as soon as every unknown inode is found, which covers the common case of a busy
+// server opening new connections. Inodes that no scan can resolve (other users' processes
+// without privileges, sockets in flight) are retried after the interval.
+class SocketOwnerMap {
+public:
+    static constexpr uint64_t DEFAULT_RESCAN_INTERVAL_NS = 1000000000ULL;
+
+    explicit SocketOwnerMap(const std::string& procRoot = "/proc",
+                            uint64_t rescanIntervalNs = DEFAULT_RESCAN_INTERVAL_NS);
+    ~SocketOwnerMap();
+
+    SocketOwnerMap(const SocketOwnerMap&) = delete;
+    SocketOwnerMap& operator=(const SocketOwnerMap&) = delete;
+
+    // Fills in the pid of every socket whose owner is known, rescanning if needed.
+    // Forgets inodes that are no longer in `sockets`.
+    void resolve(std::vector<SocketCounters>& sockets, uint64_t nowNs);
+
+    size_t size() const { return owners_.size(); }
+    uint64_t scans() const { return scans_; }
+
+private:
+    struct Owner {
+        uint32_t pid;
+        uint64_t generation;
+    };
+
+    bool openProcRoot();
+    void scan(std::unordered_set<uint64_t>& unknown);
+    // Reads one process's descriptors; returns false if the process is gone
+    bool scanProcess(uint32_t pid, std::unordered_set<uint64_t>& unknown);
+
+    std::string procRoot_;
+    int procFd_;
+    uint64_t rescanIntervalNs_;
+    uint64_t lastScanNs_;
+    bool scanned_;
+    uint64_t generation_;
+    uint64_t scans_;
+    std::vector<char> direntBuffer_;
+    std::vector<char> fdBuffer_;
+    std::unordered_map<uint64_t, Owner> owners_;
+    std::unordered_set<uint64_t> unknown_;
+    std::vector<uint32_t> recentOwners_;
+};
+
+#endif // LINUX_SOCKETOWNERMAP_H
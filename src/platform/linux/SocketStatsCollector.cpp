@@ -0,0 +1,212 @@
+#include "SocketStatsCollector.h"
+
+#include <cstddef>
+#include <cstring>
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// A dump reply is at most 32 KiB per datagram; a smaller buffer would truncate it and
+// silently lose sockets. Twice that leaves room for larger kernel chunk sizes.
+constexpr size_t RECEIVE_BUFFER_SIZE = 64 * 1024;
+
+constexpr size_t RECEIVED_END = offsetof(tcp_info, tcpi_bytes_received) + sizeof(uint64_t);
+constexpr size_t ACKED_END = offsetof(tcp_info, tcpi_bytes_acked) + sizeof(uint64_t);
+constexpr size_t RTT_END = offsetof(tcp_info, tcpi_rtt) + sizeof(uint32_t);
+constexpr size_t MIN_RTT_END = offsetof(tcp_info, tcpi_min_rtt) + sizeof(uint32_t);
+
+// TCP states from include/net/tcp_states.h
+enum {
+    STATE_ESTABLISHED = 1,
+    STATE_SYN_SENT = 2,
+    STATE_SYN_RECV = 3,
+    STATE_FIN_WAIT1 = 4,
+    STATE_FIN_WAIT2 = 5,
+    STATE_TIME_WAIT = 6,
+    STATE_CLOSE = 7,
+    STATE_CLOSE_WAIT = 8,
+    STATE_LAST_ACK = 9,
+    STATE_LISTEN = 10,
+    STATE_CLOSING = 11
+};
+
+// Sockets that are owned by a file descriptor and may carry data
+constexpr uint32_t CONNECTED_STATES =
+    (1u << STATE_ESTABLISHED) | (1u << STATE_SYN_SENT) | (1u << STATE_FIN_WAIT1) |
+    (1u << STATE_FIN_WAIT2) | (1u << STATE_CLOSE_WAIT) | (1u << STATE_LAST_ACK) |
+    (1u << STATE_CLOSING);
+
+} // namespace
+
+SocketStatsCollector::SocketStatsCollector()
+    : fd_(socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG)),
+      buffer_(RECEIVE_BUFFER_SIZE), lastCount_(0) {}
+
+SocketStatsCollector::~SocketStatsCollector() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool SocketStatsCollector::collect(std::vector<SocketCounters>& sockets) {
+    sockets.clear();
+    sockets.reserve(lastCount_ + lastCount_ / 8);
+    if (fd_ < 0) {
+        return false;
+    }
+    const bool v4 = dumpFamily(AF_INET, sockets);
+    const bool v6 = dumpFamily(AF_INET6, sockets);
+    if (!v4 || !v6) {
+        // An aborted dump may leave replies queued that would be read as the next one's
+        close(fd_);
+        fd_ = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    }
+    lastCount_ = sockets.size();
+    return v4 || v6;
+}
+
+bool SocketStatsCollector::dumpFamily(int family, std::vector<SocketCounters>& sockets) {
+    struct {
+        nlmsghdr header;
+        inet_diag_req_v2 request;
+    } message;
+    std::memset(&message, 0, sizeof(message));
+    message.header.nlmsg_len = sizeof(message);
+    message.header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    message.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    message.request.sdiag_family = static_cast<uint8_t>(family);
+    message.request.sdiag_protocol = IPPROTO_TCP;
+    message.request.idiag_states = CONNECTED_STATES;
+    message.request.idiag_ext = 1 << (INET_DIAG_INFO - 1);
+
+    sockaddr_nl kernel;
+    std::memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    if (sendto(fd_, &message, sizeof(message), 0, reinterpret_cast<sockaddr*>(&kernel),
+               sizeof(kernel)) < 0) {
+        return false;
+    }
+
+    for (;;) {
+        const ssize_t length = recv(fd_, buffer_.data(), buffer_.size(), 0);
+        if (length < 0) {
+            return false;
+        }
+
+        int remaining = static_cast<int>(length);
+        for (auto* header = reinterpret_cast<nlmsghdr*>(buffer_.data()); NLMSG_OK(header, remaining);
+             header = NLMSG_NEXT(header, remaining)) {
+            if (header->nlmsg_type == NLMSG_DONE) {
+                return true;
+            }
+            if (header->nlmsg_type == NLMSG_ERROR) {
+                return false;
+            }
+            if (header->nlmsg_type != SOCK_DIAG_BY_FAMILY) {
+                continue;
+            }
+
+            const auto* diag = static_cast<const inet_diag_msg*>(NLMSG_DATA(header));
+            if (diag->idiag_inode == 0) {
+                continue; // not attached to a file descriptor
+            }
+
+            // Read the counters and RTTs in place instead of copying the whole tcp_info; older
+            // kernels send a shorter struct, in which case the missing fields count as zero
+            uint64_t received = 0;
+            uint64_t acked = 0;
+            uint32_t rtt = 0;
+            uint32_t minRtt = 0;
+            int attributesLength = static_cast<int>(header->nlmsg_len - NLMSG_LENGTH(sizeof(*diag)));
+            for (auto* attribute = reinterpret_cast<rtattr*>(const_cast<inet_diag_msg*>(diag) + 1);
+                 RTA_OK(attribute, attributesLength); attribute = RTA_NEXT(attribute, attributesLength)) {
+                if (attribute->rta_type != INET_DIAG_INFO) {
+                    continue;
+                }
+                const auto* payload = static_cast<const char*>(RTA_DATA(attribute));
+                const size_t size = RTA_PAYLOAD(attribute);
+                if (size >= RECEIVED_END) {
+                    std::memcpy(&received, payload + offsetof(tcp_info, tcpi_bytes_received), sizeof(received));
+                }
+                if (size >= ACKED_END) {
+                    std::memcpy(&acked, payload + offsetof(tcp_info, tcpi_bytes_acked), sizeof(acked));
+                }
+                if (size >= RTT_END) {
+                    std::memcpy(&rtt, payload + offsetof(tcp_info, tcpi_rtt), sizeof(rtt));
+                }
+                if (size >= MIN_RTT_END) {
+                    std::memcpy(&minRtt, payload + offsetof(tcp_info, tcpi_min_rtt), sizeof(minRtt));
+                }
+                break;
+            }
+
+            sockets.push_back(SocketCounters{diag->idiag_inode, TrafficAccountant::UNKNOWN_PID,
+                                             received, acked, rtt, minRtt});
+        }
+    }
+}
+
+bool SocketStatsCollector::findInode(const sockaddr_storage& local, const sockaddr_storage& remote,
+                                     uint64_t& inode) {
+    if (fd_ < 0 || local.ss_family != remote.ss_family) {
+        return false;
+    }
+
+    struct {
+        nlmsghdr header;
+        inet_diag_req_v2 request;
+    } message;
+    std::memset(&message, 0, sizeof(message));
+    message.header.nlmsg_len = sizeof(message);
+    message.header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    message.header.nlmsg_flags = NLM_F_REQUEST;
+    message.request.sdiag_family = static_cast<uint8_t>(local.ss_family);
+    message.request.sdiag_protocol = IPPROTO_TCP;
+    message.request.idiag_states = ~0u;
+    message.request.id.idiag_cookie[0] = INET_DIAG_NOCOOKIE;
+    message.request.id.idiag_cookie[1] = INET_DIAG_NOCOOKIE;
+
+    if (local.ss_family == AF_INET) {
+        const auto& src = reinterpret_cast<const sockaddr_in&>(local);
+        const auto& dst = reinterpret_cast<const sockaddr_in&>(remote);
+        message.request.id.idiag_sport = src.sin_port;
+        message.request.id.idiag_dport = dst.sin_port;
+        std::memcpy(message.request.id.idiag_src, &src.sin_addr, sizeof(src.sin_addr));
+        std::memcpy(message.request.id.idiag_dst, &dst.sin_addr, sizeof(dst.sin_addr));
+    } else if (local.ss_family == AF_INET6) {
+        const auto& src = reinterpret_cast<const sockaddr_in6&>(local);
+        const auto& dst = reinterpret_cast<const sockaddr_in6&>(remote);
+        message.request.id.idiag_sport = src.sin6_port;
+        message.request.id.idiag_dport = dst.sin6_port;
+        std::memcpy(message.request.id.idiag_src, &src.sin6_addr, sizeof(src.sin6_addr));
+        std::memcpy(message.request.id.idiag_dst, &dst.sin6_addr, sizeof(dst.sin6_addr));
+    } else {
+        return false;
+    }
+
+    sockaddr_nl kernel;
+    std::memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    if (sendto(fd_, &message, sizeof(message), 0, reinterpret_cast<sockaddr*>(&kernel),
+               sizeof(kernel)) < 0) {
+        return false;
+    }
+
+    // An exact lookup answers with a single message: the socket or an error
+    const ssize_t length = recv(fd_, buffer_.data(), buffer_.size(), 0);
+    const auto* header = reinterpret_cast<const nlmsghdr*>(buffer_.data());
+    if (length < 0 || !NLMSG_OK(header, static_cast<int>(length)) ||
+        header->nlmsg_type != SOCK_DIAG_BY_FAMILY) {
+        return false;
+    }
+    const auto* diag = static_cast<const inet_diag_msg*>(NLMSG_DATA(header));
+    inode = diag->idiag_inode;
+    return inode != 0;
+}
@@ -1,5 +1,8 @@
 #include "NetworkThrottler.h"
+#include "core/MonotonicClock.h"
 #include <iphlpapi.h>
+#include <tlhelp32.h>
+#include <algorithm>
 #include <ws2tcpip.h>
 #include <iostream>
 #include <vector>
@@ -10,17 +13,21 @@
 #pragma comment(lib, "iphlpapi.lib")
 #pragma comment(lib, "ws2_32.lib")
 
+namespace {
+
+// The shaper class of a policed direction: CIR guaranteed, up to PIR borrowed
+ShapingRates committedToPeak(const TrtcmPolicer::Config& config) {
+    return ShapingRates(config.committedRate, config.peakRate);
+}
+
+} // namespace
+
 NetworkThrottler::NetworkThrottler() : engineHandle_(NULL) {
     initializeWfp();
 }
 
 NetworkThrottler::~NetworkThrottler() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    // Stop all active throttles
-    for (auto it = activeThrottles_.begin(); it != activeThrottles_.end();) {
-        stopThrottling(it->first);
-        it = activeThrottles_.begin();
-    }
+    stopAll();
     cleanupWfp();
 }
 
@@ -43,39 +50,370 @@ void NetworkThrottler::cleanupWfp() {
 }
 
 bool NetworkThrottler::startThrottling(uint32_t pid, uint64_t downloadLimitBytesPerSec, uint64_t uploadLimitBytesPerSec) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    if (!engineHandle_) {
-        if (!initializeWfp()) {
-            return false;
-        }
+    // A flat limit is a leaf directly under the link with rate == ceil (no borrowing)
+    return startThrottling(pid, TrafficShaper::LINK_GROUP,
+                           ShapingRates(downloadLimitBytesPerSec, downloadLimitBytesPerSec),
+                           ShapingRates(uploadLimitBytesPerSec, uploadLimitBytesPerSec));
+}
+
+bool NetworkThrottler::ensureEngine() {
+    std::lock_guard<std::mutex> engineLock(engineMutex_);
+    return engineHandle_ || initializeWfp();
+}
+
+bool NetworkThrottler::startThrottling(uint32_t pid, uint32_t groupId, const ShapingRates& download, const ShapingRates& upload) {
+    if (pid == 0 || !ensureEngine()) {
+        return false;
     }
     
+    auto& shard = throttles_.shard(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const ThrottleInfo* existing = shard.find(pid);
+    if (existing && existing->treeRoot != 0) {
+        return false;
+    }
+    return startThrottlingLocked(shard, pid, groupId, download, upload, true);
+}
+
+bool NetworkThrottler::startThrottlingLocked(ThrottleTable<ThrottleInfo>::Shard& shard, uint32_t pid, uint32_t groupId,
+                                             const ShapingRates& download, const ShapingRates& upload, bool seed,
+                                             uint32_t treeRoot, std::shared_ptr<ProcessLimiter> limiter) {
     // Check if already throttling this PID
-    if (activeThrottles_.find(pid) != activeThrottles_.end()) {
-        stopThrottling(pid);
+    if (shard.find(pid)) {
+        stopThrottlingLocked(shard, pid);
     }
     
+    if (!shaper_.attachProcess(pid, groupId, download, upload, std::move(limiter))) {
+        return false;
+    }
+    
+    // The per-process buckets enforce the hard ceiling; the shaper decides how borrowed
+    // bandwidth is shared between siblings below it
     ThrottleInfo info;
-    info.downloadLimit = downloadLimitBytesPerSec;
-    info.uploadLimit = uploadLimitBytesPerSec;
-    info.active = false;
+    info.treeRoot = treeRoot;
+    info.groupId = groupId;
+    info.download = download;
+    info.upload = upload;
+    info.limiter = shaper_.limiter(pid);
+    info.policed = false;
+    info.filterId = 0;
     
     // Create Windows Filtering Platform filter to throttle traffic for this PID
     // Note: This is a simplified implementation
     // In production, you'd need to properly set up filters for both inbound and outbound traffic
     
-    UINT64 filterId;
-    if (createFilter(pid, downloadLimitBytesPerSec, uploadLimitBytesPerSec, filterId)) {
+    UINT64 filterId = 0;
+    if (createFilter(pid, download.ceil, upload.ceil, filterId)) {
         info.filterId = filterId;
-        info.active = true;
-        activeThrottles_[pid] = info;
+        shard.insert(pid, info);
+        if (seed) {
+            seedFlowCache({FlowEntry{pid, groupId}});
+        }
         return true;
     }
     
+    shaper_.detachProcess(pid);
     return false;
 }
 
+bool NetworkThrottler::startPolicing(uint32_t pid, const TrtcmPolicer::Config& download,
+                                     const TrtcmPolicer::Config& upload) {
+    if (pid == 0 || !download.isValid() || !upload.isValid() || !ensureEngine()) {
+        return false;
+    }
+    
+    auto& shard = throttles_.shard(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const ThrottleInfo* existing = shard.find(pid);
+    if (existing && existing->treeRoot != 0) {
+        return false;
+    }
+    if (!startThrottlingLocked(shard, pid, TrafficShaper::LINK_GROUP, committedToPeak(download),
+                               committedToPeak(upload), true)) {
+        return false;
+    }
+    ThrottleInfo* info = shard.find(pid);
+    info->policed = true;
+    info->downloadPolicer = download;
+    info->uploadPolicer = upload;
+    if (!applyPolicers(pid, *info)) {
+        stopThrottlingLocked(shard, pid);
+        return false;
+    }
+    return true;
+}
+
+bool NetworkThrottler::applyPolicers(uint32_t pid, const ThrottleInfo& info) {
+    const uint64_t nowNs = MonotonicClock::nowNs();
+    return shaper_.setPolicer(pid, TrafficDirection::Download, info.downloadPolicer, nowNs) &&
+           shaper_.setPolicer(pid, TrafficDirection::Upload, info.uploadPolicer, nowNs);
+}
+
+bool NetworkThrottler::updateLimits(uint32_t pid, const ShapingRates& download, const ShapingRates& upload) {
+    auto& shard = throttles_.shard(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    ThrottleInfo* info = shard.find(pid);
+    if (!info || info->treeRoot != 0 || info->policed) {
+        return false;
+    }
+    // In place: held traffic and bucket fill stay. The filter only matches the process,
+    // so it does not change with the limits.
+    if (!shaper_.setProcessRates(pid, download, upload, MonotonicClock::nowNs())) {
+        return false;
+    }
+    info->download = download;
+    info->upload = upload;
+    return true;
+}
+
+bool NetworkThrottler::applyBatch(const std::vector<ThrottleRequest>& requests) {
+    // Validate the whole set before anything changes
+    std::vector<uint32_t> pids;
+    pids.reserve(requests.size());
+    for (const ThrottleRequest& request : requests) {
+        if (request.pid == 0) {
+            return false;
+        }
+        pids.push_back(request.pid);
+    }
+    std::sort(pids.begin(), pids.end());
+    if (std::adjacent_find(pids.begin(), pids.end()) != pids.end() || !ensureEngine()) {
+        return false;
+    }
+    
+    // Shard locks first, as single-PID operations take them
+    auto locks = throttles_.lockShards(pids);
+    for (uint32_t pid : pids) {
+        const ThrottleInfo* existing = throttles_.shard(pid).find(pid);
+        if (existing && existing->treeRoot != 0) {
+            return false;
+        }
+    }
+    
+    std::vector<Undo> undo;
+    undo.reserve(requests.size());
+    std::vector<FlowEntry> seeds;
+    seeds.reserve(requests.size());
+    for (const ThrottleRequest& request : requests) {
+        auto& shard = throttles_.shard(request.pid);
+        const ThrottleInfo* previous = shard.find(request.pid);
+        undo.push_back(Undo{request.pid, previous != nullptr, previous ? *previous : ThrottleInfo()});
+        if (!startThrottlingLocked(shard, request.pid, TrafficShaper::LINK_GROUP,
+                                   ShapingRates(request.downloadLimit, request.downloadLimit),
+                                   ShapingRates(request.uploadLimit, request.uploadLimit), false)) {
+            rollback(undo);
+            return false;
+        }
+        seeds.push_back(FlowEntry{request.pid, TrafficShaper::LINK_GROUP});
+    }
+    
+    std::sort(seeds.begin(), seeds.end(), [](const FlowEntry& a, const FlowEntry& b) { return a.pid < b.pid; });
+    seedFlowCache(seeds);
+    return true;
+}
+
+void NetworkThrottler::rollback(const std::vector<Undo>& undo) {
+    // Only local state is restored: createFilter() installs no WFP filter yet, so there
+    // is nothing in the engine to undo
+    for (auto it = undo.rbegin(); it != undo.rend(); ++it) {
+        auto& shard = throttles_.shard(it->pid);
+        if (shard.find(it->pid)) {
+            shaper_.detachProcess(it->pid);
+            flowCache_.removeProcess(it->pid);
+            shard.erase(it->pid);
+        }
+        if (it->existed) {
+            ThrottleInfo info = it->previous;
+            shaper_.attachProcess(it->pid, info.groupId, info.download, info.upload);
+            info.limiter = shaper_.limiter(it->pid);
+            if (info.policed) {
+                applyPolicers(it->pid, info);
+            }
+            shard.insert(it->pid, info);
+            seedFlowCache({FlowEntry{it->pid, info.groupId}});
+        }
+    }
+}
+
+bool NetworkThrottler::removeBatch(const std::vector<uint32_t>& pids) {
+    std::vector<uint32_t> sorted(pids);
+    std::sort(sorted.begin(), sorted.end());
+    if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+        return false;
+    }
+    
+    // Every PID must be throttled on its own, or nothing is removed
+    auto locks = throttles_.lockShards(sorted);
+    for (uint32_t pid : sorted) {
+        const ThrottleInfo* existing = throttles_.shard(pid).find(pid);
+        if (!existing || existing->treeRoot != 0) {
+            return false;
+        }
+    }
+    for (uint32_t pid : pids) {
+        stopThrottlingLocked(throttles_.shard(pid), pid);
+    }
+    return true;
+}
+
+bool NetworkThrottler::startThrottlingTree(uint32_t rootPid, uint64_t downloadLimitBytesPerSec,
+                                           uint64_t uploadLimitBytesPerSec) {
+    if (rootPid == 0 || !ensureEngine()) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> treesLock(treesMutex_);
+    stopTreeLocked(rootPid);
+    ThrottleInfo existing;
+    if (throttles_.find(rootPid, existing) && existing.treeRoot != 0) {
+        return false; // already inside another tree
+    }
+    
+    // The group carries the aggregate limits; members only borrow from it
+    TreeInfo tree;
+    tree.downloadLimit = downloadLimitBytesPerSec;
+    tree.uploadLimit = uploadLimitBytesPerSec;
+    tree.groupId = shaper_.createGroup(TrafficShaper::LINK_GROUP,
+                                       ShapingRates(downloadLimitBytesPerSec, downloadLimitBytesPerSec),
+                                       ShapingRates(uploadLimitBytesPerSec, uploadLimitBytesPerSec));
+    if (tree.groupId == TrafficShaper::INVALID_GROUP) {
+        return false;
+    }
+    // Every member, the root included, is attached with the same limiter, so the shaper
+    // splits the tree's budget between them by weight
+    tree.limiter = std::make_shared<ProcessLimiter>(rootPid, downloadLimitBytesPerSec, uploadLimitBytesPerSec);
+    {
+        auto& shard = throttles_.shard(rootPid);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (!startThrottlingLocked(shard, rootPid, tree.groupId, ShapingRates(0, downloadLimitBytesPerSec),
+                                   ShapingRates(0, uploadLimitBytesPerSec), true, rootPid, tree.limiter)) {
+            shaper_.removeGroup(tree.groupId);
+            return false;
+        }
+    }
+    tree.members.insert(rootPid);
+    trees_.emplace(rootPid, std::move(tree));
+    syncTreesLocked();
+    return true;
+}
+
+bool NetworkThrottler::joinTreeLocked(uint32_t pid, uint32_t root, const TreeInfo& tree) {
+    auto& shard = throttles_.shard(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const ThrottleInfo* existing = shard.find(pid);
+    if (existing && existing->treeRoot != 0) {
+        return false;
+    }
+    return startThrottlingLocked(shard, pid, tree.groupId, ShapingRates(0, tree.downloadLimit),
+                                 ShapingRates(0, tree.uploadLimit), true, root, tree.limiter);
+}
+
+void NetworkThrottler::leaveTreeLocked(uint32_t pid, uint32_t root) {
+    auto& shard = throttles_.shard(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const ThrottleInfo* existing = shard.find(pid);
+    if (existing && existing->treeRoot == root) {
+        stopThrottlingLocked(shard, pid);
+    }
+}
+
+bool NetworkThrottler::stopTreeLocked(uint32_t root) {
+    auto it = trees_.find(root);
+    if (it == trees_.end()) {
+        return false;
+    }
+    for (uint32_t pid : it->second.members) {
+        if (pid != root) {
+            leaveTreeLocked(pid, root);
+        }
+    }
+    leaveTreeLocked(root, root);
+    shaper_.removeGroup(it->second.groupId);
+    trees_.erase(it);
+    return true;
+}
+
+size_t NetworkThrottler::updateTrees() {
+    std::lock_guard<std::mutex> treesLock(treesMutex_);
+    return syncTreesLocked();
+}
+
+size_t NetworkThrottler::syncTreesLocked() {
+    if (trees_.empty()) {
+        return 0;
+    }
+    // One snapshot gives every process's parent. Windows does not clear a parent PID when
+    // the parent exits, so a child is only adopted while its parent is a live member.
+    std::unordered_map<uint32_t, std::vector<uint32_t>> children;
+    std::unordered_set<uint32_t> alive;
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (snapshot == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    PROCESSENTRY32W entry;
+    entry.dwSize = sizeof(PROCESSENTRY32W);
+    for (BOOL more = Process32FirstW(snapshot, &entry); more; more = Process32NextW(snapshot, &entry)) {
+        alive.insert(entry.th32ProcessID);
+        if (entry.th32ParentProcessID != entry.th32ProcessID) {
+            children[entry.th32ParentProcessID].push_back(entry.th32ProcessID);
+        }
+    }
+    CloseHandle(snapshot);
+    
+    size_t changed = 0;
+    std::vector<uint32_t> finished;
+    for (auto& item : trees_) {
+        const uint32_t root = item.first;
+        TreeInfo& tree = item.second;
+        for (auto it = tree.members.begin(); it != tree.members.end();) {
+            if (alive.count(*it) != 0) {
+                ++it;
+                continue;
+            }
+            if (*it != root) {
+                leaveTreeLocked(*it, root);
+            }
+            it = tree.members.erase(it);
+            ++changed;
+        }
+        if (tree.members.empty()) {
+            finished.push_back(root);
+            continue;
+        }
+        std::vector<uint32_t> frontier(tree.members.begin(), tree.members.end());
+        while (!frontier.empty()) {
+            const uint32_t parent = frontier.back();
+            frontier.pop_back();
+            auto found = children.find(parent);
+            if (found == children.end()) {
+                continue;
+            }
+            for (uint32_t child : found->second) {
+                if (tree.members.count(child) == 0 && joinTreeLocked(child, root, tree)) {
+                    tree.members.insert(child);
+                    frontier.push_back(child);
+                    ++changed;
+                }
+            }
+        }
+    }
+    for (uint32_t root : finished) {
+        stopTreeLocked(root);
+    }
+    return changed;
+}
+
+std::vector<uint32_t> NetworkThrottler::treeMembers(uint32_t rootPid) const {
+    std::lock_guard<std::mutex> treesLock(treesMutex_);
+    auto it = trees_.find(rootPid);
+    if (it == trees_.end()) {
+        return {};
+    }
+    std::vector<uint32_t> members(it->second.members.begin(), it->second.members.end());
+    std::sort(members.begin(), members.end());
+    return members;
+}
+
 bool NetworkThrottler::createFilter(uint32_t pid, uint64_t downloadLimit, uint64_t uploadLimit, UINT64& filterId) {
     // This is a placeholder implementation
     // Real implementation would use Windows Filtering Platform (WFP) API
@@ -86,33 +424,59 @@ bool NetworkThrottler::createFilter(uint32_t pid, uint64_t downloadLimit, uint64
     // 2. Use traffic shaping/shaping filters
     // 3. Apply rate limiting
     
-    // Simplified: Use a dummy filter ID for now
-    // In production, implement proper WFP filter creation
-    filterId = static_cast<UINT64>(pid) + 1000000;
-    
-    // Note: Windows doesn't have a built-in per-process bandwidth limiter
-    // You would need to use third-party solutions or implement a more complex
-    // approach using WFP with traffic shaping
+    // Rate decisions are made by the per-process token buckets (see ProcessLimiter),
+    // so no WFP filter is installed yet and the filter ID stays 0.
+    // Note: WFP cannot shape from user mode; delaying packets needs a callout driver
+    // that consults the limiter returned by getLimiter()
+    filterId = 0;
     
     return true;
 }
 
 bool NetworkThrottler::stopThrottling(uint32_t pid) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    ThrottleInfo info;
+    if (throttles_.find(pid, info) && info.treeRoot != 0) {
+        std::lock_guard<std::mutex> treesLock(treesMutex_);
+        return stopTreeLocked(info.treeRoot);
+    }
     
-    auto it = activeThrottles_.find(pid);
-    if (it == activeThrottles_.end()) {
+    auto& shard = throttles_.shard(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return stopThrottlingLocked(shard, pid);
+}
+
+bool NetworkThrottler::stopThrottlingLocked(ThrottleTable<ThrottleInfo>::Shard& shard, uint32_t pid) {
+    const ThrottleInfo* info = shard.find(pid);
+    if (!info) {
         return false;
     }
     
-    if (engineHandle_) {
-        deleteFilter(it->second.filterId);
+    if (engineHandle_ && info->filterId != 0) {
+        deleteFilter(info->filterId);
     }
     
-    activeThrottles_.erase(it);
+    shaper_.detachProcess(pid);
+    flowCache_.removeProcess(pid);
+    shard.erase(pid);
     return true;
 }
 
+size_t NetworkThrottler::stopAll() {
+    size_t stopped = 0;
+    for (uint32_t pid : throttles_.pids()) {
+        stopped += stopThrottling(pid) ? 1 : 0;
+    }
+    return stopped;
+}
+
+std::vector<ThrottleStatus> NetworkThrottler::activeThrottles() const {
+    std::vector<ThrottleStatus> result;
+    throttles_.forEach([&result](uint32_t pid, const ThrottleInfo& info) {
+        result.emplace_back(pid, info.download.ceil, info.upload.ceil, info.treeRoot);
+    });
+    return result;
+}
+
 bool NetworkThrottler::deleteFilter(UINT64 filterId) {
     if (!engineHandle_) {
         return false;
@@ -124,15 +488,71 @@ bool NetworkThrottler::deleteFilter(UINT64 filterId) {
 }
 
 bool NetworkThrottler::isThrottlingActive(uint32_t pid) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = activeThrottles_.find(pid);
-    return it != activeThrottles_.end() && it->second.active;
+    return throttles_.contains(pid);
+}
+
+std::shared_ptr<ProcessLimiter> NetworkThrottler::getLimiter(uint32_t pid) const {
+    ThrottleInfo info;
+    return throttles_.find(pid, info) ? info.limiter : nullptr;
+}
+
+void NetworkThrottler::setLinkCapacity(uint64_t downloadBytesPerSec, uint64_t uploadBytesPerSec) {
+    shaper_.setLinkCapacity(downloadBytesPerSec, uploadBytesPerSec);
 }
 
-std::vector<uint64_t> NetworkThrottler::getProcessSockets(uint32_t pid) {
-    // Get network connections for the process
-    // This would require using GetExtendedTcpTable/GetExtendedUdpTable
-    // and matching PIDs
-    return {};
+uint32_t NetworkThrottler::createGroup(uint32_t parentGroupId, const ShapingRates& download, const ShapingRates& upload) {
+    return shaper_.createGroup(parentGroupId, download, upload);
 }
 
+bool NetworkThrottler::removeGroup(uint32_t groupId) {
+    return shaper_.removeGroup(groupId);
+}
+
+size_t NetworkThrottler::seedFlowCache(const std::vector<FlowEntry>& entries) {
+    // Classify the processes' existing TCP connections up front so their first packets hit
+    // the cache. UDP tables only list local endpoints and are learned per flow instead.
+    size_t seeded = 0;
+    std::vector<unsigned char> buffer;
+    auto entryFor = [&entries](DWORD pid) -> const FlowEntry* {
+        auto it = std::lower_bound(entries.begin(), entries.end(), pid,
+                                   [](const FlowEntry& entry, DWORD value) { return entry.pid < value; });
+        return it != entries.end() && it->pid == pid ? &*it : nullptr;
+    };
+    
+    DWORD size = 0;
+    GetExtendedTcpTable(NULL, &size, FALSE, AF_INET, TCP_TABLE_OWNER_PID_CONNECTIONS, 0);
+    buffer.resize(size + size / 4);
+    size = static_cast<DWORD>(buffer.size());
+    if (GetExtendedTcpTable(buffer.data(), &size, FALSE, AF_INET, TCP_TABLE_OWNER_PID_CONNECTIONS, 0) == NO_ERROR) {
+        const auto* table = reinterpret_cast<const MIB_TCPTABLE_OWNER_PID*>(buffer.data());
+        for (DWORD i = 0; i < table->dwNumEntries; ++i) {
+            const MIB_TCPROW_OWNER_PID& row = table->table[i];
+            const FlowEntry* entry = entryFor(row.dwOwningPid);
+            if (!entry) {
+                continue;
+            }
+            FlowKey key = FlowKey::ipv4(IPPROTO_TCP, ntohl(row.dwLocalAddr), ntohs(static_cast<u_short>(row.dwLocalPort)),
+                                        ntohl(row.dwRemoteAddr), ntohs(static_cast<u_short>(row.dwRemotePort)));
+            seeded += flowCache_.insert(key, *entry) ? 1 : 0;
+        }
+    }
+    
+    size = 0;
+    GetExtendedTcpTable(NULL, &size, FALSE, AF_INET6, TCP_TABLE_OWNER_PID_CONNECTIONS, 0);
+    buffer.resize(size + size / 4);
+    size = static_cast<DWORD>(buffer.size());
+    if (GetExtendedTcpTable(buffer.data(), &size, FALSE, AF_INET6, TCP_TABLE_OWNER_PID_CONNECTIONS, 0) == NO_ERROR) {
+        const auto* table = reinterpret_cast<const MIB_TCP6TABLE_OWNER_PID*>(buffer.data());
+        for (DWORD i = 0; i < table->dwNumEntries; ++i) {
+            const MIB_TCP6ROW_OWNER_PID& row = table->table[i];
+            const FlowEntry* entry = entryFor(row.dwOwningPid);
+            if (!entry) {
+                continue;
+            }
+            FlowKey key = FlowKey::ipv6(IPPROTO_TCP, row.ucLocalAddr, ntohs(static_cast<u_short>(row.dwLocalPort)),
+                                        row.ucRemoteAddr, ntohs(static_cast<u_short>(row.dwRemotePort)));
+            seeded += flowCache_.insert(key, *entry) ? 1 : 0;
+        }
+    }
+    return seeded;
+}
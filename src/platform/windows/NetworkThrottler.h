@@ -1,9 +1,18 @@
 #ifndef WINDOWS_NETWORKTHROTTLER_H
 #define WINDOWS_NETWORKTHROTTLER_H
 
+#include "core/FlowCache.h"
+#include "core/ProcessLimiter.h"
+#include "core/ThrottleTable.h"
+#include "core/TrafficShaper.h"
+#include "core/TrtcmPolicer.h"
+#include "../../ProcessInfo.h"
 #include <cstdint>
-#include <map>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <windows.h>
 #include <fwpmu.h>
 #include <fwptypes.h>
@@ -13,27 +22,114 @@ public:
     NetworkThrottler();
     ~NetworkThrottler();
     
+    // Installing WFP filters needs an elevated token
+    static bool requiresElevation() { return true; }
+    
     bool startThrottling(uint32_t pid, uint64_t downloadLimitBytesPerSec, uint64_t uploadLimitBytesPerSec);
+    bool startThrottling(uint32_t pid, uint32_t groupId, const ShapingRates& download, const ShapingRates& upload);
+    // Stopping any member of a throttle tree stops the whole tree
     bool stopThrottling(uint32_t pid);
     bool isThrottlingActive(uint32_t pid) const;
+    // Two-rate three-color policing (RFC 2698) instead of a single limit per direction:
+    // CIR/PIR, CBS/PBS and an action per color. The process's shaper class guarantees
+    // CIR and may borrow up to PIR.
+    bool startPolicing(uint32_t pid, const TrtcmPolicer::Config& download, const TrtcmPolicer::Config& upload);
+    // Changes the limits of a running throttle without restarting it: traffic already
+    // held stays queued and the buckets keep their fill. Fails for throttle tree members
+    // and policed processes.
+    bool updateLimits(uint32_t pid, const ShapingRates& download, const ShapingRates& upload);
+    
+    // Throttle tree: rootPid and all of its descendants share one download and one upload
+    // bucket. Windows has no user-mode notification of new processes short of ETW, so
+    // descendants are found from a Toolhelp snapshot when the tree starts and on every
+    // updateTrees() call. Members cannot be given their own limits; instead each gets a
+    // weight and optional ceiling within the tree from shaper().setFairShare().
+    bool startThrottlingTree(uint32_t rootPid, uint64_t downloadLimitBytesPerSec, uint64_t uploadLimitBytesPerSec);
+    size_t updateTrees();
+    std::vector<uint32_t> treeMembers(uint32_t rootPid) const;
+    
+    // All-or-nothing: the whole set is validated first (nonzero, distinct PIDs), then
+    // applied with the PIDs' shard locks held. If any throttle fails to start, the ones
+    // already applied are undone and the PIDs get back exactly what they had. removeBatch
+    // fails, removing nothing, unless every PID is throttled on its own (not as a tree
+    // member). Since no WFP filters are installed yet, this covers the throttler's own state.
+    bool applyBatch(const std::vector<ThrottleRequest>& requests);
+    bool removeBatch(const std::vector<uint32_t>& pids);
+    
+    // Every active throttle, shard by shard (not an atomic snapshot)
+    std::vector<ThrottleStatus> activeThrottles() const;
+    size_t stopAll();
+    
+    // Token buckets configured by startThrottling; the enforcement path consumes from
+    // them without taking the throttler lock. Returns nullptr if the PID is not throttled.
+    std::shared_ptr<ProcessLimiter> getLimiter(uint32_t pid) const;
+    
+    // Hierarchical limits: link budget -> groups -> processes
+    void setLinkCapacity(uint64_t downloadBytesPerSec, uint64_t uploadBytesPerSec);
+    uint32_t createGroup(uint32_t parentGroupId, const ShapingRates& download, const ShapingRates& upload);
+    bool removeGroup(uint32_t groupId);
+    TrafficShaper& shaper() { return shaper_; }
+    const TrafficShaper& shaper() const { return shaper_; }
+    
+    // 5-tuple -> (pid, group) for per-packet classification. Lookups are lock-free;
+    // flows of a process are dropped when its throttle stops.
+    FlowCache& flowCache() { return flowCache_; }
 
 private:
     struct ThrottleInfo {
+        uint32_t treeRoot; // 0 unless the process belongs to a throttle tree
+        uint32_t groupId;
+        ShapingRates download;
+        ShapingRates upload;
+        std::shared_ptr<ProcessLimiter> limiter;
+        bool policed;
+        TrtcmPolicer::Config downloadPolicer;
+        TrtcmPolicer::Config uploadPolicer;
+        UINT64 filterId; // 0 when no WFP filter is installed
+    };
+    
+    struct TreeInfo {
+        uint32_t groupId; // holds the aggregate limits in the shaper
         uint64_t downloadLimit;
         uint64_t uploadLimit;
-        UINT64 filterId;
-        bool active;
+        std::shared_ptr<ProcessLimiter> limiter; // the buckets every member charges
+        std::unordered_set<uint32_t> members; // live processes; the root's throttle outlives it
+    };
+    
+    struct Undo {
+        uint32_t pid;
+        bool existed;
+        ThrottleInfo previous;
     };
     
-    mutable std::mutex mutex_;
-    std::map<uint32_t, ThrottleInfo> activeThrottles_;
+    // Start and stop hold the PID's shard lock throughout, so operations on one PID are
+    // serialized while different PIDs proceed in parallel
+    ThrottleTable<ThrottleInfo> throttles_;
+    std::mutex engineMutex_; // guards opening the WFP engine on demand
+    TrafficShaper shaper_;
+    FlowCache flowCache_;
     HANDLE engineHandle_;
+    // Taken before any shard lock
+    mutable std::mutex treesMutex_;
+    std::unordered_map<uint32_t, TreeInfo> trees_;
     
     bool initializeWfp();
     void cleanupWfp();
+    bool ensureEngine();
+    bool startThrottlingLocked(ThrottleTable<ThrottleInfo>::Shard& shard, uint32_t pid, uint32_t groupId,
+                               const ShapingRates& download, const ShapingRates& upload, bool seed,
+                               uint32_t treeRoot = 0, std::shared_ptr<ProcessLimiter> limiter = nullptr);
+    bool stopThrottlingLocked(ThrottleTable<ThrottleInfo>::Shard& shard, uint32_t pid);
+    void rollback(const std::vector<Undo>& undo);
+    bool applyPolicers(uint32_t pid, const ThrottleInfo& info);
+    bool joinTreeLocked(uint32_t pid, uint32_t root, const TreeInfo& tree);
+    void leaveTreeLocked(uint32_t pid, uint32_t root);
+    bool stopTreeLocked(uint32_t root);
+    size_t syncTreesLocked();
     bool createFilter(uint32_t pid, uint64_t downloadLimit, uint64_t uploadLimit, UINT64& filterId);
     bool deleteFilter(UINT64 filterId);
-    std::vector<uint64_t> getProcessSockets(uint32_t pid);
+    // entries must be sorted by PID; one pass over the connection tables seeds them all
+    size_t seedFlowCache(const std::vector<FlowEntry>& entries);
 };
 
 #endif // WINDOWS_NETWORKTHROTTLER_H
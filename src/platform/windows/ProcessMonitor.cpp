@@ -1,124 +1,274 @@
 #include "ProcessMonitor.h"
 #include "ProcessInfo.h"
+#include "core/MonotonicClock.h"
 #include <algorithm>
 #include <vector>
 #include <string>
 
-ProcessMonitor::ProcessMonitor() {
-    refresh();
+namespace {
+
+constexpr size_t MIN_STRING_BYTES = 256 * 1024; // before compacting the arena
+
+// Into a string that is reused, so converting allocates only when it grows
+void toUtf8(const WCHAR* text, int length, std::string& result) {
+    result.clear();
+    if (length <= 0) {
+        return;
+    }
+    int size = WideCharToMultiByte(CP_UTF8, 0, text, length, NULL, 0, NULL, NULL);
+    if (size > 0) {
+        result.resize(size);
+        WideCharToMultiByte(CP_UTF8, 0, text, length, &result[0], size, NULL, NULL);
+    }
 }
 
+uint64_t toUint64(const FILETIME& time) {
+    return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+}
+
+} // namespace
+
+ProcessMonitor::ProcessMonitor()
+    : generation_(0), stringsLimit_(MIN_STRING_BYTES), listStale_(true), orderStale_(true), sampleCount_(0) {}
+
 ProcessMonitor::~ProcessMonitor() = default;
 
-std::vector<ProcessInfo> ProcessMonitor::getRunningProcesses() {
-    return processes_;
+std::shared_ptr<const ProcessList> ProcessMonitor::getRunningProcesses() {
+    if (listStale_) {
+        buildList();
+    }
+    return list_;
+}
+
+void ProcessMonitor::buildList() {
+    // Records stay where they are in cache_ until they are erased, so the order holds
+    // until the processes themselves change, not just their traffic
+    if (orderStale_) {
+        order_.clear();
+        order_.reserve(cache_.size());
+        for (const auto& entry : cache_) {
+            order_.emplace_back(static_cast<uint32_t>(entry.first), &entry.second.record);
+        }
+        std::sort(order_.begin(), order_.end());
+        orderStale_ = false;
+    }
+    // Only views are copied; the list pins the arena blocks they point into
+    std::shared_ptr<ProcessList> list = listPool_.acquire();
+    list->reserve(order_.size());
+    for (const auto& entry : order_) {
+        list->append(*entry.second);
+    }
+    list->strings = strings_.pin();
+    list_ = std::move(list);
+    listStale_ = false;
+}
+
+void ProcessMonitor::compactStrings() {
+    // Lists handed out keep the old blocks for as long as they are held
+    StringArena strings;
+    for (auto& entry : cache_) {
+        ProcessRecord& record = entry.second.record;
+        record.name = strings.intern(record.name);
+        record.path = strings.intern(record.path);
+    }
+    strings_ = std::move(strings);
+    stringsLimit_ = std::max(MIN_STRING_BYTES, 2 * strings_.bytes());
 }
 
 bool ProcessMonitor::refresh() {
-    processes_.clear();
+    return refresh(scratchDelta_);
+}
+
+bool ProcessMonitor::refresh(ProcessDelta& delta) {
+    delta.clear();
     
     HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
     if (snapshot == INVALID_HANDLE_VALUE) {
         return false;
     }
     
+    ++generation_;
+    
+    // PIDs and image names from the snapshot
+    listed_.clear();
     PROCESSENTRY32W entry;
     entry.dwSize = sizeof(PROCESSENTRY32W);
-    
     if (Process32FirstW(snapshot, &entry)) {
         do {
-            ProcessInfo info;
-            if (getProcessInfo(entry.th32ProcessID, info)) {
-                processes_.push_back(info);
-            }
+            listed_.emplace_back();
+            ListedProcess& listed = listed_.back();
+            listed.pid = entry.th32ProcessID;
+            listed.creationTime = 0;
+            lstrcpynW(listed.exeFile, entry.szExeFile, MAX_PATH);
         } while (Process32NextW(snapshot, &entry));
     }
-    
     CloseHandle(snapshot);
     
-    // Sort by PID
-    std::sort(processes_.begin(), processes_.end(),
-              [](const ProcessInfo& a, const ProcessInfo& b) {
-                  return a.pid < b.pid;
-              });
-    
-    return true;
-}
-
-bool ProcessMonitor::getProcessInfo(DWORD pid, ProcessInfo& info) {
-    info.pid = pid;
-    
-    HANDLE hProcess = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, pid);
-    if (hProcess == NULL) {
-        // Try with less privileges
-        hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    // Creation times, one limited handle per process, opened in parallel
+    pool_.run(listed_.size(), [this](size_t index, size_t) {
+        ListedProcess& listed = listed_[index];
+        HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, listed.pid);
         if (hProcess == NULL) {
-            info.name = "unknown";
-            info.path = "";
-            return true; // Still add to list
+            return;
         }
-    }
+        FILETIME created, exited, kernel, user;
+        if (GetProcessTimes(hProcess, &created, &exited, &kernel, &user)) {
+            listed.creationTime = toUint64(created);
+        }
+        CloseHandle(hProcess);
+    });
     
-    // Get process name
-    WCHAR processName[MAX_PATH];
-    DWORD size = MAX_PATH;
-    if (QueryFullProcessImageNameW(hProcess, 0, processName, &size)) {
-        // Extract filename from path
-        std::wstring wpath(processName);
-        size_t lastSlash = wpath.find_last_of(L"\\/");
-        if (lastSlash != std::wstring::npos) {
-            std::wstring wname = wpath.substr(lastSlash + 1);
-            // Convert to narrow string
-            int len = WideCharToMultiByte(CP_UTF8, 0, wname.c_str(), -1, NULL, 0, NULL, NULL);
-            if (len > 0) {
-                std::vector<char> buffer(len);
-                WideCharToMultiByte(CP_UTF8, 0, wname.c_str(), -1, buffer.data(), len, NULL, NULL);
-                info.name = buffer.data();
-            }
+    for (const ListedProcess& listed : listed_) {
+        const DWORD pid = listed.pid;
+        auto inserted = cache_.try_emplace(pid);
+        CachedProcess& cached = inserted.first->second;
+        bool recycled = !inserted.second && cached.record.creationTime != listed.creationTime;
+        toUtf8(listed.exeFile, lstrlenW(listed.exeFile), exeName_);
+        if (!inserted.second && !recycled && listed.creationTime == 0) {
+            // Protected processes hide their creation time; fall back to the image name
+            recycled = cached.record.name != exeName_;
         }
         
-        // Get full path
-        info.path = getProcessPath(pid);
-    } else {
-        info.name = "unknown";
-        info.path = "";
+        if (inserted.second || recycled) {
+            if (recycled) {
+                accountant_.removeProcess(pid);
+                delta.removed.push_back(cached.record.info());
+            }
+            // The snapshot carries the image name; the full path waits until asked for
+            const std::string_view name = exeName_.empty() ? std::string_view("unknown") : std::string_view(exeName_);
+            cached.record = ProcessRecord(pid, strings_.intern(name));
+            cached.record.creationTime = listed.creationTime;
+            cached.pathResolved = false;
+            delta.added.push_back(cached.record.info());
+        }
+        cached.generation = generation_;
+    }
+    
+    for (auto it = cache_.begin(); it != cache_.end();) {
+        if (it->second.generation != generation_) {
+            accountant_.removeProcess(it->first);
+            delta.removed.push_back(it->second.record.info());
+            it = cache_.erase(it);
+        } else {
+            ++it;
+        }
     }
     
-    CloseHandle(hProcess);
+    if (!delta.empty()) {
+        listStale_ = true;
+        orderStale_ = true;
+    }
+    if (strings_.bytes() > stringsLimit_) {
+        compactStrings();
+    }
     return true;
 }
 
-std::string ProcessMonitor::getProcessPath(DWORD pid) {
-    HANDLE hProcess = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, pid);
-    if (hProcess == NULL) {
-        hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
-        if (hProcess == NULL) {
-            return "";
+size_t ProcessMonitor::resolvePaths(const std::vector<uint32_t>& pids) {
+    pending_.clear();
+    for (uint32_t pid : pids) {
+        auto it = cache_.find(pid);
+        if (it != cache_.end() && !it->second.pathResolved) {
+            pending_.push_back(&it->second);
         }
     }
-    
-    WCHAR processPath[MAX_PATH];
-    DWORD size = MAX_PATH;
-    std::string result;
-    
-    if (QueryFullProcessImageNameW(hProcess, 0, processPath, &size)) {
-        // Convert wide string to UTF-8
-        int len = WideCharToMultiByte(CP_UTF8, 0, processPath, -1, NULL, 0, NULL, NULL);
-        if (len > 0) {
-            std::vector<char> buffer(len);
-            WideCharToMultiByte(CP_UTF8, 0, processPath, -1, buffer.data(), len, NULL, NULL);
-            result = buffer.data();
+    return resolvePending();
+}
+
+size_t ProcessMonitor::resolveAllPaths() {
+    pending_.clear();
+    for (auto& entry : cache_) {
+        if (!entry.second.pathResolved) {
+            pending_.push_back(&entry.second);
         }
     }
-    
-    CloseHandle(hProcess);
-    return result;
+    return resolvePending();
+}
+
+size_t ProcessMonitor::resolvePending() {
+    if (pending_.empty()) {
+        return 0;
+    }
+    // Each task touches only its own cache entry and image; interning is serial. System and
+    // protected processes keep the snapshot's image name and no path.
+    if (images_.size() < pending_.size()) {
+        images_.resize(pending_.size());
+    }
+    pool_.run(pending_.size(), [this](size_t index, size_t) {
+        CachedProcess& cached = *pending_[index];
+        ImageRead& image = images_[index];
+        image.found = false;
+        cached.pathResolved = true;
+        HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, cached.record.pid);
+        if (hProcess == NULL) {
+            return;
+        }
+        // The PID may have been recycled since the refresh; the next one sorts that out
+        FILETIME created, exited, kernel, user;
+        if (cached.record.creationTime != 0 &&
+            (!GetProcessTimes(hProcess, &created, &exited, &kernel, &user) ||
+             toUint64(created) != cached.record.creationTime)) {
+            cached.pathResolved = false;
+            CloseHandle(hProcess);
+            return;
+        }
+        WCHAR processPath[MAX_PATH];
+        DWORD size = MAX_PATH;
+        if (QueryFullProcessImageNameW(hProcess, 0, processPath, &size)) {
+            toUtf8(processPath, static_cast<int>(size), image.path);
+            image.found = true;
+        }
+        CloseHandle(hProcess);
+    });
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        if (!images_[i].found) {
+            continue;
+        }
+        ProcessRecord& record = pending_[i]->record;
+        record.path = strings_.intern(images_[i].path);
+        const size_t lastSlash = record.path.find_last_of("\\/");
+        record.name = strings_.intern(lastSlash != std::string_view::npos ? record.path.substr(lastSlash + 1)
+                                                                          : record.path);
+    }
+    listStale_ = true;
+    if (strings_.bytes() > stringsLimit_) {
+        compactStrings();
+    }
+    return pending_.size();
 }
 
 bool ProcessMonitor::updateNetworkStats() {
-    // TODO: Implement network stats tracking for Windows
-    // Could use GetExtendedTcpTable/GetExtendedUdpTable and match by PID
-    // For now, just return true
+    const uint64_t nowNs = MonotonicClock::nowNs();
+    if (!statsBudget_.due(nowNs)) {
+        return true; // keep the last rates until the budget allows another sample
+    }
+    if (!socketStats_.collect(sockets_)) {
+        return false;
+    }
+    
+    accountant_.beginSample(nowNs);
+    for (const SocketCounters& socket : sockets_) {
+        accountant_.record(socket);
+    }
+    accountant_.endSample();
+    
+    for (auto& entry : cache_) {
+        ProcessRecord& record = entry.second.record;
+        TrafficAccountant::ProcessTraffic traffic;
+        if (!accountant_.processTraffic(entry.first, traffic)) {
+            continue;
+        }
+        record.downloadSpeed = static_cast<uint64_t>(traffic.downloadRate + 0.5);
+        record.uploadSpeed = static_cast<uint64_t>(traffic.uploadRate + 0.5);
+        record.totalDownloaded = traffic.totalDownloaded;
+        record.totalUploaded = traffic.totalUploaded;
+    }
+    listStale_ = true;
+    ++sampleCount_;
+    statsBudget_.spent(nowNs, MonotonicClock::nowNs());
     return true;
 }
 
+bool ProcessMonitor::getTraffic(uint32_t pid, TrafficAccountant::ProcessTraffic& traffic) const {
+    return accountant_.processTraffic(pid, traffic);
+}
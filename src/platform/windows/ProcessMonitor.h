@@ -2,25 +2,104 @@
 #define WINDOWS_PROCESSMONITOR_H
 
 #include "../../ProcessInfo.h"
+#include "../../ProcessList.h"
+#include "SocketStatsCollector.h"
+#include "core/SamplingBudget.h"
+#include "core/StringArena.h"
+#include "core/TaskPool.h"
+#include "core/TrafficAccountant.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <windows.h>
 #include <tlhelp32.h>
 #include <psapi.h>
 
+// Windows process enumeration.
+//
+// Processes are kept in a persistent table keyed by PID and creation time. Each refresh
+// takes a Toolhelp snapshot for the PIDs and image names, then opens every process once,
+// for its creation time only, with the OpenProcess calls spread over a TaskPool, and
+// merges the results serially. The full image path is queried and converted to UTF-8 by
+// resolvePaths(), only for the PIDs asked for, and once per process lifetime.
+//
+// Names and paths are interned in a StringArena that lives across refreshes, so a process
+// seen again costs no string copies, and getRunningProcesses() shares one immutable
+// ProcessList until something changes. Once the arena holds twice the strings it held
+// after the last compaction, the ones still in use move to a new arena.
+//
+// updateNetworkStats() samples per-connection TCP counters (ESTATS) and lets a
+// TrafficAccountant turn them into per-process totals and rates.
+// Sampling backs off so that it stays within SamplingBudget's share of one core.
 class ProcessMonitor {
 public:
     ProcessMonitor();
     ~ProcessMonitor();
     
-    std::vector<ProcessInfo> getRunningProcesses();
+    // Sorted by PID, as of the last refresh() and network sample. The first refresh() is
+    // up to the caller; a new monitor knows no processes. The list never changes; calls
+    // in between changes return the same one.
+    std::shared_ptr<const ProcessList> getRunningProcesses();
     bool refresh();
+    // Rescans and fills `delta` with the difference from the previous snapshot
+    bool refresh(ProcessDelta& delta);
+    // Resolves the image paths of these processes, where not known yet; returns how many
+    // were looked up
+    size_t resolvePaths(const std::vector<uint32_t>& pids);
+    size_t resolveAllPaths();
     bool updateNetworkStats();
+    // Rates and connection RTTs of a process as of the last network sample
+    bool getTraffic(uint32_t pid, TrafficAccountant::ProcessTraffic& traffic) const;
+    // Network samples taken so far; updateNetworkStats() skips sampling while over budget
+    uint64_t sampleCount() const { return sampleCount_; }
 
 private:
-    std::vector<ProcessInfo> processes_;
-    bool getProcessInfo(DWORD pid, ProcessInfo& info);
-    std::string getProcessPath(DWORD pid);
+    struct CachedProcess {
+        uint64_t generation; // refresh pass that last saw the PID
+        bool pathResolved;
+        ProcessRecord record;
+    };
+    
+    // One snapshot entry, with the creation time filled in by the parallel pass
+    struct ListedProcess {
+        DWORD pid;
+        uint64_t creationTime; // 0 if the process could not be opened
+        WCHAR exeFile[MAX_PATH];
+    };
+    
+    // One image path as queried by the parallel pass
+    struct ImageRead {
+        bool found; // false for system and protected processes
+        std::string path;
+    };
+    
+    size_t resolvePending();
+    void buildList();
+    void compactStrings();
+    
+    uint64_t generation_;
+    TaskPool pool_;
+    std::vector<ListedProcess> listed_;
+    std::vector<CachedProcess*> pending_; // paths to resolve
+    std::vector<ImageRead> images_; // by pending_ entry
+    std::string exeName_;
+    ProcessDelta scratchDelta_;
+    std::unordered_map<DWORD, CachedProcess> cache_;
+    StringArena strings_; // names and paths of cache_
+    size_t stringsLimit_; // compact beyond this many bytes
+    ProcessListPool listPool_;
+    std::shared_ptr<const ProcessList> list_;
+    bool listStale_;
+    std::vector<std::pair<uint32_t, const ProcessRecord*>> order_; // cache_ by PID
+    bool orderStale_;
+    
+    SocketStatsCollector socketStats_;
+    TrafficAccountant accountant_;
+    SamplingBudget statsBudget_;
+    std::vector<SocketCounters> sockets_;
+    uint64_t sampleCount_;
 };
 
 #endif // WINDOWS_PROCESSMONITOR_H
-
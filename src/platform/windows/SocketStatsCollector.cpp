@@ -0,0 +1,172 @@
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <tcpestats.h>
+
+#include "SocketStatsCollector.h"
+
+#include <climits>
+#include <cstring>
+
+namespace {
+
+// FNV-1a over the connection's identifying fields
+uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+// Fetches a TCP table into `table`, growing it as IP Helper asks
+bool readTable(std::vector<unsigned char>& table, ULONG family) {
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        DWORD size = static_cast<DWORD>(table.size());
+        DWORD result = GetExtendedTcpTable(table.empty() ? NULL : table.data(), &size, FALSE, family,
+                                           TCP_TABLE_OWNER_PID_CONNECTIONS, 0);
+        if (result == NO_ERROR) {
+            return true;
+        }
+        if (result != ERROR_INSUFFICIENT_BUFFER) {
+            return false;
+        }
+        table.resize(size + size / 4); // connections may appear between the two calls
+    }
+    return false;
+}
+
+// Smoothed and minimum RTT from the path statistics (reported in milliseconds); both stay
+// 0 if path collection could not be switched on
+template <typename Row, typename GetStats>
+void readPathRtt(GetStats getStats, Row& row, uint32_t& rttUs, uint32_t& minRttUs) {
+    TCP_ESTATS_PATH_ROD_v0 path;
+    std::memset(&path, 0, sizeof(path));
+    if (getStats(&row, TcpConnectionEstatsPath, NULL, 0, 0, NULL, 0, 0, reinterpret_cast<PUCHAR>(&path), 0,
+                 sizeof(path)) != NO_ERROR) {
+        return;
+    }
+    rttUs = path.SmoothedRtt * 1000;
+    minRttUs = path.MinRtt != ULONG_MAX ? path.MinRtt * 1000 : 0;
+}
+
+} // namespace
+
+SocketStatsCollector::SocketStatsCollector() = default;
+
+SocketStatsCollector::~SocketStatsCollector() = default;
+
+bool SocketStatsCollector::collect(std::vector<SocketCounters>& sockets) {
+    sockets.clear();
+    seen_.clear();
+    const bool v4 = collectV4(sockets);
+    const bool v6 = collectV6(sockets);
+
+    // Forget connections that closed so the set does not grow without bound
+    for (auto it = enabled_.begin(); it != enabled_.end();) {
+        if (seen_.count(*it) == 0) {
+            it = enabled_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return v4 || v6;
+}
+
+bool SocketStatsCollector::collectV4(std::vector<SocketCounters>& sockets) {
+    if (!readTable(table_, AF_INET)) {
+        return false;
+    }
+
+    const auto* table = reinterpret_cast<const MIB_TCPTABLE_OWNER_PID*>(table_.data());
+    for (DWORD i = 0; i < table->dwNumEntries; ++i) {
+        const MIB_TCPROW_OWNER_PID& owned = table->table[i];
+        MIB_TCPROW row;
+        row.dwState = owned.dwState;
+        row.dwLocalAddr = owned.dwLocalAddr;
+        row.dwLocalPort = owned.dwLocalPort;
+        row.dwRemoteAddr = owned.dwRemoteAddr;
+        row.dwRemotePort = owned.dwRemotePort;
+
+        uint64_t id = hashBytes(FNV_OFFSET, &row.dwLocalAddr, sizeof(DWORD) * 4);
+        id = hashBytes(id, &owned.dwOwningPid, sizeof(owned.dwOwningPid));
+        seen_.insert(id);
+
+        if (enabled_.insert(id).second) {
+            TCP_ESTATS_DATA_RW_v0 rw;
+            rw.EnableCollection = TRUE;
+            SetPerTcpConnectionEStats(&row, TcpConnectionEstatsData, reinterpret_cast<PUCHAR>(&rw), 0,
+                                      sizeof(rw), 0);
+            TCP_ESTATS_PATH_RW_v0 pathRw;
+            pathRw.EnableCollection = TRUE;
+            SetPerTcpConnectionEStats(&row, TcpConnectionEstatsPath, reinterpret_cast<PUCHAR>(&pathRw), 0,
+                                      sizeof(pathRw), 0);
+        }
+
+        TCP_ESTATS_DATA_ROD_v0 rod;
+        std::memset(&rod, 0, sizeof(rod));
+        if (GetPerTcpConnectionEStats(&row, TcpConnectionEstatsData, NULL, 0, 0, NULL, 0, 0,
+                                      reinterpret_cast<PUCHAR>(&rod), 0, sizeof(rod)) != NO_ERROR) {
+            continue;
+        }
+        uint32_t rttUs = 0;
+        uint32_t minRttUs = 0;
+        readPathRtt(GetPerTcpConnectionEStats, row, rttUs, minRttUs);
+        sockets.push_back(SocketCounters{id, owned.dwOwningPid, rod.DataBytesIn, rod.DataBytesOut, rttUs, minRttUs});
+    }
+    return true;
+}
+
+bool SocketStatsCollector::collectV6(std::vector<SocketCounters>& sockets) {
+    if (!readTable(table_, AF_INET6)) {
+        return false;
+    }
+
+    const auto* table = reinterpret_cast<const MIB_TCP6TABLE_OWNER_PID*>(table_.data());
+    for (DWORD i = 0; i < table->dwNumEntries; ++i) {
+        const MIB_TCP6ROW_OWNER_PID& owned = table->table[i];
+        MIB_TCP6ROW row;
+        std::memset(&row, 0, sizeof(row));
+        row.State = static_cast<MIB_TCP_STATE>(owned.dwState);
+        std::memcpy(&row.LocalAddr, owned.ucLocalAddr, sizeof(owned.ucLocalAddr));
+        row.dwLocalScopeId = owned.dwLocalScopeId;
+        row.dwLocalPort = owned.dwLocalPort;
+        std::memcpy(&row.RemoteAddr, owned.ucRemoteAddr, sizeof(owned.ucRemoteAddr));
+        row.dwRemoteScopeId = owned.dwRemoteScopeId;
+        row.dwRemotePort = owned.dwRemotePort;
+
+        uint64_t id = hashBytes(FNV_OFFSET, owned.ucLocalAddr, sizeof(owned.ucLocalAddr));
+        id = hashBytes(id, &owned.dwLocalPort, sizeof(owned.dwLocalPort));
+        id = hashBytes(id, owned.ucRemoteAddr, sizeof(owned.ucRemoteAddr));
+        id = hashBytes(id, &owned.dwRemotePort, sizeof(owned.dwRemotePort));
+        id = hashBytes(id, &owned.dwOwningPid, sizeof(owned.dwOwningPid));
+        seen_.insert(id);
+
+        if (enabled_.insert(id).second) {
+            TCP_ESTATS_DATA_RW_v0 rw;
+            rw.EnableCollection = TRUE;
+            SetPerTcp6ConnectionEStats(&row, TcpConnectionEstatsData, reinterpret_cast<PUCHAR>(&rw), 0,
+                                       sizeof(rw), 0);
+            TCP_ESTATS_PATH_RW_v0 pathRw;
+            pathRw.EnableCollection = TRUE;
+            SetPerTcp6ConnectionEStats(&row, TcpConnectionEstatsPath, reinterpret_cast<PUCHAR>(&pathRw), 0,
+                                       sizeof(pathRw), 0);
+        }
+
+        TCP_ESTATS_DATA_ROD_v0 rod;
+        std::memset(&rod, 0, sizeof(rod));
+        if (GetPerTcp6ConnectionEStats(&row, TcpConnectionEstatsData, NULL, 0, 0, NULL, 0, 0,
+                                       reinterpret_cast<PUCHAR>(&rod), 0, sizeof(rod)) != NO_ERROR) {
+            continue;
+        }
+        uint32_t rttUs = 0;
+        uint32_t minRttUs = 0;
+        readPathRtt(GetPerTcp6ConnectionEStats, row, rttUs, minRttUs);
+        sockets.push_back(SocketCounters{id, owned.dwOwningPid, rod.DataBytesIn, rod.DataBytesOut, rttUs, minRttUs});
+    }
+    return true;
+}
@@ -0,0 +1,33 @@
+#ifndef WINDOWS_SOCKETSTATSCOLLECTOR_H
+#define WINDOWS_SOCKETSTATSCOLLECTOR_H
+
+#include "core/TrafficAccountant.h"
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+// Per-connection TCP byte counters from the IP Helper extended statistics (ESTATS).
+//
+// GetExtendedTcpTable lists connections with their owning PID; data and path (RTT)
+// statistics are switched on once per new connection and read back with
+// GetPer[Tcp|Tcp6]ConnectionEStats.
+// Connections are identified by a hash of their 4-tuple and owner. Enabling ESTATS
+// requires an elevated process; without it connections report no bytes.
+class SocketStatsCollector {
+public:
+    SocketStatsCollector();
+    ~SocketStatsCollector();
+
+    // Replaces `sockets` with the current counters; false if no table could be read
+    bool collect(std::vector<SocketCounters>& sockets);
+
+private:
+    bool collectV4(std::vector<SocketCounters>& sockets);
+    bool collectV6(std::vector<SocketCounters>& sockets);
+
+    std::vector<unsigned char> table_;
+    std::unordered_set<uint64_t> enabled_;  // connections with collection switched on
+    std::unordered_set<uint64_t> seen_;
+};
+
+#endif // WINDOWS_SOCKETSTATSCOLLECTOR_H
@@ -0,0 +1,331 @@
+#include "PacketClassifier.h"
+
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace {
+
+constexpr uint16_t LINKTYPE_NULL = 0;
+constexpr uint16_t LINKTYPE_ETHERNET = 1;
+constexpr uint16_t LINKTYPE_RAW = 101;
+constexpr uint16_t LINKTYPE_LINUX_SLL = 113;
+constexpr uint16_t LINKTYPE_IPV4 = 228;
+constexpr uint16_t LINKTYPE_IPV6 = 229;
+constexpr uint16_t LINKTYPE_LINUX_SLL2 = 276;
+
+constexpr uint16_t ETHERTYPE_IPV4 = 0x0800;
+constexpr uint16_t ETHERTYPE_IPV6 = 0x86dd;
+constexpr uint16_t ETHERTYPE_VLAN = 0x8100;
+constexpr uint16_t ETHERTYPE_QINQ = 0x88a8;
+constexpr uint16_t ETHERTYPE_QINQ_OLD = 0x9100;
+
+constexpr uint8_t PROTO_TCP = 6;
+constexpr uint8_t PROTO_UDP = 17;
+constexpr uint8_t PROTO_ICMP = 1;
+constexpr uint8_t PROTO_SCTP = 132;
+constexpr uint8_t PROTO_UDPLITE = 136;
+
+// FlowCache class ids: what a flow was classified as
+constexpr uint32_t NO_CLASS = 0;
+constexpr uint32_t DOWNLOAD_CLASS = 1;
+constexpr uint32_t UPLOAD_CLASS = 2;
+
+// Extension headers followed in search of the transport header
+constexpr size_t MAX_IPV6_EXTENSIONS = 8;
+
+uint16_t load16(const uint8_t* at) {
+    return static_cast<uint16_t>(at[0] << 8 | at[1]);
+}
+
+void mapIpv4(const uint8_t* address, uint8_t mapped[16]) {
+    std::memset(mapped, 0, 10);
+    mapped[10] = 0xff;
+    mapped[11] = 0xff;
+    std::memcpy(mapped + 12, address, 4);
+}
+
+void readPorts(const uint8_t* transport, uint32_t available, bool firstFragment, PacketHeaders& headers) {
+    headers.sourcePort = 0;
+    headers.destinationPort = 0;
+    const bool hasPorts = headers.protocol == PROTO_TCP || headers.protocol == PROTO_UDP ||
+                          headers.protocol == PROTO_SCTP || headers.protocol == PROTO_UDPLITE;
+    if (hasPorts && firstFragment && available >= 4) {
+        headers.sourcePort = load16(transport);
+        headers.destinationPort = load16(transport + 2);
+    }
+}
+
+bool parseIpv4(const uint8_t* data, uint32_t length, PacketHeaders& headers) {
+    if (length < 20) {
+        return false;
+    }
+    const uint32_t headerLength = (data[0] & 0x0f) * 4u;
+    if (headerLength < 20 || headerLength > length) {
+        return false;
+    }
+    headers.protocol = data[9];
+    mapIpv4(data + 12, headers.source);
+    mapIpv4(data + 16, headers.destination);
+    const bool firstFragment = (load16(data + 6) & 0x1fff) == 0;
+    readPorts(data + headerLength, length - headerLength, firstFragment, headers);
+    return true;
+}
+
+bool parseIpv6(const uint8_t* data, uint32_t length, PacketHeaders& headers) {
+    if (length < 40) {
+        return false;
+    }
+    std::memcpy(headers.source, data + 8, 16);
+    std::memcpy(headers.destination, data + 24, 16);
+    uint8_t next = data[6];
+    uint32_t offset = 40;
+    bool firstFragment = true;
+    for (size_t i = 0; i < MAX_IPV6_EXTENSIONS; ++i) {
+        uint32_t extension;
+        if (next == 0 || next == 43 || next == 60) { // hop-by-hop, routing, destination options
+            if (length - offset < 8) {
+                break;
+            }
+            extension = (data[offset + 1] + 1u) * 8;
+        } else if (next == 44) { // fragment
+            if (length - offset < 8) {
+                break;
+            }
+            firstFragment = (load16(data + offset + 2) & 0xfff8) == 0;
+            extension = 8;
+        } else if (next == 51) { // authentication header
+            if (length - offset < 8) {
+                break;
+            }
+            extension = (data[offset + 1] + 2u) * 4;
+        } else {
+            break;
+        }
+        next = data[offset];
+        offset = extension > length - offset ? length : offset + extension;
+    }
+    headers.protocol = next;
+    readPorts(data + offset, length - offset, firstFragment, headers);
+    return true;
+}
+
+bool parseNetwork(uint16_t etherType, const uint8_t* data, uint32_t length, PacketHeaders& headers) {
+    if (etherType == ETHERTYPE_IPV4) {
+        return parseIpv4(data, length, headers);
+    }
+    if (etherType == ETHERTYPE_IPV6) {
+        return parseIpv6(data, length, headers);
+    }
+    return false;
+}
+
+bool parseRawIp(const uint8_t* data, uint32_t length, PacketHeaders& headers) {
+    if (length < 1) {
+        return false;
+    }
+    const uint8_t version = data[0] >> 4;
+    return version == 4 ? parseIpv4(data, length, headers)
+                        : version == 6 && parseIpv6(data, length, headers);
+}
+
+bool parsePrefix(const std::string& text, uint8_t address[16], uint32_t& prefixLength) {
+    const size_t slash = text.find('/');
+    const std::string host = text.substr(0, slash);
+    uint8_t ipv4[4];
+    uint32_t maximum;
+    if (inet_pton(AF_INET, host.c_str(), ipv4) == 1) {
+        mapIpv4(ipv4, address);
+        maximum = 32;
+    } else if (inet_pton(AF_INET6, host.c_str(), address) == 1) {
+        maximum = 128;
+    } else {
+        return false;
+    }
+    uint32_t length = maximum;
+    if (slash != std::string::npos) {
+        char* end = nullptr;
+        const unsigned long value = std::strtoul(text.c_str() + slash + 1, &end, 10);
+        if (*end != '\0' || end == text.c_str() + slash + 1 || value > maximum) {
+            return false;
+        }
+        length = static_cast<uint32_t>(value);
+    }
+    // IPv4 prefixes cover the mapped part of the address
+    prefixLength = maximum == 32 ? length + 96 : length;
+    return true;
+}
+
+bool parsePorts(const std::string& text, uint16_t ports[2]) {
+    char* end = nullptr;
+    const unsigned long low = std::strtoul(text.c_str(), &end, 10);
+    unsigned long high = low;
+    if (*end == '-') {
+        high = std::strtoul(end + 1, &end, 10);
+    }
+    if (*end != '\0' || low > high || high > 65535) {
+        return false;
+    }
+    ports[0] = static_cast<uint16_t>(low);
+    ports[1] = static_cast<uint16_t>(high);
+    return true;
+}
+
+bool parseProtocol(const std::string& text, int& protocol) {
+    if (text == "tcp") {
+        protocol = PROTO_TCP;
+    } else if (text == "udp") {
+        protocol = PROTO_UDP;
+    } else if (text == "icmp") {
+        protocol = PROTO_ICMP;
+    } else {
+        char* end = nullptr;
+        const unsigned long value = std::strtoul(text.c_str(), &end, 10);
+        if (*end != '\0' || end == text.c_str() || value > 255) {
+            return false;
+        }
+        protocol = static_cast<int>(value);
+    }
+    return true;
+}
+
+bool inPrefix(const uint8_t address[16], const uint8_t prefix[16], uint32_t length) {
+    const uint32_t bytes = length / 8;
+    if (std::memcmp(address, prefix, bytes) != 0) {
+        return false;
+    }
+    const uint32_t bits = length % 8;
+    if (bits == 0) {
+        return true;
+    }
+    const uint8_t mask = static_cast<uint8_t>(0xff << (8 - bits));
+    return (address[bytes] & mask) == (prefix[bytes] & mask);
+}
+
+} // namespace
+
+bool parsePacketHeaders(uint16_t linkType, const uint8_t* data, uint32_t length, PacketHeaders& headers) {
+    switch (linkType) {
+    case LINKTYPE_ETHERNET: {
+        uint32_t offset = 12;
+        while (length >= offset + 2) {
+            const uint16_t etherType = load16(data + offset);
+            if (etherType == ETHERTYPE_VLAN || etherType == ETHERTYPE_QINQ || etherType == ETHERTYPE_QINQ_OLD) {
+                offset += 4;
+                continue;
+            }
+            return parseNetwork(etherType, data + offset + 2, length - offset - 2, headers);
+        }
+        return false;
+    }
+    case LINKTYPE_LINUX_SLL:
+        return length >= 16 && parseNetwork(load16(data + 14), data + 16, length - 16, headers);
+    case LINKTYPE_LINUX_SLL2:
+        return length >= 20 && parseNetwork(load16(data), data + 20, length - 20, headers);
+    case LINKTYPE_NULL:
+        // Address family in the capturing host's byte order; the IP version says the same
+        return length >= 4 && parseRawIp(data + 4, length - 4, headers);
+    case LINKTYPE_RAW:
+    case LINKTYPE_IPV4:
+    case LINKTYPE_IPV6:
+        return parseRawIp(data, length, headers);
+    default:
+        return false;
+    }
+}
+
+PacketClassifier::PacketClassifier(size_t flowCapacity) : cache_(flowCapacity), stats_() {}
+
+bool PacketClassifier::addRule(const std::string& line, std::string& error) {
+    std::istringstream tokens(line);
+    std::string keyword;
+    std::string direction;
+    Rule rule = {};
+    rule.protocol = -1;
+    rule.sourcePorts[1] = 65535;
+    rule.destinationPorts[1] = 65535;
+    if (!(tokens >> keyword >> rule.match.pid >> direction) || keyword != "class" || rule.match.pid == 0) {
+        error = "expected: class PID upload|download [field value]...";
+        return false;
+    }
+    if (direction == "upload") {
+        rule.match.direction = TrafficDirection::Upload;
+    } else if (direction == "download") {
+        rule.match.direction = TrafficDirection::Download;
+    } else {
+        error = "direction must be upload or download";
+        return false;
+    }
+
+    std::string field;
+    std::string value;
+    while (tokens >> field) {
+        if (!(tokens >> value)) {
+            error = "missing value for " + field;
+            return false;
+        }
+        bool valid;
+        if (field == "proto") {
+            valid = parseProtocol(value, rule.protocol);
+        } else if (field == "src") {
+            valid = parsePrefix(value, rule.source.address, rule.source.length);
+        } else if (field == "dst") {
+            valid = parsePrefix(value, rule.destination.address, rule.destination.length);
+        } else if (field == "sport") {
+            valid = parsePorts(value, rule.sourcePorts);
+        } else if (field == "dport") {
+            valid = parsePorts(value, rule.destinationPorts);
+        } else {
+            error = "unknown field " + field;
+            return false;
+        }
+        if (!valid) {
+            error = "bad " + field + " " + value;
+            return false;
+        }
+    }
+    rules_.push_back(rule);
+    cache_.invalidateAll();
+    return true;
+}
+
+bool PacketClassifier::matches(const Rule& rule, const PacketHeaders& headers) {
+    return (rule.protocol < 0 || rule.protocol == headers.protocol) &&
+           headers.sourcePort >= rule.sourcePorts[0] && headers.sourcePort <= rule.sourcePorts[1] &&
+           headers.destinationPort >= rule.destinationPorts[0] &&
+           headers.destinationPort <= rule.destinationPorts[1] &&
+           inPrefix(headers.source, rule.source.address, rule.source.length) &&
+           inPrefix(headers.destination, rule.destination.address, rule.destination.length);
+}
+
+bool PacketClassifier::classify(const PacketHeaders& headers, Match& match) {
+    ++stats_.packets;
+    const FlowKey key = FlowKey::ipv6(headers.protocol, headers.source, headers.sourcePort, headers.destination,
+                                      headers.destinationPort);
+    FlowEntry entry;
+    if (!cache_.lookup(key, entry)) {
+        ++stats_.ruleEvaluations;
+        entry.pid = 0;
+        entry.classId = NO_CLASS;
+        for (const Rule& rule : rules_) {
+            if (matches(rule, headers)) {
+                entry.pid = rule.match.pid;
+                entry.classId = rule.match.direction == TrafficDirection::Upload ? UPLOAD_CLASS : DOWNLOAD_CLASS;
+                break;
+            }
+        }
+        if (!cache_.insert(key, entry)) {
+            // Full of live flows: start over rather than match every packet from now on
+            cache_.invalidateAll();
+            cache_.insert(key, entry);
+        }
+    }
+    if (entry.classId == NO_CLASS) {
+        ++stats_.unclassified;
+        return false;
+    }
+    match.pid = entry.pid;
+    match.direction = entry.classId == UPLOAD_CLASS ? TrafficDirection::Upload : TrafficDirection::Download;
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef SIM_PACKETCLASSIFIER_H
+#define SIM_PACKETCLASSIFIER_H
+
+#include "core/FlowCache.h"
+#include "core/ProcessLimiter.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Transport 5-tuple of a captured packet. Addresses are IPv6 or IPv4-mapped, in network
+// byte order; ports are 0 for protocols without them and for non-first fragments.
+struct PacketHeaders {
+    uint8_t protocol;
+    uint8_t source[16];
+    uint8_t destination[16];
+    uint16_t sourcePort;
+    uint16_t destinationPort;
+};
+
+// Decodes the link, network and transport headers of a captured frame. Handles Ethernet
+// (with VLAN tags), Linux cooked captures (SLL and SLL2), BSD loopback and raw IP link
+// types carrying IPv4 or IPv6 (extension headers are skipped). False for anything else,
+// or a frame captured too short to hold the headers.
+bool parsePacketHeaders(uint16_t linkType, const uint8_t* data, uint32_t length, PacketHeaders& headers);
+
+// Maps packets to synthetic processes by 5-tuple rules, first match wins.
+//
+// Rules are written one per line as
+//   class PID upload|download [proto tcp|udp|icmp|N] [src CIDR] [dst CIDR]
+//         [sport P[-Q]] [dport P[-Q]]
+// with omitted fields matching anything. Matching is per packet direction as captured, so
+// the two directions of a connection take one rule each. Results (including "no class")
+// are kept in a FlowCache, so a flow is matched against the rules once.
+class PacketClassifier {
+public:
+    struct Match {
+        uint32_t pid;
+        TrafficDirection direction;
+    };
+
+    struct Stats {
+        uint64_t packets;
+        uint64_t unclassified;
+        uint64_t ruleEvaluations; // flows matched against the rule list
+    };
+
+    explicit PacketClassifier(size_t flowCapacity = FlowCache::DEFAULT_CAPACITY);
+
+    // Parses a "class ..." line; false (see error) if it is malformed
+    bool addRule(const std::string& line, std::string& error);
+    size_t ruleCount() const { return rules_.size(); }
+
+    // False if no rule matches
+    bool classify(const PacketHeaders& headers, Match& match);
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct Prefix {
+        uint8_t address[16];
+        uint32_t length; // bits; 0 matches everything
+    };
+
+    struct Rule {
+        Match match;
+        int protocol; // -1 = any
+        Prefix source;
+        Prefix destination;
+        uint16_t sourcePorts[2];
+        uint16_t destinationPorts[2];
+    };
+
+    static bool matches(const Rule& rule, const PacketHeaders& headers);
+
+    std::vector<Rule> rules_;
+    FlowCache cache_;
+    Stats stats_;
+};
+
+#endif // SIM_PACKETCLASSIFIER_H
@@ -0,0 +1,323 @@
+#include "PcapReader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint32_t PCAP_MAGIC_US = 0xa1b2c3d4;
+constexpr uint32_t PCAP_MAGIC_NS = 0xa1b23c4d;
+constexpr uint32_t PCAP_HEADER_BYTES = 24;
+constexpr uint32_t PCAP_RECORD_BYTES = 16;
+
+constexpr uint32_t PCAPNG_SECTION_HEADER = 0x0a0d0d0a;
+constexpr uint32_t PCAPNG_INTERFACE = 1;
+constexpr uint32_t PCAPNG_PACKET = 2; // obsolete Packet Block
+constexpr uint32_t PCAPNG_SIMPLE_PACKET = 3;
+constexpr uint32_t PCAPNG_ENHANCED_PACKET = 6;
+constexpr uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+constexpr uint16_t PCAPNG_OPT_TSRESOL = 9;
+constexpr uint16_t PCAPNG_OPT_TSOFFSET = 14;
+
+// Larger records are taken as corruption rather than followed
+constexpr uint32_t MAX_RECORD_BYTES = 256u * 1024 * 1024;
+// Read pages are given back in steps of this size
+constexpr uint64_t RELEASE_STEP = 64ULL * 1024 * 1024;
+
+constexpr uint64_t NS_PER_SEC = 1000000000ULL;
+
+} // namespace
+
+PcapReader::PcapReader()
+    : map_(nullptr), size_(0), offset_(0), releasedTo_(0), format_(Format::Pcap), swapped_(false),
+      nanoseconds_(false), linkType_(0), lastTimestampNs_(0) {}
+
+PcapReader::~PcapReader() {
+    close();
+}
+
+void PcapReader::close() {
+    if (map_) {
+        munmap(const_cast<uint8_t*>(map_), size_);
+    }
+    map_ = nullptr;
+    size_ = 0;
+    offset_ = 0;
+    releasedTo_ = 0;
+    interfaces_.clear();
+}
+
+uint16_t PcapReader::read16(uint64_t at) const {
+    uint16_t value;
+    std::memcpy(&value, map_ + at, sizeof(value));
+    return swapped_ ? __builtin_bswap16(value) : value;
+}
+
+uint32_t PcapReader::read32(uint64_t at) const {
+    uint32_t value;
+    std::memcpy(&value, map_ + at, sizeof(value));
+    return swapped_ ? __builtin_bswap32(value) : value;
+}
+
+bool PcapReader::fail(const char* message) {
+    error_ = message; // next() reads nothing more
+    return false;
+}
+
+bool PcapReader::open(const std::string& path) {
+    close();
+    error_.clear();
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error_ = std::strerror(errno);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < 4) {
+        ::close(fd);
+        error_ = "not a capture file";
+        return false;
+    }
+    void* map = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        error_ = std::strerror(errno);
+        return false;
+    }
+    map_ = static_cast<const uint8_t*>(map);
+    size_ = static_cast<uint64_t>(info.st_size);
+    madvise(map, size_, MADV_SEQUENTIAL);
+
+    uint32_t magic;
+    std::memcpy(&magic, map_, sizeof(magic));
+    if (magic == PCAPNG_SECTION_HEADER) {
+        format_ = Format::PcapNg;
+        uint32_t blockLength = 0;
+        if (!readSectionHeader(0, blockLength)) {
+            close();
+            return false;
+        }
+        offset_ = blockLength;
+        return true;
+    }
+
+    format_ = Format::Pcap;
+    swapped_ = magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS);
+    const uint32_t native = swapped_ ? __builtin_bswap32(magic) : magic;
+    if ((native != PCAP_MAGIC_US && native != PCAP_MAGIC_NS) || size_ < PCAP_HEADER_BYTES) {
+        close();
+        error_ = "not a pcap or pcapng file";
+        return false;
+    }
+    nanoseconds_ = native == PCAP_MAGIC_NS;
+    linkType_ = static_cast<uint16_t>(read32(20)); // upper bits may carry FCS information
+    offset_ = PCAP_HEADER_BYTES;
+    return true;
+}
+
+bool PcapReader::next(Packet& packet) {
+    if (!map_ || !error_.empty()) {
+        return false;
+    }
+    releaseConsumed();
+    return format_ == Format::Pcap ? nextPcap(packet) : nextPcapNg(packet);
+}
+
+bool PcapReader::nextPcap(Packet& packet) {
+    if (offset_ == size_) {
+        return false;
+    }
+    if (size_ - offset_ < PCAP_RECORD_BYTES) {
+        return fail("truncated record header");
+    }
+    const uint32_t seconds = read32(offset_);
+    const uint32_t fraction = read32(offset_ + 4);
+    const uint32_t captured = read32(offset_ + 8);
+    const uint32_t wire = read32(offset_ + 12);
+    if (captured > MAX_RECORD_BYTES) {
+        return fail("corrupt record length");
+    }
+    if (size_ - offset_ - PCAP_RECORD_BYTES < captured) {
+        return fail("truncated packet");
+    }
+    packet.timestampNs = seconds * NS_PER_SEC + (nanoseconds_ ? fraction : fraction * 1000ULL);
+    packet.capturedLength = captured;
+    packet.wireLength = std::max(wire, captured);
+    packet.linkType = linkType_;
+    packet.data = map_ + offset_ + PCAP_RECORD_BYTES;
+    offset_ += PCAP_RECORD_BYTES + captured;
+    return true;
+}
+
+bool PcapReader::readSectionHeader(uint64_t at, uint32_t& blockLength) {
+    if (size_ - at < 28) {
+        return fail("truncated section header");
+    }
+    uint32_t magic;
+    std::memcpy(&magic, map_ + at + 8, sizeof(magic));
+    if (magic == PCAPNG_BYTE_ORDER_MAGIC) {
+        swapped_ = false;
+    } else if (magic == __builtin_bswap32(PCAPNG_BYTE_ORDER_MAGIC)) {
+        swapped_ = true;
+    } else {
+        return fail("bad pcapng byte-order magic");
+    }
+    blockLength = read32(at + 4);
+    if (blockLength < 28 || blockLength % 4 != 0 || blockLength > size_ - at) {
+        return fail("corrupt section header");
+    }
+    // Interface ids are per section
+    interfaces_.clear();
+    return true;
+}
+
+bool PcapReader::readInterface(uint64_t at, uint32_t blockLength) {
+    if (blockLength < 20) {
+        return fail("corrupt interface description");
+    }
+    Interface interface;
+    interface.linkType = read16(at + 8);
+    interface.snapLength = read32(at + 12);
+    interface.tsUnitsPerSec = 1000000; // default: microseconds
+    interface.tsShift = 0;
+    interface.tsOffsetSec = 0;
+
+    uint64_t option = at + 16;
+    const uint64_t end = at + blockLength - 4;
+    while (end - option >= 4) {
+        const uint16_t code = read16(option);
+        const uint16_t length = read16(option + 2);
+        if (code == 0 || length > end - option - 4) {
+            break;
+        }
+        if (code == PCAPNG_OPT_TSRESOL && length >= 1) {
+            const uint8_t resolution = map_[option + 4];
+            if (resolution & 0x80) {
+                interface.tsUnitsPerSec = 0;
+                interface.tsShift = std::min<uint32_t>(resolution & 0x7f, 63);
+            } else {
+                interface.tsUnitsPerSec = 1;
+                for (uint8_t i = 0; i < std::min<uint8_t>(resolution, 19); ++i) {
+                    interface.tsUnitsPerSec *= 10;
+                }
+            }
+        } else if (code == PCAPNG_OPT_TSOFFSET && length == 8) {
+            const uint64_t low = read32(option + 4);
+            const uint64_t high = read32(option + 8);
+            interface.tsOffsetSec = static_cast<int64_t>(swapped_ ? low << 32 | high : high << 32 | low);
+        }
+        option += 4 + ((length + 3u) & ~3u);
+    }
+    interfaces_.push_back(interface);
+    return true;
+}
+
+uint64_t PcapReader::toNs(const Interface& interface, uint64_t ticks) const {
+    uint64_t ns;
+    if (interface.tsUnitsPerSec == 0) {
+        ns = static_cast<uint64_t>((static_cast<unsigned __int128>(ticks) * NS_PER_SEC) >> interface.tsShift);
+    } else if (interface.tsUnitsPerSec <= NS_PER_SEC && NS_PER_SEC % interface.tsUnitsPerSec == 0) {
+        ns = ticks * (NS_PER_SEC / interface.tsUnitsPerSec);
+    } else {
+        ns = static_cast<uint64_t>(static_cast<unsigned __int128>(ticks) * NS_PER_SEC / interface.tsUnitsPerSec);
+    }
+    return ns + static_cast<uint64_t>(interface.tsOffsetSec) * NS_PER_SEC;
+}
+
+bool PcapReader::nextPcapNg(Packet& packet) {
+    while (offset_ != size_) {
+        if (size_ - offset_ < 12) {
+            return fail("truncated block");
+        }
+        const uint64_t at = offset_;
+        const uint32_t type = read32(at);
+        uint32_t blockLength = read32(at + 4);
+        if (type == PCAPNG_SECTION_HEADER) {
+            // A new section may switch the byte order, so its length is read after the magic
+            if (!readSectionHeader(at, blockLength)) {
+                return false;
+            }
+            offset_ += blockLength;
+            continue;
+        }
+        if (blockLength < 12 || blockLength % 4 != 0 || blockLength > MAX_RECORD_BYTES) {
+            return fail("corrupt block length");
+        }
+        if (blockLength > size_ - at) {
+            return fail("truncated block");
+        }
+        // Errors below are reported at the start of the block
+        const uint64_t next = at + blockLength;
+
+        uint32_t interfaceId;
+        uint64_t ticks;
+        uint32_t captured;
+        uint32_t wire;
+        uint64_t dataAt;
+        switch (type) {
+        case PCAPNG_INTERFACE:
+            if (!readInterface(at, blockLength)) {
+                return false;
+            }
+            offset_ = next;
+            continue;
+        case PCAPNG_ENHANCED_PACKET:
+        case PCAPNG_PACKET:
+            if (blockLength < 32) {
+                return fail("corrupt packet block");
+            }
+            interfaceId = type == PCAPNG_ENHANCED_PACKET ? read32(at + 8) : read16(at + 8);
+            ticks = static_cast<uint64_t>(read32(at + 12)) << 32 | read32(at + 16);
+            captured = read32(at + 20);
+            wire = read32(at + 24);
+            dataAt = at + 28;
+            break;
+        case PCAPNG_SIMPLE_PACKET:
+            if (blockLength < 16) {
+                return fail("corrupt packet block");
+            }
+            interfaceId = 0;
+            ticks = 0;
+            wire = read32(at + 8);
+            captured = std::min(wire, blockLength - 16);
+            dataAt = at + 12;
+            break;
+        default:
+            offset_ = next;
+            continue;
+        }
+        if (interfaceId >= interfaces_.size()) {
+            return fail("packet for an undescribed interface");
+        }
+        if (captured > blockLength - (dataAt - at) - 4) {
+            return fail("corrupt packet length");
+        }
+        const Interface& interface = interfaces_[interfaceId];
+        if (type != PCAPNG_SIMPLE_PACKET) {
+            lastTimestampNs_ = toNs(interface, ticks);
+        }
+        packet.timestampNs = lastTimestampNs_;
+        packet.capturedLength = captured;
+        packet.wireLength = std::max(wire, captured);
+        packet.linkType = interface.linkType;
+        packet.data = map_ + dataAt;
+        offset_ = next;
+        return true;
+    }
+    return false;
+}
+
+void PcapReader::releaseConsumed() {
+    // Read pages are clean file pages: dropping them only costs a refault if touched again
+    static const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    const uint64_t end = offset_ / page * page;
+    if (end - releasedTo_ >= RELEASE_STEP) {
+        madvise(const_cast<uint8_t*>(map_) + releasedTo_, end - releasedTo_, MADV_DONTNEED);
+        releasedTo_ = end;
+    }
+}
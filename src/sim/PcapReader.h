@@ -0,0 +1,84 @@
+#ifndef SIM_PCAPREADER_H
+#define SIM_PCAPREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Streams packets out of a pcap or pcapng capture.
+//
+// The file is memory-mapped read-only and walked front to back; packets point straight into
+// the mapping, so nothing is copied and captures larger than memory work. Pages already
+// read are dropped from the process every few tens of MB, so the resident set stays small
+// however long the capture.
+//
+// Classic pcap is read in either byte order with microsecond or nanosecond timestamps.
+// pcapng is read section by section (each with its own byte order), with per-interface
+// link types, timestamp resolutions and offsets, from Enhanced, Simple and obsolete Packet
+// Blocks; other blocks are skipped. A truncated or malformed file ends the stream with an
+// error. POSIX only.
+class PcapReader {
+public:
+    struct Packet {
+        uint64_t timestampNs;   // since the epoch, as captured
+        uint32_t capturedLength;
+        uint32_t wireLength;    // original length on the wire
+        uint16_t linkType;      // LINKTYPE_* of the capturing interface
+        const uint8_t* data;    // capturedLength bytes, valid until the reader is closed
+    };
+
+    enum class Format { Pcap, PcapNg };
+
+    PcapReader();
+    ~PcapReader();
+
+    PcapReader(const PcapReader&) = delete;
+    PcapReader& operator=(const PcapReader&) = delete;
+
+    // Maps the file and reads its header; false (see error()) if it is not a capture
+    bool open(const std::string& path);
+    void close();
+
+    // Next packet in file order; false at the end of the file or on an error
+    bool next(Packet& packet);
+
+    Format format() const { return format_; }
+    uint64_t fileSize() const { return size_; }
+    uint64_t offset() const { return offset_; }
+    // Empty unless open() or next() failed; offset() is then where reading stopped
+    const std::string& error() const { return error_; }
+
+private:
+    struct Interface {
+        uint16_t linkType;
+        uint32_t snapLength;
+        uint64_t tsUnitsPerSec; // 0: power-of-two resolution in tsShift
+        uint32_t tsShift;
+        int64_t tsOffsetSec;
+    };
+
+    uint16_t read16(uint64_t at) const;
+    uint32_t read32(uint64_t at) const;
+    bool fail(const char* message);
+    bool nextPcap(Packet& packet);
+    bool nextPcapNg(Packet& packet);
+    bool readSectionHeader(uint64_t at, uint32_t& blockLength);
+    bool readInterface(uint64_t at, uint32_t blockLength);
+    uint64_t toNs(const Interface& interface, uint64_t ticks) const;
+    void releaseConsumed();
+
+    const uint8_t* map_;
+    uint64_t size_;
+    uint64_t offset_;
+    uint64_t releasedTo_;
+    Format format_;
+    bool swapped_;         // file byte order differs from the host's
+    bool nanoseconds_;     // classic pcap timestamp resolution
+    uint16_t linkType_;    // classic pcap
+    uint64_t lastTimestampNs_; // for Simple Packet Blocks, which carry none
+    std::vector<Interface> interfaces_;
+    std::string error_;
+};
+
+#endif // SIM_PCAPREADER_H
@@ -0,0 +1,123 @@
+#include "SyntheticSources.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr uint64_t NS_PER_SEC = 1000000000ULL;
+
+uint64_t pacingGapNs(uint32_t unitBytes, uint64_t rate) {
+    return std::max<uint64_t>(1, unitBytes * NS_PER_SEC / rate);
+}
+
+} // namespace
+
+BulkSource::BulkSource(uint32_t pid, TrafficDirection direction, uint32_t unitBytes, uint64_t windowBytes,
+                       uint64_t startNs)
+    : unit_{pid, direction, unitBytes}, windowBytes_(windowBytes), inFlightBytes_(0), readyNs_(startNs) {}
+
+uint64_t BulkSource::nextAt() const {
+    return inFlightBytes_ + unit_.bytes <= windowBytes_ ? readyNs_ : IDLE;
+}
+
+SimUnit BulkSource::emit(uint64_t nowNs) {
+    (void)nowNs;
+    inFlightBytes_ += unit_.bytes;
+    return unit_;
+}
+
+void BulkSource::onComplete(const SimUnit& unit, uint64_t nowNs, bool sent) {
+    (void)sent;
+    inFlightBytes_ -= unit.bytes;
+    readyNs_ = std::max(readyNs_, nowNs);
+}
+
+BurstySource::BurstySource(uint32_t pid, TrafficDirection direction, uint32_t unitBytes, uint64_t burstBytes,
+                           uint64_t periodNs, uint64_t peakRate, uint64_t seed)
+    : unit_{pid, direction, unitBytes}, burstBytes_(burstBytes), periodNs_(periodNs),
+      gapNs_(pacingGapNs(unitBytes, peakRate)), burstSent_(0) {
+    std::mt19937_64 random(seed);
+    burstStartNs_ = std::uniform_int_distribution<uint64_t>(0, periodNs - 1)(random);
+    nextNs_ = burstStartNs_;
+}
+
+SimUnit BurstySource::emit(uint64_t nowNs) {
+    (void)nowNs;
+    burstSent_ += unit_.bytes;
+    if (burstSent_ < burstBytes_) {
+        nextNs_ += gapNs_;
+    } else {
+        burstStartNs_ += periodNs_;
+        burstSent_ = 0;
+        nextNs_ = burstStartNs_;
+    }
+    return unit_;
+}
+
+RequestResponseSource::RequestResponseSource(uint32_t pid, uint32_t requestBytes, uint32_t responseBytes,
+                                             uint64_t serverNs, uint64_t meanThinkNs, uint64_t seed)
+    : pid_(pid), requestBytes_(requestBytes), responseBytes_(responseBytes), serverNs_(serverNs), random_(seed),
+      think_(1.0 / static_cast<double>(meanThinkNs)), direction_(TrafficDirection::Upload), toEmit_(0),
+      remaining_(0), startedNs_(0), nextNs_(IDLE) {
+    startedNs_ = static_cast<uint64_t>(think_(random_));
+    startPhase(TrafficDirection::Upload, requestBytes_, startedNs_);
+}
+
+void RequestResponseSource::startPhase(TrafficDirection direction, uint32_t bytes, uint64_t atNs) {
+    direction_ = direction;
+    toEmit_ = bytes;
+    remaining_ = bytes;
+    nextNs_ = atNs;
+}
+
+SimUnit RequestResponseSource::emit(uint64_t nowNs) {
+    (void)nowNs;
+    // The whole request or response is offered at once, as a socket write would be
+    const uint32_t bytes = std::min(toEmit_, UNIT_BYTES);
+    toEmit_ -= bytes;
+    if (toEmit_ == 0) {
+        nextNs_ = IDLE;
+    }
+    return SimUnit{pid_, direction_, bytes};
+}
+
+void RequestResponseSource::onComplete(const SimUnit& unit, uint64_t nowNs, bool sent) {
+    (void)sent;
+    remaining_ -= unit.bytes;
+    if (remaining_ != 0) {
+        return;
+    }
+    if (direction_ == TrafficDirection::Upload) {
+        startPhase(TrafficDirection::Download, responseBytes_, nowNs + serverNs_);
+    } else {
+        transactionsNs_.push_back(nowNs - startedNs_);
+        startedNs_ = nowNs + static_cast<uint64_t>(think_(random_));
+        startPhase(TrafficDirection::Upload, requestBytes_, startedNs_);
+    }
+}
+
+ShortFlowSource::ShortFlowSource(uint32_t pid, TrafficDirection direction, uint32_t unitBytes,
+                                 uint64_t meanFlowBytes, uint64_t meanGapNs, uint64_t peakRate, uint64_t seed)
+    : unit_{pid, direction, unitBytes}, unitGapNs_(pacingGapNs(unitBytes, peakRate)), random_(seed),
+      flowBytes_(1.0 / static_cast<double>(meanFlowBytes)), flowGaps_(1.0 / static_cast<double>(meanGapNs)),
+      flowLeft_(0), nextNs_(0) {
+    startFlow(0);
+}
+
+void ShortFlowSource::startFlow(uint64_t afterNs) {
+    // At least one unit per flow
+    flowLeft_ = std::max<uint64_t>(unit_.bytes, static_cast<uint64_t>(flowBytes_(random_)));
+    nextNs_ = afterNs + static_cast<uint64_t>(flowGaps_(random_));
+}
+
+SimUnit ShortFlowSource::emit(uint64_t nowNs) {
+    SimUnit unit = unit_;
+    unit.bytes = static_cast<uint32_t>(std::min<uint64_t>(flowLeft_, unit_.bytes));
+    flowLeft_ -= unit.bytes;
+    if (flowLeft_ > 0) {
+        nextNs_ += unitGapNs_;
+    } else {
+        startFlow(nowNs);
+    }
+    return unit;
+}
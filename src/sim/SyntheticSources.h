@@ -0,0 +1,106 @@
+#ifndef SIM_SYNTHETICSOURCES_H
+#define SIM_SYNTHETICSOURCES_H
+
+#include "TrafficSimulator.h"
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Synthetic workloads for TrafficSimulator. Random ones take a seed, so a run is
+// reproducible.
+
+// Greedy transfer: keeps a window of bytes in flight and offers the next unit as soon as
+// one completes, like a bulk TCP sender whose window is larger than the limit needs
+class BulkSource : public TrafficSource {
+public:
+    BulkSource(uint32_t pid, TrafficDirection direction, uint32_t unitBytes, uint64_t windowBytes,
+               uint64_t startNs = 0);
+
+    uint64_t nextAt() const override;
+    SimUnit emit(uint64_t nowNs) override;
+    void onComplete(const SimUnit& unit, uint64_t nowNs, bool sent) override;
+
+private:
+    SimUnit unit_;
+    uint64_t windowBytes_;
+    uint64_t inFlightBytes_;
+    uint64_t readyNs_;
+};
+
+// On/off sender: every period, a burst of burstBytes paced at peakRate, then silence.
+// Each source starts at a random phase of the period.
+class BurstySource : public TrafficSource {
+public:
+    BurstySource(uint32_t pid, TrafficDirection direction, uint32_t unitBytes, uint64_t burstBytes,
+                 uint64_t periodNs, uint64_t peakRate, uint64_t seed);
+
+    uint64_t nextAt() const override { return nextNs_; }
+    SimUnit emit(uint64_t nowNs) override;
+
+private:
+    SimUnit unit_;
+    uint64_t burstBytes_;
+    uint64_t periodNs_;
+    uint64_t gapNs_; // between units of a burst
+    uint64_t burstStartNs_;
+    uint64_t burstSent_;
+    uint64_t nextNs_;
+};
+
+// Closed-loop request/response: an upload request, then a download response once the
+// request is through (after a fixed server time), then an exponentially distributed think
+// time before the next request. Tracks how long each transaction took.
+class RequestResponseSource : public TrafficSource {
+public:
+    RequestResponseSource(uint32_t pid, uint32_t requestBytes, uint32_t responseBytes, uint64_t serverNs,
+                          uint64_t meanThinkNs, uint64_t seed);
+
+    uint64_t nextAt() const override { return nextNs_; }
+    SimUnit emit(uint64_t nowNs) override;
+    void onComplete(const SimUnit& unit, uint64_t nowNs, bool sent) override;
+
+    // Request start to last response byte, per finished transaction
+    const std::vector<uint64_t>& transactionsNs() const { return transactionsNs_; }
+
+private:
+    static constexpr uint32_t UNIT_BYTES = 1500;
+
+    void startPhase(TrafficDirection direction, uint32_t bytes, uint64_t atNs);
+
+    uint32_t pid_;
+    uint32_t requestBytes_;
+    uint32_t responseBytes_;
+    uint64_t serverNs_;
+    std::mt19937_64 random_;
+    std::exponential_distribution<double> think_;
+    TrafficDirection direction_;
+    uint32_t toEmit_;    // bytes of the current phase not yet offered
+    uint32_t remaining_; // bytes of the current phase not yet completed
+    uint64_t startedNs_;
+    uint64_t nextNs_;
+    std::vector<uint64_t> transactionsNs_;
+};
+
+// Short flows arriving at random: Poisson arrivals of flows with exponentially
+// distributed sizes, each paced at peakRate. Flows of one source share its process.
+class ShortFlowSource : public TrafficSource {
+public:
+    ShortFlowSource(uint32_t pid, TrafficDirection direction, uint32_t unitBytes, uint64_t meanFlowBytes,
+                    uint64_t meanGapNs, uint64_t peakRate, uint64_t seed);
+
+    uint64_t nextAt() const override { return nextNs_; }
+    SimUnit emit(uint64_t nowNs) override;
+
+private:
+    void startFlow(uint64_t afterNs);
+
+    SimUnit unit_;
+    uint64_t unitGapNs_;
+    std::mt19937_64 random_;
+    std::exponential_distribution<double> flowBytes_;
+    std::exponential_distribution<double> flowGaps_;
+    uint64_t flowLeft_;
+    uint64_t nextNs_;
+};
+
+#endif // SIM_SYNTHETICSOURCES_H
@@ -0,0 +1,191 @@
+#include "TrafficSimulator.h"
+
+#include "core/MonotonicClock.h"
+
+#include <algorithm>
+
+namespace {
+
+// Cost of the two clock reads around a timed call, so that it is not charged to the shaper
+uint64_t measureClockOverhead() {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 1000; ++i) {
+        const uint64_t start = MonotonicClock::nowNs();
+        best = std::min(best, MonotonicClock::nowNs() - start);
+    }
+    return best;
+}
+
+uint64_t classKey(uint32_t pid, TrafficDirection direction) {
+    return static_cast<uint64_t>(pid) << 1 | (direction == TrafficDirection::Upload ? 1 : 0);
+}
+
+} // namespace
+
+TrafficSimulator::TrafficSimulator(TrafficShaper& shaper)
+    : shaper_(shaper), inFlight_(shaper.pool().capacity()), cost_(), clockOverheadNs_(measureClockOverhead()),
+      nowNs_(0), measureFromNs_(0), seriesIntervalNs_(0), recordDelays_(true), poolExhausted_(0) {}
+
+size_t TrafficSimulator::addSource(std::unique_ptr<TrafficSource> source) {
+    sources_.push_back(std::move(source));
+    scheduledAt_.push_back(TrafficSource::IDLE);
+    const uint32_t index = static_cast<uint32_t>(sources_.size() - 1);
+    schedule(index);
+    return index;
+}
+
+uint32_t TrafficSimulator::classIndex(uint32_t pid, TrafficDirection direction) {
+    auto inserted = classIndex_.emplace(classKey(pid, direction), static_cast<uint32_t>(classes_.size()));
+    if (inserted.second) {
+        ClassStats stats = {};
+        stats.pid = pid;
+        stats.direction = direction;
+        classes_.push_back(std::move(stats));
+    }
+    return inserted.first->second;
+}
+
+void TrafficSimulator::schedule(uint32_t source) {
+    // Entries are not removed when a source's time changes; stale ones are skipped when
+    // they come up, so only an earlier time needs a new entry
+    const uint64_t at = sources_[source]->nextAt();
+    if (at != TrafficSource::IDLE && at < scheduledAt_[source]) {
+        scheduledAt_[source] = at;
+        wakeups_.emplace(at, source);
+    }
+}
+
+void TrafficSimulator::run(uint64_t untilNs) {
+    while (true) {
+        const uint64_t wakeup = shaper_.nextWakeup();
+        const uint64_t next = std::min(wakeup, wakeups_.empty() ? TrafficSource::IDLE : wakeups_.top().first);
+        if (next >= untilNs) {
+            break;
+        }
+        nowNs_ = std::max(nowNs_, next);
+
+        size_t events = wakeup <= nowNs_ ? release() : 0;
+        while (!wakeups_.empty() && wakeups_.top().first <= nowNs_) {
+            const Wakeup top = wakeups_.top();
+            wakeups_.pop();
+            if (scheduledAt_[top.second] != top.first) {
+                continue;
+            }
+            scheduledAt_[top.second] = TrafficSource::IDLE;
+            if (sources_[top.second]->nextAt() <= nowNs_) {
+                offer(top.second);
+                ++events;
+            }
+            schedule(top.second);
+        }
+        if (events == 0 && shaper_.nextWakeup() <= nowNs_) {
+            ++nowNs_; // a wheel lower bound that did not fire yet
+        }
+    }
+    if (untilNs != TrafficSource::IDLE) {
+        nowNs_ = std::max(nowNs_, untilNs);
+    }
+}
+
+TrafficSimulator::SeriesPoint* TrafficSimulator::seriesPoint(ClassStats& stats) {
+    if (seriesIntervalNs_ == 0) {
+        return nullptr;
+    }
+    const size_t index = static_cast<size_t>((nowNs_ - measureFromNs_) / seriesIntervalNs_);
+    if (index >= stats.series.size()) {
+        stats.series.resize(index + 1, SeriesPoint());
+    }
+    return &stats.series[index];
+}
+
+void TrafficSimulator::offer(uint32_t source) {
+    InFlight inFlight;
+    inFlight.source = source;
+    inFlight.unit = sources_[source]->emit(nowNs_);
+    inFlight.classIndex = classIndex(inFlight.unit.pid, inFlight.unit.direction);
+    inFlight.submittedNs = nowNs_;
+    if (nowNs_ >= measureFromNs_) {
+        ClassStats& stats = classes_[inFlight.classIndex];
+        stats.offeredBytes += inFlight.unit.bytes;
+        if (SeriesPoint* point = seriesPoint(stats)) {
+            point->offeredBytes += inFlight.unit.bytes;
+        }
+    }
+
+    BufferPool& pool = shaper_.pool();
+    const uint32_t segment = pool.acquire();
+    if (segment == BufferPool::INVALID_SEGMENT) {
+        ++poolExhausted_;
+        complete(inFlight, false);
+        return;
+    }
+    pool.setLength(segment, inFlight.unit.bytes);
+    inFlight_[segment] = inFlight;
+
+    const uint64_t start = MonotonicClock::nowNs();
+    const TrafficShaper::Verdict verdict =
+        shaper_.submit(inFlight.unit.pid, inFlight.unit.direction, segment, nowNs_);
+    const uint64_t elapsed = MonotonicClock::nowNs() - start;
+    cost_.shaperNs += elapsed > clockOverheadNs_ ? elapsed - clockOverheadNs_ : 0;
+    ++cost_.decisions;
+
+    switch (verdict) {
+    case TrafficShaper::Verdict::Marked:
+        if (nowNs_ >= measureFromNs_) {
+            classes_[inFlight.classIndex].markedBytes += inFlight.unit.bytes;
+        }
+        // fall through
+    case TrafficShaper::Verdict::Pass:
+        pool.release(segment);
+        complete(inFlight, true);
+        break;
+    case TrafficShaper::Verdict::Dropped:
+        complete(inFlight, false);
+        break;
+    case TrafficShaper::Verdict::Held:
+        break;
+    }
+}
+
+size_t TrafficSimulator::release() {
+    released_.clear();
+    const uint64_t start = MonotonicClock::nowNs();
+    shaper_.releaseDue(nowNs_, released_);
+    const uint64_t elapsed = MonotonicClock::nowNs() - start;
+    cost_.shaperNs += elapsed > clockOverheadNs_ ? elapsed - clockOverheadNs_ : 0;
+    cost_.decisions += released_.size();
+
+    for (const TrafficShaper::ReleasedUnit& unit : released_) {
+        const InFlight inFlight = inFlight_[unit.segment];
+        shaper_.pool().release(unit.segment);
+        complete(inFlight, true);
+    }
+    return released_.size();
+}
+
+void TrafficSimulator::complete(const InFlight& inFlight, bool sent) {
+    if (nowNs_ >= measureFromNs_) {
+        ClassStats& stats = classes_[inFlight.classIndex];
+        SeriesPoint* point = seriesPoint(stats);
+        const uint64_t delayNs = nowNs_ - inFlight.submittedNs;
+        if (sent) {
+            stats.sentBytes += inFlight.unit.bytes;
+            if (recordDelays_) {
+                stats.delaysNs.push_back(delayNs);
+            }
+            if (point) {
+                point->sentBytes += inFlight.unit.bytes;
+                ++point->sentUnits;
+                point->delaySumNs += delayNs;
+                point->delayMaxNs = std::max(point->delayMaxNs, delayNs);
+            }
+        } else {
+            stats.droppedBytes += inFlight.unit.bytes;
+            if (point) {
+                point->droppedBytes += inFlight.unit.bytes;
+            }
+        }
+    }
+    sources_[inFlight.source]->onComplete(inFlight.unit, nowNs_, sent);
+    schedule(inFlight.source);
+}
@@ -0,0 +1,144 @@
+#ifndef SIM_TRAFFICSIMULATOR_H
+#define SIM_TRAFFICSIMULATOR_H
+
+#include "core/ProcessLimiter.h"
+#include "core/TrafficShaper.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// One unit of traffic a source offers to the shaper
+struct SimUnit {
+    uint32_t pid;
+    TrafficDirection direction;
+    uint32_t bytes;
+};
+
+// Generates traffic against the simulator's virtual clock. The simulator takes a unit from
+// the source at nextAt() and reports back when each unit leaves the shaper, so closed-loop
+// sources (a window of data in flight, request/response) can react to the shaping.
+class TrafficSource {
+public:
+    static constexpr uint64_t IDLE = UINT64_MAX;
+
+    virtual ~TrafficSource() = default;
+
+    // Virtual time (ns) of the next unit; IDLE while waiting on completions, or when done
+    virtual uint64_t nextAt() const = 0;
+    // Returns the unit due at nextAt() and moves on to the next one
+    virtual SimUnit emit(uint64_t nowNs) = 0;
+    // A unit this source emitted was sent (or dropped) at nowNs
+    virtual void onComplete(const SimUnit& unit, uint64_t nowNs, bool sent) {
+        (void)unit;
+        (void)nowNs;
+        (void)sent;
+    }
+};
+
+// Deterministic discrete-event driver for TrafficShaper.
+//
+// Time is virtual: the simulator jumps from one event (a source's next unit, the shaper's
+// next wakeup) to the next, so a run is reproducible and takes as long as the shaping work
+// it does rather than the simulated time. Sources submit segments from the shaper's pool;
+// held segments are released by releaseDue() as the shaper allows. The caller sets up the
+// shaper's processes and limits beforehand.
+//
+// Per process and direction it counts the bytes offered, sent and dropped and keeps the
+// time each sent unit spent in the shaper, and optionally the same per fixed interval as a
+// time series (for long runs, the per-unit delays can be turned off). Only what happens
+// from the measurement start on is counted (bytes offered, sent or dropped at that time or
+// later), so rates are exact over the window and the initial burst of a full bucket can be
+// left out. Segments displaced by
+// a head-drop queue limit are not reported back to their sources. The wall time spent
+// inside submit() and releaseDue() is accumulated separately from the simulator's own work,
+// with the cost of reading the clock subtracted.
+class TrafficSimulator {
+public:
+    // One interval of a class's time series
+    struct SeriesPoint {
+        uint64_t offeredBytes;
+        uint64_t sentBytes;
+        uint64_t droppedBytes;
+        uint64_t sentUnits;
+        uint64_t delaySumNs;
+        uint64_t delayMaxNs;
+    };
+
+    struct ClassStats {
+        uint32_t pid;
+        TrafficDirection direction;
+        uint64_t offeredBytes;
+        uint64_t sentBytes;
+        uint64_t droppedBytes;
+        uint64_t markedBytes;
+        std::vector<uint64_t> delaysNs; // per sent unit, unless turned off
+        std::vector<SeriesPoint> series; // by interval from the measurement start
+    };
+
+    struct Cost {
+        uint64_t decisions; // submits plus released units
+        uint64_t shaperNs;  // wall time inside the shaper
+    };
+
+    explicit TrafficSimulator(TrafficShaper& shaper);
+
+    // The simulator owns its sources; returns the source's index
+    size_t addSource(std::unique_ptr<TrafficSource> source);
+    // Start of the measurement window (default 0)
+    void setMeasureFrom(uint64_t nowNs) { measureFromNs_ = nowNs; }
+    // Interval of the per-class time series; 0 (the default) keeps none
+    void setSeriesInterval(uint64_t intervalNs) { seriesIntervalNs_ = intervalNs; }
+    // Whether every sent unit's delay is kept (default true)
+    void setRecordDelays(bool record) { recordDelays_ = record; }
+
+    // Advances virtual time to untilNs, processing every event before it. With
+    // TrafficSource::IDLE it runs until no source has traffic left and nothing is held.
+    void run(uint64_t untilNs);
+    uint64_t nowNs() const { return nowNs_; }
+
+    // Classes in the order they first offered traffic
+    const std::vector<ClassStats>& classes() const { return classes_; }
+    const Cost& cost() const { return cost_; }
+    // Units offered while the pool had no free segment (counted as dropped)
+    uint64_t poolExhausted() const { return poolExhausted_; }
+
+private:
+    struct InFlight {
+        uint32_t source;
+        uint32_t classIndex;
+        uint64_t submittedNs;
+        SimUnit unit;
+    };
+
+    using Wakeup = std::pair<uint64_t, uint32_t>; // time, source
+    using WakeupQueue = std::priority_queue<Wakeup, std::vector<Wakeup>, std::greater<Wakeup>>;
+
+    uint32_t classIndex(uint32_t pid, TrafficDirection direction);
+    void schedule(uint32_t source);
+    void offer(uint32_t source);
+    void complete(const InFlight& inFlight, bool sent);
+    size_t release();
+    SeriesPoint* seriesPoint(ClassStats& stats);
+
+    TrafficShaper& shaper_;
+    std::vector<std::unique_ptr<TrafficSource>> sources_;
+    std::vector<uint64_t> scheduledAt_; // per source, IDLE if not queued
+    WakeupQueue wakeups_;
+    std::vector<InFlight> inFlight_;    // by segment
+    std::unordered_map<uint64_t, uint32_t> classIndex_;
+    std::vector<ClassStats> classes_;
+    std::vector<TrafficShaper::ReleasedUnit> released_;
+    Cost cost_;
+    uint64_t clockOverheadNs_;
+    uint64_t nowNs_;
+    uint64_t measureFromNs_;
+    uint64_t seriesIntervalNs_;
+    bool recordDelays_;
+    uint64_t poolExhausted_;
+};
+
+#endif // SIM_TRAFFICSIMULATOR_H